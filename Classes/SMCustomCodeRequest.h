@@ -48,6 +48,31 @@
  */
 @property (nonatomic, strong) NSString *requestBody;
 
+/**
+ An optional binary body to send to the custom code method.  Takes precedence over <requestBody>.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSData *requestBodyData;
+
+/**
+ An optional stream to read the body from, for bodies too large to hold in memory.  Takes precedence over <requestBodyData> and <requestBody>.
+ 
+ A stream can only be read once, so requests with a body stream are not retried after a 503 `SMErrorServiceUnavailable` or 401 `SMErrorUnauthorized` response.  An expired access token is still refreshed before the request is sent.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSInputStream *requestBodyStream;
+
+/**
+ An optional stream the response body is written to as it arrives, instead of being buffered and parsed as JSON.
+ 
+ When set, the `JSON` argument of the success block is `nil`.  As with <requestBodyStream>, the request is sent once and never retried.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSOutputStream *responseOutputStream;
+
 /**
  The HTTP Verb to use in the request to the custom code method.
  
@@ -39,7 +39,10 @@
 
 - (NSString *)URLEncodedStringFromValue:(NSString *)value
 {
-	return (__bridge_transfer  NSString *)CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (__bridge CFStringRef)value, nil, NULL, CFStringConvertNSStringEncodingToEncoding(NSUTF8StringEncoding));
+    // Escape the query string delimiters as well, so a value containing & or = can't break up the query string
+    static NSString * const charactersToBeEscaped = @"&=+#";
+    
+	return (__bridge_transfer  NSString *)CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (__bridge CFStringRef)value, nil, (__bridge CFStringRef)charactersToBeEscaped, CFStringConvertNSStringEncodingToEncoding(NSUTF8StringEncoding));
 }
 
 @end
@@ -49,6 +52,9 @@
 @synthesize queryStringParameters = _queryStringParameters;
 @synthesize method = _method;
 @synthesize requestBody = _requestBody;
+@synthesize requestBodyData = _requestBodyData;
+@synthesize requestBodyStream = _requestBodyStream;
+@synthesize responseOutputStream = _responseOutputStream;
 @synthesize httpVerb = _httpVerb;
 
 - (id)initPostRequestWithMethod:(NSString *)method body:(NSString *)body
@@ -73,8 +79,14 @@
 
 - (void)addQueryStringParameterWhere:(NSString *)key equals:(NSString *)value
 {
+    NSString *encodedKey = [self URLEncodedStringFromValue:key];
     NSString *encodedValue = [self URLEncodedStringFromValue:value];
-    [self.queryStringParameters addObject:[NSString stringWithFormat:@"%@=%@", key, encodedValue]];
+    
+    NSMutableString *parameter = [NSMutableString stringWithCapacity:[encodedKey length] + [encodedValue length] + 1];
+    [parameter appendString:encodedKey];
+    [parameter appendString:@"="];
+    [parameter appendString:encodedValue];
+    [self.queryStringParameters addObject:parameter];
 }
 
 @end
@@ -17,8 +17,40 @@
 #import "SMDataStore.h"
 #import "SMUserSession.h"
 #import "SMResponseBlocks.h"
+#import "SMRequestOptions.h"
 #import "AFJSONRequestOperation.h"
 
+/**
+ The dispatch time of a deadline, or `DISPATCH_TIME_FOREVER` when there is none.
+ */
+extern dispatch_time_t SMDispatchTimeForDeadline(NSDate *deadline);
+
+/**
+ Internal methods of <SMRequestHandle> used while a request is in flight.
+ */
+@interface SMRequestHandle (Protected)
+
+- (id)initWithDeadline:(NSDate *)deadline;
+
+// Tracks an operation or handle to cancel along with this one.  If this handle is already cancelled, it is cancelled right away.
+- (void)SM_addCancellable:(id)cancellable;
+
+- (void)SM_expire;
+
+- (NSError *)SM_cancellationErrorWithUnderlyingError:(NSError *)underlyingError;
+
+@end
+
+/**
+ Internal methods of <SMRequestOptions> used to track the retries of a request.
+ */
+@interface SMRequestOptions (Retry)
+
+- (NSUInteger)SM_retryAttempt;
+- (void)SM_setRetryAttempt:(NSUInteger)retryAttempt;
+
+@end
+
 
 /**
  Supplemental methods for <SMDataStore>.  In essence they add an extra layer of logic to existing `SMDataStore` methods for special conditions. 
@@ -63,7 +95,7 @@
 - (int)countFromRangeHeader:(NSString *)rangeHeader results:(NSArray *)results;
 
 
-- (void)readObjectWithId:(NSString *)theObjectId 
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId 
                 inSchema:(NSString *)schema 
               parameters:(NSDictionary *)parameters
                  options:(SMRequestOptions *)options
@@ -72,12 +104,20 @@
                onSuccess:(SMDataStoreSuccessBlock)successBlock 
                onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock;
 
+- (void)queueRequest:(NSURLRequest *)request options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)onSuccess onFailure:(SMFullResponseFailureBlock)onFailure;
+
 - (void)queueRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)onSuccess onFailure:(SMFullResponseFailureBlock)onFailure;
 
 - (NSString *)URLEncodedStringFromValue:(NSString *)value;
 
+// Fails a request whose token refresh failed, through the session's tokenRefreshFailureBlock if one is set.  originalError, if any, is the error that caused the refresh.
+- (void)SM_failRequest:(NSURLRequest *)request withTokenRefreshError:(NSError *)theError originalError:(NSError *)originalError failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onFailure:(SMFullResponseFailureBlock)failureBlock;
+
 - (AFJSONRequestOperation *)newOperationForRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
 
+// Retries of the returned operation are queued through handle, so cancelling it also stops a retry waiting out its backoff
+- (AFJSONRequestOperation *)newOperationForRequest:(NSURLRequest *)request options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+
 - (AFJSONRequestOperation *)postOperationForObject:(NSDictionary *)theObject inSchema:(NSString *)schema options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMCoreDataSaveFailureBlock)failureBlock;
 
 - (AFJSONRequestOperation *)putOperationForObjectID:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMCoreDataSaveFailureBlock)failureBlock;
@@ -19,6 +19,21 @@
 #import "SMJSONRequestOperation.h"
 #import "SMRequestOptions.h"
 #import "SMNetworkReachability.h"
+#import "SMOAuth2Client.h"
+#import "SMMetrics+Protected.h"
+
+dispatch_time_t SMDispatchTimeForDeadline(NSDate *deadline)
+{
+    if (!deadline) {
+        return DISPATCH_TIME_FOREVER;
+    }
+    
+    NSTimeInterval secondsSince1970 = [deadline timeIntervalSince1970];
+    struct timespec deadlineSpec;
+    deadlineSpec.tv_sec = (time_t)secondsSince1970;
+    deadlineSpec.tv_nsec = (long)((secondsSince1970 - deadlineSpec.tv_sec) * NSEC_PER_SEC);
+    return dispatch_walltime(&deadlineSpec, 0);
+}
 
 @implementation SMDataStore (SpecialCondition)
 
@@ -145,8 +160,9 @@
     } 
 }
 
-- (void)readObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema parameters:(NSDictionary *)parameters options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema parameters:(NSDictionary *)parameters options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
+    SMRequestHandle *handle = nil;
     if (theObjectId == nil || schema == nil) {
         if (failureBlock) {
             NSError *error = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorInvalidArguments userInfo:nil];
@@ -157,48 +173,106 @@
         NSMutableURLRequest *request = [[self.session oauthClientWithHTTPS:options.isSecure] requestWithMethod:@"GET" path:path parameters:parameters];
         SMFullResponseSuccessBlock urlSuccessBlock = [self SMFullResponseSuccessBlockForSchema:schema withSuccessBlock:successBlock];
         SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForObjectId:theObjectId ofSchema:schema withFailureBlock:failureBlock];
-        [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+        handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+        [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
     }
+    return handle;
 }
 
-- (void)refreshAndRetry:(NSURLRequest *)request originalError:(NSError *)originalError requestSuccessCallbackQueue:(dispatch_queue_t)successCallbackQueue requestFailureCallbackQueue:(dispatch_queue_t)failureCallbackQueue options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+- (void)refreshAndRetry:(NSURLRequest *)request originalError:(NSError *)originalError requestSuccessCallbackQueue:(dispatch_queue_t)successCallbackQueue requestFailureCallbackQueue:(dispatch_queue_t)failureCallbackQueue options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
 {
-    if (self.session.refreshing) {
-        if (failureBlock) {
-            dispatch_async(failureCallbackQueue, ^{
-                NSError *error = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenInProgress userInfo:nil];
-                failureBlock(request, nil, error, nil);
-            });
+    // Refreshes are coordinated by the session, if one is already in flight this request waits for it and is re-signed afterwards.
+    [options setTryRefreshToken:NO];
+    __block dispatch_queue_t newQueueForRefresh = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+    [self.session refreshTokenWithSuccessCallbackQueue:newQueueForRefresh failureCallbackQueue:newQueueForRefresh onSuccess:^(NSDictionary *userObject) {
+        if (originalError) {
+            // Sent once already and rejected with a 401, as opposed to refreshed up front
+            SMMetricsIncrementCounter(SMMetricsRetryCounter, 1);
         }
-    } else {
-        //__block SMRequestOptions *options = [SMRequestOptions options];
-        [options setTryRefreshToken:NO];
-        __block dispatch_queue_t newQueueForRefresh = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
-        [self.session refreshTokenWithSuccessCallbackQueue:newQueueForRefresh failureCallbackQueue:newQueueForRefresh onSuccess:^(NSDictionary *userObject) {
-            [self queueRequest:[self.session signRequest:request] options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
-        } onFailure:^(NSError *theError) {
-            NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:theError, SMRefreshErrorObjectKey, @"Attempt to refresh access token failed.", NSLocalizedDescriptionKey, nil];
-            if (originalError) {
-                [userInfo setObject:originalError forKey:SMOriginalErrorCausingRefreshKey];
-            }
-            __block NSError *refreshError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenFailed userInfo:userInfo];
-            if (self.session.tokenRefreshFailureBlock) {
-                dispatch_async(failureCallbackQueue, ^{
-                    SMFailureBlock newFailureBlock = ^(NSError *error){
-                        failureBlock(nil, nil, error, nil);
-                    };
-                    self.session.tokenRefreshFailureBlock(refreshError, newFailureBlock);
-                });
-            } else if (failureBlock) {
-                dispatch_async(failureCallbackQueue, ^{
-                    failureBlock(request, nil, refreshError, nil);
-                });
-            }
-        }];
+        [self queueRequest:[self.session signRequest:request] options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    } onFailure:^(NSError *theError) {
+        [self SM_failRequest:request withTokenRefreshError:theError originalError:originalError failureCallbackQueue:failureCallbackQueue onFailure:failureBlock];
+    }];
+}
+
+- (void)SM_failRequest:(NSURLRequest *)request withTokenRefreshError:(NSError *)theError originalError:(NSError *)originalError failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onFailure:(SMFullResponseFailureBlock)failureBlock
+{
+    if (!failureCallbackQueue) {
+        failureCallbackQueue = dispatch_get_main_queue();
+    }
+    
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:theError, SMRefreshErrorObjectKey, @"Attempt to refresh access token failed.", NSLocalizedDescriptionKey, nil];
+    if (originalError) {
+        [userInfo setObject:originalError forKey:SMOriginalErrorCausingRefreshKey];
+    }
+    __block NSError *refreshError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenFailed userInfo:userInfo];
+    if (self.session.tokenRefreshFailureBlock) {
+        dispatch_async(failureCallbackQueue, ^{
+            SMFailureBlock newFailureBlock = ^(NSError *error){
+                if (failureBlock) {
+                    failureBlock(nil, nil, error, nil);
+                }
+            };
+            self.session.tokenRefreshFailureBlock(refreshError, newFailureBlock);
+        });
+    } else if (failureBlock) {
+        dispatch_async(failureCallbackQueue, ^{
+            failureBlock(request, nil, refreshError, nil);
+        });
+    }
+}
+
+/*
+ The retry is handed its own copy of the options carrying the remaining retries and the attempt count, so options shared between requests, such as the global request options, are never used up by one of them.
+ */
+- (BOOL)SM_scheduleRetryOfRequest:(NSURLRequest *)request response:(NSHTTPURLResponse *)response error:(NSError *)error options:(SMRequestOptions *)options retry:(void (^)(SMRequestOptions *retryOptions))retry
+{
+    SMRetryPolicy *retryPolicy = options.retryPolicy ?: [SMRetryPolicy policy];
+    if (options.numberOfRetries <= 0 || ![retryPolicy shouldRetryRequest:request response:response error:error]) {
+        return NO;
+    }
+    
+    NSUInteger attempt = [options SM_retryAttempt];
+    NSTimeInterval delay = [retryPolicy delayForRetryAttempt:attempt response:response];
+    if (options.deadline && [options.deadline timeIntervalSinceNow] < delay) {
+        // Would only be sent after the deadline
+        return NO;
+    }
+    
+    if (retryPolicy.retryBudget && ![retryPolicy.retryBudget withdrawRetry]) {
+        return NO;
+    }
+    
+    SMRequestOptions *retryOptions = [options copy];
+    [retryOptions setNumberOfRetries:(options.numberOfRetries - 1)];
+    [retryOptions SM_setRetryAttempt:(attempt + 1)];
+    SMMetricsIncrementCounter(SMMetricsRetryCounter, 1);
+    if ([[response allHeaderFields] valueForKey:@"Retry-After"]) {
+        SMMetricsIncrementCounter(SMMetricsRetryAfterBackoffCounter, 1);
+    }
+    
+    // Waited out on a background queue so retries don't depend on the main thread being free
+    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC));
+    dispatch_after(popTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        retry(retryOptions);
+    });
+    return YES;
+}
+
+- (void)SM_recordRequestWithOptions:(SMRequestOptions *)options
+{
+    // Only first attempts earn retry budget
+    if ([options SM_retryAttempt] == 0) {
+        [(options.retryPolicy ?: [SMRetryPolicy policy]).retryBudget recordRequest];
     }
 }
 
 - (AFJSONRequestOperation *)newOperationForRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+{
+    return [self newOperationForRequest:request options:options handle:nil successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+}
+
+- (AFJSONRequestOperation *)newOperationForRequest:(NSURLRequest *)request options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
 {
     if (options.headers && [options.headers count] > 0) {
         // Enumerate through options and add them to the request header.
@@ -213,25 +287,21 @@
     }
     
     SMFullResponseFailureBlock retryBlock = ^(NSURLRequest *originalRequest, NSHTTPURLResponse *response, NSError *error, id JSON) {
-        if ([response statusCode] == SMErrorServiceUnavailable && options.numberOfRetries > 0) {
-            NSString *retryAfter = [[response allHeaderFields] valueForKey:@"Retry-After"];
-            if (retryAfter) {
-                [options setNumberOfRetries:(options.numberOfRetries - 1)];
-                double delayInSeconds = [retryAfter doubleValue];
-                dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, delayInSeconds * NSEC_PER_SEC);
-                dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
-                    if (options.retryBlock) {
-                        options.retryBlock(originalRequest, response, error, JSON, options, successBlock, failureBlock);
-                    } else {
-                        [self queueRequest:[self.session signRequest:originalRequest] options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
-                    }
+        BOOL retrying = !handle.isCancelled && [self SM_scheduleRetryOfRequest:originalRequest response:response error:error options:options retry:^(SMRequestOptions *retryOptions) {
+            if (retryOptions.retryBlock && [response statusCode] == SMErrorServiceUnavailable) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    retryOptions.retryBlock(originalRequest, response, error, JSON, retryOptions, successBlock, failureBlock);
                 });
             } else {
-                if (failureBlock) {
-                    failureBlock(originalRequest, response, error, JSON);
-                }
+                // A handle cancelled during the backoff fails the request when it is queued
+                [self queueRequest:[self.session signRequest:originalRequest] options:retryOptions handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
             }
-        } else if ([error domain] == NSURLErrorDomain && [error code] == -1009) {
+        }];
+        if (retrying) {
+            return;
+        }
+        
+        if ([error domain] == NSURLErrorDomain && [error code] == -1009) {
             if (failureBlock) {
                 NSError *networkNotReachableError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorNetworkNotReachable userInfo:[error userInfo]];
                 failureBlock(originalRequest, response, networkNotReachableError, JSON);
@@ -244,12 +314,14 @@
     };
     
     AFJSONRequestOperation *op = [SMJSONRequestOperation JSONRequestOperationWithRequest:request success:successBlock failure:retryBlock];
+    [op setQueuePriority:SMOperationQueuePriorityForRequestPriority(options.priority)];
     if (successCallbackQueue) {
         [op setSuccessCallbackQueue:successCallbackQueue];
     }
     if (failureCallbackQueue) {
         [op setFailureCallbackQueue:failureCallbackQueue];
     }
+    [self SM_recordRequestWithOptions:options];
     
     return op;
     
@@ -257,6 +329,25 @@
 
 - (void)queueRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)onSuccess onFailure:(SMFullResponseFailureBlock)onFailure
 {
+    [self queueRequest:request options:options handle:nil successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:onSuccess onFailure:onFailure];
+}
+
+- (void)queueRequest:(NSURLRequest *)request options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)onSuccess onFailure:(SMFullResponseFailureBlock)onFailure
+{
+    if (!handle && options.deadline) {
+        handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+    }
+    
+    // A request cancelled while waiting on a retry or token refresh is never sent
+    if (handle.isCancelled) {
+        if (onFailure) {
+            dispatch_async(failureCallbackQueue ? failureCallbackQueue : dispatch_get_main_queue(), ^{
+                onFailure(request, nil, [handle SM_cancellationErrorWithUnderlyingError:nil], nil);
+            });
+        }
+        return;
+    }
+    
     if (options.headers && [options.headers count] > 0) {
         // Enumerate through options and add them to the request header.
         NSMutableURLRequest *tempRequest = [request mutableCopy];
@@ -280,30 +371,27 @@
     
     
     if ([self.session eligibleForTokenRefresh:options]) {
-        [self refreshAndRetry:request originalError:nil requestSuccessCallbackQueue:successCallbackQueue requestFailureCallbackQueue:failureCallbackQueue options:options onSuccess:onSuccess onFailure:onFailure];
+        [self refreshAndRetry:request originalError:nil requestSuccessCallbackQueue:successCallbackQueue requestFailureCallbackQueue:failureCallbackQueue options:options handle:handle onSuccess:onSuccess onFailure:onFailure];
     } 
     else {
         SMFullResponseFailureBlock retryBlock = ^(NSURLRequest *originalRequest, NSHTTPURLResponse *response, NSError *error, id JSON) {
-            if ([response statusCode] == SMErrorUnauthorized && options.tryRefreshToken && self.session.refreshToken != nil) {
-                [self refreshAndRetry:originalRequest originalError:[self errorFromResponse:response JSON:JSON] requestSuccessCallbackQueue:successCallbackQueue requestFailureCallbackQueue:failureCallbackQueue options:options onSuccess:onSuccess onFailure:onFailure];
-            } else if ([response statusCode] == SMErrorServiceUnavailable && options.numberOfRetries > 0) {
-                NSString *retryAfter = [[response allHeaderFields] valueForKey:@"Retry-After"];
-                if (retryAfter) {
-                    [options setNumberOfRetries:(options.numberOfRetries - 1)];
-                    double delayInSeconds = [retryAfter doubleValue];
-                    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, delayInSeconds * NSEC_PER_SEC);
-                    dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
-                        if (options.retryBlock) {
-                            options.retryBlock(originalRequest, response, error, JSON, options, onSuccess, onFailure);
-                        } else {
-                            [self queueRequest:[self.session signRequest:originalRequest] options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:onSuccess onFailure:onFailure];
-                        }
+            if (handle.isCancelled) {
+                if (onFailure) {
+                    onFailure(originalRequest, response, [handle SM_cancellationErrorWithUnderlyingError:error], JSON);
+                }
+            } else if ([response statusCode] == SMErrorUnauthorized && options.tryRefreshToken && self.session.refreshToken != nil) {
+                [self refreshAndRetry:originalRequest originalError:[self errorFromResponse:response JSON:JSON] requestSuccessCallbackQueue:successCallbackQueue requestFailureCallbackQueue:failureCallbackQueue options:options handle:handle onSuccess:onSuccess onFailure:onFailure];
+            } else if ([self SM_scheduleRetryOfRequest:originalRequest response:response error:error options:options retry:^(SMRequestOptions *retryOptions) {
+                // A handle cancelled during the backoff fails the request when it is queued
+                if (retryOptions.retryBlock && [response statusCode] == SMErrorServiceUnavailable) {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        retryOptions.retryBlock(originalRequest, response, error, JSON, retryOptions, onSuccess, onFailure);
                     });
                 } else {
-                    if (onFailure) {
-                        onFailure(originalRequest, response, error, JSON);
-                    }
+                    [self queueRequest:[self.session signRequest:originalRequest] options:retryOptions handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:onSuccess onFailure:onFailure];
                 }
+            }]) {
+                // Sent again once the backoff is over
             } else if ([error domain] == NSURLErrorDomain && [error code] == -1009) {
                 if (onFailure) {
                     NSError *networkNotReachableError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorNetworkNotReachable userInfo:[error userInfo]];
@@ -317,12 +405,15 @@
         };
         
         AFJSONRequestOperation *op = [SMJSONRequestOperation JSONRequestOperationWithRequest:request success:onSuccess failure:retryBlock];
+        [op setQueuePriority:SMOperationQueuePriorityForRequestPriority(options.priority)];
         if (successCallbackQueue) {
             [op setSuccessCallbackQueue:successCallbackQueue];
         }
         if (failureCallbackQueue) {
             [op setFailureCallbackQueue:failureCallbackQueue];
         }
+        [handle SM_addCancellable:op];
+        [self SM_recordRequestWithOptions:options];
         [[self.session oauthClientWithHTTPS:options.isSecure] enqueueHTTPRequestOperation:op];
     }
     
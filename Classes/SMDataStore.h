@@ -28,6 +28,38 @@
 @class SMRequestOptions;
 @class SMCustomCodeRequest;
 
+/**
+ `SMRequestHandle` is returned by every `SMDataStore` request method and lets you cancel the request while it is outstanding.
+ 
+ Cancelling covers the whole life of the request, including 503 retries and token refreshes it is waiting on.  A cancelled request calls its failure block with an `SMErrorRequestCancelled` error, or `SMErrorDeadlineExceeded` when it was cancelled because the <SMRequestOptions> `deadline` passed.
+ 
+ You don't need to keep a reference to the handle for the request to run.
+ */
+@interface SMRequestHandle : NSObject
+
+/**
+ Whether the request has been cancelled, either by <cancel> or because its deadline passed.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (readonly, nonatomic) BOOL isCancelled;
+
+/**
+ Whether the request was cancelled because the `deadline` of its <SMRequestOptions> passed.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (readonly, nonatomic) BOOL deadlineExceeded;
+
+/**
+ Cancel the request.  Does nothing if the request has already finished or been cancelled.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)cancel;
+
+@end
+
 /**
  `SMDataStore` exposes an interface for performing CRUD operations on known StackMob objects and for executing an <SMQuery> or <SMCustomCodeRequest>.
  
@@ -71,6 +103,15 @@
  */
 @property(nonatomic, readwrite, strong) SMUserSession *session;
 
+/**
+ The custom code method that computes aggregate queries on the server, or `nil` to compute them on the device.  Default is `nil`.
+ 
+ The StackMob REST API has no aggregation of its own.  When this is set, <performAggregateQuery:onSuccess:onFailure:> POSTs the query to the method as a JSON object with the keys `schema`, `parameters` (the query conditions), `aggregates` and `groupBy`, and expects a JSON array of result rows back.  Otherwise only the fields the aggregates need are fetched, and the rows are computed with `aggregateObjects:` on `SMQuery`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property(nonatomic, readwrite, copy) NSString *aggregateCustomCodeMethod;
+
 
 ///-------------------------------
 /// @name Initialize
@@ -102,9 +143,11 @@
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully created. Passed the dictionary representation of the response from StackMob and the schema in which the new object was created.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to create the specified object. Passed the error returned by StackMob, the dictionary sent with this create request, and the schema in which the object was to be created.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)createObject:(NSDictionary *)theObject
+- (SMRequestHandle *)createObject:(NSDictionary *)theObject
             inSchema:(NSString *)schema
            onSuccess:(SMDataStoreSuccessBlock)successBlock
            onFailure:(SMDataStoreFailureBlock)failureBlock;
@@ -118,9 +161,11 @@
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully created. Passed the dictionary representation of the response from StackMob and the schema in which the new object was created.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to create the specified object. Passed the error returned by StackMob, the dictionary sent with this create request, and the schema in which the object was to be created.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)createObject:(NSDictionary *)theObject
+- (SMRequestHandle *)createObject:(NSDictionary *)theObject
             inSchema:(NSString *)schema
          options:(SMRequestOptions *)options
            onSuccess:(SMDataStoreSuccessBlock)successBlock
@@ -137,9 +182,11 @@
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the successCallbackQueue after the object is successfully created. Passed the dictionary representation of the response from StackMob and the schema in which the new object was created.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to create the specified object. Passed the error returned by StackMob, the dictionary sent with this create request, and the schema in which the object was to be created.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)createObject:(NSDictionary *)theObject
+- (SMRequestHandle *)createObject:(NSDictionary *)theObject
             inSchema:(NSString *)schema
              options:(SMRequestOptions *)options
 successCallbackQueue:(dispatch_queue_t)successCallbackQueue
@@ -155,9 +202,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully read. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreObjectIdFailureBlock)(NSError *theError, NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the object id sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)readObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId
                 inSchema:(NSString *)schema
                onSuccess:(SMDataStoreSuccessBlock)successBlock
                onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock;
@@ -171,9 +220,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully read. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreObjectIdFailureBlock)(NSError *theError, NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the object id sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)readObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId
                 inSchema:(NSString *)schema
              options:(SMRequestOptions *)options
                onSuccess:(SMDataStoreSuccessBlock)successBlock
@@ -190,9 +241,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the successCallbackQueue after the object is successfully read. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreObjectIdFailureBlock)(NSError *theError, NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to read the specified object. Passed the error returned by StackMob, the object id sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)readObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId
                 inSchema:(NSString *)schema
                  options:(SMRequestOptions *)options
     successCallbackQueue:(dispatch_queue_t)successCallbackQueue
@@ -209,9 +262,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully updated. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the dictionary sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)updateObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateObjectWithId:(NSString *)theObjectId
                   inSchema:(NSString *)schema
                     update:(NSDictionary *)updatedFields
                  onSuccess:(SMDataStoreSuccessBlock)successBlock
@@ -227,9 +282,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully updated. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the dictionary sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)updateObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateObjectWithId:(NSString *)theObjectId
                   inSchema:(NSString *)schema
                     update:(NSDictionary *)updatedFields
                options:(SMRequestOptions *)options
@@ -248,9 +305,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the successCallbackQueue after the object is successfully updated. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to read the specified object. Passed the error returned by StackMob, the dictionary sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)updateObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateObjectWithId:(NSString *)theObjectId
                   inSchema:(NSString *)schema
                     update:(NSDictionary *)updatedFields
                    options:(SMRequestOptions *)options
@@ -269,9 +328,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully updated. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the dictionary sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)updateAtomicCounterWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateAtomicCounterWithId:(NSString *)theObjectId
                             field:(NSString *)field
                          inSchema:(NSString *)schema
                                by:(int)increment
@@ -289,9 +350,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully updated. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the dictionary sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)updateAtomicCounterWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateAtomicCounterWithId:(NSString *)theObjectId
                             field:(NSString *)field
                          inSchema:(NSString *)schema
                                by:(int)increment
@@ -312,9 +375,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreSuccessBlock)(NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the successCallbackQueue after the object is successfully updated. Passed the dictionary representation of the response from StackMob and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreFailureBlock)(NSError *theError, NSDictionary* theObject, NSString *schema)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to read the specified object. Passed the error returned by StackMob, the dictionary sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)updateAtomicCounterWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateAtomicCounterWithId:(NSString *)theObjectId
                             field:(NSString *)field
                          inSchema:(NSString *)schema
                                by:(int)increment
@@ -332,9 +397,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreObjectIdSuccessBlock)(NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully deleted. Passed the object id of the deleted object and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreObjectIdFailureBlock)(NSError *theError, NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the object id sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)deleteObjectId:(NSString *)theObjectId
+- (SMRequestHandle *)deleteObjectId:(NSString *)theObjectId
               inSchema:(NSString *)schema
              onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock
              onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock;
@@ -348,9 +415,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreObjectIdSuccessBlock)(NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the main thread after the object is successfully deleted. Passed the object id of the deleted object and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreObjectIdFailureBlock)(NSError *theError, NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the main thread if the Datastore fails to read the specified object. Passed the error returned by StackMob, the object id sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)deleteObjectId:(NSString *)theObjectId
+- (SMRequestHandle *)deleteObjectId:(NSString *)theObjectId
               inSchema:(NSString *)schema
            options:(SMRequestOptions *)options
              onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock
@@ -367,9 +436,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMDataStoreObjectIdSuccessBlock)(NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the successCallbackQueue after the object is successfully deleted. Passed the object id of the deleted object and the object's schema.
  @param failureBlock <i>typedef void (^SMDataStoreObjectIdFailureBlock)(NSError *theError, NSString* theObjectId, NSString *schema)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to read the specified object. Passed the error returned by StackMob, the object id sent with this request, and the schema in which the object was to be found.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)deleteObjectId:(NSString *)theObjectId
+- (SMRequestHandle *)deleteObjectId:(NSString *)theObjectId
               inSchema:(NSString *)schema
                options:(SMRequestOptions *)options
   successCallbackQueue:(dispatch_queue_t)successCallbackQueue
@@ -391,9 +462,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMResultsSuccessBlock)(NSArray *results)</i>. A block object to invoke on the main thread after the query succeeds. Passed an array of object dictionaries returned from StackMob (if any).
  @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the main thread if the Datastore fails to perform the query. Passed the error returned by StackMob.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)performQuery:(SMQuery *)query onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+- (SMRequestHandle *)performQuery:(SMQuery *)query onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
 /** 
  Execute a query against your StackMob Datastore (with request options).
@@ -403,9 +476,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMResultsSuccessBlock)(NSArray *results)</i>. A block object to invoke on the main thread after the query succeeds. Passed an array of object dictionaries returned from StackMob (if any).
  @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the main thread if the Datastore fails to perform the query. Passed the error returned by StackMob.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)performQuery:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+- (SMRequestHandle *)performQuery:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
 /**
  Execute a query against your StackMob Datastore (with request options).
@@ -417,9 +492,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
  @param successBlock <i>typedef void (^SMResultsSuccessBlock)(NSArray *results)</i>. A block object to invoke on the successCallbackQueue after the query succeeds. Passed an array of object dictionaries returned from StackMob (if any).
  @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to perform the query. Passed the error returned by StackMob.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)performQuery:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue
+- (SMRequestHandle *)performQuery:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue
 failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
 /** 
@@ -429,9 +506,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResults
  @param successBlock <i>typedef void (^SMCountSuccessBlock)(NSNumber *count)</i>. A block object to invoke on the main thread when the count is complete.  Passed the number of objects returned that would by the query.
  @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the main thread if the Datastore fails to perform the query. Passed the error returned by StackMob.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)performCount:(SMQuery *)query onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+- (SMRequestHandle *)performCount:(SMQuery *)query onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
 /** 
  Count the results that would be returned by a query against your StackMob Datastore (with request options).
@@ -441,9 +520,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResults
  @param successBlock <i>typedef void (^SMCountSuccessBlock)(NSNumber *count)</i>. A block object to invoke on the main thread when the count is complete.  Passed the number of objects that would be returned by the query.
  @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the main thread if the Datastore fails to perform the query. Passed the error returned by StackMob.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)performCount:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+- (SMRequestHandle *)performCount:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
 /**
  Count the results that would be returned by a query against your StackMob Datastore (with request options).
@@ -455,11 +536,59 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResults
  @param successBlock <i>typedef void (^SMCountSuccessBlock)(NSNumber *count)</i>. A block object to invoke on the successCallbackQueue when the count is complete.  Passed the number of objects that would be returned by the query.
  @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to on the invoke failureCallbackQueue if the Datastore fails to perform the query. Passed the error returned by StackMob.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)performCount:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue
+- (SMRequestHandle *)performCount:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue
 failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
+/**
+ Compute the aggregates and distinct values of a query against your StackMob Datastore.
+ 
+ See the Aggregates section of <SMQuery> for how to define the aggregates, and <aggregateCustomCodeMethod> for where they are computed.
+ 
+ @param query An `SMQuery` object with aggregates or group-by fields.
+ @param successBlock <i>typedef void (^SMResultsSuccessBlock)(NSArray *results)</i>. A block object to invoke on the main thread after the query succeeds. Passed an array of dictionaries, one per group.
+ @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the main thread if the Datastore fails to perform the query. Passed the error returned by StackMob.
+ 
+ @return An <SMRequestHandle> for cancelling the request.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMRequestHandle *)performAggregateQuery:(SMQuery *)query onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+
+/**
+ Compute the aggregates and distinct values of a query against your StackMob Datastore (with request options).
+ 
+ @param query An `SMQuery` object with aggregates or group-by fields.
+ @param options An options object contains headers and other configuration for this request.
+ @param successBlock <i>typedef void (^SMResultsSuccessBlock)(NSArray *results)</i>. A block object to invoke on the main thread after the query succeeds. Passed an array of dictionaries, one per group.
+ @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the main thread if the Datastore fails to perform the query. Passed the error returned by StackMob.
+ 
+ @return An <SMRequestHandle> for cancelling the request.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMRequestHandle *)performAggregateQuery:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+
+/**
+ Compute the aggregates and distinct values of a query against your StackMob Datastore (with request options).
+ 
+ @param query An `SMQuery` object with aggregates or group-by fields.
+ @param options An options object contains headers and other configuration for this request.
+ @param successCallbackQueue The dispatch queue used to execute the success block. If nil is passed, the main queue is used.
+ @param failureCallbackQueue The dispatch queue used to execute the failure block. If nil is passed, the main queue is used.
+ @param successBlock <i>typedef void (^SMResultsSuccessBlock)(NSArray *results)</i>. A block object to invoke on the successCallbackQueue after the query succeeds. Passed an array of dictionaries, one per group.
+ @param failureBlock <i>typedef void (^SMFailureBlock)(NSError *error)</i>. A block object to invoke on the failureCallbackQueue if the Datastore fails to perform the query. Passed the error returned by StackMob.
+ 
+ @return An <SMRequestHandle> for cancelling the request.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMRequestHandle *)performAggregateQuery:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue
+failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+
 #pragma mark - Custom Code
 ///-------------------------------
 /// @name Performing Custom Code Methods
@@ -472,9 +601,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSu
  @param successBlock <i>typedef void (^SMFullResponseSuccessBlock)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON)</i>. A block object to call on the main thread upon success.
  @param failureBlock <i>typedef void (^SMFullResponseFailureBlock)(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON)</i>. A block object to call on the main thread upon failure.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+- (SMRequestHandle *)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
 /**
  Execute a custom code method on StackMob.
  
@@ -485,9 +616,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSu
  @param successBlock <i>typedef void (^SMFullResponseSuccessBlock)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON)</i>. A block object to call on the main thread upon success.
  @param failureBlock <i>typedef void (^SMFullResponseFailureBlock)(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON)</i>. A block object to call on the main thread upon failure.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+- (SMRequestHandle *)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
 
 /**
  Execute a custom code method on StackMob.
@@ -501,9 +634,44 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSu
  @param successBlock <i>typedef void (^SMFullResponseSuccessBlock)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON)</i>. A block object to call on the successCallbackQueue upon success.
  @param failureBlock <i>typedef void (^SMFullResponseFailureBlock)(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON)</i>. A block object to call on the failureCallbackQueue upon failure.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+- (SMRequestHandle *)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+
+/**
+ Calls <performCustomCodeRequests:options:maxConcurrentRequests:completionCallbackQueue:onComplete:> with the main queue for the parameter `completionCallbackQueue`.
+ 
+ @param customCodeRequests An array of <SMCustomCodeRequest> instances to execute.
+ @param options The options for every request in the batch.
+ @param maxConcurrentRequests The maximum number of requests in flight at once.  Pass 0 to send every request at once.
+ @param completionBlock <i>typedef void (^SMCustomCodeBatchCompletionBlock)(NSArray *responses, NSArray *errors)</i>. A block object to call on the main thread once every request has finished.
+ 
+ @return An <SMRequestHandle> that cancels every request of the batch still outstanding.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMRequestHandle *)performCustomCodeRequests:(NSArray *)customCodeRequests options:(SMRequestOptions *)options maxConcurrentRequests:(NSUInteger)maxConcurrentRequests onComplete:(SMCustomCodeBatchCompletionBlock)completionBlock;
+
+/**
+ Execute a batch of custom code methods on StackMob.
+ 
+ Requests are sent in order with at most `maxConcurrentRequests` in flight; each time one finishes the next one is started.  Idempotent requests share pipelined connections where the server allows it.  The results are collected in the order of `customCodeRequests`, regardless of the order the responses arrive in, and delivered once every request has finished.
+ 
+ Each request gets its own copy of `options`, so retries and token refreshes behave as they do for <performCustomCodeRequest:options:successCallbackQueue:failureCallbackQueue:onSuccess:onFailure:>.
+ 
+ @param customCodeRequests An array of <SMCustomCodeRequest> instances to execute.
+ @param options The options for every request in the batch.
+ @param maxConcurrentRequests The maximum number of requests in flight at once.  Pass 0 to send every request at once.
+ @param completionCallbackQueue The dispatch queue used to execute the completion block. If nil is passed, the main queue is used.
+ @param completionBlock <i>typedef void (^SMCustomCodeBatchCompletionBlock)(NSArray *responses, NSArray *errors)</i>. A block object to call on the completionCallbackQueue once every request has finished.
+ 
+ @return An <SMRequestHandle> that cancels every request of the batch still outstanding.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMRequestHandle *)performCustomCodeRequests:(NSArray *)customCodeRequests options:(SMRequestOptions *)options maxConcurrentRequests:(NSUInteger)maxConcurrentRequests completionCallbackQueue:(dispatch_queue_t)completionCallbackQueue onComplete:(SMCustomCodeBatchCompletionBlock)completionBlock;
 
 /**
  Retry executing a custom code method on StackMob.
@@ -515,9 +683,11 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSu
  @param successBlock <i>typedef void (^SMFullResponseSuccessBlock)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON)</i>. A block object to call on the main thread upon success.
  @param failureBlock <i>typedef void (^SMFullResponseFailureBlock)(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON)</i>. A block object to call on the main thread upon failure.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
-- (void)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+- (SMRequestHandle *)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
 
 /**
  Retry executing a custom code method on StackMob.
@@ -531,8 +701,10 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSu
  @param successBlock <i>typedef void (^SMFullResponseSuccessBlock)(NSURLRequest *request, NSHTTPURLResponse *response, id JSON)</i>. A block object to call on the successCallbackQueue upon success.
  @param failureBlock <i>typedef void (^SMFullResponseFailureBlock)(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON)</i>. A block object to call on the failureCallbackQueue upon failure.
  
+ @return An <SMRequestHandle> for cancelling the request.
+ 
  @since Available in iOS SDK 1.2.0 and later.
  */
-- (void)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+- (SMRequestHandle *)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
 
 @end
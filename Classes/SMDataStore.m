@@ -28,16 +28,111 @@
 #import "SMCustomCodeRequest.h"
 #import "SMResponseBlocks.h"
 
+@interface SMRequestHandle ()
+
+@property (readwrite, nonatomic) BOOL isCancelled;
+@property (readwrite, nonatomic) BOOL deadlineExceeded;
+@property (strong, nonatomic) NSMutableArray *cancellables;
+
+@end
+
+@implementation SMRequestHandle
+
+@synthesize isCancelled = _SM_isCancelled;
+@synthesize deadlineExceeded = _SM_deadlineExceeded;
+@synthesize cancellables = _SM_cancellables;
+
+- (id)init
+{
+    return [self initWithDeadline:nil];
+}
+
+- (id)initWithDeadline:(NSDate *)deadline
+{
+    self = [super init];
+    if (self) {
+        self.cancellables = [NSMutableArray array];
+        if (deadline) {
+            // The request keeps its handle alive while outstanding, so a handle that is gone has nothing left to expire
+            __weak SMRequestHandle *weakSelf = self;
+            dispatch_after(SMDispatchTimeForDeadline(deadline), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [weakSelf SM_expire];
+            });
+        }
+    }
+    return self;
+}
+
+- (void)cancel
+{
+    NSArray *cancellablesToCancel = nil;
+    @synchronized(self) {
+        if (self.isCancelled) {
+            return;
+        }
+        self.isCancelled = YES;
+        cancellablesToCancel = [self.cancellables copy];
+        [self.cancellables removeAllObjects];
+    }
+    [cancellablesToCancel makeObjectsPerformSelector:@selector(cancel)];
+}
+
+- (void)SM_expire
+{
+    @synchronized(self) {
+        if (self.isCancelled) {
+            return;
+        }
+        self.deadlineExceeded = YES;
+    }
+    [self cancel];
+}
+
+- (void)SM_addCancellable:(id)cancellable
+{
+    if (!cancellable) {
+        return;
+    }
+    
+    BOOL cancelNow = NO;
+    @synchronized(self) {
+        if (self.isCancelled) {
+            cancelNow = YES;
+        } else {
+            // Finished operations from earlier attempts have nothing left to cancel
+            NSIndexSet *finished = [self.cancellables indexesOfObjectsPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+                return [obj isKindOfClass:[NSOperation class]] && [obj isFinished];
+            }];
+            [self.cancellables removeObjectsAtIndexes:finished];
+            [self.cancellables addObject:cancellable];
+        }
+    }
+    if (cancelNow) {
+        [cancellable cancel];
+    }
+}
+
+- (NSError *)SM_cancellationErrorWithUnderlyingError:(NSError *)underlyingError
+{
+    NSDictionary *userInfo = underlyingError ? [NSDictionary dictionaryWithObject:underlyingError forKey:NSUnderlyingErrorKey] : nil;
+    return [[NSError alloc] initWithDomain:SMErrorDomain code:(self.deadlineExceeded ? SMErrorDeadlineExceeded : SMErrorRequestCancelled) userInfo:userInfo];
+}
+
+@end
+
 @interface SMDataStore ()
 
 @property(nonatomic, readwrite, copy) NSString *apiVersion;
 
+- (void)SM_queueOneShotRequest:(NSURLRequest *)request outputStream:(NSOutputStream *)outputStream options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock;
+
 @end
 
 @implementation SMDataStore
 
 @synthesize apiVersion = _SM_apiVersion;
 @synthesize session = _SM_session;
+@synthesize aggregateCustomCodeMethod = _SM_aggregateCustomCodeMethod;
 
 - (id)initWithAPIVersion:(NSString *)apiVersion session:(SMUserSession *)session
 {
@@ -49,17 +144,17 @@
     return self;
 }
 
-- (void)createObject:(NSDictionary *)theObject inSchema:(NSString *)schema onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
+- (SMRequestHandle *)createObject:(NSDictionary *)theObject inSchema:(NSString *)schema onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
 {
-    [self createObject:theObject inSchema:schema options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self createObject:theObject inSchema:schema options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)createObject:(NSDictionary *)theObject inSchema:(NSString *)schema options:(SMRequestOptions *)options onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
+- (SMRequestHandle *)createObject:(NSDictionary *)theObject inSchema:(NSString *)schema options:(SMRequestOptions *)options onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
 {
-    [self createObject:theObject inSchema:schema options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self createObject:theObject inSchema:schema options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)createObject:(NSDictionary *)theObject
+- (SMRequestHandle *)createObject:(NSDictionary *)theObject
             inSchema:(NSString *)schema
              options:(SMRequestOptions *)options
 successCallbackQueue:(dispatch_queue_t)successCallbackQueue
@@ -67,6 +162,7 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
            onSuccess:(SMDataStoreSuccessBlock)successBlock
            onFailure:(SMDataStoreFailureBlock)failureBlock
 {
+     SMRequestHandle *handle = nil;
      if (theObject == nil || schema == nil) {
      if (failureBlock) {
      NSError *error = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorInvalidArguments userInfo:nil];
@@ -82,40 +178,43 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
      NSMutableURLRequest *request = [[self.session oauthClientWithHTTPS:options.isSecure] requestWithMethod:@"POST" path:theSchema parameters:theObject];
      SMFullResponseSuccessBlock urlSuccessBlock = [self SMFullResponseSuccessBlockForSchema:schema withSuccessBlock:successBlock];
      SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForObject:theObject ofSchema:schema withFailureBlock:failureBlock];
-     [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+     handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+     [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
      }
+     return handle;
 }
 
-- (void)readObjectWithId:(NSString *)theObjectId
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId
                 inSchema:(NSString *)schema
                onSuccess:(SMDataStoreSuccessBlock)successBlock
                onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
-    [self readObjectWithId:theObjectId inSchema:schema options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self readObjectWithId:theObjectId inSchema:schema options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)readObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
-    [self readObjectWithId:theObjectId inSchema:schema options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self readObjectWithId:theObjectId inSchema:schema options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)readObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
+- (SMRequestHandle *)readObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
-    [self readObjectWithId:theObjectId inSchema:schema parameters:nil options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    return [self readObjectWithId:theObjectId inSchema:schema parameters:nil options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)updateObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
+- (SMRequestHandle *)updateObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
 {
-    [self updateObjectWithId:theObjectId inSchema:schema update:updatedFields options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self updateObjectWithId:theObjectId inSchema:schema update:updatedFields options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)updateObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields options:(SMRequestOptions *)options onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
+- (SMRequestHandle *)updateObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields options:(SMRequestOptions *)options onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
 {
-    [self updateObjectWithId:theObjectId inSchema:schema update:updatedFields options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self updateObjectWithId:theObjectId inSchema:schema update:updatedFields options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)updateObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
+- (SMRequestHandle *)updateObjectWithId:(NSString *)theObjectId inSchema:(NSString *)schema update:(NSDictionary *)updatedFields options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
 {
+    SMRequestHandle *handle = nil;
     if (theObjectId == nil || schema == nil) {
         if (failureBlock) {
             NSError *error = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorInvalidArguments userInfo:nil];
@@ -128,21 +227,23 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
         
         SMFullResponseSuccessBlock urlSuccessBlock = [self SMFullResponseSuccessBlockForSchema:schema withSuccessBlock:successBlock];
         SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForObject:updatedFields ofSchema:schema withFailureBlock:failureBlock];
-        [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+        handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+        [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
     }
+    return handle;
 }
 
-- (void)updateAtomicCounterWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateAtomicCounterWithId:(NSString *)theObjectId
                             field:(NSString *)field
                          inSchema:(NSString *)schema
                                by:(int)increment
                         onSuccess:(SMDataStoreSuccessBlock)successBlock
                         onFailure:(SMDataStoreFailureBlock)failureBlock
 {
-    [self updateAtomicCounterWithId:theObjectId field:field inSchema:schema by:increment options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self updateAtomicCounterWithId:theObjectId field:field inSchema:schema by:increment options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)updateAtomicCounterWithId:(NSString *)theObjectId
+- (SMRequestHandle *)updateAtomicCounterWithId:(NSString *)theObjectId
                             field:(NSString *)field
                          inSchema:(NSString *)schema
                                by:(int)increment
@@ -150,27 +251,28 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
                         onSuccess:(SMDataStoreSuccessBlock)successBlock
                         onFailure:(SMDataStoreFailureBlock)failureBlock
 {
-    [self updateAtomicCounterWithId:theObjectId field:field inSchema:schema by:increment options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self updateAtomicCounterWithId:theObjectId field:field inSchema:schema by:increment options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)updateAtomicCounterWithId:(NSString *)theObjectId field:(NSString *)field inSchema:(NSString *)schema by:(int)increment options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
+- (SMRequestHandle *)updateAtomicCounterWithId:(NSString *)theObjectId field:(NSString *)field inSchema:(NSString *)schema by:(int)increment options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreSuccessBlock)successBlock onFailure:(SMDataStoreFailureBlock)failureBlock
 {
     NSDictionary *args = [[NSDictionary dictionary] dictionaryByAppendingCounterUpdateForField:field by:increment];
-    [self updateObjectWithId:theObjectId inSchema:schema update:args options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    return [self updateObjectWithId:theObjectId inSchema:schema update:args options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)deleteObjectId:(NSString *)theObjectId inSchema:(NSString *)schema onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
+- (SMRequestHandle *)deleteObjectId:(NSString *)theObjectId inSchema:(NSString *)schema onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
-    [self deleteObjectId:theObjectId inSchema:schema options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self deleteObjectId:theObjectId inSchema:schema options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)deleteObjectId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
+- (SMRequestHandle *)deleteObjectId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
-    [self deleteObjectId:theObjectId inSchema:schema options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self deleteObjectId:theObjectId inSchema:schema options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)deleteObjectId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
+- (SMRequestHandle *)deleteObjectId:(NSString *)theObjectId inSchema:(NSString *)schema options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMDataStoreObjectIdSuccessBlock)successBlock onFailure:(SMDataStoreObjectIdFailureBlock)failureBlock
 {
+    SMRequestHandle *handle = nil;
     if (theObjectId == nil || schema == nil) {
         if (failureBlock) {
             NSError *error = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorInvalidArguments userInfo:nil];
@@ -182,8 +284,10 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
         NSMutableURLRequest *request = [[self.session oauthClientWithHTTPS:options.isSecure] requestWithMethod:@"DELETE" path:path parameters:nil];
         SMFullResponseSuccessBlock urlSuccessBlock = [self SMFullResponseSuccessBlockForObjectId:theObjectId ofSchema:schema withSuccessBlock:successBlock];
         SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForObjectId:theObjectId ofSchema:schema withFailureBlock:failureBlock];
-        [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+        handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+        [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
     }
+    return handle;
 }
 
 - (NSMutableURLRequest *)requestFromQuery:(SMQuery *)query options:(SMRequestOptions *)options
@@ -199,37 +303,39 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
     return request;
 }
 
-- (void)performQuery:(SMQuery *)query onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+- (SMRequestHandle *)performQuery:(SMQuery *)query onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
-    [self performQuery:query options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self performQuery:query options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)performQuery:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+- (SMRequestHandle *)performQuery:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
-    [self performQuery:query options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self performQuery:query options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)performQuery:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+- (SMRequestHandle *)performQuery:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     NSMutableURLRequest *request = [self requestFromQuery:query options:options];
     
     SMFullResponseSuccessBlock urlSuccessBlock = [self SMFullResponseSuccessBlockForQuerySuccessBlock:successBlock];
     SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForFailureBlock:failureBlock];
     
-    [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+    SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+    [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+    return handle;
 }
 
-- (void)performCount:(SMQuery *)query onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+- (SMRequestHandle *)performCount:(SMQuery *)query onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
-    [self performCount:query options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];    
+    return [self performCount:query options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];    
 }
 
-- (void)performCount:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+- (SMRequestHandle *)performCount:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
-    [self performCount:query options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self performCount:query options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)performCount:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+- (SMRequestHandle *)performCount:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMCountSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     SMQuery *countQuery = [[SMQuery alloc] initWithSchema:query.schemaName];
     countQuery.requestParameters = query.requestParameters;
@@ -252,34 +358,253 @@ failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue
     };
     
     SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForFailureBlock:failureBlock];
-    [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+    SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+    [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+    return handle;
 }
 
-- (void)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+- (SMRequestHandle *)performAggregateQuery:(SMQuery *)query onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
-    [self performCustomCodeRequest:customCodeRequest options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+    return [self performAggregateQuery:query options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+- (SMRequestHandle *)performAggregateQuery:(SMQuery *)query options:(SMRequestOptions *)options onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
-    [self performCustomCodeRequest:customCodeRequest options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self performAggregateQuery:query options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+- (SMRequestHandle *)performAggregateQuery:(SMQuery *)query options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMResultsSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+{
+    if (self.aggregateCustomCodeMethod) {
+        NSMutableDictionary *body = [NSMutableDictionary dictionary];
+        [body setObject:query.schemaName forKey:@"schema"];
+        [body setObject:query.requestParameters forKey:@"parameters"];
+        [body setObject:query.aggregates forKey:@"aggregates"];
+        [body setObject:query.groupByFields forKey:@"groupBy"];
+        
+        NSError *error = nil;
+        NSData *bodyData = [NSJSONSerialization dataWithJSONObject:body options:0 error:&error];
+        if (!bodyData) {
+            if (failureBlock) {
+                dispatch_async(failureCallbackQueue ? failureCallbackQueue : dispatch_get_main_queue(), ^{
+                    failureBlock(error);
+                });
+            }
+            return [[SMRequestHandle alloc] init];
+        }
+        
+        SMCustomCodeRequest *customCodeRequest = [[SMCustomCodeRequest alloc] initPostRequestWithMethod:self.aggregateCustomCodeMethod body:nil];
+        customCodeRequest.requestBodyData = bodyData;
+        
+        SMFullResponseSuccessBlock urlSuccessBlock = ^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+            if (![JSON isKindOfClass:[NSArray class]]) {
+                if (failureBlock) {
+                    // Called on the success queue, so hop to the failure queue the caller asked for
+                    NSError *rowsError = [NSError errorWithDomain:SMErrorDomain code:SMErrorInvalidArguments userInfo:[NSDictionary dictionaryWithObject:@"The aggregate custom code method did not return an array of rows" forKey:NSLocalizedDescriptionKey]];
+                    dispatch_async(failureCallbackQueue ? failureCallbackQueue : dispatch_get_main_queue(), ^{
+                        failureBlock(rowsError);
+                    });
+                }
+            } else if (successBlock) {
+                successBlock((NSArray *)JSON);
+            }
+        };
+        SMFullResponseFailureBlock urlFailureBlock = [self SMFullResponseFailureBlockForFailureBlock:failureBlock];
+        
+        return [self performCustomCodeRequest:customCodeRequest options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+    }
+    
+    // No server aggregation, so fetch only the fields the aggregates need and reduce the objects here
+    SMQuery *fieldsQuery = [[SMQuery alloc] initWithSchema:query.schemaName];
+    fieldsQuery.requestParameters = query.requestParameters;
+    NSMutableDictionary *requestHeaders = [NSMutableDictionary dictionaryWithDictionary:query.requestHeaders];
+    
+    NSMutableArray *fields = [NSMutableArray arrayWithArray:query.groupByFields];
+    for (NSDictionary *aggregate in query.aggregates) {
+        NSString *field = [aggregate objectForKey:@"field"];
+        if (field && ![fields containsObject:field]) {
+            [fields addObject:field];
+        }
+    }
+    // Counting objects needs no fields, but selecting none would return them whole
+    BOOL countsObjects = [[query.aggregates valueForKey:@"field"] containsObject:[NSNull null]];
+    if ([fields count] > 0 && !countsObjects) {
+        [requestHeaders setObject:[fields componentsJoinedByString:@","] forKey:@"X-StackMob-Select"];
+    }
+    fieldsQuery.requestHeaders = requestHeaders;
+    
+    return [self performQuery:fieldsQuery options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:^(NSArray *results) {
+        if (successBlock) {
+            successBlock([query aggregateObjects:results]);
+        }
+    } onFailure:failureBlock];
+}
+
+- (SMRequestHandle *)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+{
+    return [self performCustomCodeRequest:customCodeRequest options:[SMRequestOptions options] onSuccess:successBlock onFailure:failureBlock];
+}
+
+- (SMRequestHandle *)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+{
+    return [self performCustomCodeRequest:customCodeRequest options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+}
+
+- (SMRequestHandle *)performCustomCodeRequest:(SMCustomCodeRequest *)customCodeRequest options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
 {
     NSMutableURLRequest *request = [[self.session oauthClientWithHTTPS:options.isSecure] customCodeRequest:customCodeRequest options:options];
+    SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+    
+    if (customCodeRequest.requestBodyStream || customCodeRequest.responseOutputStream) {
+        [self SM_queueOneShotRequest:request outputStream:customCodeRequest.responseOutputStream options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    } else {
+        [self queueRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    }
+    return handle;
+}
+
+- (void)SM_queueOneShotRequest:(NSURLRequest *)request outputStream:(NSOutputStream *)outputStream options:(SMRequestOptions *)options handle:(SMRequestHandle *)handle successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+{
+    if (handle.isCancelled) {
+        if (failureBlock) {
+            dispatch_async(failureCallbackQueue ? failureCallbackQueue : dispatch_get_main_queue(), ^{
+                failureBlock(request, nil, [handle SM_cancellationErrorWithUnderlyingError:nil], nil);
+            });
+        }
+        return;
+    }
+    
+    // Changed below for this request only, the caller may share its options with other requests
+    options = [options copy];
+    
+    // Streams can only be read and written once, so the token is refreshed up front and the request is never retried
+    if ([self.session eligibleForTokenRefresh:options]) {
+        [options setTryRefreshToken:NO];
+        dispatch_queue_t newQueueForRefresh = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+        [self.session refreshTokenWithSuccessCallbackQueue:newQueueForRefresh failureCallbackQueue:newQueueForRefresh onSuccess:^(NSDictionary *userObject) {
+            [self SM_queueOneShotRequest:[self.session signRequest:request] outputStream:outputStream options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+        } onFailure:^(NSError *theError) {
+            [self SM_failRequest:request withTokenRefreshError:theError originalError:nil failureCallbackQueue:failureCallbackQueue onFailure:failureBlock];
+        }];
+        return;
+    }
+    
+    [options setNumberOfRetries:0];
+    SMFullResponseFailureBlock cancellationAwareFailureBlock = ^(NSURLRequest *failedRequest, NSHTTPURLResponse *response, NSError *error, id JSON) {
+        if (failureBlock) {
+            failureBlock(failedRequest, response, handle.isCancelled ? [handle SM_cancellationErrorWithUnderlyingError:error] : error, JSON);
+        }
+    };
+    AFJSONRequestOperation *op = [self newOperationForRequest:request options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:cancellationAwareFailureBlock];
+    if (outputStream) {
+        [op setOutputStream:outputStream];
+    }
+    [handle SM_addCancellable:op];
+    [[self.session oauthClientWithHTTPS:options.isSecure] enqueueHTTPRequestOperation:op];
+}
+
+- (SMRequestHandle *)performCustomCodeRequests:(NSArray *)customCodeRequests options:(SMRequestOptions *)options maxConcurrentRequests:(NSUInteger)maxConcurrentRequests onComplete:(SMCustomCodeBatchCompletionBlock)completionBlock
+{
+    return [self performCustomCodeRequests:customCodeRequests options:options maxConcurrentRequests:maxConcurrentRequests completionCallbackQueue:dispatch_get_main_queue() onComplete:completionBlock];
+}
+
+- (SMRequestHandle *)performCustomCodeRequests:(NSArray *)customCodeRequests options:(SMRequestOptions *)options maxConcurrentRequests:(NSUInteger)maxConcurrentRequests completionCallbackQueue:(dispatch_queue_t)completionCallbackQueue onComplete:(SMCustomCodeBatchCompletionBlock)completionBlock
+{
+    if (!completionCallbackQueue) {
+        completionCallbackQueue = dispatch_get_main_queue();
+    }
+    
+    NSUInteger requestCount = [customCodeRequests count];
+    NSMutableArray *responses = [NSMutableArray arrayWithCapacity:requestCount];
+    NSMutableArray *errors = [NSMutableArray arrayWithCapacity:requestCount];
+    for (NSUInteger i = 0; i < requestCount; i++) {
+        [responses addObject:[NSNull null]];
+        [errors addObject:[NSNull null]];
+    }
+    
+    SMRequestHandle *batchHandle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+    
+    if (requestCount == 0) {
+        if (completionBlock) {
+            dispatch_async(completionCallbackQueue, ^{
+                completionBlock(responses, errors);
+            });
+        }
+        return batchHandle;
+    }
+    
+    NSUInteger window = maxConcurrentRequests > 0 ? MIN(maxConcurrentRequests, requestCount) : requestCount;
+    
+    // Every callback of the batch lands on this queue, which serializes the bookkeeping below
+    dispatch_queue_t batchQueue = dispatch_queue_create("com.stackmob.customCodeBatchQueue", NULL);
+    __block NSUInteger nextIndex = 0;
+    __block NSUInteger finishedCount = 0;
+    __block void (^sendNextRequest)(void);
+    
+    sendNextRequest = ^{
+        NSUInteger index = nextIndex++;
+        SMCustomCodeRequest *customCodeRequest = [customCodeRequests objectAtIndex:index];
+        SMRequestOptions *requestOptions = options ? [options copy] : [SMRequestOptions options];
+        
+        void (^finishRequest)(id, NSError *) = ^(id JSON, NSError *error) {
+            if (JSON) {
+                [responses replaceObjectAtIndex:index withObject:JSON];
+            }
+            if (error) {
+                [errors replaceObjectAtIndex:index withObject:error];
+            }
+            finishedCount++;
+            
+            // Once the batch is cancelled, requests that were never sent fail without going out
+            if (batchHandle.isCancelled) {
+                while (nextIndex < requestCount) {
+                    [errors replaceObjectAtIndex:nextIndex++ withObject:[batchHandle SM_cancellationErrorWithUnderlyingError:nil]];
+                    finishedCount++;
+                }
+            }
+            
+            if (nextIndex < requestCount) {
+                sendNextRequest();
+            } else if (finishedCount == requestCount) {
+                if (completionBlock) {
+                    dispatch_async(completionCallbackQueue, ^{
+                        completionBlock(responses, errors);
+                    });
+                }
+                sendNextRequest = nil;
+#if !OS_OBJECT_USE_OBJC
+                dispatch_release(batchQueue);
+#endif
+            }
+        };
+        
+        SMRequestHandle *requestHandle = [self performCustomCodeRequest:customCodeRequest options:requestOptions successCallbackQueue:batchQueue failureCallbackQueue:batchQueue onSuccess:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
+            finishRequest(JSON, nil);
+        } onFailure:^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON) {
+            finishRequest(nil, error);
+        }];
+        [batchHandle SM_addCancellable:requestHandle];
+    };
+    
+    dispatch_async(batchQueue, ^{
+        for (NSUInteger i = 0; i < window; i++) {
+            sendNextRequest();
+        }
+    });
     
-    [self queueRequest:request options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    return batchHandle;
 }
 
-- (void)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+- (SMRequestHandle *)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
 {
-    [self retryCustomCodeRequest:request options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
+    return [self retryCustomCodeRequest:request options:options successCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
 }
 
-- (void)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
+- (SMRequestHandle *)retryCustomCodeRequest:(NSURLRequest *)request options:(SMRequestOptions *)options successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue onSuccess:(SMFullResponseSuccessBlock)successBlock onFailure:(SMFullResponseFailureBlock)failureBlock
 {
-    [self queueRequest:[self.session signRequest:request] options:options successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:options.deadline];
+    [self queueRequest:[self.session signRequest:request] options:options handle:handle successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+    return handle;
 }
 
 @end
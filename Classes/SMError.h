@@ -41,6 +41,8 @@ typedef enum {
     SMErrorCoreDataSave = -108,
     SMErrorRefreshTokenFailed = -109,
     SMErrorLocationManagerFailed = -110,
+    SMErrorRequestCancelled = -111,
+    SMErrorDeadlineExceeded = -112,
     //Success messages. These shouldn't normally be encountered
     SMErrorOK = 200,
     SMErrorCreated = 201,
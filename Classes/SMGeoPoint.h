@@ -55,15 +55,21 @@
  
  ## Using SMGeoPoint with Core Data ##
  
- GeoPoints are stored in Core Data using the `Transformable` attribute type. To save an `SMGeoPoint` in Core Data, it must be archived into `NSData`:
+ GeoPoints are stored in Core Data using the `Transformable` attribute type.  The recommended setup is to set the attribute's Value Transformer Name to `SMGeoPointTransformer` in the model editor.  The attribute then holds an `SMGeoPoint` directly, and it is stored as 16 bytes instead of a keyed archive:
  
     NSNumber *lat = [NSNumber numberWithDouble:37.77215879638275];
     NSNumber *lon = [NSNumber numberWithDouble:-122.4064476357965];
  
     SMGeoPoint *location = [SMGeoPoint geoPointWithLatitude:lat longitude:lon];
  
+    [object setValue:location forKey:@"location"];
+ 
+ Attributes without a value transformer name hold the point archived into `NSData`, as in earlier versions of the SDK:
+ 
     NSData *data = [NSKeyedArchiver archivedDataWithRootObject:location];
  
+ Switching an existing attribute to `SMGeoPointTransformer` does not need a model migration.  Values already in the cache are still read, and each one is rewritten in the compact format when it is next saved.  Remember to update code that archives or unarchives the attribute's value at the same time.
+ 
  To query using SMGeoPoint, use the special predicate methods provided by the [SMPredicate](http://stackmob.github.com/stackmob-ios-sdk/Classes/SMPredicate.html) class:
  
     NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"EntityName"];
@@ -77,7 +83,7 @@
     SMPredicate *predicate = [SMPredicate predicateWhere:@"geopoint" isWithin:3.5 milesOfGeoPoint:geoPoint];
     [fetchRequest setPredicate:predicate];
  
- Once you've made a fetch request, make sure to unarchive the NSData:
+ When the attribute uses `SMGeoPointTransformer`, results hold `SMGeoPoint` values.  Otherwise, make sure to unarchive the NSData once you've made a fetch request:
     
     // Execute fetch request
     [self.managedObjectContext executeFetchRequest:fetchRequest onSuccess:^(NSArray *results) {
@@ -93,7 +99,7 @@
             NSLog(@"Error: %@", error);
     }];
  
- **Important:** Fetching from the cache using `SMPredicate` is not supported, and will return an empty array of results. Similarly, when a fetch is performed from the network (StackMob), any results are not cached.
+ Fetching from the cache with an `SMPredicate` is supported when the predicate stands alone or is combined with other criteria using AND.  Other compound predicates return an empty array of results from the cache.
  
  ## Using SMGeoPoint with the Datastore API ##
  
@@ -203,3 +209,42 @@
 
 @end
 
+/**
+ The name of <SMGeoPointTransformer>, for use as the Value Transformer Name of a `Transformable` attribute.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+extern NSString *const SMGeoPointTransformerName;
+
+/**
+ `SMGeoPointTransformer` stores an `SMGeoPoint` attribute as 16 bytes: the latitude followed by the longitude, each a little-endian 64-bit double.
+ 
+ Set `SMGeoPointTransformer` as the Value Transformer Name of a `Transformable` attribute to use it.  Data written by `NSKeyedArchiver`, by earlier versions of the SDK or by an attribute without a value transformer name, is also read, so existing caches keep working after the switch.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@interface SMGeoPointTransformer : NSValueTransformer
+
+/**
+ Encode a geo point in the 16 byte format.
+ 
+ @param geoPoint The geo point to encode.
+ 
+ @return The encoded geo point, or `nil` if `geoPoint` has no latitude or longitude.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (NSData *)dataWithGeoPoint:(NSDictionary *)geoPoint;
+
+/**
+ Decode a geo point, either from the 16 byte format or from a keyed archive.
+ 
+ @param data The encoded geo point.
+ 
+ @return An instance of `SMGeoPoint`, or `nil` if `data` does not hold a geo point.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMGeoPoint *)geoPointWithData:(NSData *)data;
+
+@end
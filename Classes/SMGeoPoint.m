@@ -124,4 +124,96 @@
 }
 
 
+@end
+
+#define GEO_POINT_DATA_LENGTH 16
+
+NSString *const SMGeoPointTransformerName = @"SMGeoPointTransformer";
+
+@implementation SMGeoPointTransformer
+
++ (Class)transformedValueClass
+{
+    return [NSData class];
+}
+
++ (BOOL)allowsReverseTransformation
+{
+    return YES;
+}
+
++ (NSData *)dataWithGeoPoint:(NSDictionary *)geoPoint
+{
+    if (![geoPoint latitude] || ![geoPoint longitude]) {
+        return nil;
+    }
+    
+    double coordinates[2] = { [[geoPoint latitude] doubleValue], [[geoPoint longitude] doubleValue] };
+    uint64_t bytes[2];
+    for (int i = 0; i < 2; i++) {
+        uint64_t bits;
+        memcpy(&bits, &coordinates[i], sizeof(bits));
+        bytes[i] = CFSwapInt64HostToLittle(bits);
+    }
+    
+    return [NSData dataWithBytes:bytes length:GEO_POINT_DATA_LENGTH];
+}
+
++ (SMGeoPoint *)geoPointWithData:(NSData *)data
+{
+    if ([data length] == GEO_POINT_DATA_LENGTH) {
+        uint64_t bytes[2];
+        [data getBytes:bytes length:GEO_POINT_DATA_LENGTH];
+        double coordinates[2];
+        for (int i = 0; i < 2; i++) {
+            uint64_t bits = CFSwapInt64LittleToHost(bytes[i]);
+            memcpy(&coordinates[i], &bits, sizeof(bits));
+        }
+        return [SMGeoPoint geoPointWithLatitude:[NSNumber numberWithDouble:coordinates[0]] longitude:[NSNumber numberWithDouble:coordinates[1]]];
+    }
+    
+    // Anything else was written by NSKeyedArchiver
+    id object = nil;
+    @try {
+        object = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    }
+    @catch (NSException *exception) {
+        return nil;
+    }
+    
+    // Transformable attributes without a transformer name archive the NSData they are given a second time
+    if ([object isKindOfClass:[NSData class]]) {
+        return [self geoPointWithData:object];
+    }
+    
+    if (![object isKindOfClass:[NSDictionary class]] || ![(NSDictionary *)object latitude] || ![(NSDictionary *)object longitude]) {
+        return nil;
+    }
+    
+    return object;
+}
+
+- (id)transformedValue:(id)value
+{
+    if ([value isKindOfClass:[NSData class]]) {
+        // Already archived by code written for the old format
+        value = [SMGeoPointTransformer geoPointWithData:value];
+    }
+    
+    if (![value isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+    
+    return [SMGeoPointTransformer dataWithGeoPoint:value];
+}
+
+- (id)reverseTransformedValue:(id)value
+{
+    if (![value isKindOfClass:[NSData class]]) {
+        return nil;
+    }
+    
+    return [SMGeoPointTransformer geoPointWithData:value];
+}
+
 @end
@@ -18,4 +18,13 @@
 
 @interface SMJSONRequestOperation : AFJSONRequestOperation
 
+/**
+ Records when the operation was handed to the client, so the time it spends waiting for a connection slot can be reported to the <SMMetricsObserver>.
+ 
+ Does nothing when no metrics observer is set.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)SM_markEnqueued;
+
 @end
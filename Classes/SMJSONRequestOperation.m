@@ -15,12 +15,138 @@
  */
 
 #import "SMJSONRequestOperation.h"
+#import "SMMetrics+Protected.h"
+
+@interface SMJSONRequestOperation ()
+{
+    // Whether an observer was set when the operation was created, nothing below is touched otherwise
+    BOOL _SM_metricsEnabled;
+    CFAbsoluteTime _SM_enqueuedTime;
+    CFAbsoluteTime _SM_startTime;
+    CFAbsoluteTime _SM_responseTime;
+    CFAbsoluteTime _SM_finishTime;
+    NSTimeInterval _SM_parseDuration;
+}
+
+- (SMRequestMetrics *)SM_metricsWithError:(NSError *)error;
+
+@end
 
 @implementation SMJSONRequestOperation
 
+- (id)initWithRequest:(NSURLRequest *)urlRequest
+{
+    self = [super initWithRequest:urlRequest];
+    if (self) {
+        _SM_metricsEnabled = SMMetricsEnabled();
+        _SM_parseDuration = -1;
+    }
+    
+    return self;
+}
+
 + (NSSet *)acceptableContentTypes {
     NSSet *defaultAcceptableContentTypes = [super acceptableContentTypes];
     return [defaultAcceptableContentTypes setByAddingObject:@"application/vnd.stackmob+json"];
 }
 
+#pragma mark - Metrics
+
+- (void)SM_markEnqueued
+{
+    if (_SM_metricsEnabled) {
+        _SM_enqueuedTime = CFAbsoluteTimeGetCurrent();
+    }
+}
+
+- (void)start
+{
+    if (_SM_metricsEnabled && _SM_startTime == 0) {
+        _SM_startTime = CFAbsoluteTimeGetCurrent();
+    }
+    [super start];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    if (_SM_metricsEnabled) {
+        _SM_responseTime = CFAbsoluteTimeGetCurrent();
+    }
+    [super connection:connection didReceiveResponse:response];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    if (_SM_metricsEnabled) {
+        _SM_finishTime = CFAbsoluteTimeGetCurrent();
+    }
+    [super connectionDidFinishLoading:connection];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+    if (_SM_metricsEnabled) {
+        _SM_finishTime = CFAbsoluteTimeGetCurrent();
+    }
+    [super connection:connection didFailWithError:error];
+}
+
+- (id)responseJSON
+{
+    if (!_SM_metricsEnabled || _SM_parseDuration >= 0) {
+        return [super responseJSON];
+    }
+    
+    CFAbsoluteTime parseStart = CFAbsoluteTimeGetCurrent();
+    id JSON = [super responseJSON];
+    if ([self isFinished]) {
+        _SM_parseDuration = CFAbsoluteTimeGetCurrent() - parseStart;
+    }
+    
+    return JSON;
+}
+
+- (void)setCompletionBlockWithSuccess:(void (^)(AFHTTPRequestOperation *operation, id responseObject))success
+                              failure:(void (^)(AFHTTPRequestOperation *operation, NSError *error))failure
+{
+    if (!_SM_metricsEnabled) {
+        [super setCompletionBlockWithSuccess:success failure:failure];
+        return;
+    }
+    
+    // Report once the caller's callback has run, so the parse stage is known
+    [super setCompletionBlockWithSuccess:^(AFHTTPRequestOperation *operation, id responseObject) {
+        if (success) {
+            success(operation, responseObject);
+        }
+        SMMetricsReportRequest([(SMJSONRequestOperation *)operation SM_metricsWithError:nil]);
+    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
+        if (failure) {
+            failure(operation, error);
+        }
+        SMMetricsReportRequest([(SMJSONRequestOperation *)operation SM_metricsWithError:error]);
+    }];
+}
+
+- (SMRequestMetrics *)SM_metricsWithError:(NSError *)error
+{
+    SMRequestMetrics *metrics = [[SMRequestMetrics alloc] init];
+    metrics.request = self.request;
+    metrics.response = self.response;
+    metrics.error = error;
+    metrics.signingDuration = [[NSURLProtocol propertyForKey:SMMetricsSigningDurationKey inRequest:self.request] doubleValue];
+    if (_SM_enqueuedTime > 0 && _SM_startTime > _SM_enqueuedTime) {
+        metrics.queueWaitDuration = _SM_startTime - _SM_enqueuedTime;
+    }
+    if (_SM_startTime > 0 && _SM_responseTime > _SM_startTime) {
+        metrics.timeToFirstByteDuration = _SM_responseTime - _SM_startTime;
+    }
+    if (_SM_responseTime > 0 && _SM_finishTime > _SM_responseTime) {
+        metrics.downloadDuration = _SM_finishTime - _SM_responseTime;
+    }
+    metrics.parseDuration = MAX(_SM_parseDuration, 0);
+    
+    return metrics;
+}
+
 @end
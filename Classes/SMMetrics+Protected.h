@@ -0,0 +1,25 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "SMMetrics.h"
+
+// Used by the SDK to report metrics, each returns straight away when no observer is set
+extern NSString *const SMMetricsSigningDurationKey;
+BOOL SMMetricsEnabled(void);
+void SMMetricsIncrementCounter(NSString *counter, NSUInteger amount);
+void SMMetricsSetGauge(NSString *gauge, double value);
+void SMMetricsRecordDurationSince(NSString *timer, CFAbsoluteTime start);
+void SMMetricsReportRequest(SMRequestMetrics *metrics);
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+// Counters
+extern NSString *const SMMetricsRetryCounter;
+extern NSString *const SMMetricsTokenRefreshCounter;
+extern NSString *const SMMetricsRetryAfterBackoffCounter;
+extern NSString *const SMMetricsCacheHitCounter;
+extern NSString *const SMMetricsCacheMissCounter;
+
+// Gauges
+extern NSString *const SMMetricsDirtyQueueDepthGauge;
+extern NSString *const SMMetricsPushOutboundQueueDepthGauge;
+
+// Timers
+extern NSString *const SMMetricsMaterializationTimer;
+
+/**
+ `SMRequestMetrics` holds the timing of one request, split into the stages it went through.
+ 
+ Durations are in seconds.  A stage the request never reached, for example the download of a request whose connection failed, has a duration of 0.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@interface SMRequestMetrics : NSObject
+
+/**
+ The request as it was sent.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSURLRequest *request;
+
+/**
+ The response, or `nil` if none was received.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSHTTPURLResponse *response;
+
+/**
+ The error the request failed with, or `nil` if it succeeded.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSError *error;
+
+/**
+ Time spent signing the request with the OAuth2 MAC credentials.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval signingDuration;
+
+/**
+ Time between the request being handed to the client and starting, spent waiting for a free connection slot.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval queueWaitDuration;
+
+/**
+ Time between the request starting and the response headers arriving.  This covers DNS lookup, connecting, TLS and time to first byte, which `NSURLConnection` does not report separately.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval timeToFirstByteDuration;
+
+/**
+ Time between the response headers arriving and the last byte of the body.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval downloadDuration;
+
+/**
+ Time spent parsing the JSON response body.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval parseDuration;
+
+@end
+
+/**
+ Implement `SMMetricsObserver` to receive request timings and SDK counters, for example to feed them into your own telemetry.
+ 
+ Every method is optional.  Methods are called on whichever thread the event happens on, often a background thread, so implementations must be thread safe and should return quickly.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@protocol SMMetricsObserver <NSObject>
+
+@optional
+
+/**
+ Called once for each request sent to StackMob, after its callbacks have run.
+ 
+ @param metrics The timings of the request.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)requestDidFinishWithMetrics:(SMRequestMetrics *)metrics;
+
+/**
+ Called when a counter, such as `SMMetricsRetryCounter` or `SMMetricsCacheHitCounter`, goes up.
+ 
+ @param counter The name of the counter.
+ @param amount How much the counter went up by.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)metricsCounter:(NSString *)counter didIncrementBy:(NSUInteger)amount;
+
+/**
+ Called when a gauge, such as `SMMetricsDirtyQueueDepthGauge`, changes.
+ 
+ @param gauge The name of the gauge.
+ @param value The new value.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)metricsGauge:(NSString *)gauge didChangeToValue:(double)value;
+
+/**
+ Called when a timed stage outside of a request, such as `SMMetricsMaterializationTimer`, finishes.
+ 
+ @param timer The name of the stage.
+ @param duration How long it took, in seconds.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)metricsTimer:(NSString *)timer didRecordDuration:(NSTimeInterval)duration;
+
+@end
+
+/**
+ `SMMetrics` is where the SDK reports metrics to your <SMMetricsObserver>.
+ 
+ No metrics are collected until an observer is set, and with none set the instrumentation costs a single check per event.  Set the observer once, before making requests:
+ 
+    [SMMetrics setObserver:myTelemetryObserver];
+ 
+ Counters:
+ 
+ * `SMMetricsRetryCounter` - requests sent again, after a 503 or a refreshed access token.
+ * `SMMetricsTokenRefreshCounter` - access token refreshes.
+ * `SMMetricsRetryAfterBackoffCounter` - 503 responses that were retried after their `Retry-After` delay.
+ * `SMMetricsCacheHitCounter` - Core Data fetches answered from the cache.
+ * `SMMetricsCacheMissCounter` - Core Data fetches that looked in the cache and went on to the network.
+ 
+ Gauges:
+ 
+ * `SMMetricsDirtyQueueDepthGauge` - objects waiting in the Core Data dirty queue to be synced.
+ * `SMMetricsPushOutboundQueueDepthGauge` - push requests waiting in the outbound queue.
+ 
+ Timers:
+ 
+ * `SMMetricsMaterializationTimer` - turning the results of a network fetch into managed objects.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@interface SMMetrics : NSObject
+
+/**
+ Set the observer that receives metrics.  Pass `nil` to stop collecting metrics.
+ 
+ The observer is held strongly.
+ 
+ @param observer The observer.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (void)setObserver:(id<SMMetricsObserver>)observer;
+
+/**
+ The observer that receives metrics, or `nil` if metrics are off.
+ 
+ @return The current observer.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (id<SMMetricsObserver>)observer;
+
+@end
+
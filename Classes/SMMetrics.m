@@ -0,0 +1,142 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "SMMetrics+Protected.h"
+#import <libkern/OSAtomic.h>
+
+NSString *const SMMetricsRetryCounter = @"SMMetricsRetryCounter";
+NSString *const SMMetricsTokenRefreshCounter = @"SMMetricsTokenRefreshCounter";
+NSString *const SMMetricsRetryAfterBackoffCounter = @"SMMetricsRetryAfterBackoffCounter";
+NSString *const SMMetricsCacheHitCounter = @"SMMetricsCacheHitCounter";
+NSString *const SMMetricsCacheMissCounter = @"SMMetricsCacheMissCounter";
+NSString *const SMMetricsDirtyQueueDepthGauge = @"SMMetricsDirtyQueueDepthGauge";
+NSString *const SMMetricsPushOutboundQueueDepthGauge = @"SMMetricsPushOutboundQueueDepthGauge";
+NSString *const SMMetricsMaterializationTimer = @"SMMetricsMaterializationTimer";
+NSString *const SMMetricsSigningDurationKey = @"SMMetricsSigningDuration";
+
+enum {
+    SMMetricsObserverSet = 1 << 0,
+    SMMetricsObserverWantsRequests = 1 << 1,
+    SMMetricsObserverWantsCounters = 1 << 2,
+    SMMetricsObserverWantsGauges = 1 << 3,
+    SMMetricsObserverWantsTimers = 1 << 4
+};
+
+// The observer and the optional methods it implements, looked up once when it is set rather than on every event.  Both are only read or written together under the lock.
+static OSSpinLock SMMetricsObserverLock = OS_SPINLOCK_INIT;
+static id<SMMetricsObserver> SMMetricsActiveObserver = nil;
+static volatile uint32_t SMMetricsActiveObserverMethods = 0;
+
+/*
+ Returns the observer if it implements method, retained so it stays alive while it is being called even if another thread swaps it out.
+ */
+static id<SMMetricsObserver> SMMetricsObserverImplementing(uint32_t method)
+{
+    // Unlocked check so metrics cost nothing more when they are off
+    if ((SMMetricsActiveObserverMethods & method) == 0) {
+        return nil;
+    }
+    
+    id<SMMetricsObserver> observer = nil;
+    OSSpinLockLock(&SMMetricsObserverLock);
+    if (SMMetricsActiveObserverMethods & method) {
+        observer = SMMetricsActiveObserver;
+    }
+    OSSpinLockUnlock(&SMMetricsObserverLock);
+    return observer;
+}
+
+BOOL SMMetricsEnabled(void)
+{
+    return (SMMetricsActiveObserverMethods & SMMetricsObserverSet) != 0;
+}
+
+void SMMetricsIncrementCounter(NSString *counter, NSUInteger amount)
+{
+    if (amount > 0) {
+        [SMMetricsObserverImplementing(SMMetricsObserverWantsCounters) metricsCounter:counter didIncrementBy:amount];
+    }
+}
+
+void SMMetricsSetGauge(NSString *gauge, double value)
+{
+    [SMMetricsObserverImplementing(SMMetricsObserverWantsGauges) metricsGauge:gauge didChangeToValue:value];
+}
+
+void SMMetricsRecordDurationSince(NSString *timer, CFAbsoluteTime start)
+{
+    if (start > 0) {
+        [SMMetricsObserverImplementing(SMMetricsObserverWantsTimers) metricsTimer:timer didRecordDuration:CFAbsoluteTimeGetCurrent() - start];
+    }
+}
+
+void SMMetricsReportRequest(SMRequestMetrics *metrics)
+{
+    [SMMetricsObserverImplementing(SMMetricsObserverWantsRequests) requestDidFinishWithMetrics:metrics];
+}
+
+@implementation SMRequestMetrics
+
+@synthesize request = _SM_request;
+@synthesize response = _SM_response;
+@synthesize error = _SM_error;
+@synthesize signingDuration = _SM_signingDuration;
+@synthesize queueWaitDuration = _SM_queueWaitDuration;
+@synthesize timeToFirstByteDuration = _SM_timeToFirstByteDuration;
+@synthesize downloadDuration = _SM_downloadDuration;
+@synthesize parseDuration = _SM_parseDuration;
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: %p; %@ %@; status %ld; sign %.4f; queue %.4f; ttfb %.4f; download %.4f; parse %.4f>", [self class], self, [self.request HTTPMethod], [[self.request URL] path], (long)[self.response statusCode], self.signingDuration, self.queueWaitDuration, self.timeToFirstByteDuration, self.downloadDuration, self.parseDuration];
+}
+
+@end
+
+@implementation SMMetrics
+
++ (void)setObserver:(id<SMMetricsObserver>)observer
+{
+    uint32_t methods = 0;
+    if (observer) {
+        methods |= SMMetricsObserverSet;
+        methods |= [observer respondsToSelector:@selector(requestDidFinishWithMetrics:)] ? SMMetricsObserverWantsRequests : 0;
+        methods |= [observer respondsToSelector:@selector(metricsCounter:didIncrementBy:)] ? SMMetricsObserverWantsCounters : 0;
+        methods |= [observer respondsToSelector:@selector(metricsGauge:didChangeToValue:)] ? SMMetricsObserverWantsGauges : 0;
+        methods |= [observer respondsToSelector:@selector(metricsTimer:didRecordDuration:)] ? SMMetricsObserverWantsTimers : 0;
+    }
+    
+    id<SMMetricsObserver> previousObserver = nil;
+    OSSpinLockLock(&SMMetricsObserverLock);
+    previousObserver = SMMetricsActiveObserver;
+    SMMetricsActiveObserver = observer;
+    SMMetricsActiveObserverMethods = methods;
+    OSSpinLockUnlock(&SMMetricsObserverLock);
+    
+    // Released once the lock is dropped, in case the observer reports metrics as it goes away
+    previousObserver = nil;
+}
+
++ (id<SMMetricsObserver>)observer
+{
+    id<SMMetricsObserver> observer = nil;
+    OSSpinLockLock(&SMMetricsObserverLock);
+    observer = SMMetricsActiveObserver;
+    OSSpinLockUnlock(&SMMetricsObserverLock);
+    return observer;
+}
+
+@end
@@ -17,8 +17,18 @@
 #import <Foundation/Foundation.h>
 #import "AFHTTPClient.h"
 
+#import "SMRequestOptions.h"
+
 @class SMCustomCodeRequest;
-@class SMRequestOptions;
+
+/**
+ Returns the `NSOperationQueuePriority` that carries `priority` on an operation passed to <SMOAuth2Client> `enqueueHTTPRequestOperation:`.
+ 
+ `SMRequestPriorityInteractive` maps to `NSOperationQueuePriorityNormal`, so operations created elsewhere are treated as interactive.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+extern NSOperationQueuePriority SMOperationQueuePriorityForRequestPriority(SMRequestPriority priority);
 
 /**
  An interface for creating OAuth2 signed requests.
@@ -65,6 +75,29 @@
  */
 @property (nonatomic, copy) NSString *macKey;
 
+/**
+ The maximum number of requests this client has in flight at once. Default is 4.
+ 
+ Operations passed to `enqueueHTTPRequestOperation:` wait in the client until they can start.  The request priority is read from the operation's `queuePriority`, see `SMOperationQueuePriorityForRequestPriority`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSUInteger maxConcurrentRequests;
+
+/**
+ How many of <maxConcurrentRequests> only interactive requests may use, so a burst of background work can't hold up a user action. Default is 1. At most `maxConcurrentRequests - 1` are reserved, so utility and background requests always have a slot.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSUInteger reservedInteractiveRequests;
+
+/**
+ How long, in seconds, a waiting request takes to be promoted one priority level. Default is 5.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval priorityAgingInterval;
+
 ///-------------------------------
 /// @name Initialize
 ///-------------------------------
@@ -121,6 +154,16 @@
  */
 - (void)signRequest:(NSMutableURLRequest *)request path:(NSString *)path;
 
+/**
+ Sets the Authorization header on each request in a batch using the client's credentials.
+ 
+ The batch shares one timestamp and each request gets its own nonce. The path of each request's URL is used for signing.
+ 
+ @param requests An array of `NSMutableURLRequest` instances to be signed with this client's credentials.
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)signRequests:(NSArray *)requests;
+
 /**
  Returns whether the client has non-nil values for both the accessToken and macKey.
  
@@ -140,12 +183,12 @@
 /**
  Creates the MAC header for OAuth2 authorization.
  
- The current timestamp and a random nonce are used.
+ The current timestamp and a unique nonce are used.
  
  @param method The HTTP verb to use, either `POST`,`GET`, `PUT`, or `DELETE`.
  @param path The REST path.
  
- @return A string that is set in signRequest: for the Authorization header.
+ @return A string that is set in signRequest: for the Authorization header, or `nil` if the client has no credentials.
  @since Available in iOS SDK 1.0.0 and later.
  */
 - (NSString *)createMACHeaderForHttpMethod:(NSString *)method path:(NSString *)path;
@@ -158,7 +201,7 @@
  @param timestamp The timestamp to use for the authorization.
  @param nonce The nonce to use for the authorization.
  
- @return A string that is set in <signRequest:> for the Authorization header.
+ @return A string that is set in <signRequest:> for the Authorization header, or `nil` if the client has no credentials.
  @since Available in iOS SDK 1.0.0 and later.
  */
 - (NSString *)createMACHeaderForHttpMethod:(NSString *)method path:(NSString *)path timestamp:(double)timestamp nonce:(NSString *)nonce;
@@ -21,6 +21,74 @@
 #import "SMRequestOptions.h"
 #import "Base64EncodedStringFromData.h"
 #import "SystemInformation.h"
+#import "SMJSONRequestOperation.h"
+#import "SMMetrics+Protected.h"
+#import <libkern/OSAtomic.h>
+
+#define DEFAULT_MAX_CONCURRENT_REQUESTS 4
+#define DEFAULT_RESERVED_INTERACTIVE_REQUESTS 1
+#define DEFAULT_PRIORITY_AGING_INTERVAL 5.0
+
+static void *SMOperationFinishedContext = &SMOperationFinishedContext;
+static void *SMOperationCancelledContext = &SMOperationCancelledContext;
+
+NSOperationQueuePriority SMOperationQueuePriorityForRequestPriority(SMRequestPriority priority)
+{
+    switch (priority) {
+        case SMRequestPriorityUtility:
+            return NSOperationQueuePriorityLow;
+        case SMRequestPriorityBackground:
+            return NSOperationQueuePriorityVeryLow;
+        default:
+            return NSOperationQueuePriorityNormal;
+    }
+}
+
+static SMRequestPriority SMRequestPriorityForOperationQueuePriority(NSOperationQueuePriority queuePriority)
+{
+    if (queuePriority <= NSOperationQueuePriorityVeryLow) {
+        return SMRequestPriorityBackground;
+    } else if (queuePriority <= NSOperationQueuePriorityLow) {
+        return SMRequestPriorityUtility;
+    }
+    return SMRequestPriorityInteractive;
+}
+
+/*
+ An operation waiting in the client for capacity.
+ */
+@interface SMScheduledOperation : NSObject
+
+@property (nonatomic, strong) AFHTTPRequestOperation *operation;
+@property (nonatomic) SMRequestPriority priority;
+@property (nonatomic, strong) NSDate *enqueuedDate;
+
+@end
+
+@implementation SMScheduledOperation
+
+@synthesize operation = _SM_operation;
+@synthesize priority = _SM_priority;
+@synthesize enqueuedDate = _SM_enqueuedDate;
+
+@end
+
+@interface SMOAuth2Client () {
+    CCHmacContext _SM_macKeyContext;
+}
+
+@property (nonatomic, copy) NSString *signingHost;
+@property (nonatomic, copy) NSString *signingPort;
+@property (nonatomic, strong) NSMutableArray *pendingOperations;
+@property (nonatomic, strong) NSMutableSet *runningOperations;
+@property (nonatomic) BOOL agingRecheckScheduled;
+
+- (void)SM_startPendingOperations;
+
+- (void)SM_signRequest:(NSMutableURLRequest *)request path:(NSString *)path timestamp:(double)timestamp;
+- (NSString *)SM_newNonce;
+
+@end
 
 @implementation SMOAuth2Client
 
@@ -29,6 +97,14 @@
 @synthesize apiHost = _SM_apiHost;
 @synthesize accessToken = _SM_accessToken;
 @synthesize macKey = _SM_macKey;
+@synthesize signingHost = _SM_signingHost;
+@synthesize signingPort = _SM_signingPort;
+@synthesize maxConcurrentRequests = _SM_maxConcurrentRequests;
+@synthesize reservedInteractiveRequests = _SM_reservedInteractiveRequests;
+@synthesize priorityAgingInterval = _SM_priorityAgingInterval;
+@synthesize pendingOperations = _SM_pendingOperations;
+@synthesize runningOperations = _SM_runningOperations;
+@synthesize agingRecheckScheduled = _SM_agingRecheckScheduled;
 
 - (id)initWithAPIVersion:(NSString *)version
                    scheme:(NSString *)scheme
@@ -45,10 +121,189 @@
         [self setDefaultHeader:@"X-StackMob-API-Key" value:self.publicKey];
         [self setDefaultHeader:@"User-Agent" value:[NSString stringWithFormat:@"StackMob/%@ (%@/%@; %@;)", SDK_VERSION, smDeviceModel(), smSystemVersion(), [[NSLocale currentLocale] localeIdentifier]]];
         self.parameterEncoding = AFJSONParameterEncoding;
+        
+        // The base URL never changes, so host and port are computed once for signing
+        self.signingHost = [[self baseURL] host];
+        if ([[self baseURL] port] != nil) {
+            self.signingPort = [[[self baseURL] port] stringValue];
+        } else if ([[[self baseURL] scheme] hasPrefix:@"https"]) {
+            self.signingPort = @"443";
+        } else {
+            self.signingPort = @"80";
+        }
+        
+        self.maxConcurrentRequests = DEFAULT_MAX_CONCURRENT_REQUESTS;
+        self.reservedInteractiveRequests = DEFAULT_RESERVED_INTERACTIVE_REQUESTS;
+        self.priorityAgingInterval = DEFAULT_PRIORITY_AGING_INTERVAL;
+        self.pendingOperations = [NSMutableArray array];
+        self.runningOperations = [NSMutableSet set];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    for (AFHTTPRequestOperation *operation in _SM_runningOperations) {
+        [operation removeObserver:self forKeyPath:@"isFinished" context:SMOperationFinishedContext];
+    }
+    for (SMScheduledOperation *scheduledOperation in _SM_pendingOperations) {
+        [scheduledOperation.operation removeObserver:self forKeyPath:@"isCancelled" context:SMOperationCancelledContext];
+    }
+}
+
+#pragma mark - Scheduling
+
+- (void)enqueueHTTPRequestOperation:(AFHTTPRequestOperation *)operation
+{
+    SMScheduledOperation *scheduledOperation = [[SMScheduledOperation alloc] init];
+    scheduledOperation.operation = operation;
+    scheduledOperation.priority = SMRequestPriorityForOperationQueuePriority([operation queuePriority]);
+    scheduledOperation.enqueuedDate = [NSDate date];
+    
+    if ([operation isKindOfClass:[SMJSONRequestOperation class]]) {
+        [(SMJSONRequestOperation *)operation SM_markEnqueued];
+    }
+    
+    // A request cancelled while it waits is let go at once, or whoever waits on it would wait for a slot to free up
+    [operation addObserver:self forKeyPath:@"isCancelled" options:0 context:SMOperationCancelledContext];
+    
+    @synchronized(self.pendingOperations) {
+        [self.pendingOperations addObject:scheduledOperation];
+    }
+    
+    [self SM_startPendingOperations];
+}
+
+- (void)SM_startPendingOperations
+{
+    NSMutableArray *operationsToStart = [NSMutableArray array];
+    NSMutableArray *cancelledOperations = [NSMutableArray array];
+    NSTimeInterval nextAgingDelay = 0;
+    
+    @synchronized(self.pendingOperations) {
+        // Cancelled requests skip the limits, the queue only starts them to finish them
+        for (SMScheduledOperation *candidate in [self.pendingOperations copy]) {
+            if ([candidate.operation isCancelled]) {
+                [self.pendingOperations removeObject:candidate];
+                [cancelledOperations addObject:candidate.operation];
+            }
+        }
+        
+        NSDate *now = [NSDate date];
+        NSUInteger maxConcurrentRequests = MAX(self.maxConcurrentRequests, (NSUInteger)1);
+        // At least one slot always stays open to utility and background requests
+        NSUInteger nonInteractiveLimit = maxConcurrentRequests - MIN(self.reservedInteractiveRequests, maxConcurrentRequests - 1);
+        
+        while ([self.runningOperations count] < maxConcurrentRequests && [self.pendingOperations count] > 0) {
+            // Pick the highest effective priority, oldest first.  Every aging interval spent waiting raises a request one level.
+            SMScheduledOperation *nextOperation = nil;
+            NSInteger nextPriority = NSIntegerMax;
+            for (SMScheduledOperation *candidate in self.pendingOperations) {
+                NSInteger levelsAged = self.priorityAgingInterval > 0 ? (NSInteger)([now timeIntervalSinceDate:candidate.enqueuedDate] / self.priorityAgingInterval) : 0;
+                NSInteger effectivePriority = MAX((NSInteger)candidate.priority - levelsAged, (NSInteger)SMRequestPriorityInteractive);
+                if (effectivePriority < nextPriority) {
+                    nextOperation = candidate;
+                    nextPriority = effectivePriority;
+                    if (effectivePriority == SMRequestPriorityInteractive) {
+                        break;
+                    }
+                }
+            }
+            
+            if (nextPriority != SMRequestPriorityInteractive && [self.runningOperations count] > 0 && [self.runningOperations count] >= nonInteractiveLimit) {
+                break;
+            }
+            
+            [self.pendingOperations removeObject:nextOperation];
+            [self.runningOperations addObject:nextOperation.operation];
+            [operationsToStart addObject:nextOperation.operation];
+        }
+        
+        // Waiting requests only age when the queue is looked at again, so come back when the next one is due a promotion
+        if (self.priorityAgingInterval > 0 && !self.agingRecheckScheduled) {
+            for (SMScheduledOperation *candidate in self.pendingOperations) {
+                NSTimeInterval waited = [now timeIntervalSinceDate:candidate.enqueuedDate];
+                NSInteger levelsAged = (NSInteger)(waited / self.priorityAgingInterval);
+                if ((NSInteger)candidate.priority - levelsAged > (NSInteger)SMRequestPriorityInteractive) {
+                    NSTimeInterval delay = (levelsAged + 1) * self.priorityAgingInterval - waited;
+                    nextAgingDelay = nextAgingDelay > 0 ? MIN(nextAgingDelay, delay) : delay;
+                }
+            }
+            self.agingRecheckScheduled = nextAgingDelay > 0;
+        }
+    }
+    
+    if (nextAgingDelay > 0) {
+        dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(nextAgingDelay * NSEC_PER_SEC));
+        dispatch_after(popTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void){
+            @synchronized(self.pendingOperations) {
+                self.agingRecheckScheduled = NO;
+            }
+            [self SM_startPendingOperations];
+        });
+    }
+    
+    for (AFHTTPRequestOperation *operation in cancelledOperations) {
+        [operation removeObserver:self forKeyPath:@"isCancelled" context:SMOperationCancelledContext];
+        [super enqueueHTTPRequestOperation:operation];
+    }
+    
+    for (AFHTTPRequestOperation *operation in operationsToStart) {
+        [operation removeObserver:self forKeyPath:@"isCancelled" context:SMOperationCancelledContext];
+        // Observed directly rather than through AFNetworkingOperationDidFinishNotification, which is posted on the main queue and would stall while the main thread waits on a fetch
+        [operation addObserver:self forKeyPath:@"isFinished" options:0 context:SMOperationFinishedContext];
+        [super enqueueHTTPRequestOperation:operation];
+    }
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
+{
+    if (context == SMOperationCancelledContext) {
+        if ([object isCancelled]) {
+            [self SM_startPendingOperations];
+        }
+        return;
+    }
+    
+    if (context != SMOperationFinishedContext) {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    
+    if (![object isFinished]) {
+        return;
+    }
+    
+    @synchronized(self.pendingOperations) {
+        if (![self.runningOperations containsObject:object]) {
+            return;
+        }
+        [self.runningOperations removeObject:object];
+    }
+    [object removeObserver:self forKeyPath:@"isFinished" context:SMOperationFinishedContext];
+    
+    [self SM_startPendingOperations];
+}
+
+- (void)setMacKey:(NSString *)macKey
+{
+    @synchronized(self) {
+        _SM_macKey = [macKey copy];
+        if (_SM_macKey) {
+            // Keep the keyed HMAC state around so each signature only hashes the base string
+            const char *keyCString = [_SM_macKey UTF8String];
+            CCHmacInit(&_SM_macKeyContext, kCCHmacAlgSHA1, keyCString, strlen(keyCString));
+        }
+    }
+}
+
+- (NSString *)macKey
+{
+    @synchronized(self) {
+        return _SM_macKey;
+    }
+}
+
 - (NSMutableURLRequest *)requestWithMethod:(NSString *)method 
                                        path:(NSString *)path 
                                  parameters:(NSDictionary *)parameters
@@ -79,23 +334,51 @@
         [request setURL:url];
     }
     
-    if (aRequest.requestBody) {
+    if (aRequest.requestBodyStream) {
+        [request setHTTPBodyStream:aRequest.requestBodyStream];
+    } else if (aRequest.requestBodyData) {
+        [request setHTTPBody:aRequest.requestBodyData];
+    } else if (aRequest.requestBody) {
         [request setHTTPBody:[aRequest.requestBody dataUsingEncoding:NSUTF8StringEncoding]];
     }
     
+    // Bursts of custom code calls can share a connection, NSURLConnection only pipelines idempotent requests
+    [request setHTTPShouldUsePipelining:YES];
+    
     [self signRequest:request path:[[request URL] path]];
     return request;
 }
 
 - (void)signRequest:(NSMutableURLRequest *)request path:(NSString *)path
+{
+    [self SM_signRequest:request path:path timestamp:[[NSDate date] timeIntervalSince1970]];
+}
+
+- (void)signRequests:(NSArray *)requests
+{
+    // One timestamp for the whole batch, every request still gets its own nonce
+    double timestamp = [[NSDate date] timeIntervalSince1970];
+    for (NSMutableURLRequest *request in requests) {
+        [self SM_signRequest:request path:[[request URL] path] timestamp:timestamp];
+    }
+}
+
+- (void)SM_signRequest:(NSMutableURLRequest *)request path:(NSString *)path timestamp:(double)timestamp
 {
     if ([self hasValidCredentials]) {
+        CFAbsoluteTime signingStart = SMMetricsEnabled() ? CFAbsoluteTimeGetCurrent() : 0;
         static NSString * const charactersToLeaveEscaped = @":/.?&=;+!@#$()~ ";
-        NSString *decodedQuery = (__bridge_transfer NSString *)CFURLCreateStringByReplacingPercentEscapesUsingEncoding(kCFAllocatorDefault, (__bridge CFStringRef)[[request URL] query], (__bridge CFStringRef)(charactersToLeaveEscaped), CFStringConvertNSStringEncodingToEncoding(NSUTF8StringEncoding));
-        NSString *queryString = [[[request URL] query] length] == 0 ? @"" : [NSString stringWithFormat:@"?%@", decodedQuery];
-        NSString *pathAndQuery = [NSString stringWithFormat:@"%@%@", path, queryString];
-        NSString *macHeader = [self createMACHeaderForHttpMethod:[request HTTPMethod] path:pathAndQuery];
+        NSString *query = [[request URL] query];
+        NSString *pathAndQuery = path;
+        if ([query length] > 0) {
+            NSString *decodedQuery = (__bridge_transfer NSString *)CFURLCreateStringByReplacingPercentEscapesUsingEncoding(kCFAllocatorDefault, (__bridge CFStringRef)query, (__bridge CFStringRef)(charactersToLeaveEscaped), CFStringConvertNSStringEncodingToEncoding(NSUTF8StringEncoding));
+            pathAndQuery = [NSString stringWithFormat:@"%@?%@", path, decodedQuery];
+        }
+        NSString *macHeader = [self createMACHeaderForHttpMethod:[request HTTPMethod] path:pathAndQuery timestamp:timestamp nonce:[self SM_newNonce]];
         [request setValue:macHeader forHTTPHeaderField:@"Authorization"];
+        if (signingStart > 0) {
+            [NSURLProtocol setProperty:[NSNumber numberWithDouble:CFAbsoluteTimeGetCurrent() - signingStart] forKey:SMMetricsSigningDurationKey inRequest:request];
+        }
     }
 }
 
@@ -106,46 +389,68 @@
 
 - (NSString *) getPort
 {
-    if ([[self baseURL] port] != nil) {
-        return [[[self baseURL] port] stringValue];
-    } else if ([[[self baseURL] scheme] hasPrefix:@"https"]) {
-        return @"443";
-    } else {
-        return @"80";
-    }
+    return self.signingPort;
 }
 
-- (NSString *)createMACHeaderForHttpMethod:(NSString *)method path:(NSString *)path timestamp:(double)timestamp nonce:(NSString *)nonce
+- (NSString *)SM_newNonce
 {
+    // A process-wide counter makes nonces unique within a second, the random half keeps them unique across launches
+    static volatile int32_t nonceCounter = 0;
+    uint32_t count = (uint32_t)OSAtomicIncrement32(&nonceCounter);
+    return [NSString stringWithFormat:@"n%x%08x", count, arc4random()];
+}
 
-    NSString *host = [[self baseURL] host];
-    NSString *port = [self getPort];
+- (NSString *)createMACHeaderForHttpMethod:(NSString *)method path:(NSString *)path timestamp:(double)timestamp nonce:(NSString *)nonce
+{
+    CCHmacContext context;
+    NSString *accessToken = nil;
+    NSString *macKey = nil;
+    @synchronized(self) {
+        context = _SM_macKeyContext;
+        accessToken = self.accessToken;
+        macKey = self.macKey;
+    }
     
-    // create base
-    NSArray *baseArray = [NSArray arrayWithObjects:[NSString stringWithFormat:@"%.f", timestamp], nonce, method, path, host, port, nil];
-    unichar newline = 0x0A;
-    NSString *baseString = [baseArray componentsJoinedByString:[NSString stringWithFormat:@"%C", newline]];
-    baseString = [baseString stringByAppendingString:[NSString stringWithFormat:@"%C", newline]];
-    baseString = [baseString stringByAppendingString:[NSString stringWithFormat:@"%C", newline]];
+    // Credentials can be cleared, by a logout, while requests are still queued to be signed
+    if (accessToken == nil || macKey == nil) {
+        return nil;
+    }
     
-    const char *keyCString = [self.macKey cStringUsingEncoding:NSUTF8StringEncoding];
-    const char *baseCString = [baseString cStringUsingEncoding:NSUTF8StringEncoding];
+    char timestampCString[32];
+    snprintf(timestampCString, sizeof(timestampCString), "%.f", timestamp);
     
+    // The base string is timestamp, nonce, method, path, host and port, each followed by a newline, plus an empty extension line.
+    // Feeding the pieces straight into the HMAC avoids building the string at all.
+    const char *baseParts[] = { timestampCString, [nonce UTF8String], [method UTF8String], [path UTF8String], [self.signingHost UTF8String], [self.signingPort UTF8String] };
+    const char newline = 0x0A;
+    for (size_t i = 0; i < sizeof(baseParts) / sizeof(baseParts[0]); i++) {
+        CCHmacUpdate(&context, baseParts[i], strlen(baseParts[i]));
+        CCHmacUpdate(&context, &newline, 1);
+    }
+    CCHmacUpdate(&context, &newline, 1);
     
     char buffer[CC_SHA1_DIGEST_LENGTH];
-    CCHmac(kCCHmacAlgSHA1, keyCString, strlen(keyCString), baseCString, strlen(baseCString), buffer); 
-    NSData *digestData = [NSData dataWithBytes:buffer length:CC_SHA1_DIGEST_LENGTH];
-    NSString *mac = Base64EncodedStringFromData(digestData); 
+    CCHmacFinal(&context, buffer);
+    NSString *mac = Base64EncodedStringFromData([NSData dataWithBytesNoCopy:buffer length:CC_SHA1_DIGEST_LENGTH freeWhenDone:NO]);
+    
     //return 'MAC id="' + id + '",ts="' + ts + '",nonce="' + nonce + '",mac="' + mac + '"'
-    unichar quotes = 0x22;
-    NSString *returnString = [NSString stringWithFormat:@"MAC id=%C%@%C,ts=%C%.f%C,nonce=%C%@%C,mac=%C%@%C", quotes, self.accessToken, quotes, quotes, timestamp, quotes, quotes, nonce, quotes, quotes, mac, quotes];
-    return returnString; 
+    NSMutableString *returnString = [NSMutableString stringWithCapacity:64 + [accessToken length] + [nonce length] + [mac length]];
+    [returnString appendString:@"MAC id=\""];
+    [returnString appendString:accessToken];
+    [returnString appendString:@"\",ts=\""];
+    [returnString appendString:[NSString stringWithUTF8String:timestampCString]];
+    [returnString appendString:@"\",nonce=\""];
+    [returnString appendString:nonce];
+    [returnString appendString:@"\",mac=\""];
+    [returnString appendString:mac];
+    [returnString appendString:@"\""];
+    return returnString;
 }
 
 
 - (NSString *)createMACHeaderForHttpMethod:(NSString *)method path:(NSString *)path
 {
-    return [self createMACHeaderForHttpMethod:method path:path timestamp:[[NSDate date] timeIntervalSince1970] nonce:[NSString stringWithFormat:@"n%d", arc4random() % 10000]];
+    return [self createMACHeaderForHttpMethod:method path:path timestamp:[[NSDate date] timeIntervalSince1970] nonce:[self SM_newNonce]];
 }
 
 @end
@@ -18,6 +18,19 @@
 #import <CoreLocation/CoreLocation.h>
 #import "SMGeoPoint.h"
 
+/**
+ The functions an aggregate query can compute over a field.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+typedef enum {
+    SMAggregateCount = 0,
+    SMAggregateSum,
+    SMAggregateAverage,
+    SMAggregateMin,
+    SMAggregateMax
+} SMAggregateFunction;
+
 /**
  `SMQuery` exposes an interface for defining a query against StackMob's Datastore API.
  
@@ -355,6 +368,80 @@
  */
 - (SMQuery *)or:(SMQuery *)query;
 
+#pragma mark - Aggregates
+///-------------------------------
+/// @name Aggregates
+///-------------------------------
+
+/**
+ The aggregates added with <aggregate:ofField:as:>, in order.  Each is a dictionary with the keys `function` (the name of the function, one of `count`, `sum`, `avg`, `min` or `max`), `field` (absent when counting objects) and `name`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (readonly, nonatomic) NSArray *aggregates;
+
+/**
+ The fields added with <groupByField:>, in order.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (readonly, nonatomic) NSArray *groupByFields;
 
+/**
+ Compute an aggregate over the objects matching the query, instead of returning the objects.
+ 
+ Aggregate queries are performed with `performAggregateQuery:onSuccess:onFailure:` on `SMDataStore`.  Each result is a dictionary with the value of the aggregate under `name`, along with the values of any group-by fields.
+ 
+ Null values are skipped, as in SQL.  Counting with a `nil` field counts every matching object.
+ 
+ @param function The function to compute.
+ @param field The field to compute it over, or `nil` to count objects.
+ @param name The key of the result in each row.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)aggregate:(SMAggregateFunction)function ofField:(NSString *)field as:(NSString *)name;
+
+/**
+ Compute aggregates separately for each value of `field`.  Can be called more than once to group by several fields.
+ 
+ Grouping without any aggregates returns the distinct values of the group-by fields.
+ 
+ @param field The field to group by.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)groupByField:(NSString *)field;
+
+/**
+ Return the distinct values of `field` among the matching objects.  Equivalent to <groupByField:> with no aggregates.
+ 
+ @param field The field to return the distinct values of.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)selectDistinctValuesOfField:(NSString *)field;
+
+/**
+ Whether the query has any aggregates or group-by fields.
+ 
+ @return `YES` if the query is an aggregate query.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (BOOL)isAggregateQuery;
+
+/**
+ Compute the aggregates of the query over objects that were already fetched.
+ 
+ This is what `SMDataStore` does when no custom code method is set to aggregate on the server.  Rows are returned in the order their group first appears in `objects`.
+ 
+ @param objects The objects to aggregate, as dictionaries of field values.
+ 
+ @return An array of dictionaries, one per group, or a single dictionary when the query has no group-by fields.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (NSArray *)aggregateObjects:(NSArray *)objects;
 
 @end
@@ -26,6 +26,10 @@
     int _andGroup;
     int _orGroup;
     BOOL _isOrQuery;
+    // Conditions are added in place, and only copied into requestParameters when it is read
+    NSMutableDictionary *_conditions;
+    NSMutableArray *_aggregates;
+    NSMutableArray *_groupByFields;
 }
 
 @end
@@ -56,100 +60,101 @@
     if (self) {
         _entity = entity;
         _schemaName = [schema lowercaseString];
-        _requestParameters = [NSMutableDictionary dictionaryWithCapacity:1];
+        _conditions = [NSMutableDictionary dictionaryWithCapacity:1];
+        _requestParameters = nil;
         _requestHeaders = [NSMutableDictionary dictionaryWithCapacity:1];
         _andGroup = 0;
         _orGroup = 0;
         _isOrQuery = NO;
+        _aggregates = [NSMutableArray array];
+        _groupByFields = [NSMutableArray array];
     }
     return self;
 }
 
+- (NSDictionary *)requestParameters
+{
+    if (_requestParameters == nil) {
+        _requestParameters = [NSDictionary dictionaryWithDictionary:_conditions];
+    }
+    
+    return _requestParameters;
+}
+
+- (void)setRequestParameters:(NSDictionary *)requestParameters
+{
+    _conditions = requestParameters ? [requestParameters mutableCopy] : [NSMutableDictionary dictionary];
+    _requestParameters = nil;
+}
+
+- (NSDictionary *)SM_conditions
+{
+    return _conditions;
+}
+
+- (void)SM_setCondition:(id)value forKey:(NSString *)key
+{
+    [_conditions setObject:value forKey:key];
+    _requestParameters = nil;
+}
+
 - (void)where:(NSString *)field isEqualTo:(id)value
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     if(value == nil) {
-        [requestParametersCopy setObject:@"true"
-                                  forKey:CONCAT(field, @"[null]")];
+        [self SM_setCondition:@"true" forKey:CONCAT(field, @"[null]")];
     } else if ([value isEqual:@""]) {
-        [requestParametersCopy setObject:@"true"
-                                  forKey:CONCAT(field, @"[empty]")];
+        [self SM_setCondition:@"true" forKey:CONCAT(field, @"[empty]")];
     } else {
-        [requestParametersCopy setObject:[self marshalValue:value] 
-                                  forKey:field];
+        [self SM_setCondition:[self marshalValue:value] forKey:field];
     }
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
 }
 
 - (void)where:(NSString *)field isNotEqualTo:(id)value
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     if(value == nil) {
-        [requestParametersCopy setObject:@"false"
-                                  forKey:CONCAT(field, @"[null]")];
+        [self SM_setCondition:@"false" forKey:CONCAT(field, @"[null]")];
     } else if ([value isEqual:@""]) {
-        [requestParametersCopy setObject:@"false"
-                                  forKey:CONCAT(field, @"[empty]")];
+        [self SM_setCondition:@"false" forKey:CONCAT(field, @"[empty]")];
     } else {
-        [requestParametersCopy setObject:[self marshalValue:value]
-                                  forKey:CONCAT(field, @"[ne]")];
+        [self SM_setCondition:[self marshalValue:value] forKey:CONCAT(field, @"[ne]")];
     }
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
 }
 
 - (void)where:(NSString *)field isLessThan:(id)value
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
-    [requestParametersCopy setObject:[self marshalValue:value]
-                              forKey:CONCAT(field, @"[lt]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:[self marshalValue:value] forKey:CONCAT(field, @"[lt]")];
 }
 
 - (void)where:(NSString *)field isLessThanOrEqualTo:(id)value
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
-    [requestParametersCopy setObject:[self marshalValue:value]
-                              forKey:CONCAT(field, @"[lte]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:[self marshalValue:value] forKey:CONCAT(field, @"[lte]")];
 }
 
 - (void)where:(NSString *)field isGreaterThan:(id)value
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
-    [requestParametersCopy setObject:[self marshalValue:value]
-                              forKey:CONCAT(field, @"[gt]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:[self marshalValue:value] forKey:CONCAT(field, @"[gt]")];
 }
 
 - (void)where:(NSString *)field isGreaterThanOrEqualTo:(id)value
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
-    [requestParametersCopy setObject:[self marshalValue:value]
-                              forKey:CONCAT(field, @"[gte]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:[self marshalValue:value] forKey:CONCAT(field, @"[gte]")];
 }
 
 - (void)where:(NSString *)field isIn:(NSArray *)valuesArray
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     NSString *possibleValues = [valuesArray componentsJoinedByString:@","];
-    [requestParametersCopy setObject:possibleValues
-                              forKey:CONCAT(field, @"[in]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:possibleValues forKey:CONCAT(field, @"[in]")];
 }
 
 - (void)where:(NSString *)field isWithin:(CLLocationDistance)miles milesOf:(CLLocationCoordinate2D)point
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     double radius = miles / EARTH_RADIAN_MILES;
     NSString *withinParam = [NSString stringWithFormat:@"%.6f,%.6f,%.6f",
                              point.latitude, 
                              point.longitude, 
                              radius];
     
-    [requestParametersCopy setObject:withinParam
-                              forKey:CONCAT(field, @"[within]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:withinParam forKey:CONCAT(field, @"[within]")];
 }
 
 - (void)where:(NSString *)field isWithin:(double)miles milesOfGeoPoint:(SMGeoPoint *)geoPoint {
@@ -162,15 +167,12 @@
 
 - (void)where:(NSString *)field isWithin:(CLLocationDistance)kilometers kilometersOf:(CLLocationCoordinate2D)point
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     double radius = kilometers / EARTH_RADIAN_KM;
     NSString *withinParam = [NSString stringWithFormat:@"%.6f,%.6f,%.6f",
                              point.latitude, 
                              point.longitude, 
                              radius];
-    [requestParametersCopy setObject:withinParam
-                              forKey:CONCAT(field, @"[within]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:withinParam forKey:CONCAT(field, @"[within]")];
 }
 
 - (void)where:(NSString *)field isWithin:(CLLocationDistance)kilometers kilometersOfGeoPoint:(SMGeoPoint *)geoPoint {
@@ -183,15 +185,12 @@
 
 - (void)where:(NSString *)field isWithinBoundsWithSWCorner:(CLLocationCoordinate2D)sw andNECorner:(CLLocationCoordinate2D)ne
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     NSString *withinParam = [NSString stringWithFormat:@"%.6f,%.6f,%.6f,%.6f",
                              sw.latitude, 
                              sw.longitude,
                              ne.latitude,
                              ne.longitude];                            
-    [requestParametersCopy setObject:withinParam
-                              forKey:CONCAT(field, @"[within]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:withinParam forKey:CONCAT(field, @"[within]")];
 }
 
 - (void)where:(NSString *)field isWithinBoundsWithSWGeoPoint:(SMGeoPoint *)sw andNEGeoPoint:(SMGeoPoint *)ne {
@@ -208,13 +207,10 @@
 
 // TODO: how do we highlight to the user that this is going to add a 'distance' field and will ignore order by criteria
 - (void)where:(NSString *)field near:(CLLocationCoordinate2D)point {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
     NSString *nearParam = [NSString stringWithFormat:@"%f,%f",
                            point.latitude, point.longitude];
     
-    [requestParametersCopy setObject:nearParam 
-                              forKey:CONCAT(field, @"[near]")];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [self SM_setCondition:nearParam forKey:CONCAT(field, @"[near]")];
 }
 
 - (void)where:(NSString *)field nearGeoPoint:(SMGeoPoint *)geoPoint {
@@ -280,7 +276,7 @@
         _andGroup += 1;
         [requestParameters enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
             keyToSet = [NSString stringWithFormat:@"[or%d].[and%d].%@", _orGroup, _andGroup, key];
-            if (![[*newParameters allKeys] containsObject:keyToSet]) {
+            if ([*newParameters objectForKey:keyToSet] == nil) {
                 [*newParameters setObject:obj forKey:keyToSet];
             } else {
                 [NSException raise:SMExceptionIncompatibleObject format:@"Duplicate parameter key found: %@.  This may cause unexpected query results as the key to set will override the existing key/value.  To include a condition where a key can be one of multiple values, use IN i.e. 'key IN [value1, value2]'.", keyToSet];
@@ -289,7 +285,7 @@
     } else {
         [requestParameters enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
             keyToSet = [NSString stringWithFormat:@"[or%d].%@", _orGroup, key];
-            if (![[*newParameters allKeys] containsObject:keyToSet]) {
+            if ([*newParameters objectForKey:keyToSet] == nil) {
                 [*newParameters setObject:obj forKey:keyToSet];
             } else {
                 [NSException raise:SMExceptionIncompatibleObject format:@"Duplicate parameter key found: %@.  This may cause unexpected query results as the key to set will override the existing key/value.  To include a condition where a key can be one of multiple values, use IN i.e. 'key IN [value1, value2]'.", keyToSet];
@@ -302,27 +298,26 @@
 {
     NSMutableDictionary *newParameters = [NSMutableDictionary dictionary];
     if (_isOrQuery) {
-        NSMutableDictionary *currentParametersCopy = [self.requestParameters mutableCopy];
-        [self SM_setKeysAndValuesFrom:query.requestParameters to:&newParameters];
+        [self SM_setKeysAndValuesFrom:[query SM_conditions] to:&newParameters];
         
-        // Enumerate through entries to be added and check for duplicate keys that would be overriden
+        // Enumerate through entries to be added and check for duplicate keys that would be overriden, before any are added
         [newParameters enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
-            if (![[currentParametersCopy allKeys] containsObject:key]) {
-                [currentParametersCopy setObject:obj forKey:key];
-            } else {
+            if ([_conditions objectForKey:key] != nil) {
                 [NSException raise:SMExceptionIncompatibleObject format:@"Duplicate parameter key found: '%@'.  This may cause unexpected query results as the new key/value will override the existing key/value.  To include a condition where a key can be one of multiple values, use IN i.e. 'key IN [value1, value2]'.", key];
             }
         }];
-        self.requestParameters = [NSDictionary dictionaryWithDictionary:currentParametersCopy];
+        [_conditions addEntriesFromDictionary:newParameters];
+        _requestParameters = nil;
         
     } else {
         _isOrQuery = YES;
         _orGroup += 1;
         
-        [self SM_setKeysAndValuesFrom:self.requestParameters to:&newParameters];
-        [self SM_setKeysAndValuesFrom:query.requestParameters to:&newParameters];
+        [self SM_setKeysAndValuesFrom:_conditions to:&newParameters];
+        [self SM_setKeysAndValuesFrom:[query SM_conditions] to:&newParameters];
         
-        self.requestParameters = [NSDictionary dictionaryWithDictionary:newParameters];
+        _conditions = newParameters;
+        _requestParameters = nil;
     }
     
     return self;
@@ -330,11 +325,150 @@
 
 - (SMQuery *)and:(SMQuery *)query
 {
-    NSMutableDictionary *requestParametersCopy = [self.requestParameters mutableCopy];
-    [requestParametersCopy addEntriesFromDictionary:query.requestParameters];
-    self.requestParameters = [NSDictionary dictionaryWithDictionary:requestParametersCopy];
+    [_conditions addEntriesFromDictionary:[query SM_conditions]];
+    _requestParameters = nil;
     
     return self;
 }
 
+- (NSArray *)aggregates
+{
+    return [NSArray arrayWithArray:_aggregates];
+}
+
+- (NSArray *)groupByFields
+{
+    return [NSArray arrayWithArray:_groupByFields];
+}
+
+- (void)aggregate:(SMAggregateFunction)function ofField:(NSString *)field as:(NSString *)name
+{
+    NSString *functionName = nil;
+    switch (function) {
+        case SMAggregateCount:
+            functionName = @"count";
+            break;
+        case SMAggregateSum:
+            functionName = @"sum";
+            break;
+        case SMAggregateAverage:
+            functionName = @"avg";
+            break;
+        case SMAggregateMin:
+            functionName = @"min";
+            break;
+        case SMAggregateMax:
+            functionName = @"max";
+            break;
+        default:
+            [NSException raise:SMExceptionIncompatibleObject format:@"Unknown aggregate function %d", (int)function];
+            break;
+    }
+    
+    if (!field && function != SMAggregateCount) {
+        [NSException raise:SMExceptionIncompatibleObject format:@"A field is needed to compute %@", functionName];
+    }
+    
+    NSMutableDictionary *aggregate = [NSMutableDictionary dictionaryWithObjectsAndKeys:functionName, @"function", name, @"name", nil];
+    if (field) {
+        [aggregate setObject:field forKey:@"field"];
+    }
+    [_aggregates addObject:[NSDictionary dictionaryWithDictionary:aggregate]];
+}
+
+- (void)groupByField:(NSString *)field
+{
+    if (![_groupByFields containsObject:field]) {
+        [_groupByFields addObject:field];
+    }
+}
+
+- (void)selectDistinctValuesOfField:(NSString *)field
+{
+    [self groupByField:field];
+}
+
+- (BOOL)isAggregateQuery
+{
+    return [_aggregates count] > 0 || [_groupByFields count] > 0;
+}
+
+- (NSArray *)aggregateObjects:(NSArray *)objects
+{
+    // Objects of each group, keyed by the group-by values, in the order groups are first seen
+    NSMutableArray *groupKeys = [NSMutableArray array];
+    NSMutableDictionary *groups = [NSMutableDictionary dictionary];
+    
+    for (NSDictionary *object in objects) {
+        NSMutableArray *groupKey = [NSMutableArray arrayWithCapacity:[_groupByFields count]];
+        for (NSString *field in _groupByFields) {
+            id value = [object objectForKey:field];
+            [groupKey addObject:value ? value : [NSNull null]];
+        }
+        NSMutableArray *group = [groups objectForKey:groupKey];
+        if (!group) {
+            group = [NSMutableArray array];
+            [groups setObject:group forKey:groupKey];
+            [groupKeys addObject:groupKey];
+        }
+        [group addObject:object];
+    }
+    
+    // Without group-by fields there is always one row, even for no objects
+    if ([_groupByFields count] == 0 && [groupKeys count] == 0) {
+        [groupKeys addObject:[NSArray array]];
+        [groups setObject:[NSMutableArray array] forKey:[NSArray array]];
+    }
+    
+    NSMutableArray *rows = [NSMutableArray arrayWithCapacity:[groupKeys count]];
+    for (NSArray *groupKey in groupKeys) {
+        NSArray *group = [groups objectForKey:groupKey];
+        NSMutableDictionary *row = [NSMutableDictionary dictionary];
+        
+        [_groupByFields enumerateObjectsUsingBlock:^(id field, NSUInteger idx, BOOL *stop) {
+            id value = [groupKey objectAtIndex:idx];
+            if (value != [NSNull null]) {
+                [row setObject:value forKey:field];
+            }
+        }];
+        
+        for (NSDictionary *aggregate in _aggregates) {
+            id value = [self SM_computeAggregate:aggregate overObjects:group];
+            if (value) {
+                [row setObject:value forKey:[aggregate objectForKey:@"name"]];
+            }
+        }
+        
+        [rows addObject:[NSDictionary dictionaryWithDictionary:row]];
+    }
+    
+    return [NSArray arrayWithArray:rows];
+}
+
+- (id)SM_computeAggregate:(NSDictionary *)aggregate overObjects:(NSArray *)objects
+{
+    NSString *function = [aggregate objectForKey:@"function"];
+    NSString *field = [aggregate objectForKey:@"field"];
+    
+    if (!field) {
+        return [NSNumber numberWithUnsignedInteger:[objects count]];
+    }
+    
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:[objects count]];
+    for (NSDictionary *object in objects) {
+        id value = [object objectForKey:field];
+        if (value && value != [NSNull null]) {
+            [values addObject:value];
+        }
+    }
+    
+    if ([function isEqualToString:@"count"]) {
+        return [NSNumber numberWithUnsignedInteger:[values count]];
+    } else if ([values count] == 0) {
+        return nil;
+    }
+    
+    return [values valueForKeyPath:[NSString stringWithFormat:@"@%@.self", function]];
+}
+
 @end
@@ -15,6 +15,20 @@
  */
 
 #import "SMResponseBlocks.h"
+#import "SMRetryPolicy.h"
+
+typedef enum {
+    SMCachePolicyTryNetworkOnly = 0,
+    SMCachePolicyTryCacheOnly  = 1,
+    SMCachePolicyTryNetworkElseCache = 2,
+    SMCachePolicyTryCacheElseNetwork = 3,
+} SMCachePolicy;
+
+typedef enum {
+    SMRequestPriorityInteractive = 0,
+    SMRequestPriorityUtility = 1,
+    SMRequestPriorityBackground = 2,
+} SMRequestPriority;
 
 /**
  `SMRequestOptions` is a class designed to supply various choices to requests, including:
@@ -23,9 +37,13 @@
  * Extra headers to add to the request
  * Select and expand choices to control the data being returned to you
  * The ability to disable automatic login refresh
+ * Cache policy and cache max age for Core Data fetches
+ * Request priority
+ * A deadline for the request
+ * The retry policy for transient failures
  
  */
-@interface SMRequestOptions : NSObject
+@interface SMRequestOptions : NSObject <NSCopying>
 
 ///-------------------------------
 /// @name Properties
@@ -53,9 +71,9 @@
 @property(nonatomic, readwrite) BOOL tryRefreshToken;
 
 /**
- In the case that a 503 `SMErrorServiceUnavailable` response is returned, the number of times to retry.  The default is 3 times.
+ In the case of a transient failure, such as a 503 `SMErrorServiceUnavailable` response or a timeout, the number of times to retry.  The default is 3 times.
  
- The default retry action is to send the original request, resigned with up to date arguments. If a <retryBlock> has been added it is used in place of the default.
+ Which failures are retried, and how long to wait before each retry, is decided by the <retryPolicy>. The default retry action is to send the original request, resigned with up to date arguments. If a <retryBlock> has been added it is used in place of the default.
  
  @since Available in iOS SDK 1.0.0 and later.
  */
@@ -73,6 +91,78 @@
  */
 @property (nonatomic, strong) SMFailureRetryBlock retryBlock;
 
+/**
+ The cache policy to use for a Core Data fetch made with these options.
+ 
+ When set, takes precedence over any cache policy set for the fetched entity or the `SMCoreDataStore` instance. When not set, see <cachePolicySet>, the entity or global cache policy is used.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) SMCachePolicy cachePolicy;
+
+/**
+ Whether <cachePolicy> has been explicitly set on these options. Default is `NO`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, readonly) BOOL cachePolicySet;
+
+/**
+ The maximum age, in seconds, of cached results for a Core Data fetch made with these options.
+ 
+ When greater than 0, a fetch whose cached results were all confirmed against the server within the max age is answered from the cache without a network request, regardless of cache policy.  Setting it to 0 turns the max age off for the fetch.
+ 
+ When set, takes precedence over any max age set for the fetched entity or the `SMCoreDataStore` instance. When not set, see <cacheMaxAgeSet>, the entity or global max age is used.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval cacheMaxAge;
+
+/**
+ Whether <cacheMaxAge> has been explicitly set on these options. Default is `NO`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, readonly) BOOL cacheMaxAgeSet;
+
+/**
+ The priority of requests made with these options. Default is `SMRequestPriorityInteractive`.
+ 
+ Requests are scheduled by priority, with some capacity always kept free for interactive requests.  Lower priority requests that have waited long enough are promoted, so they are never starved.  See <SMOAuth2Client> `maxConcurrentRequests`.
+ 
+ The Core Data integration sends its own requests at a lower priority when this is not set, see <prioritySet>: faults and network checks as `SMRequestPriorityUtility`, syncing with the server as `SMRequestPriorityBackground`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) SMRequestPriority priority;
+
+/**
+ Whether <priority> has been explicitly set on these options. Default is `NO`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, readonly) BOOL prioritySet;
+
+/**
+ The time by which requests made with these options must finish. Default is `nil`, meaning no deadline.
+ 
+ A request still outstanding at the deadline is cancelled and fails with an `SMErrorDeadlineExceeded` error, including any 503 retries or token refreshes it is waiting on. For Core Data, a fetch or save made with these options stops waiting on the network at the deadline and fails with the same error.
+ 
+ Because the deadline is a fixed point in time, set a new one for each request rather than reusing it in options shared between requests.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) NSDate *deadline;
+
+/**
+ Decides which failed requests are retried and the wait before each retry, see <SMRetryPolicy>. Default is a policy with exponential backoff and jitter drawing on the shared <[SMRetryBudget defaultBudget]>.
+ 
+ Set <numberOfRetries> to 0 to turn retries off.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, copy) SMRetryPolicy *retryPolicy;
+
 ///-------------------------------
 /// @name Initialize
 ///-------------------------------
@@ -128,6 +218,17 @@
  */
 + (SMRequestOptions *)optionsWithReturnedFieldsRestrictedTo:(NSArray *)fields;
 
+/**
+ Options that will use the provided cache policy for a Core Data fetch.
+ 
+ @param cachePolicy The cache policy to use.
+ 
+ @return An `SMRequestOptions` object with cachePolicy set to the supplied policy.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMRequestOptions *)optionsWithCachePolicy:(SMCachePolicy)cachePolicy;
+
 #pragma mark - Expanding relationships
 ///-------------------------------
 /// @name Expanding Relationships
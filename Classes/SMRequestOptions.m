@@ -16,6 +16,13 @@
 
 #import "SMRequestOptions.h"
 
+@interface SMRequestOptions ()
+
+// Retries already made by the request these options belong to, not copied
+@property (nonatomic) NSUInteger retryAttempt;
+
+@end
+
 @implementation SMRequestOptions
 
 @synthesize headers = _SM_headers;
@@ -23,6 +30,15 @@
 @synthesize tryRefreshToken = _SM_tryRefreshToken;
 @synthesize numberOfRetries = _SM_numberOfRetries;
 @synthesize retryBlock = _SM_retryBlock;
+@synthesize cachePolicy = _SM_cachePolicy;
+@synthesize cachePolicySet = _SM_cachePolicySet;
+@synthesize cacheMaxAge = _SM_cacheMaxAge;
+@synthesize cacheMaxAgeSet = _SM_cacheMaxAgeSet;
+@synthesize priority = _SM_priority;
+@synthesize prioritySet = _SM_prioritySet;
+@synthesize deadline = _SM_deadline;
+@synthesize retryPolicy = _SM_retryPolicy;
+@synthesize retryAttempt = _SM_retryAttempt;
 
 
 + (SMRequestOptions *)options
@@ -33,6 +49,7 @@
     opts.tryRefreshToken = YES;
     opts.numberOfRetries = 3;
     opts.retryBlock = nil;
+    opts.retryPolicy = [SMRetryPolicy policy];
     return opts;
 }
 
@@ -65,6 +82,53 @@
     return opt;
 }
 
++ (SMRequestOptions *)optionsWithCachePolicy:(SMCachePolicy)cachePolicy
+{
+    SMRequestOptions *opt = [SMRequestOptions options];
+    opt.cachePolicy = cachePolicy;
+    return opt;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    SMRequestOptions *opts = [[[self class] allocWithZone:zone] init];
+    opts.headers = [self.headers copy];
+    opts.isSecure = self.isSecure;
+    opts.tryRefreshToken = self.tryRefreshToken;
+    opts.numberOfRetries = self.numberOfRetries;
+    opts.retryBlock = self.retryBlock;
+    if (self.cachePolicySet) {
+        opts.cachePolicy = self.cachePolicy;
+    }
+    if (self.cacheMaxAgeSet) {
+        opts.cacheMaxAge = self.cacheMaxAge;
+    }
+    if (self.prioritySet) {
+        opts.priority = self.priority;
+    }
+    opts.deadline = self.deadline;
+    opts.retryPolicy = self.retryPolicy;
+    return opts;
+}
+
+- (void)setCachePolicy:(SMCachePolicy)cachePolicy
+{
+    _SM_cachePolicy = cachePolicy;
+    _SM_cachePolicySet = YES;
+}
+
+- (void)setCacheMaxAge:(NSTimeInterval)cacheMaxAge
+{
+    _SM_cacheMaxAge = cacheMaxAge;
+    _SM_cacheMaxAgeSet = YES;
+}
+
+- (void)setPriority:(SMRequestPriority)priority
+{
+    _SM_priority = priority;
+    _SM_prioritySet = YES;
+}
+
 - (void)setExpandDepth:(NSUInteger)depth
 {
     if (!self.headers) {
@@ -91,3 +155,17 @@
 }
 
 @end
+
+@implementation SMRequestOptions (Retry)
+
+- (NSUInteger)SM_retryAttempt
+{
+    return self.retryAttempt;
+}
+
+- (void)SM_setRetryAttempt:(NSUInteger)retryAttempt
+{
+    self.retryAttempt = retryAttempt;
+}
+
+@end
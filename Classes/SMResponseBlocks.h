@@ -145,3 +145,14 @@ typedef void (^SMFailureRetryBlock)(NSURLRequest *request, NSHTTPURLResponse *re
  */
 typedef void (^SMCoreDataSaveFailureBlock)(NSURLRequest *theRequest, NSError *theError, NSDictionary *theObject, SMRequestOptions *theOptions, SMResultSuccessBlock originalSuccessBlock);
 
+/**
+ The block parameters expected for the completion of a batch of custom code requests.
+ 
+ Both arrays have one entry per request, in the order the requests were passed in.  Entries are `NSNull` where a request has no JSON response or did not fail.
+ 
+ @param responses The JSON response of each request.
+ @param errors The error of each request that failed.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+typedef void (^SMCustomCodeBatchCompletionBlock)(NSArray *responses, NSArray *errors);
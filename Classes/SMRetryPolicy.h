@@ -0,0 +1,175 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ `SMRetryBudget` caps how many retries can be sent compared to regular requests, so a backend that is partly down isn't flooded with retries on top of its normal traffic.
+ 
+ The budget holds tokens.  Every request sent adds <tokenRatio> of a token, up to <maxTokens>, and every retry takes a whole token.  When less than one token is left, failures are returned instead of retried until enough requests have gone out.  With the defaults, retries are held to about one for every ten requests once an initial allowance of 10 is used up.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@interface SMRetryBudget : NSObject
+
+/**
+ The most tokens the budget can hold, and what it starts with.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (readonly, nonatomic) double maxTokens;
+
+/**
+ The fraction of a token each request adds.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (readonly, nonatomic) double tokenRatio;
+
+/**
+ The budget shared by every <SMRetryPolicy> that isn't given its own.  It holds 10 tokens, and each request adds 0.1 of a token.
+ 
+ @return The shared budget.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMRetryBudget *)defaultBudget;
+
+/**
+ Initialize a budget.
+ 
+ @param maxTokens The most tokens the budget can hold.
+ @param tokenRatio The fraction of a token each request adds.
+ 
+ @return An instance of `SMRetryBudget`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (id)initWithMaxTokens:(double)maxTokens tokenRatio:(double)tokenRatio;
+
+/**
+ Credit the budget for a request being sent.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)recordRequest;
+
+/**
+ Take a token for a retry.
+ 
+ @return `YES` if the retry may be sent, `NO` if the budget is used up.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (BOOL)withdrawRetry;
+
+@end
+
+/**
+ `SMRetryPolicy` decides which failed requests are retried and how long to wait before each retry.
+ 
+ Requests are retried after:
+ 
+ * 503 Service Unavailable, for any method, since the request was not processed.
+ * 502 Bad Gateway and 504 Gateway Timeout, for idempotent methods.
+ * Failing to connect, for any method, since nothing was sent.
+ * Timeouts and dropped connections, for idempotent methods.
+ 
+ GET, HEAD, PUT and DELETE are idempotent.  POST is only retried after a response that may have reached the server if <retriesNonIdempotentRequests> is `YES`.
+ 
+ The wait before retry `n` (counting from 0) is a random time between 0 and `MIN(maxDelay, baseDelay * 2^n)`, so clients that failed together don't retry together.  A `Retry-After` header from the server is respected as the minimum wait, with the random time added on top.
+ 
+ Each retry also needs a token from the <retryBudget>, and the number of retries for a request is limited by `numberOfRetries` on its `SMRequestOptions`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@interface SMRetryPolicy : NSObject <NSCopying>
+
+/**
+ The longest wait before the first retry, doubled for each retry after it.  Default is 0.5 seconds.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval baseDelay;
+
+/**
+ The longest wait before any retry, not counting a `Retry-After` from the server.  Default is 30 seconds.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval maxDelay;
+
+/**
+ Whether to retry POST requests after a failure that may have happened once the server had the request, such as a timeout or a 504.  Default is `NO`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) BOOL retriesNonIdempotentRequests;
+
+/**
+ The budget retries are drawn from.  Default is <[SMRetryBudget defaultBudget]>.  Set to `nil` to retry without a budget.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) SMRetryBudget *retryBudget;
+
+/**
+ A policy with the default settings.
+ 
+ @return A new instance of `SMRetryPolicy`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMRetryPolicy *)policy;
+
+/**
+ A policy with the given delays and the default settings otherwise.
+ 
+ @param baseDelay The longest wait before the first retry.
+ @param maxDelay The longest wait before any retry.
+ 
+ @return A new instance of `SMRetryPolicy`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMRetryPolicy *)policyWithBaseDelay:(NSTimeInterval)baseDelay maxDelay:(NSTimeInterval)maxDelay;
+
+/**
+ Whether a failed request should be retried, not taking the budget or number of retries into account.
+ 
+ @param request The request that failed.
+ @param response The response, or `nil` if none was received.
+ @param error The error the request failed with.
+ 
+ @return `YES` if the failure is transient and the request is safe to send again.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (BOOL)shouldRetryRequest:(NSURLRequest *)request response:(NSHTTPURLResponse *)response error:(NSError *)error;
+
+/**
+ How long to wait before a retry.
+ 
+ @param attempt The number of retries already made for the request.
+ @param response The response that failed, used for its `Retry-After` header.
+ 
+ @return The wait in seconds.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (NSTimeInterval)delayForRetryAttempt:(NSUInteger)attempt response:(NSHTTPURLResponse *)response;
+
+@end
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "SMRetryPolicy.h"
+
+#define DEFAULT_RETRY_BUDGET_MAX_TOKENS 10.0
+#define DEFAULT_RETRY_BUDGET_TOKEN_RATIO 0.1
+#define DEFAULT_RETRY_BASE_DELAY 0.5
+#define DEFAULT_RETRY_MAX_DELAY 30.0
+
+@interface SMRetryBudget ()
+
+@property (readwrite, nonatomic) double maxTokens;
+@property (readwrite, nonatomic) double tokenRatio;
+@property (nonatomic) double tokens;
+
+@end
+
+@implementation SMRetryBudget
+
+@synthesize maxTokens = _SM_maxTokens;
+@synthesize tokenRatio = _SM_tokenRatio;
+@synthesize tokens = _SM_tokens;
+
++ (SMRetryBudget *)defaultBudget
+{
+    static SMRetryBudget *defaultBudget = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        defaultBudget = [[SMRetryBudget alloc] initWithMaxTokens:DEFAULT_RETRY_BUDGET_MAX_TOKENS tokenRatio:DEFAULT_RETRY_BUDGET_TOKEN_RATIO];
+    });
+    
+    return defaultBudget;
+}
+
+- (id)initWithMaxTokens:(double)maxTokens tokenRatio:(double)tokenRatio
+{
+    self = [super init];
+    if (self) {
+        self.maxTokens = maxTokens;
+        self.tokenRatio = tokenRatio;
+        self.tokens = maxTokens;
+    }
+    
+    return self;
+}
+
+- (void)recordRequest
+{
+    @synchronized(self) {
+        self.tokens = MIN(self.tokens + self.tokenRatio, self.maxTokens);
+    }
+}
+
+- (BOOL)withdrawRetry
+{
+    @synchronized(self) {
+        if (self.tokens < 1.0) {
+            return NO;
+        }
+        self.tokens -= 1.0;
+        return YES;
+    }
+}
+
+@end
+
+@implementation SMRetryPolicy
+
+@synthesize baseDelay = _SM_baseDelay;
+@synthesize maxDelay = _SM_maxDelay;
+@synthesize retriesNonIdempotentRequests = _SM_retriesNonIdempotentRequests;
+@synthesize retryBudget = _SM_retryBudget;
+
++ (SMRetryPolicy *)policy
+{
+    return [[SMRetryPolicy alloc] init];
+}
+
++ (SMRetryPolicy *)policyWithBaseDelay:(NSTimeInterval)baseDelay maxDelay:(NSTimeInterval)maxDelay
+{
+    SMRetryPolicy *policy = [SMRetryPolicy policy];
+    policy.baseDelay = baseDelay;
+    policy.maxDelay = maxDelay;
+    return policy;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        self.baseDelay = DEFAULT_RETRY_BASE_DELAY;
+        self.maxDelay = DEFAULT_RETRY_MAX_DELAY;
+        self.retriesNonIdempotentRequests = NO;
+        self.retryBudget = [SMRetryBudget defaultBudget];
+    }
+    
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    SMRetryPolicy *policy = [[[self class] allocWithZone:zone] init];
+    policy.baseDelay = self.baseDelay;
+    policy.maxDelay = self.maxDelay;
+    policy.retriesNonIdempotentRequests = self.retriesNonIdempotentRequests;
+    // The budget is shared on purpose, it limits retries across requests
+    policy.retryBudget = self.retryBudget;
+    return policy;
+}
+
+- (BOOL)shouldRetryRequest:(NSURLRequest *)request response:(NSHTTPURLResponse *)response error:(NSError *)error
+{
+    NSString *method = [[request HTTPMethod] uppercaseString] ?: @"GET";
+    BOOL idempotent = [[NSSet setWithObjects:@"GET", @"HEAD", @"PUT", @"DELETE", @"OPTIONS", nil] containsObject:method];
+    BOOL safeToResend = idempotent || self.retriesNonIdempotentRequests;
+    
+    if (response) {
+        switch ([response statusCode]) {
+            case 503:
+                return YES;
+            case 502:
+            case 504:
+                return safeToResend;
+            default:
+                return NO;
+        }
+    }
+    
+    if (![[error domain] isEqualToString:NSURLErrorDomain]) {
+        return NO;
+    }
+    
+    switch ([error code]) {
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorDNSLookupFailed:
+            // Never reached the server
+            return YES;
+        case NSURLErrorTimedOut:
+        case NSURLErrorNetworkConnectionLost:
+            return safeToResend;
+        default:
+            return NO;
+    }
+}
+
+- (NSTimeInterval)delayForRetryAttempt:(NSUInteger)attempt response:(NSHTTPURLResponse *)response
+{
+    // Full jitter, anywhere between 0 and the capped exponential backoff
+    NSTimeInterval backoff = MIN(self.maxDelay, self.baseDelay * pow(2.0, MIN(attempt, (NSUInteger)30)));
+    NSTimeInterval delay = backoff * ((double)arc4random() / UINT32_MAX);
+    
+    NSString *retryAfter = [[response allHeaderFields] valueForKey:@"Retry-After"];
+    if (retryAfter) {
+        delay += MAX([retryAfter doubleValue], 0.0);
+    }
+    
+    return delay;
+}
+
+@end
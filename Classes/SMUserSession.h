@@ -108,10 +108,21 @@ typedef void (^SMTokenRefreshFailureBlock)(NSError *error, SMFailureBlock origin
 /**
  A boolean flag for whether an access token refresh is in progress.
  
+ Informational only. Concurrent calls to <refreshTokenWithSuccessCallbackQueue:failureCallbackQueue:onSuccess:onFailure:> are coordinated by the session, so there is no need to check this flag before requesting a refresh.
+ 
  @since Available in iOS SDK 1.0.0 and later.
  */
 @property (atomic) BOOL refreshing;
 
+/**
+ How long before the access token expires, in seconds, the session should refresh it in the background.
+ 
+ When greater than 0, the session schedules a refresh using the persisted refresh token so requests do not have to wait on a refresh round trip. The scheduled refresh is skipped while the network is not reachable and rescheduled when the network status changes.  A refresh that fails for any other reason than the refresh token being rejected is retried with exponential backoff, starting at 5 seconds and up to 5 minutes apart. Default is 0, which disables proactive refresh.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval tokenRefreshMargin;
+
 /**
  Optional block to be executed whenever a token refresh request fails.
  
@@ -127,6 +138,8 @@ typedef void (^SMTokenRefreshFailureBlock)(NSError *error, SMFailureBlock origin
 /**
  Makes a request to refresh the current user session using the refresh token.
  
+ Only one refresh request is sent at a time. If a refresh is already in progress, the callbacks are queued and performed with the result of that refresh rather than failing.
+ 
  @param successCallbackQueue The queue to perform successBlock on.
  @param failureCallbackQueue The queue to perform failureBlock on.
  @param successBlock Upon success provides the user object.
@@ -15,21 +15,36 @@
  */
 
 #import "StackMob.h"
+#import "SMMetrics+Protected.h"
 #import "AFJSONRequestOperation.h"
 #import "SMVersion.h"
 #import "SystemInformation.h"
+#import "FileManagement.h"
+
+#define USER_IDENTIFIER_MAP_FILE @"UserIdentifierMap.smdata"
+#define LEGACY_USER_IDENTIFIER_MAP_FILE @"UserIdentifierMap.plist"
 
 #define ACCESS_TOKEN @"access_token"
 #define EXPIRES_IN @"expires_in"
 #define MAC_KEY @"mac_key"
 #define REFRESH_TOKEN @"refresh_token"
 
+#define PROACTIVE_REFRESH_RETRY_BASE_DELAY 5.0
+#define PROACTIVE_REFRESH_RETRY_MAX_DELAY 300.0
+
 @interface SMUserSession ()
 
 @property (nonatomic, copy) NSString *oauthStorageKey;
 @property (readwrite, nonatomic, copy) SMTokenRefreshFailureBlock tokenRefreshFailureBlock;
+@property (nonatomic, strong) NSMutableArray *refreshWaiters;
+@property (nonatomic) NSUInteger proactiveRefreshGeneration;
 
-- (NSURL *)SM_getStoreURLForUserIdentifierTable;
+- (void)SM_finishRefreshWithUserObject:(NSDictionary *)userObject error:(NSError *)error;
+- (void)SM_scheduleProactiveRefresh;
+- (void)SM_performProactiveRefreshForGeneration:(NSUInteger)generation attempt:(NSUInteger)attempt;
+- (void)SM_scheduleProactiveRefreshForGeneration:(NSUInteger)generation attempt:(NSUInteger)attempt afterDelay:(NSTimeInterval)delayInSeconds;
+- (void)SM_networkStatusDidChange:(NSNotification *)notification;
+- (NSURL *)SM_getStoreURLForUserIdentifierTableFile:(NSString *)fileComponent;
 - (void)SM_createStoreURLPathIfNeeded:(NSURL *)storeURL;
 
 @end
@@ -51,6 +66,9 @@
 @synthesize networkMonitor = _SM_networkMonitor;
 @synthesize userIdentifierMap = _SM_userIdentifierMap;
 @synthesize tokenRefreshFailureBlock = _tokenRefreshFailureBlock;
+@synthesize refreshWaiters = _SM_refreshWaiters;
+@synthesize tokenRefreshMargin = _SM_tokenRefreshMargin;
+@synthesize proactiveRefreshGeneration = _SM_proactiveRefreshGeneration;
 
 - (id)initWithAPIVersion:(NSString *)version
                  apiHost:(NSString *)apiHost
@@ -74,6 +92,9 @@
         self.userPrimaryKeyField = userPrimaryKeyField;
         self.userPasswordField = userPasswordField;
         self.refreshing = NO;
+        self.refreshWaiters = [NSMutableArray array];
+        self.proactiveRefreshGeneration = 0;
+        _SM_tokenRefreshMargin = 0;
         self.tokenRefreshFailureBlock = nil;
         
         NSString *applicationName = [[[NSBundle mainBundle] infoDictionary] valueForKey:(NSString *)kCFBundleNameKey];
@@ -85,11 +106,18 @@
         
         [self SMReadUserIdentifierMap];
         
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(SM_networkStatusDidChange:) name:SMNetworkStatusDidChangeNotification object:nil];
+        
     }
     
     return self;
 }
 
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:SMNetworkStatusDidChangeNotification object:nil];
+}
+
 
 - (BOOL)accessTokenHasExpired
 {
@@ -131,20 +159,56 @@
                 failureBlock(refreshError);
             });
         }
-    } else if (self.refreshing) {
-        if (failureBlock) {
-            NSError *refreshError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenInProgress userInfo:nil];
-            dispatch_async(failureCallbackQueue, ^{
-                failureBlock(refreshError);
-            });
-        }
     } else {
-        self.refreshing = YES;//Don't ever trigger two refreshToken calls
-        [self doTokenRequestWithEndpoint:@"refreshToken" credentials:[NSDictionary dictionaryWithObjectsAndKeys:self.refreshToken, @"refresh_token", nil] options:[SMRequestOptions options] successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue onSuccess:successBlock onFailure:failureBlock];
+        // Every caller is queued as a waiter. Only the first waiter starts the refresh request, everyone else is called back with its result.
+        void (^waiter)(NSDictionary *, NSError *) = ^(NSDictionary *userObject, NSError *theError) {
+            if (theError) {
+                if (failureBlock) {
+                    dispatch_async(failureCallbackQueue, ^{
+                        failureBlock(theError);
+                    });
+                }
+            } else if (successBlock) {
+                dispatch_async(successCallbackQueue, ^{
+                    successBlock(userObject);
+                });
+            }
+        };
+        
+        BOOL startRefresh = NO;
+        @synchronized(self.refreshWaiters) {
+            startRefresh = [self.refreshWaiters count] == 0;
+            [self.refreshWaiters addObject:[waiter copy]];
+            self.refreshing = YES;
+        }
+        
+        if (startRefresh) {
+            SMMetricsIncrementCounter(SMMetricsTokenRefreshCounter, 1);
+            dispatch_queue_t refreshQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+            [self doTokenRequestWithEndpoint:@"refreshToken" credentials:[NSDictionary dictionaryWithObjectsAndKeys:self.refreshToken, @"refresh_token", nil] options:[SMRequestOptions options] successCallbackQueue:refreshQueue failureCallbackQueue:refreshQueue onSuccess:^(NSDictionary *userObject) {
+                [self SM_finishRefreshWithUserObject:userObject error:nil];
+            } onFailure:^(NSError *theError) {
+                [self SM_finishRefreshWithUserObject:nil error:theError];
+            }];
+        }
     }
     
 }
 
+- (void)SM_finishRefreshWithUserObject:(NSDictionary *)userObject error:(NSError *)error
+{
+    NSArray *waiters = nil;
+    @synchronized(self.refreshWaiters) {
+        waiters = [self.refreshWaiters copy];
+        [self.refreshWaiters removeAllObjects];
+        self.refreshing = NO;
+    }
+    
+    for (void (^waiter)(NSDictionary *, NSError *) in waiters) {
+        waiter(userObject, error);
+    }
+}
+
 - (void)doTokenRequestWithEndpoint:(NSString *)endpoint
                        credentials:(NSDictionary *)credentials
                            options:(SMRequestOptions *)options
@@ -219,6 +283,71 @@
     self.secureOAuthClient.accessToken = accessToken;
     self.secureOAuthClient.macKey = macKey;
     self.refreshing = NO;
+    [self SM_scheduleProactiveRefresh];
+}
+
+- (void)setTokenRefreshMargin:(NSTimeInterval)tokenRefreshMargin
+{
+    _SM_tokenRefreshMargin = tokenRefreshMargin;
+    [self SM_scheduleProactiveRefresh];
+}
+
+- (void)SM_scheduleProactiveRefresh
+{
+    // Bumping the generation invalidates any refresh scheduled for a previous token
+    NSUInteger generation = 0;
+    @synchronized(self) {
+        generation = ++self.proactiveRefreshGeneration;
+    }
+    
+    if (self.tokenRefreshMargin <= 0 || self.refreshToken == nil || self.expiration == nil) {
+        return;
+    }
+    
+    NSTimeInterval delayInSeconds = MAX([self.expiration timeIntervalSinceNow] - self.tokenRefreshMargin, 0);
+    [self SM_scheduleProactiveRefreshForGeneration:generation attempt:0 afterDelay:delayInSeconds];
+}
+
+- (void)SM_scheduleProactiveRefreshForGeneration:(NSUInteger)generation attempt:(NSUInteger)attempt afterDelay:(NSTimeInterval)delayInSeconds
+{
+    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delayInSeconds * NSEC_PER_SEC));
+    __weak SMUserSession *weakSelf = self;
+    dispatch_after(popTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [weakSelf SM_performProactiveRefreshForGeneration:generation attempt:attempt];
+    });
+}
+
+- (void)SM_performProactiveRefreshForGeneration:(NSUInteger)generation attempt:(NSUInteger)attempt
+{
+    @synchronized(self) {
+        if (generation != self.proactiveRefreshGeneration) {
+            return;
+        }
+    }
+    
+    // Paused while offline, SM_networkStatusDidChange: schedules it again once StackMob is reachable
+    if (self.refreshToken == nil || [self.networkMonitor currentNetworkStatus] == SMNetworkStatusNotReachable) {
+        return;
+    }
+    
+    // A successful refresh saves the new token info, which schedules the next refresh
+    dispatch_queue_t refreshQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+    __weak SMUserSession *weakSelf = self;
+    [self refreshTokenWithSuccessCallbackQueue:refreshQueue failureCallbackQueue:refreshQueue onSuccess:nil onFailure:^(NSError *theError) {
+        // A rejected refresh token won't be accepted later either
+        if ([[theError domain] isEqualToString:HTTPErrorDomain] && [theError code] >= 400 && [theError code] < 500) {
+            return;
+        }
+        NSTimeInterval delayInSeconds = MIN(PROACTIVE_REFRESH_RETRY_MAX_DELAY, PROACTIVE_REFRESH_RETRY_BASE_DELAY * pow(2.0, MIN(attempt, (NSUInteger)30)));
+        [weakSelf SM_scheduleProactiveRefreshForGeneration:generation attempt:attempt + 1 afterDelay:delayInSeconds];
+    }];
+}
+
+- (void)SM_networkStatusDidChange:(NSNotification *)notification
+{
+    if ([[[notification userInfo] objectForKey:SMCurrentNetworkStatusKey] intValue] == SMNetworkStatusReachable) {
+        [self SM_scheduleProactiveRefresh];
+    }
 }
 
 - (NSURLRequest *) signRequest:(NSURLRequest *)request
@@ -234,7 +363,7 @@
     return options.tryRefreshToken && self.refreshToken != nil && [self accessTokenHasExpired];
 }
 
-- (NSURL *)SM_getStoreURLForUserIdentifierTable
+- (NSURL *)SM_getStoreURLForUserIdentifierTableFile:(NSString *)fileComponent
 {
     
     NSString *applicationName = [[[NSBundle mainBundle] infoDictionary] valueForKey:(NSString *)kCFBundleNameKey];
@@ -244,9 +373,9 @@
     NSString *userIDMapName = nil;
     if (applicationName != nil)
     {
-        userIDMapName = [NSString stringWithFormat:@"%@-%@-UserIdentifierMap.plist", applicationName, self.regularOAuthClient.publicKey];
+        userIDMapName = [NSString stringWithFormat:@"%@-%@-%@", applicationName, self.regularOAuthClient.publicKey, fileComponent];
     } else {
-        userIDMapName = [NSString stringWithFormat:@"%@-UserIdentifierMap.plist", self.regularOAuthClient.publicKey];
+        userIDMapName = [NSString stringWithFormat:@"%@-%@", self.regularOAuthClient.publicKey, fileComponent];
     }
     
     NSArray *paths = [NSArray arrayWithObjects:applicationDocumentsDirectory, applicationStorageDirectory, nil];
@@ -285,45 +414,27 @@
 - (void)SMReadUserIdentifierMap
 {
     
-    NSString *errorDesc = nil;
-    NSPropertyListFormat format;
-    NSURL *mapPath = [self SM_getStoreURLForUserIdentifierTable];
+    NSError *error = nil;
+    NSURL *mapPath = [self SM_getStoreURLForUserIdentifierTableFile:USER_IDENTIFIER_MAP_FILE];
+    NSURL *legacyMapPath = [self SM_getStoreURLForUserIdentifierTableFile:LEGACY_USER_IDENTIFIER_MAP_FILE];
     
-    if ([[NSFileManager defaultManager] fileExistsAtPath:[mapPath path]]) {
-        NSData *plistXML = [[NSFileManager defaultManager] contentsAtPath:[mapPath path]];
-        NSDictionary *temp = (NSDictionary *)[NSPropertyListSerialization
-                                              propertyListFromData:plistXML
-                                              mutabilityOption:NSPropertyListMutableContainersAndLeaves
-                                              format:&format
-                                              errorDescription:&errorDesc];
-        
-        if (!temp) {
-            [NSException raise:SMExceptionCacheError format:@"Error reading user identifier: %@, format: %d", errorDesc, (int)format];
-        } else {
-            self.userIdentifierMap = [temp mutableCopy];
-        }
-    } else {
-        self.userIdentifierMap = [NSMutableDictionary dictionary];
+    NSMutableDictionary *temp = [FileManagement SM_readMetadataAtURL:mapPath legacyPropertyListURL:legacyMapPath error:&error];
+    
+    if (error) {
+        [NSException raise:SMExceptionCacheError format:@"Error reading user identifier: %@", error];
     }
     
+    self.userIdentifierMap = temp ? temp : [NSMutableDictionary dictionary];
+    
 }
 
 - (void)SMSaveUserIdentifierMap
 {
-    NSString *errorDesc = nil;
     NSError *error = nil;
-    NSURL *mapPath = [self SM_getStoreURLForUserIdentifierTable];
+    NSURL *mapPath = [self SM_getStoreURLForUserIdentifierTableFile:USER_IDENTIFIER_MAP_FILE];
     [self SM_createStoreURLPathIfNeeded:mapPath];
     
-    NSData *mapData = [NSPropertyListSerialization dataFromPropertyList:self.userIdentifierMap
-                                                                 format:NSPropertyListXMLFormat_v1_0
-                                                       errorDescription:&errorDesc];
-    
-    if (!mapData) {
-        [NSException raise:SMExceptionCacheError format:@"Error serializing user identifier data with error description %@", errorDesc];
-    }
-    
-    BOOL successfulWrite = [mapData writeToFile:[mapPath path] options:NSDataWritingAtomic error:&error];
+    BOOL successfulWrite = [FileManagement SM_writeMetadata:self.userIdentifierMap toURL:mapPath error:&error];
     if (!successfulWrite) {
         [NSException raise:SMExceptionCacheError format:@"Error saving identifier data with error %@", error];
     }
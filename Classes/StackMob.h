@@ -24,9 +24,11 @@
 #import "SMUserSession.h"
 #import "SMOAuth2Client.h"
 #import "SMJSONRequestOperation.h"
+#import "SMMetrics.h"
 
 #import "SMError.h"
 #import "SMRequestOptions.h"
+#import "SMRetryPolicy.h"
 #import "SMResponseBlocks.h"
 #import "SMNetworkReachability.h"
 #import "Synchronization.h"
@@ -34,6 +36,7 @@
 
 #import "SMCoreDataStore.h"
 #import "SMIncrementalStore.h"
+#import "SMRequestContext.h"
 #import "SMUserManagedObject.h"
 #import "NSManagedObject+StackMobSerialization.h"
 #import "NSEntityDescription+StackMobSerialization.h"
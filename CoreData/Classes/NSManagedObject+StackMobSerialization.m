@@ -16,6 +16,7 @@
 
 #import "NSManagedObject+StackMobSerialization.h"
 #import "SMError.h"
+#import "SMGeoPoint.h"
 #import "SMUserManagedObject.h"
 #import "SMError.h"
 #import "NSEntityDescription+StackMobSerialization.h"
@@ -132,9 +133,16 @@
                 }  else if (attributeDescription.attributeType == NSTransformableAttributeType) {
                     
                     // make sure geopoint values are serialized as dictionaries
-                    NSData *data = propertyValue;
-                    NSDictionary *geoDictionary = [NSKeyedUnarchiver unarchiveObjectWithData:data];
-                    [objectDictionary setObject:geoDictionary forKey:[selfEntity SMFieldNameForProperty:property]];
+                    NSDictionary *geoDictionary = nil;
+                    if ([propertyValue isKindOfClass:[NSDictionary class]]) {
+                        // attributes using SMGeoPointTransformer already hold the dictionary
+                        geoDictionary = propertyValue;
+                    } else if ([propertyValue isKindOfClass:[NSData class]]) {
+                        geoDictionary = [SMGeoPointTransformer geoPointWithData:propertyValue];
+                    }
+                    if (geoDictionary != nil) {
+                        [objectDictionary setObject:geoDictionary forKey:[selfEntity SMFieldNameForProperty:property]];
+                    }
                     
                 } else {
                     id value = propertyValue;
@@ -50,6 +50,10 @@
  ## Hooking Up to the Chain Of Contexts ##
  
  If you create your own context and make it a child of a context provided by <SMCoreDataStore>, and you plan to save on your created context, use <setContextShouldObtainPermanentIDsBeforeSaving:> so that permanent IDs for newly inserted objects are created on your child context level.  Otherwise objects in your context will appear to have temporary IDs even after they have been saved!
+ 
+## Direct Saves ##
+ 
+By default a save called on the main thread context goes through a temporary child context, the main thread context and the private parent context, one performBlock: at a time.  Contexts set with <setContextSavesDirectlyToStore:> skip the temporary context and save themselves and then each parent in turn, so the main thread context reaches the context connected to the persistent store in a single hop.  Set `savesDirectlyToStore` on <SMCoreDataStore> to turn this on for the contexts it provides.
  <a name="pr_options"></a>
  ## Per Request Options ##
  
@@ -280,4 +284,24 @@
  */
 - (void)setContextShouldObtainPermanentIDsBeforeSaving:(BOOL)value;
 
+/**
+ Sets whether saves on this context push changes straight up the chain of parent contexts.
+ 
+ When YES, the save methods of this category save this context and then each parent context in turn until the one connected to the persistent store coordinator, instead of first pushing the changes through a temporary child context.  The merge policy of each context in the chain is used as is.  The value is stored in the context's `userInfo`.
+ 
+ @param value If YES, saves on this context go directly up the chain of parent contexts.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)setContextSavesDirectlyToStore:(BOOL)value;
+
+/**
+ Whether saves on this context push changes straight up the chain of parent contexts.
+ 
+ @return YES if <setContextSavesDirectlyToStore:> was set to YES for this context.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (BOOL)contextSavesDirectlyToStore;
+
 @end
@@ -16,6 +16,9 @@
 
 #import "NSManagedObjectContext+Concurrency.h"
 #import "SMClient.h"
+#import "SMRequestContext.h"
+
+static NSString *const SM_SavesDirectlyToStoreKey = @"SM_SavesDirectlyToStoreKey";
 
 @implementation NSManagedObjectContext (Concurrency)
 
@@ -61,6 +64,16 @@
     }
 }
 
+- (void)setContextSavesDirectlyToStore:(BOOL)value
+{
+    [[self userInfo] setObject:[NSNumber numberWithBool:value] forKey:SM_SavesDirectlyToStoreKey];
+}
+
+- (BOOL)contextSavesDirectlyToStore
+{
+    return [[[self userInfo] objectForKey:SM_SavesDirectlyToStoreKey] boolValue];
+}
+
 - (void)saveOnSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     [self saveWithSuccessCallbackQueue:dispatch_get_main_queue() failureCallbackQueue:dispatch_get_main_queue() onSuccess:successBlock onFailure:failureBlock];
@@ -73,6 +86,12 @@
 
 - (void)saveWithSuccessCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue options:(SMRequestOptions *)options onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
+    if ([self contextSavesDirectlyToStore]) {
+        SMRequestContext *requestContext = options ? [SMRequestContext requestContextWithOptions:options] : nil;
+        [self SM_saveContextAndParents:self successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue requestContext:requestContext onSuccess:successBlock onFailure:failureBlock];
+        return;
+    }
+    
     NSManagedObjectContext *mainContext = nil;
     NSManagedObjectContext *temporaryContext = nil;
     if ([self concurrencyType] == NSMainQueueConcurrencyType) {
@@ -94,22 +113,17 @@
         [NSException raise:SMExceptionIncompatibleObject format:@"Method saveAndWait: main context should have parent with set persistent store coordinator"];
     }
     
+    SMRequestContext *requestContext = options ? [SMRequestContext requestContextWithOptions:options] : nil;
+    
     [temporaryContext performBlock:^{
         
         __block NSError *saveError;
         
-        if (options) {
-            SMRequestOptions *newOptions = options;
-            NSMutableDictionary *threadDict = [[NSThread currentThread] threadDictionary];
-            [threadDict setObject:newOptions forKey:SMRequestSpecificOptions];
-        }
-        
         // Save Temporary Context
-        BOOL tempContextSaveSuccess = [temporaryContext save:&saveError];
-        
-        if (options) {
-            [[[NSThread currentThread] threadDictionary] removeObjectForKey:SMRequestSpecificOptions];
-        }
+        __block BOOL tempContextSaveSuccess = NO;
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:temporaryContext block:^{
+            tempContextSaveSuccess = [temporaryContext save:&saveError];
+        }];
         
         if (!tempContextSaveSuccess) {
             
@@ -119,17 +133,10 @@
             // Save Main Context
             [mainContext performBlock:^{
                 
-                if (options) {
-                    SMRequestOptions *newOptions = options;
-                    NSMutableDictionary *threadDict = [[NSThread currentThread] threadDictionary];
-                    [threadDict setObject:newOptions forKey:SMRequestSpecificOptions];
-                }
-                
-                BOOL mainContextSaveSuccess = [mainContext save:&saveError];
-                
-                if (options) {
-                    [[[NSThread currentThread] threadDictionary] removeObjectForKey:SMRequestSpecificOptions];
-                }
+                __block BOOL mainContextSaveSuccess = NO;
+                [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:mainContext block:^{
+                    mainContextSaveSuccess = [mainContext save:&saveError];
+                }];
                 
                 if (!mainContextSaveSuccess) {
                     
@@ -142,17 +149,10 @@
                         // Save Private Context to disk
                         [privateContext performBlock:^{
                             
-                            if (options) {
-                                SMRequestOptions *newOptions = options;
-                                NSMutableDictionary *threadDict = [[NSThread currentThread] threadDictionary];
-                                [threadDict setObject:newOptions forKey:SMRequestSpecificOptions];
-                            }
-                            
-                            BOOL privateContextSaveSuccess = [privateContext save:&saveError];
-                            
-                            if (options) {
-                                [[[NSThread currentThread] threadDictionary] removeObjectForKey:SMRequestSpecificOptions];
-                            }
+                            __block BOOL privateContextSaveSuccess = NO;
+                            [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:privateContext block:^{
+                                privateContextSaveSuccess = [privateContext save:&saveError];
+                            }];
                             
                             if (!privateContextSaveSuccess) {
                                 
@@ -188,6 +188,15 @@
 
 - (BOOL)saveAndWait:(NSError *__autoreleasing *)error options:(SMRequestOptions *)options
 {
+    if ([self contextSavesDirectlyToStore]) {
+        NSError *saveError = nil;
+        SMRequestContext *requestContext = options ? [SMRequestContext requestContextWithOptions:options] : nil;
+        BOOL success = [self SM_saveContextAndParentsAndWait:self requestContext:requestContext error:&saveError];
+        if (!success && error != NULL) {
+            *error = saveError;
+        }
+        return success;
+    }
     
     NSManagedObjectContext *mainContext = nil;
     NSManagedObjectContext *temporaryContext = nil;
@@ -210,31 +219,36 @@
         [NSException raise:SMExceptionIncompatibleObject format:@"Method saveAndWait: main context should have parent with set persistent store coordinator"];
     }
     
+    SMRequestContext *requestContext = options ? [SMRequestContext requestContextWithOptions:options] : nil;
+    
     __block BOOL success = NO;
     __block NSError *saveError = nil;
     [temporaryContext performBlockAndWait:^{
         
-        if (options) {
-            SMRequestOptions *newOptions = options;
-            NSMutableDictionary *threadDict = [[NSThread currentThread] threadDictionary];
-            [threadDict setObject:newOptions forKey:SMRequestSpecificOptions];
-        }
+        __block BOOL tempContextSaveSuccess = NO;
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:temporaryContext block:^{
+            tempContextSaveSuccess = [temporaryContext save:&saveError];
+        }];
         
         // Save Temporary Context
-        if ([temporaryContext save:&saveError]) {
+        if (tempContextSaveSuccess) {
             
             // Save Main Context
             [mainContext performBlockAndWait:^{
                 
-                if ([mainContext save:&saveError]) {
+                __block BOOL mainContextSaveSuccess = NO;
+                [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:mainContext block:^{
+                    mainContextSaveSuccess = [mainContext save:&saveError];
+                }];
+                
+                if (mainContextSaveSuccess) {
                     
                     // Save Private Context to disk
                     [privateContext performBlockAndWait:^{
                         
-                        if ([privateContext save:&saveError]) {
-
-                            success = YES;
-                        }
+                        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:privateContext block:^{
+                            success = [privateContext save:&saveError];
+                        }];
                         
                     }];
                     
@@ -250,8 +264,51 @@
         *error = saveError;
     }
     
-    if (options) {
-        [[[NSThread currentThread] threadDictionary] removeObjectForKey:SMRequestSpecificOptions];
+    return success;
+}
+
+/*
+ Direct save path: save context, then each parent in turn on its own queue until the context connected to the persistent store coordinator has saved.
+ */
+- (void)SM_saveContextAndParents:(NSManagedObjectContext *)context successCallbackQueue:(dispatch_queue_t)successCallbackQueue failureCallbackQueue:(dispatch_queue_t)failureCallbackQueue requestContext:(SMRequestContext *)requestContext onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+{
+    [context performBlock:^{
+        
+        __block NSError *saveError = nil;
+        __block BOOL contextSaveSuccess = NO;
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:context block:^{
+            contextSaveSuccess = [context save:&saveError];
+        }];
+        
+        if (!contextSaveSuccess) {
+            [self callFailureBlock:failureBlock queue:failureCallbackQueue error:saveError];
+        } else if (context.parentContext) {
+            [self SM_saveContextAndParents:context.parentContext successCallbackQueue:successCallbackQueue failureCallbackQueue:failureCallbackQueue requestContext:requestContext onSuccess:successBlock onFailure:failureBlock];
+        } else if (successBlock) {
+            dispatch_async(successCallbackQueue, ^{
+                successBlock();
+            });
+        }
+        
+    }];
+}
+
+- (BOOL)SM_saveContextAndParentsAndWait:(NSManagedObjectContext *)context requestContext:(SMRequestContext *)requestContext error:(NSError *__autoreleasing *)error
+{
+    __block BOOL success = NO;
+    __block NSError *saveError = nil;
+    [context performBlockAndWait:^{
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:context block:^{
+            success = [context save:&saveError];
+        }];
+    }];
+    
+    if (success && context.parentContext) {
+        return [self SM_saveContextAndParentsAndWait:context.parentContext requestContext:requestContext error:error];
+    }
+    
+    if (!success && error != NULL) {
+        *error = saveError;
     }
     
     return success;
@@ -282,32 +339,36 @@
     }
     
     NSManagedObjectContext *backgroundContext = mainContext.parentContext;
+    NSFetchRequest *fetchCopy = [request copy];
+    [fetchCopy setResultType:NSManagedObjectIDResultType];
     
-    [backgroundContext performBlock:^{
-        NSError *fetchError = nil;
-        NSFetchRequest *fetchCopy = [request copy];
-        [fetchCopy setResultType:NSManagedObjectIDResultType];
-        
-        if (options) {
-            SMRequestOptions *newOptions = options;
-            NSMutableDictionary *threadDict = [[NSThread currentThread] threadDictionary];
-            [threadDict setObject:newOptions forKey:SMRequestSpecificOptions];
-        }
-        
-        __block NSArray *resultsOfFetch = [backgroundContext executeFetchRequest:fetchCopy error:&fetchError];
-        
-        if (options) {
-            [[[NSThread currentThread] threadDictionary] removeObjectForKey:SMRequestSpecificOptions];
-        }
-        
-        if (fetchError) {
-            [self callFailureBlock:failureBlock queue:failureCallbackQueue error:fetchError];
-        } else {
-            if (successBlock) {
+    void (^fetchInBackgroundContext)(id) = ^(id networkResponse) {
+        [backgroundContext performBlock:^{
+            __block NSError *fetchError = nil;
+            __block NSArray *resultsOfFetch = nil;
+            
+            SMRequestContext *requestContext = nil;
+            if (options || networkResponse) {
+                requestContext = [SMRequestContext requestContextWithOptions:options];
+                requestContext.networkFetchResponse = networkResponse;
+            }
+            
+            [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:backgroundContext block:^{
+                resultsOfFetch = [backgroundContext executeFetchRequest:fetchCopy error:&fetchError];
+            }];
+            
+            if (fetchError) {
+                [self callFailureBlock:failureBlock queue:failureCallbackQueue error:fetchError];
+            } else if (successBlock) {
                 if (returnIDs) {
                     dispatch_async(successCallbackQueue, ^{
                         successBlock(resultsOfFetch);
                     });
+                } else if (successCallbackQueue == dispatch_get_main_queue()) {
+                    // Register the objects in the main context on its own queue
+                    [mainContext performBlock:^{
+                        successBlock([self SM_objectsWithIDs:resultsOfFetch inContext:mainContext]);
+                    }];
                 } else {
                     dispatch_async(successCallbackQueue, ^{
                         
@@ -322,23 +383,42 @@
                             
                         }
                         
-                        __block NSArray *managedObjectsToReturn = [resultsOfFetch map:^id(id item) {
-                            NSManagedObject *objectFromCurrentContext = [context objectWithID:item];
-                            [context refreshObject:objectFromCurrentContext mergeChanges:YES];
-                            return objectFromCurrentContext;
-                        }];
-                        
-                        successBlock(managedObjectsToReturn);
+                        successBlock([self SM_objectsWithIDs:resultsOfFetch inContext:context]);
                         
                     });
                 }
             }
+        }];
+    };
+    
+    SMIncrementalStore *incrementalStore = nil;
+    for (NSPersistentStore *store in [[backgroundContext persistentStoreCoordinator] persistentStores]) {
+        if ([store isKindOfClass:[SMIncrementalStore class]]) {
+            incrementalStore = (SMIncrementalStore *)store;
+            break;
         }
-        
-    }];
+    }
+    
+    if (incrementalStore && [incrementalStore SM_fetchRequestGoesToNetwork:fetchCopy options:options]) {
+        // Send the query now so no thread waits on the network, the background context is only used once the response is in
+        [incrementalStore SM_performNetworkFetch:fetchCopy options:options onCompletion:^(NSArray *results, NSError *error) {
+            fetchInBackgroundContext(error ? (id)error : (id)results);
+        }];
+    } else {
+        fetchInBackgroundContext(nil);
+    }
     
 }
 
+- (NSArray *)SM_objectsWithIDs:(NSArray *)objectIDs inContext:(NSManagedObjectContext *)context
+{
+    return [objectIDs map:^id(id item) {
+        NSManagedObject *objectFromCurrentContext = [context objectWithID:item];
+        [context refreshObject:objectFromCurrentContext mergeChanges:YES];
+        return objectFromCurrentContext;
+    }];
+}
+
 - (NSArray *)executeFetchRequestAndWait:(NSFetchRequest *)request error:(NSError *__autoreleasing *)error
 {
     return [self executeFetchRequestAndWait:request returnManagedObjectIDs:NO error:error];
@@ -369,19 +449,12 @@
         [fetchCopy setFetchBatchSize:[request fetchBatchSize]];
     }
     
+    SMRequestContext *requestContext = options ? [SMRequestContext requestContextWithOptions:options] : nil;
+    
     [backgroundContext performBlockAndWait:^{
-        
-        if (options) {
-            SMRequestOptions *newOptions = options;
-            NSMutableDictionary *threadDict = [[NSThread currentThread] threadDictionary];
-            [threadDict setObject:newOptions forKey:SMRequestSpecificOptions];
-        }
-        
-        resultsOfFetch = [backgroundContext executeFetchRequest:fetchCopy error:&fetchError];
-        
-        if (options) {
-            [[[NSThread currentThread] threadDictionary] removeObjectForKey:SMRequestSpecificOptions];
-        }
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:backgroundContext block:^{
+            resultsOfFetch = [backgroundContext executeFetchRequest:fetchCopy error:&fetchError];
+        }];
     }];
     
     if (fetchError && error != NULL) {
@@ -15,6 +15,7 @@
  */
 
 #import "SMDataStore.h"
+#import "SMRequestOptions.h"
 #import "SMSyncedObject.h"
 
 extern NSString *const SMSetCachePolicyNotification;
@@ -22,13 +23,6 @@ extern NSString *const SMDirtyQueueNotification;
 
 extern BOOL SM_CACHE_ENABLED;
 
-typedef enum {
-    SMCachePolicyTryNetworkOnly = 0,
-    SMCachePolicyTryCacheOnly  = 1,
-    SMCachePolicyTryNetworkElseCache = 2,
-    SMCachePolicyTryCacheElseNetwork = 3,
-} SMCachePolicy;
-
 typedef enum {
     SMClientObject = 0,
     SMServerObject = 1,
@@ -104,6 +98,15 @@ extern SMMergePolicy const SMMergePolicyServerModifiedWins;
  */
 @property (nonatomic) SMCachePolicy cachePolicy;
 
+/**
+ The maximum age, in seconds, of cached fetch results. Default is 0, meaning no max age.
+ 
+ When greater than 0, a fetch whose cached results were all confirmed against the server within the max age is answered from the cache without a network request. Use <setCacheMaxAge:forEntityName:> to set a max age for a specific entity.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) NSTimeInterval cacheMaxAge;
+
 /**
  The queue used to execute sync callbacks (success and failure).
  
@@ -133,6 +136,19 @@ extern SMMergePolicy const SMMergePolicyServerModifiedWins;
  */
 @property (nonatomic) BOOL sendLocalTimestamps;
 
+/**
+ Boolean indicating whether saves skip intermediate contexts on their way to the persistent store.  Default is NO.
+ 
+ By default a save on the mainThreadContext goes through a temporary child context, the mainThreadContext and its private parent context, and a save on a context returned by <contextForCurrentThread> goes through the mainThreadContext.  When this property is YES, a save on the mainThreadContext reaches the private parent context in one hop, and contexts returned by <contextForCurrentThread> are created as children of the private parent context, which saves them in one hop as well.  Changes saved that way are merged into the mainThreadContext afterwards.
+ 
+ Merge policies set with <setDefaultMergePolicy:applyToMainThreadContextAndParent:> are used by every context in the chain, as in the default mode.
+ 
+ @note Set this property before calling <contextForCurrentThread> on background threads, contexts already returned keep the parent they were created with.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic) BOOL savesDirectlyToStore;
+
 /**
  During sync, the global merge policy used to fix conflicts.
  
@@ -211,6 +227,7 @@ extern SMMergePolicy const SMMergePolicyServerModifiedWins;
  **Note:** Not all options provided by the SMRequestOptions class are taken into account during save/fetch requests.  The following options are currently safe to customize:
  
  * isSecure property (HTTPS)
+ * cachePolicy and cacheMaxAge properties
  
  Customizing other options can result in unexpected requests, which can lead to save/fetch failures.
  
@@ -243,7 +260,7 @@ extern SMMergePolicy const SMMergePolicyServerModifiedWins;
  
  Merge policy is set to NSMergeByPropertyObjectTrumpMergePolicy.
  
- If the current thread is the main thread, returns a context initialized with a NSMainQueueConcurrencyType.  Otherwise, returns a context initialized with a NSPrivateQueueConcurrencyType, with the mainThreadContext as its parent.
+ If the current thread is the main thread, returns a context initialized with a NSMainQueueConcurrencyType.  Otherwise, returns a context initialized with a NSPrivateQueueConcurrencyType, with the mainThreadContext as its parent, or the private parent context of the mainThreadContext if <savesDirectlyToStore> is YES.
  
  @since Available in iOS SDK 1.2.0 and later.
  */
@@ -275,6 +292,56 @@ extern SMMergePolicy const SMMergePolicyServerModifiedWins;
  */
 - (void)setDefaultCoreDataMergePolicy:(id)mergePolicy applyToMainThreadContextAndParent:(BOOL)apply;
 
+///-------------------------------
+/// @name Per Entity Cache Settings
+///-------------------------------
+
+/**
+ Sets the cache policy used during fetch requests for the given entity, in place of <cachePolicy>.
+ 
+ A cache policy set on the `SMRequestOptions` of a fetch takes precedence over the entity cache policy.
+ 
+ @param cachePolicy The cache policy to use for the entity.
+ @param entityName The name of the entity.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)setCachePolicy:(SMCachePolicy)cachePolicy forEntityName:(NSString *)entityName;
+
+/**
+ Returns the cache policy used during fetch requests for the given entity.
+ 
+ @param entityName The name of the entity.
+ 
+ @return The cache policy set for the entity, otherwise <cachePolicy>.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMCachePolicy)cachePolicyForEntityName:(NSString *)entityName;
+
+/**
+ Sets the maximum age, in seconds, of cached fetch results for the given entity, in place of <cacheMaxAge>.
+ 
+ Useful for reference data which rarely changes, so fetches hit the server at most once per interval.
+ 
+ @param maxAge The max age for the entity. Pass 0 to disable.
+ @param entityName The name of the entity.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (void)setCacheMaxAge:(NSTimeInterval)maxAge forEntityName:(NSString *)entityName;
+
+/**
+ Returns the maximum age of cached fetch results for the given entity.
+ 
+ @param entityName The name of the entity.
+ 
+ @return The max age set for the entity, otherwise <cacheMaxAge>.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (NSTimeInterval)cacheMaxAgeForEntityName:(NSString *)entityName;
+
 ///-------------------------------
 /// @name Manually Purging the Cache
 ///-------------------------------
@@ -71,6 +71,8 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
 @property (nonatomic, strong) id defaultCoreDataMergePolicy;
 @property (nonatomic) dispatch_queue_t cachePurgeQueue;
 @property (nonatomic, strong) NSArray *currentDirtyQueue;
+@property (nonatomic, strong) NSMutableDictionary *entityCachePolicies;
+@property (nonatomic, strong) NSMutableDictionary *entityCacheMaxAges;
 
 - (NSManagedObjectContext *)SM_newPrivateQueueContextWithParent:(NSManagedObjectContext *)parent;
 - (void)SM_didReceiveSetCachePolicyNotification:(NSNotification *)notification;
@@ -97,6 +99,10 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
 @synthesize syncInProgress = _syncInProgress;
 @synthesize currentDirtyQueue = _currentDirtyQueue;
 @synthesize sendLocalTimestamps = _sendLocalTimestamps;
+@synthesize savesDirectlyToStore = _savesDirectlyToStore;
+@synthesize cacheMaxAge = _cacheMaxAge;
+@synthesize entityCachePolicies = _entityCachePolicies;
+@synthesize entityCacheMaxAges = _entityCacheMaxAges;
 
 - (id)initWithAPIVersion:(NSString *)apiVersion session:(SMUserSession *)session managedObjectModel:(NSManagedObjectModel *)managedObjectModel
 {
@@ -111,6 +117,9 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
         
         /// Set default cache and merge policies
         [self setCachePolicy:SMCachePolicyTryNetworkOnly];
+        self.cacheMaxAge = 0;
+        self.entityCachePolicies = [NSMutableDictionary dictionary];
+        self.entityCacheMaxAges = [NSMutableDictionary dictionary];
         _defaultCoreDataMergePolicy = NSMergeByPropertyObjectTrumpMergePolicy;
         self.defaultSMMergePolicy = SMMergePolicyServerModifiedWins;
         self.insertsSMMergePolicy = nil;
@@ -141,6 +150,12 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
     return self;
 }
 
+- (void)dealloc
+{
+    // Child contexts can keep the private context, and its save notifications, alive after the store is gone
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 - (NSPersistentStoreCoordinator *)persistentStoreCoordinator
 {
     if (_persistentStoreCoordinator == nil) {
@@ -204,10 +219,36 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
     [context setMergePolicy:self.defaultCoreDataMergePolicy];
     [context setParentContext:parent];
     [context setContextShouldObtainPermanentIDsBeforeSaving:YES];
+    [context setContextSavesDirectlyToStore:self.savesDirectlyToStore];
     
     return context;
 }
 
+- (void)setSavesDirectlyToStore:(BOOL)savesDirectlyToStore
+{
+    if (savesDirectlyToStore != _savesDirectlyToStore) {
+        
+        _savesDirectlyToStore = savesDirectlyToStore;
+        
+        [self.mainThreadContext setContextSavesDirectlyToStore:savesDirectlyToStore];
+        
+        // Thread contexts save straight to the private context, so the main thread context has to pick up their changes
+        if (savesDirectlyToStore) {
+            [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(SM_mergePrivateContextSaveIntoMainThreadContext:) name:NSManagedObjectContextDidSaveNotification object:self.privateContext];
+        } else {
+            [[NSNotificationCenter defaultCenter] removeObserver:self name:NSManagedObjectContextDidSaveNotification object:self.privateContext];
+        }
+    }
+}
+
+- (void)SM_mergePrivateContextSaveIntoMainThreadContext:(NSNotification *)notification
+{
+    NSManagedObjectContext *mainThreadContext = self.mainThreadContext;
+    [mainThreadContext performBlock:^{
+        [mainThreadContext mergeChangesFromContextDidSaveNotification:notification];
+    }];
+}
+
 - (NSManagedObjectContext *)contextForCurrentThread
 {
     if ([NSThread isMainThread])
@@ -220,7 +261,7 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
 		NSManagedObjectContext *threadContext = [threadDict objectForKey:SM_ManagedObjectContextKey];
 		if (threadContext == nil)
 		{
-			threadContext = [self SM_newPrivateQueueContextWithParent:self.mainThreadContext];
+			threadContext = [self SM_newPrivateQueueContextWithParent:self.savesDirectlyToStore ? self.privateContext : self.mainThreadContext];
 			[threadDict setObject:threadContext forKey:SM_ManagedObjectContextKey];
 		}
 		return threadContext;
@@ -245,6 +286,40 @@ SMMergePolicy const SMMergePolicyServerModifiedWins = ^(NSDictionary *clientObje
     }
 }
 
+- (void)setCachePolicy:(SMCachePolicy)cachePolicy forEntityName:(NSString *)entityName
+{
+    @synchronized(self.entityCachePolicies) {
+        [self.entityCachePolicies setObject:[NSNumber numberWithInt:cachePolicy] forKey:entityName];
+    }
+}
+
+- (SMCachePolicy)cachePolicyForEntityName:(NSString *)entityName
+{
+    NSNumber *entityCachePolicy = nil;
+    @synchronized(self.entityCachePolicies) {
+        entityCachePolicy = [self.entityCachePolicies objectForKey:entityName];
+    }
+    
+    return entityCachePolicy ? [entityCachePolicy intValue] : self.cachePolicy;
+}
+
+- (void)setCacheMaxAge:(NSTimeInterval)maxAge forEntityName:(NSString *)entityName
+{
+    @synchronized(self.entityCacheMaxAges) {
+        [self.entityCacheMaxAges setObject:[NSNumber numberWithDouble:maxAge] forKey:entityName];
+    }
+}
+
+- (NSTimeInterval)cacheMaxAgeForEntityName:(NSString *)entityName
+{
+    NSNumber *entityCacheMaxAge = nil;
+    @synchronized(self.entityCacheMaxAges) {
+        entityCacheMaxAge = [self.entityCacheMaxAges objectForKey:entityName];
+    }
+    
+    return entityCacheMaxAge ? [entityCacheMaxAge doubleValue] : self.cacheMaxAge;
+}
+
 - (void)purgeCacheOfManagedObjectID:(NSManagedObjectID *)objectID
 {
     dispatch_async(self.cachePurgeQueue, ^{
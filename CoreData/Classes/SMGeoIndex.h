@@ -0,0 +1,53 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CoreLocation/CoreLocation.h>
+
+/*
+ Spatial index over the geo point fields of objects in the local cache, used to answer SMPredicate queries offline.
+ 
+ Points are kept per entity and StackMob field name, keyed by remote ID.  Lookups go through a sorted list of geohashes, so a radius or bounding box query only looks at the few geohash cells covering it instead of every cached object.  Results are only candidates as far as other predicates go, the caller filters them against the cache.
+ 
+ The points dictionary is a property list, so it can be written next to the cache map.  All methods are thread safe.
+ */
+@interface SMGeoIndex : NSObject
+
+// YES if points were set or removed since the index was created or markSaved was called
+@property (readonly, nonatomic) BOOL hasChanges;
+
+- (id)initWithPoints:(NSDictionary *)points;
+
+// entity name -> field -> remote ID -> [latitude, longitude]
+- (NSDictionary *)points;
+- (void)markSaved;
+
+- (void)setCoordinate:(CLLocationCoordinate2D)coordinate forRemoteID:(NSString *)remoteID field:(NSString *)field entityName:(NSString *)entityName;
+- (void)removeRemoteID:(NSString *)remoteID field:(NSString *)field entityName:(NSString *)entityName;
+- (void)removeRemoteID:(NSString *)remoteID entityName:(NSString *)entityName;
+- (void)removeAllPoints;
+
+// Remote IDs ordered by distance from coordinate, nearest first
+- (NSArray *)remoteIDsForEntityName:(NSString *)entityName field:(NSString *)field withinDistance:(CLLocationDistance)meters ofCoordinate:(CLLocationCoordinate2D)coordinate;
+- (NSArray *)remoteIDsForEntityName:(NSString *)entityName field:(NSString *)field nearCoordinate:(CLLocationCoordinate2D)coordinate;
+
+// Remote IDs in no particular order.  A box whose SW longitude is east of its NE longitude crosses the 180th meridian.
+- (NSArray *)remoteIDsForEntityName:(NSString *)entityName field:(NSString *)field withinBoundsWithSWCorner:(CLLocationCoordinate2D)sw andNECorner:(CLLocationCoordinate2D)ne;
+
+@end
+
+// Geohash of coordinate with precision characters, exposed for tests
+NSString *SMGeohashForCoordinate(CLLocationCoordinate2D coordinate, NSUInteger precision);
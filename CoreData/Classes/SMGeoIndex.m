@@ -0,0 +1,381 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "SMGeoIndex.h"
+
+#define SM_GEOHASH_PRECISION 10
+#define SM_EARTH_RADIUS_METERS 6371008.8
+#define SM_METERS_PER_DEGREE_LATITUDE (SM_EARTH_RADIUS_METERS * M_PI / 180.0)
+
+static const char SMGeohashAlphabet[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+NSString *SMGeohashForCoordinate(CLLocationCoordinate2D coordinate, NSUInteger precision)
+{
+    char hash[SM_GEOHASH_PRECISION + 1];
+    precision = MIN(precision, (NSUInteger)SM_GEOHASH_PRECISION);
+    
+    double latitudeRange[2] = {-90.0, 90.0};
+    double longitudeRange[2] = {-180.0, 180.0};
+    BOOL evenBit = YES;
+    int bit = 0;
+    int character = 0;
+    NSUInteger length = 0;
+    
+    while (length < precision) {
+        double *range = evenBit ? longitudeRange : latitudeRange;
+        double value = evenBit ? coordinate.longitude : coordinate.latitude;
+        double mid = (range[0] + range[1]) / 2.0;
+        character <<= 1;
+        if (value >= mid) {
+            character |= 1;
+            range[0] = mid;
+        } else {
+            range[1] = mid;
+        }
+        evenBit = !evenBit;
+        
+        if (++bit == 5) {
+            hash[length++] = SMGeohashAlphabet[character];
+            bit = 0;
+            character = 0;
+        }
+    }
+    hash[length] = '\0';
+    
+    return [NSString stringWithUTF8String:hash];
+}
+
+static CLLocationDistance SMGeoDistance(CLLocationCoordinate2D from, CLLocationCoordinate2D to)
+{
+    double fromLatitude = from.latitude * M_PI / 180.0;
+    double toLatitude = to.latitude * M_PI / 180.0;
+    double deltaLatitude = toLatitude - fromLatitude;
+    double deltaLongitude = (to.longitude - from.longitude) * M_PI / 180.0;
+    
+    double a = sin(deltaLatitude / 2.0) * sin(deltaLatitude / 2.0) + cos(fromLatitude) * cos(toLatitude) * sin(deltaLongitude / 2.0) * sin(deltaLongitude / 2.0);
+    return 2.0 * SM_EARTH_RADIUS_METERS * atan2(sqrt(a), sqrt(1.0 - a));
+}
+
+@interface SMGeoIndex ()
+
+@property (readwrite, nonatomic) BOOL hasChanges;
+@property (nonatomic, strong) NSMutableDictionary *pointsByEntity;
+@property (nonatomic, strong) NSMutableDictionary *sortedHashesByEntity;
+
+@end
+
+@implementation SMGeoIndex
+
+@synthesize hasChanges = _SM_hasChanges;
+@synthesize pointsByEntity = _SM_pointsByEntity;
+@synthesize sortedHashesByEntity = _SM_sortedHashesByEntity;
+
+- (id)init
+{
+    return [self initWithPoints:nil];
+}
+
+- (id)initWithPoints:(NSDictionary *)points
+{
+    self = [super init];
+    if (self) {
+        self.pointsByEntity = [NSMutableDictionary dictionary];
+        self.sortedHashesByEntity = [NSMutableDictionary dictionary];
+        self.hasChanges = NO;
+        
+        [points enumerateKeysAndObjectsUsingBlock:^(id entityName, id pointsForEntity, BOOL *stop) {
+            [pointsForEntity enumerateKeysAndObjectsUsingBlock:^(id field, id pointsForField, BOOL *stopField) {
+                NSMutableDictionary *mutablePoints = [NSMutableDictionary dictionaryWithDictionary:pointsForField];
+                NSMutableArray *sortedHashes = [NSMutableArray arrayWithCapacity:[mutablePoints count]];
+                [mutablePoints enumerateKeysAndObjectsUsingBlock:^(id remoteID, id point, BOOL *stopPoint) {
+                    [sortedHashes addObject:[self SM_hashKeyForPoint:point remoteID:remoteID]];
+                }];
+                [sortedHashes sortUsingSelector:@selector(compare:)];
+                
+                [[self SM_mutableDictionaryForKey:entityName in:self.pointsByEntity] setObject:mutablePoints forKey:field];
+                [[self SM_mutableDictionaryForKey:entityName in:self.sortedHashesByEntity] setObject:sortedHashes forKey:field];
+            }];
+        }];
+    }
+    
+    return self;
+}
+
+- (NSDictionary *)points
+{
+    @synchronized(self) {
+        NSMutableDictionary *points = [NSMutableDictionary dictionaryWithCapacity:[self.pointsByEntity count]];
+        [self.pointsByEntity enumerateKeysAndObjectsUsingBlock:^(id entityName, id pointsForEntity, BOOL *stop) {
+            NSMutableDictionary *fields = [NSMutableDictionary dictionaryWithCapacity:[pointsForEntity count]];
+            [pointsForEntity enumerateKeysAndObjectsUsingBlock:^(id field, id pointsForField, BOOL *stopField) {
+                [fields setObject:[NSDictionary dictionaryWithDictionary:pointsForField] forKey:field];
+            }];
+            [points setObject:fields forKey:entityName];
+        }];
+        return points;
+    }
+}
+
+- (void)markSaved
+{
+    @synchronized(self) {
+        self.hasChanges = NO;
+    }
+}
+
+- (void)setCoordinate:(CLLocationCoordinate2D)coordinate forRemoteID:(NSString *)remoteID field:(NSString *)field entityName:(NSString *)entityName
+{
+    if (!CLLocationCoordinate2DIsValid(coordinate)) {
+        [self removeRemoteID:remoteID field:field entityName:entityName];
+        return;
+    }
+    
+    NSArray *point = [NSArray arrayWithObjects:[NSNumber numberWithDouble:coordinate.latitude], [NSNumber numberWithDouble:coordinate.longitude], nil];
+    
+    @synchronized(self) {
+        NSMutableDictionary *pointsForField = [self SM_mutableDictionaryForKey:field in:[self SM_mutableDictionaryForKey:entityName in:self.pointsByEntity]];
+        NSArray *existingPoint = [pointsForField objectForKey:remoteID];
+        if ([existingPoint isEqualToArray:point]) {
+            return;
+        }
+        
+        NSMutableArray *sortedHashes = [self SM_sortedHashesForEntityName:entityName field:field];
+        if (existingPoint) {
+            [self SM_removeHashKey:[self SM_hashKeyForPoint:existingPoint remoteID:remoteID] from:sortedHashes];
+        }
+        
+        NSString *hashKey = [self SM_hashKeyForPoint:point remoteID:remoteID];
+        NSUInteger insertionIndex = [sortedHashes indexOfObject:hashKey inSortedRange:NSMakeRange(0, [sortedHashes count]) options:NSBinarySearchingInsertionIndex usingComparator:^NSComparisonResult(id obj1, id obj2) {
+            return [obj1 compare:obj2];
+        }];
+        [sortedHashes insertObject:hashKey atIndex:insertionIndex];
+        [pointsForField setObject:point forKey:remoteID];
+        self.hasChanges = YES;
+    }
+}
+
+- (void)removeRemoteID:(NSString *)remoteID field:(NSString *)field entityName:(NSString *)entityName
+{
+    @synchronized(self) {
+        NSMutableDictionary *pointsForField = [[self.pointsByEntity objectForKey:entityName] objectForKey:field];
+        NSArray *existingPoint = [pointsForField objectForKey:remoteID];
+        if (existingPoint) {
+            [self SM_removeHashKey:[self SM_hashKeyForPoint:existingPoint remoteID:remoteID] from:[self SM_sortedHashesForEntityName:entityName field:field]];
+            [pointsForField removeObjectForKey:remoteID];
+            self.hasChanges = YES;
+        }
+    }
+}
+
+- (void)removeRemoteID:(NSString *)remoteID entityName:(NSString *)entityName
+{
+    @synchronized(self) {
+        for (NSString *field in [[self.pointsByEntity objectForKey:entityName] allKeys]) {
+            [self removeRemoteID:remoteID field:field entityName:entityName];
+        }
+    }
+}
+
+- (void)removeAllPoints
+{
+    @synchronized(self) {
+        if ([self.pointsByEntity count] > 0) {
+            [self.pointsByEntity removeAllObjects];
+            [self.sortedHashesByEntity removeAllObjects];
+            self.hasChanges = YES;
+        }
+    }
+}
+
+- (NSArray *)remoteIDsForEntityName:(NSString *)entityName field:(NSString *)field withinDistance:(CLLocationDistance)meters ofCoordinate:(CLLocationCoordinate2D)coordinate
+{
+    // Bounding box of the circle, widened to every longitude near the poles
+    double latitudeDelta = meters / SM_METERS_PER_DEGREE_LATITUDE;
+    double minLatitude = MAX(coordinate.latitude - latitudeDelta, -90.0);
+    double maxLatitude = MIN(coordinate.latitude + latitudeDelta, 90.0);
+    double cosine = cos(MAX(fabs(minLatitude), fabs(maxLatitude)) * M_PI / 180.0);
+    double longitudeDelta = cosine > 0.0 ? latitudeDelta / cosine : 360.0;
+    
+    NSArray *candidates = nil;
+    if (longitudeDelta >= 180.0) {
+        candidates = [self SM_remoteIDsInBoxWithMinLatitude:minLatitude maxLatitude:maxLatitude minLongitude:-180.0 maxLongitude:180.0 entityName:entityName field:field];
+    } else {
+        CLLocationCoordinate2D sw = CLLocationCoordinate2DMake(minLatitude, [self SM_normalizedLongitude:coordinate.longitude - longitudeDelta]);
+        CLLocationCoordinate2D ne = CLLocationCoordinate2DMake(maxLatitude, [self SM_normalizedLongitude:coordinate.longitude + longitudeDelta]);
+        candidates = [self remoteIDsForEntityName:entityName field:field withinBoundsWithSWCorner:sw andNECorner:ne];
+    }
+    
+    return [self SM_remoteIDs:candidates entityName:entityName field:field sortedByDistanceFrom:coordinate maxDistance:meters];
+}
+
+- (NSArray *)remoteIDsForEntityName:(NSString *)entityName field:(NSString *)field nearCoordinate:(CLLocationCoordinate2D)coordinate
+{
+    NSArray *candidates = nil;
+    @synchronized(self) {
+        candidates = [[[self.pointsByEntity objectForKey:entityName] objectForKey:field] allKeys];
+    }
+    
+    return [self SM_remoteIDs:candidates entityName:entityName field:field sortedByDistanceFrom:coordinate maxDistance:DBL_MAX];
+}
+
+- (NSArray *)remoteIDsForEntityName:(NSString *)entityName field:(NSString *)field withinBoundsWithSWCorner:(CLLocationCoordinate2D)sw andNECorner:(CLLocationCoordinate2D)ne
+{
+    double minLatitude = MIN(sw.latitude, ne.latitude);
+    double maxLatitude = MAX(sw.latitude, ne.latitude);
+    
+    if (sw.longitude <= ne.longitude) {
+        return [self SM_remoteIDsInBoxWithMinLatitude:minLatitude maxLatitude:maxLatitude minLongitude:sw.longitude maxLongitude:ne.longitude entityName:entityName field:field];
+    }
+    
+    // Split a box crossing the 180th meridian in two
+    NSArray *west = [self SM_remoteIDsInBoxWithMinLatitude:minLatitude maxLatitude:maxLatitude minLongitude:sw.longitude maxLongitude:180.0 entityName:entityName field:field];
+    NSArray *east = [self SM_remoteIDsInBoxWithMinLatitude:minLatitude maxLatitude:maxLatitude minLongitude:-180.0 maxLongitude:ne.longitude entityName:entityName field:field];
+    return [west arrayByAddingObjectsFromArray:east];
+}
+
+#pragma mark - Private
+
+- (NSArray *)SM_remoteIDsInBoxWithMinLatitude:(double)minLatitude maxLatitude:(double)maxLatitude minLongitude:(double)minLongitude maxLongitude:(double)maxLongitude entityName:(NSString *)entityName field:(NSString *)field
+{
+    // Finest precision whose cells are at least as big as the box, so at most 2 x 2 cells cover it
+    NSUInteger precision = SM_GEOHASH_PRECISION;
+    while (precision > 0) {
+        NSUInteger bits = precision * 5;
+        double cellWidth = 360.0 / pow(2.0, (bits + 1) / 2);
+        double cellHeight = 180.0 / pow(2.0, bits / 2);
+        if (cellWidth >= maxLongitude - minLongitude && cellHeight >= maxLatitude - minLatitude) {
+            break;
+        }
+        precision--;
+    }
+    
+    NSMutableSet *prefixes = [NSMutableSet setWithCapacity:4];
+    if (precision == 0) {
+        [prefixes addObject:@""];
+    } else {
+        [prefixes addObject:SMGeohashForCoordinate(CLLocationCoordinate2DMake(minLatitude, minLongitude), precision)];
+        [prefixes addObject:SMGeohashForCoordinate(CLLocationCoordinate2DMake(minLatitude, maxLongitude), precision)];
+        [prefixes addObject:SMGeohashForCoordinate(CLLocationCoordinate2DMake(maxLatitude, minLongitude), precision)];
+        [prefixes addObject:SMGeohashForCoordinate(CLLocationCoordinate2DMake(maxLatitude, maxLongitude), precision)];
+    }
+    
+    NSMutableArray *remoteIDs = [NSMutableArray array];
+    
+    @synchronized(self) {
+        NSArray *sortedHashes = [[self.sortedHashesByEntity objectForKey:entityName] objectForKey:field];
+        NSDictionary *pointsForField = [[self.pointsByEntity objectForKey:entityName] objectForKey:field];
+        
+        for (NSString *prefix in prefixes) {
+            NSUInteger index = [sortedHashes indexOfObject:prefix inSortedRange:NSMakeRange(0, [sortedHashes count]) options:NSBinarySearchingInsertionIndex usingComparator:^NSComparisonResult(id obj1, id obj2) {
+                return [obj1 compare:obj2];
+            }];
+            
+            for (; index < [sortedHashes count]; index++) {
+                NSString *hashKey = [sortedHashes objectAtIndex:index];
+                if ([prefix length] > 0 && ![hashKey hasPrefix:prefix]) {
+                    break;
+                }
+                
+                NSString *remoteID = [hashKey substringFromIndex:SM_GEOHASH_PRECISION];
+                NSArray *point = [pointsForField objectForKey:remoteID];
+                double latitude = [[point objectAtIndex:0] doubleValue];
+                double longitude = [[point objectAtIndex:1] doubleValue];
+                if (latitude >= minLatitude && latitude <= maxLatitude && longitude >= minLongitude && longitude <= maxLongitude) {
+                    [remoteIDs addObject:remoteID];
+                }
+            }
+        }
+    }
+    
+    return remoteIDs;
+}
+
+- (NSArray *)SM_remoteIDs:(NSArray *)remoteIDs entityName:(NSString *)entityName field:(NSString *)field sortedByDistanceFrom:(CLLocationCoordinate2D)coordinate maxDistance:(CLLocationDistance)maxDistance
+{
+    NSMutableArray *remoteIDsInRange = [NSMutableArray arrayWithCapacity:[remoteIDs count]];
+    NSMutableDictionary *distances = [NSMutableDictionary dictionaryWithCapacity:[remoteIDs count]];
+    
+    @synchronized(self) {
+        NSDictionary *pointsForField = [[self.pointsByEntity objectForKey:entityName] objectForKey:field];
+        for (NSString *remoteID in remoteIDs) {
+            NSArray *point = [pointsForField objectForKey:remoteID];
+            CLLocationCoordinate2D pointCoordinate = CLLocationCoordinate2DMake([[point objectAtIndex:0] doubleValue], [[point objectAtIndex:1] doubleValue]);
+            CLLocationDistance distance = SMGeoDistance(coordinate, pointCoordinate);
+            if (distance <= maxDistance) {
+                [remoteIDsInRange addObject:remoteID];
+                [distances setObject:[NSNumber numberWithDouble:distance] forKey:remoteID];
+            }
+        }
+    }
+    
+    [remoteIDsInRange sortUsingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return [[distances objectForKey:obj1] compare:[distances objectForKey:obj2]];
+    }];
+    
+    return remoteIDsInRange;
+}
+
+- (NSString *)SM_hashKeyForPoint:(NSArray *)point remoteID:(NSString *)remoteID
+{
+    CLLocationCoordinate2D coordinate = CLLocationCoordinate2DMake([[point objectAtIndex:0] doubleValue], [[point objectAtIndex:1] doubleValue]);
+    return [SMGeohashForCoordinate(coordinate, SM_GEOHASH_PRECISION) stringByAppendingString:remoteID];
+}
+
+- (void)SM_removeHashKey:(NSString *)hashKey from:(NSMutableArray *)sortedHashes
+{
+    NSUInteger index = [sortedHashes indexOfObject:hashKey inSortedRange:NSMakeRange(0, [sortedHashes count]) options:NSBinarySearchingFirstEqual usingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return [obj1 compare:obj2];
+    }];
+    if (index != NSNotFound) {
+        [sortedHashes removeObjectAtIndex:index];
+    }
+}
+
+- (NSMutableArray *)SM_sortedHashesForEntityName:(NSString *)entityName field:(NSString *)field
+{
+    NSMutableDictionary *hashesForEntity = [self SM_mutableDictionaryForKey:entityName in:self.sortedHashesByEntity];
+    NSMutableArray *sortedHashes = [hashesForEntity objectForKey:field];
+    if (!sortedHashes) {
+        sortedHashes = [NSMutableArray array];
+        [hashesForEntity setObject:sortedHashes forKey:field];
+    }
+    
+    return sortedHashes;
+}
+
+- (NSMutableDictionary *)SM_mutableDictionaryForKey:(NSString *)key in:(NSMutableDictionary *)dictionary
+{
+    NSMutableDictionary *value = [dictionary objectForKey:key];
+    if (!value) {
+        value = [NSMutableDictionary dictionary];
+        [dictionary setObject:value forKey:key];
+    }
+    
+    return value;
+}
+
+- (double)SM_normalizedLongitude:(double)longitude
+{
+    if (longitude > 180.0) {
+        return longitude - 360.0;
+    } else if (longitude < -180.0) {
+        return longitude + 360.0;
+    }
+    
+    return longitude;
+}
+
+@end
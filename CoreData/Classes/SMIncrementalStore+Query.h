@@ -49,5 +49,19 @@
                   predicate:(NSPredicate *)predicate
                       error:(NSError *__autoreleasing *)error;
 
+/**
+ Given a fetch request with `NSDictionaryResultType`, returns the equivalent aggregate query to be sent to StackMob.
+ 
+ Expression descriptions in `propertiesToFetch` must be `count:`, `sum:`, `average:`, `min:` or `max:` of a single key path, and become aggregates named after the description.  The other properties to fetch become group-by fields when the request has `propertiesToGroupBy`, `returnsDistinctResults` or any aggregates, with `propertiesToGroupBy` taking precedence.
+ 
+ @param fetchRequest The fetch request to be translated.
+ @param error If an error occurs during the translation, it is placed here as an instance of `SMError`.
+ 
+ @return An instance of `SMQuery` with aggregates or group-by fields.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (SMQuery *)aggregateQueryForFetchRequest:(NSFetchRequest *)fetchRequest
+                                     error:(NSError *__autoreleasing *)error;
 
 @end
@@ -19,12 +19,60 @@
 #import "SMError.h"
 #import "SMPredicate.h"
 
+#define QUERY_PLAN_SLOT_FORMAT @"$SMQueryPlanSlot%lu$"
+
+typedef enum {
+    SMQueryPlanEqualitySlot,
+    SMQueryPlanBooleanEqualitySlot,
+    SMQueryPlanComparisonSlot,
+    SMQueryPlanBetweenLowSlot,
+    SMQueryPlanBetweenHighSlot,
+    SMQueryPlanInSlot
+} SMQueryPlanSlotType;
+
+/*
+ The query for one shape of fetch request, built with a placeholder in place of each constant of the predicate.  Binding the constants of a fetch request with the same shape only replaces the parameters the placeholders ended up in.
+ */
+@interface SMQueryPlan : NSObject
+
+@property (nonatomic, strong) NSDictionary *requestParameters;
+@property (nonatomic, strong) NSDictionary *requestHeaders;
+
+// [constant index, SMQueryPlanSlotType] for each placeholder
+@property (nonatomic, strong) NSArray *slots;
+
+// The parameter each placeholder ended up in
+@property (nonatomic, strong) NSArray *parameterKeys;
+
+@end
+
+@implementation SMQueryPlan
+
+@synthesize requestParameters = _SM_requestParameters;
+@synthesize requestHeaders = _SM_requestHeaders;
+@synthesize slots = _SM_slots;
+@synthesize parameterKeys = _SM_parameterKeys;
+
+@end
+
+@interface SMQuery (Marshal)
+
+- (id)marshalValue:(id)value;
+
+@end
+
 @implementation SMIncrementalStore (Query)
 
 - (SMQuery *)queryForEntity:(NSEntityDescription *)entityDescription
                   predicate:(NSPredicate *)predicate
                       error:(NSError *__autoreleasing *)error {
     
+    NSMutableArray *constants = [NSMutableArray array];
+    SMQueryPlan *plan = [self SM_queryPlanForEntity:entityDescription predicate:predicate sortDescriptors:nil constants:constants];
+    if (plan) {
+        return [self SM_queryForEntity:entityDescription plan:plan constants:constants];
+    }
+    
     SMQuery *query = [[SMQuery alloc] initWithEntity:entityDescription];
     [self buildQuery:&query forPredicate:predicate error:error];
     
@@ -34,13 +82,20 @@
 - (SMQuery *)queryForFetchRequest:(NSFetchRequest *)fetchRequest
                             error:(NSError *__autoreleasing *)error {
     
-    SMQuery *query = [self queryForEntity:fetchRequest.entity
-                                predicate:fetchRequest.predicate
-                                    error:error];
+    NSMutableArray *constants = [NSMutableArray array];
+    SMQueryPlan *plan = [self SM_queryPlanForEntity:fetchRequest.entity predicate:fetchRequest.predicate sortDescriptors:fetchRequest.sortDescriptors constants:constants];
     
-    if (*error != nil) {
-        *error = (__bridge id)(__bridge_retained CFTypeRef)*error;
-        return nil;
+    SMQuery *query = nil;
+    if (plan) {
+        query = [self SM_queryForEntity:fetchRequest.entity plan:plan constants:constants];
+    } else {
+        query = [[SMQuery alloc] initWithEntity:fetchRequest.entity];
+        [self buildQuery:&query forPredicate:fetchRequest.predicate error:error];
+        
+        if (*error != nil) {
+            *error = (__bridge id)(__bridge_retained CFTypeRef)*error;
+            return nil;
+        }
     }
     
     // Limit / pagination
@@ -63,21 +118,360 @@
         [[query requestHeaders] setValue:rangeHeader forKey:@"Range"];
     }
     
-    // Ordering
+    // Ordering, already part of the plan
+    
+    if (!plan) {
+        [self SM_orderQuery:query bySortDescriptors:fetchRequest.sortDescriptors];
+    }
+    
+    return query;
+}
+
+- (SMQuery *)aggregateQueryForFetchRequest:(NSFetchRequest *)fetchRequest
+                                     error:(NSError *__autoreleasing *)error {
+    
+    NSEntityDescription *entity = fetchRequest.entity;
+    NSError *queryError = nil;
+    SMQuery *query = [self queryForEntity:entity predicate:fetchRequest.predicate error:&queryError];
+    if (queryError) {
+        if (error != NULL) {
+            *error = (__bridge id)(__bridge_retained CFTypeRef)queryError;
+        }
+        return nil;
+    }
+    
+    NSMutableArray *fetchedProperties = [NSMutableArray array];
+    for (id property in fetchRequest.propertiesToFetch) {
+        if (![property isKindOfClass:[NSExpressionDescription class]]) {
+            [fetchedProperties addObject:property];
+            continue;
+        }
+        
+        NSExpression *expression = [(NSExpressionDescription *)property expression];
+        NSDictionary *functions = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [NSNumber numberWithInt:SMAggregateCount], @"count:",
+                                   [NSNumber numberWithInt:SMAggregateSum], @"sum:",
+                                   [NSNumber numberWithInt:SMAggregateAverage], @"average:",
+                                   [NSNumber numberWithInt:SMAggregateMin], @"min:",
+                                   [NSNumber numberWithInt:SMAggregateMax], @"max:", nil];
+        NSNumber *function = [expression expressionType] == NSFunctionExpressionType ? [functions objectForKey:[expression function]] : nil;
+        NSExpression *argument = [[expression arguments] count] == 1 ? [[expression arguments] lastObject] : nil;
+        
+        // count:(SELF) counts the objects, every other aggregate needs an attribute
+        NSString *keyPath = [argument expressionType] == NSKeyPathExpressionType ? [argument keyPath] : nil;
+        BOOL countsObjects = [function intValue] == SMAggregateCount && [argument expressionType] == NSEvaluatedObjectExpressionType;
+        if (!function || (!countsObjects && ![[entity attributesByName] objectForKey:keyPath])) {
+            [self setError:error withReason:[NSString stringWithFormat:@"Expression %@ not supported, only count:, sum:, average:, min: and max: of a single attribute are", expression]];
+            return nil;
+        }
+        
+        NSString *field = countsObjects ? nil : [self convertPredicateExpressionToStackMobFieldName:keyPath entity:entity];
+        [query aggregate:[function intValue] ofField:field as:[property name]];
+    }
+    
+    NSArray *groupByProperties = nil;
+    if ([fetchRequest.propertiesToGroupBy count] > 0) {
+        groupByProperties = fetchRequest.propertiesToGroupBy;
+    } else if (fetchRequest.returnsDistinctResults || [query.aggregates count] > 0) {
+        groupByProperties = fetchedProperties;
+    }
+    
+    for (id property in groupByProperties) {
+        NSString *propertyName = [property isKindOfClass:[NSPropertyDescription class]] ? [property name] : property;
+        if (![propertyName isKindOfClass:[NSString class]] || ![[entity propertiesByName] objectForKey:propertyName]) {
+            [self setError:error withReason:[NSString stringWithFormat:@"Group by property %@ not supported, only attributes and to-one relationships of %@ are", property, [entity name]]];
+            return nil;
+        }
+        NSRelationshipDescription *relationship = [[entity relationshipsByName] objectForKey:propertyName];
+        if ([relationship isToMany]) {
+            [self setError:error withReason:[NSString stringWithFormat:@"Group by to-many relationship %@ not supported", propertyName]];
+            return nil;
+        }
+        [query groupByField:[self convertPredicateExpressionToStackMobFieldName:propertyName entity:entity]];
+    }
+    
+    if (![query isAggregateQuery]) {
+        [self setError:error withReason:@"NSFetchRequest has no aggregates, distinct results or properties to group by"];
+        return nil;
+    }
+    
+    if (fetchRequest.havingPredicate) {
+        [self setError:error withReason:@"NSFetchRequest havingPredicate not supported"];
+        return nil;
+    }
     
-    [fetchRequest.sortDescriptors enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
+    return query;
+}
+
+- (void)SM_orderQuery:(SMQuery *)query bySortDescriptors:(NSArray *)sortDescriptors
+{
+    [sortDescriptors enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
         NSString *fieldName = nil;
         if ([[obj key] rangeOfCharacterFromSet:[NSCharacterSet uppercaseLetterCharacterSet]].location != NSNotFound) {
-            fieldName = [self convertPredicateExpressionToStackMobFieldName:[obj key] entity:fetchRequest.entity];
+            fieldName = [self convertPredicateExpressionToStackMobFieldName:[obj key] entity:[query entity]];
         } else {
             fieldName = [obj key];
         }
         [query orderByField:fieldName ascending:[obj ascending]];
     }];
+}
+
+////////////////////////////
+#pragma mark - Query Plans
+////////////////////////////
+
+/*
+ Returns the plan for the shape of the predicate and sort descriptors, compiling it if it isn't cached, and fills constants with the values to bind into it.  Returns nil if the predicate can't be planned, in which case it should be translated directly so any error is reported as usual.
+ */
+- (SMQueryPlan *)SM_queryPlanForEntity:(NSEntityDescription *)entity predicate:(NSPredicate *)predicate sortDescriptors:(NSArray *)sortDescriptors constants:(NSMutableArray *)constants
+{
+    NSMutableString *planKey = [NSMutableString stringWithFormat:@"%@ WHERE ", [entity name]];
+    if (predicate && ![self SM_appendQueryPlanKeyForPredicate:predicate entity:entity toKey:planKey constants:constants slots:nil templatePredicate:NULL]) {
+        return nil;
+    }
+    for (NSSortDescriptor *sortDescriptor in sortDescriptors) {
+        [planKey appendFormat:@" ORDER BY %@ %d", [sortDescriptor key], [sortDescriptor ascending]];
+    }
+    
+    SMQueryPlan *plan = [[self SM_queryPlanCache] objectForKey:planKey];
+    if (plan) {
+        return plan;
+    }
+    
+    // Build the query with a placeholder for each constant
+    NSMutableArray *slots = [NSMutableArray array];
+    NSPredicate *templatePredicate = nil;
+    if (predicate) {
+        [constants removeAllObjects];
+        [self SM_appendQueryPlanKeyForPredicate:predicate entity:entity toKey:[NSMutableString string] constants:constants slots:slots templatePredicate:&templatePredicate];
+    }
+    
+    SMQuery *query = [[SMQuery alloc] initWithEntity:entity];
+    NSError *planError = nil;
+    @try {
+        [self buildQuery:&query forPredicate:templatePredicate error:&planError];
+        [self SM_orderQuery:query bySortDescriptors:sortDescriptors];
+    }
+    @catch (NSException *exception) {
+        return nil;
+    }
+    if (planError) {
+        return nil;
+    }
+    
+    // Find the parameter each placeholder ended up in.  Placeholders that were merged away can't be bound, so the predicate is left unplanned.
+    NSMutableArray *parameterKeys = [NSMutableArray arrayWithCapacity:[slots count]];
+    NSMutableDictionary *slotIndexesByPlaceholder = [NSMutableDictionary dictionaryWithCapacity:[slots count]];
+    for (NSUInteger i = 0; i < [slots count]; i++) {
+        [parameterKeys addObject:[NSNull null]];
+        [slotIndexesByPlaceholder setObject:[NSNumber numberWithUnsignedInteger:i] forKey:[NSString stringWithFormat:QUERY_PLAN_SLOT_FORMAT, (unsigned long)i]];
+    }
+    [[query requestParameters] enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        NSNumber *slotIndex = [obj isKindOfClass:[NSString class]] ? [slotIndexesByPlaceholder objectForKey:obj] : nil;
+        if (slotIndex) {
+            [parameterKeys replaceObjectAtIndex:[slotIndex unsignedIntegerValue] withObject:key];
+        }
+    }];
+    if ([parameterKeys containsObject:[NSNull null]]) {
+        return nil;
+    }
+    
+    plan = [[SMQueryPlan alloc] init];
+    plan.requestParameters = [query requestParameters];
+    plan.requestHeaders = [query requestHeaders];
+    plan.slots = slots;
+    plan.parameterKeys = parameterKeys;
+    [[self SM_queryPlanCache] setObject:plan forKey:planKey];
+    
+    return plan;
+}
+
+- (SMQuery *)SM_queryForEntity:(NSEntityDescription *)entity plan:(SMQueryPlan *)plan constants:(NSArray *)constants
+{
+    SMQuery *query = [[SMQuery alloc] initWithEntity:entity];
+    
+    NSMutableDictionary *requestParameters = [plan.requestParameters mutableCopy];
+    [plan.slots enumerateObjectsUsingBlock:^(id slot, NSUInteger idx, BOOL *stop) {
+        id constant = [constants objectAtIndex:[[slot objectAtIndex:0] unsignedIntegerValue]];
+        id value = [self SM_queryValueForConstant:constant slotType:[[slot objectAtIndex:1] intValue] query:query];
+        [requestParameters setObject:value forKey:[plan.parameterKeys objectAtIndex:idx]];
+    }];
+    
+    query.requestParameters = requestParameters;
+    query.requestHeaders = [plan.requestHeaders mutableCopy];
     
     return query;
 }
 
+/*
+ The value buildQuery:forComparisonPredicate:error: would have set for the constant.
+ */
+- (id)SM_queryValueForConstant:(id)constant slotType:(SMQueryPlanSlotType)slotType query:(SMQuery *)query
+{
+    switch (slotType) {
+        case SMQueryPlanBooleanEqualitySlot:
+            if (constant == [NSNumber numberWithBool:YES]) {
+                return @"true";
+            } else if (constant == [NSNumber numberWithBool:NO]) {
+                return @"false";
+            }
+            return [query marshalValue:constant];
+        case SMQueryPlanEqualitySlot:
+            if ([constant isKindOfClass:[NSManagedObject class]]) {
+                constant = [self referenceObjectForObjectID:[constant objectID]];
+            } else if ([constant isKindOfClass:[NSManagedObjectID class]]) {
+                constant = [self referenceObjectForObjectID:constant];
+            }
+            return [query marshalValue:constant];
+        case SMQueryPlanBetweenLowSlot:
+            return [query marshalValue:[constant objectAtIndex:0]];
+        case SMQueryPlanBetweenHighSlot:
+            return [query marshalValue:[constant objectAtIndex:1]];
+        case SMQueryPlanInSlot:
+            return [constant componentsJoinedByString:@","];
+        default:
+            return [query marshalValue:constant];
+    }
+}
+
+/*
+ Appends the shape of the predicate to key, with every constant that can be bound later left out and added to constants instead.  When slots is given, a slot is recorded for each placeholder and the predicate with the placeholders is returned in templatePredicate.  Returns NO for predicates that can't be planned.
+ */
+- (BOOL)SM_appendQueryPlanKeyForPredicate:(NSPredicate *)predicate entity:(NSEntityDescription *)entity toKey:(NSMutableString *)key constants:(NSMutableArray *)constants slots:(NSMutableArray *)slots templatePredicate:(NSPredicate **)templatePredicate
+{
+    if ([predicate isKindOfClass:[SMPredicate class]]) {
+        // Geo queries are formatted with their coordinates, so they are planned by value
+        [key appendFormat:@"{%d %@}", (int)[(SMPredicate *)predicate sm_predicateOperatorType], [(SMPredicate *)predicate predicateDictionary]];
+        if (templatePredicate) {
+            *templatePredicate = predicate;
+        }
+        return YES;
+    }
+    
+    if ([predicate isKindOfClass:[NSCompoundPredicate class]]) {
+        NSCompoundPredicate *compoundPredicate = (NSCompoundPredicate *)predicate;
+        if ([compoundPredicate compoundPredicateType] == NSNotPredicateType) {
+            return NO;
+        }
+        
+        [key appendString:[compoundPredicate compoundPredicateType] == NSAndPredicateType ? @"(AND" : @"(OR"];
+        NSMutableArray *subpredicateTemplates = templatePredicate ? [NSMutableArray array] : nil;
+        for (NSPredicate *subpredicate in [compoundPredicate subpredicates]) {
+            [key appendString:@" "];
+            NSPredicate *subpredicateTemplate = nil;
+            if (![self SM_appendQueryPlanKeyForPredicate:subpredicate entity:entity toKey:key constants:constants slots:slots templatePredicate:templatePredicate ? &subpredicateTemplate : NULL]) {
+                return NO;
+            }
+            [subpredicateTemplates addObject:subpredicateTemplate];
+        }
+        [key appendString:@")"];
+        
+        if (templatePredicate) {
+            *templatePredicate = [[NSCompoundPredicate alloc] initWithType:[compoundPredicate compoundPredicateType] subpredicates:subpredicateTemplates];
+        }
+        return YES;
+    }
+    
+    if (![predicate isKindOfClass:[NSComparisonPredicate class]]) {
+        return NO;
+    }
+    
+    NSComparisonPredicate *comparisonPredicate = (NSComparisonPredicate *)predicate;
+    if (comparisonPredicate.leftExpression.expressionType != NSKeyPathExpressionType || comparisonPredicate.rightExpression.expressionType != NSConstantValueExpressionType) {
+        return NO;
+    }
+    
+    NSString *keyPath = comparisonPredicate.leftExpression.keyPath;
+    id rhs = comparisonPredicate.rightExpression.constantValue;
+    id templateValue = nil;
+    [key appendFormat:@"%@ %d ", keyPath, (int)comparisonPredicate.predicateOperatorType];
+    
+    switch (comparisonPredicate.predicateOperatorType) {
+        case NSEqualToPredicateOperatorType:
+        case NSNotEqualToPredicateOperatorType:
+            // nil and empty strings are sent as different parameters, so they are part of the shape
+            if (rhs == nil) {
+                [key appendString:@"nil"];
+            } else if ([rhs isEqual:@""]) {
+                [key appendString:@"empty"];
+                templateValue = rhs;
+            } else {
+                NSAttributeDescription *attributeDesc = [[entity attributesByName] objectForKey:keyPath];
+                BOOL isBoolean = attributeDesc != nil && [attributeDesc attributeType] == NSBooleanAttributeType;
+                templateValue = [self SM_addQueryPlanSlotForConstant:rhs type:(isBoolean ? SMQueryPlanBooleanEqualitySlot : SMQueryPlanEqualitySlot) constants:constants slots:slots];
+            }
+            break;
+        case NSLessThanPredicateOperatorType:
+        case NSLessThanOrEqualToPredicateOperatorType:
+        case NSGreaterThanPredicateOperatorType:
+        case NSGreaterThanOrEqualToPredicateOperatorType:
+            // Left to the builder, which refuses nil for comparisons
+            if (rhs == nil) {
+                return NO;
+            }
+            templateValue = [self SM_addQueryPlanSlotForConstant:rhs type:SMQueryPlanComparisonSlot constants:constants slots:slots];
+            break;
+        case NSBetweenPredicateOperatorType: {
+            if (![rhs isKindOfClass:[NSArray class]] || [rhs count] < 2) {
+                return NO;
+            }
+            // Both bounds are read from the same array constant, so the high slot points at the index the low slot added
+            NSString *lowPlaceholder = [self SM_addQueryPlanSlotForConstant:rhs type:SMQueryPlanBetweenLowSlot constants:constants slots:slots];
+            NSString *highPlaceholder = [self SM_addQueryPlanSlotForConstantAtIndex:[constants count] - 1 type:SMQueryPlanBetweenHighSlot slots:slots];
+            templateValue = [NSArray arrayWithObjects:lowPlaceholder, highPlaceholder, nil];
+            break;
+        }
+        case NSInPredicateOperatorType:
+            if (![rhs isKindOfClass:[NSArray class]]) {
+                return NO;
+            }
+            templateValue = [NSArray arrayWithObject:[self SM_addQueryPlanSlotForConstant:rhs type:SMQueryPlanInSlot constants:constants slots:slots]];
+            break;
+        default:
+            return NO;
+    }
+    [key appendString:@"$"];
+    
+    if (templatePredicate) {
+        *templatePredicate = [NSComparisonPredicate predicateWithLeftExpression:comparisonPredicate.leftExpression
+                                                                rightExpression:[NSExpression expressionForConstantValue:templateValue]
+                                                                       modifier:comparisonPredicate.comparisonPredicateModifier
+                                                                           type:comparisonPredicate.predicateOperatorType
+                                                                        options:comparisonPredicate.options];
+    }
+    
+    return YES;
+}
+
+/*
+ Adds constant to constants and returns the placeholder for it when slots are being recorded.
+ */
+- (NSString *)SM_addQueryPlanSlotForConstant:(id)constant type:(SMQueryPlanSlotType)type constants:(NSMutableArray *)constants slots:(NSMutableArray *)slots
+{
+    [constants addObject:constant];
+    
+    return [self SM_addQueryPlanSlotForConstantAtIndex:[constants count] - 1 type:type slots:slots];
+}
+
+/*
+ Records a slot for the constant already at index in constants and returns its placeholder, or nil when slots aren't being recorded.
+ */
+- (NSString *)SM_addQueryPlanSlotForConstantAtIndex:(NSUInteger)index type:(SMQueryPlanSlotType)type slots:(NSMutableArray *)slots
+{
+    if (!slots) {
+        return nil;
+    }
+    
+    NSString *placeholder = [NSString stringWithFormat:QUERY_PLAN_SLOT_FORMAT, (unsigned long)[slots count]];
+    [slots addObject:[NSArray arrayWithObjects:[NSNumber numberWithUnsignedInteger:index], [NSNumber numberWithInt:type], nil]];
+    
+    return placeholder;
+}
+
+////////////////////////////
+#pragma mark - Building Queries
+////////////////////////////
+
 - (NSString *)convertPredicateExpressionToStackMobFieldName:(NSString *)keyPath entity:(NSEntityDescription *)entity
 {
     NSPropertyDescription *property = [[entity propertiesByName] objectForKey:keyPath];
@@ -16,6 +16,8 @@
 
 #import <CoreData/CoreData.h>
 
+@class SMRequestOptions;
+
 extern NSString *const SMIncrementalStoreType;
 extern NSString *const SM_DataStoreKey;
 extern NSString *const SMInsertedObjectFailures;
@@ -23,6 +25,9 @@ extern NSString *const SMUpdatedObjectFailures;
 extern NSString *const SMDeletedObjectFailures;
 extern NSString *const SMFailedManagedObjectID;
 extern NSString *const SMFailedManagedObjectError;
+extern NSString *const SMSaveUnitResults;
+extern NSString *const SMSaveUnitObjectIDs;
+extern NSString *const SMSaveUnitError;
 
 extern NSString *const SMPurgeObjectFromCacheNotification;
 extern NSString *const SMPurgeObjectsFromCacheNotification;
@@ -33,7 +38,6 @@ extern NSString *const SMCachePurgeArrayOfManageObjectIDs;
 extern NSString *const SMCachePurgeOfObjectsFromEntityName;
 
 extern NSString *const SMThreadDefaultOptions;
-extern NSString *const SMRequestSpecificOptions;
 
 extern NSString *const SMFailedRefreshBlock;
 
@@ -68,7 +72,11 @@ extern unsigned int SM_MAX_LOG_LENGTH;
  * `obtainPermanentIDsForObjects:error:`
  
  For more information on each method and StackMob's implementation see `SMIncrementalStore.m`.
- 
+
+ ## Saving ##
+
+ The objects of a save are split into units of objects that reference each other, and units are sent to StackMob concurrently.  When a unit fails, the others may still have been saved, so the save error's `userInfo` holds `SMSaveUnitResults`: one dictionary per unit, with the unit's object IDs under `SMSaveUnitObjectIDs` and, only if the unit failed, its error under `SMSaveUnitError`.
+
  ## References ##
  
  [Apple's NSIncrementalStore class reference](http://developer.apple.com/library/ios/documentation/CoreData/Reference/NSIncrementalStore_Class/Reference/NSIncrementalStore.html)
@@ -78,6 +86,9 @@ extern unsigned int SM_MAX_LOG_LENGTH;
 @interface SMIncrementalStore : NSIncrementalStore
 
 
-- (BOOL)SM_checkNetworkAvailability;
+- (BOOL)SM_checkNetworkAvailabilityWithOptions:(SMRequestOptions *)options;
+- (BOOL)SM_fetchRequestGoesToNetwork:(NSFetchRequest *)fetchRequest options:(SMRequestOptions *)options;
+- (void)SM_performNetworkFetch:(NSFetchRequest *)fetchRequest options:(SMRequestOptions *)options onCompletion:(void (^)(NSArray *results, NSError *error))completionBlock;
+- (NSCache *)SM_queryPlanCache;
 
 @end
@@ -22,15 +22,23 @@
 #import "StackMob.h"
 #import "KeychainWrapper.h"
 #import "SMDataStore+Protected.h"
+#import "SMMetrics+Protected.h"
 #import "AFHTTPClient.h"
 #import "SMIncrementalStoreNode.h"
 #import "SMSyncedObject.h"
+#import "SMGeoIndex.h"
 #import "FileManagement.h"
 #import "Common.h"
 
-#define CACHE_MAP_FILE @"CacheMap.plist"
+#define CACHE_MAP_FILE @"CacheMap.smdata"
+#define LEGACY_CACHE_MAP_FILE @"CacheMap.plist"
 #define SQL_DB @"CoreDataStore.sqlite"
-#define DIRTY_QUEUE_FILE @"DirtyQueue.plist"
+#define DIRTY_QUEUE_FILE @"DirtyQueue.smdata"
+#define GEO_INDEX_FILE @"GeoIndex.smdata"
+#define LEGACY_DIRTY_QUEUE_FILE @"DirtyQueue.plist"
+#define SM_MAX_EXPAND_DEPTH 3
+#define SM_RELATED_OBJECTS_QUERY_CHUNK_SIZE 100
+#define SM_QUERY_PLAN_CACHE_COUNT_LIMIT 100
 
 NSString *const SMIncrementalStoreType = @"SMIncrementalStore";
 NSString *const SM_DataStoreKey = @"SM_DataStoreKey";
@@ -43,6 +51,9 @@ NSString *const SMDeletedObjectFailures = @"SMDeletedObjectFailures";
 
 NSString *const SMFailedManagedObjectID = @"SMFailedManagedObjectID";
 NSString *const SMFailedManagedObjectError = @"SMFailedManagedObjectError";
+NSString *const SMSaveUnitResults = @"SMSaveUnitResults";
+NSString *const SMSaveUnitObjectIDs = @"SMSaveUnitObjectIDs";
+NSString *const SMSaveUnitError = @"SMSaveUnitError";
 
 NSString *const SMPurgeObjectFromCacheNotification = @"SMPurgeObjectFromCacheNotification";
 NSString *const SMPurgeObjectsFromCacheNotification = @"SMPurgeObjectsFromCacheNotification";
@@ -54,7 +65,6 @@ NSString *const SMCachePurgeArrayOfManageObjectIDs = @"SMCachePurgeArrayOfManage
 NSString *const SMCachePurgeOfObjectsFromEntityName = @"SMCachePurgeOfObjectsFromEntityName";
 
 NSString *const SMThreadDefaultOptions = @"SMThreadDefaultOptions";
-NSString *const SMRequestSpecificOptions = @"SMRequestSpecificOptions";
 
 NSString *const SMFailedRefreshBlock = @"SMFailedRefreshBlock";
 
@@ -98,6 +108,11 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     return [[NSString stringWithFormat:@"%@", objectToCheck] length] > SM_MAX_LOG_LENGTH ? [[[NSString stringWithFormat:@"%@", objectToCheck] substringToIndex:SM_MAX_LOG_LENGTH] stringByAppendingString:@" <MAX_LOG_LENGTH_REACHED>"] : objectToCheck;
 }
 
+/*
+ The network half of saving a set of changed objects: sends the requests built from them, waits for the responses and caches the results.  Returns NO and sets error if any of them failed.
+ */
+typedef BOOL (^SMSaveStep)(NSError *__autoreleasing *error);
+
 @interface SMIncrementalStore () {
     
 }
@@ -114,28 +129,34 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     Entity1 : {
                 objectID: {
                             referenceToCacheID,
-                            dateWhenLastReadFromServer
+                            dateWhenLastReadFromServer,
+                            dateWhenLastConfirmedWithServer
                           },
                 objectID: {
                             referenceToCacheID,
-                            dateWhenLastReadFromServer
+                            dateWhenLastReadFromServer,
+                            dateWhenLastConfirmedWithServer
                           }
                 ...
               },
     Entity2 : {
                 objectID: {
                             referenceToCacheID,
-                            dateWhenLastReadFromServer
+                            dateWhenLastReadFromServer,
+                            dateWhenLastConfirmedWithServer
                           },
                 objectID: {
                             referenceToCacheID,
-                            dateWhenLastReadFromServer
+                            dateWhenLastReadFromServer,
+                            dateWhenLastConfirmedWithServer
                           }
                 ...
               },
     ...
  
  }
+ 
+ dateWhenLastReadFromServer and dateWhenLastConfirmedWithServer are optional.  dateWhenLastConfirmedWithServer is the local date the cached values were last received from the server, used for cache max age checks.
  */
 @property (nonatomic, strong) __block NSMutableDictionary *cacheMappingTable;
 
@@ -162,6 +183,16 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
  */
 @property (nonatomic, strong) __block NSMutableDictionary *dirtyQueue;
 
+/*
+ Geohash index over the geo point fields of cached objects, so SMPredicate fetches can be answered from the cache.  Written next to the cache map.
+ */
+@property (nonatomic, strong) SMGeoIndex *geoIndex;
+
+/*
+ Compiled translations of fetch requests to queries, keyed by predicate shape.  See SMIncrementalStore+Query.
+ */
+@property (nonatomic, strong) NSCache *queryPlanCache;
+
 @property (nonatomic) dispatch_queue_t callbackQueue;
 
 @property (nonatomic) NSTimeInterval serverTimeDiff;
@@ -180,6 +211,8 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 @synthesize localPersistentStoreCoordinator = _localPersistentStoreCoordinator;
 @synthesize cacheMappingTable = _cacheMappingTable;
 @synthesize dirtyQueue = _dirtyQueue;
+@synthesize geoIndex = _geoIndex;
+@synthesize queryPlanCache = _queryPlanCache;
 @synthesize callbackQueue = _callbackQueue;
 @synthesize isSaving = _isSaving;
 @synthesize serverTimeDiff = _serverTimeDiff;
@@ -354,7 +387,21 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     return _networkAvailabilityGroup;
 }
 
-- (BOOL)SM_checkNetworkAvailability
+/*
+ Internal requests (faults, network checks, syncing) run below interactive traffic unless the options ask for a specific priority.
+ */
+- (SMRequestOptions *)SM_requestOptions:(SMRequestOptions *)options withDefaultPriority:(SMRequestPriority)priority
+{
+    if (options.prioritySet) {
+        return options;
+    }
+    
+    SMRequestOptions *optionsWithPriority = options ? [options copy] : [SMRequestOptions options];
+    optionsWithPriority.priority = priority;
+    return optionsWithPriority;
+}
+
+- (BOOL)SM_checkNetworkAvailabilityWithOptions:(SMRequestOptions *)options
 {
     if (SM_CORE_DATA_DEBUG) { DLog() }
     
@@ -365,17 +412,16 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     SMRequestOptions *requestOptions = [SMRequestOptions options];
     requestOptions.tryRefreshToken = NO;
+    requestOptions.priority = SMRequestPriorityUtility;
     
-    NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
-    SMRequestOptions *options = [threadDictionary objectForKey:SMRequestSpecificOptions];
     if (!options) {
-        requestOptions.isSecure = [self.coreDataStore.globalRequestOptions isSecure];
-    } else {
-        requestOptions.isSecure = [options isSecure];
+        options = self.coreDataStore.globalRequestOptions;
     }
+    requestOptions.isSecure = [options isSecure];
+    requestOptions.deadline = [options deadline];
     
     
-    NSMutableURLRequest *request = [[self.coreDataStore.session oauthClientWithHTTPS:options.isSecure] requestWithMethod:@"HEAD" path:nil parameters:nil];
+    NSMutableURLRequest *request = [[self.coreDataStore.session oauthClientWithHTTPS:requestOptions.isSecure] requestWithMethod:@"HEAD" path:nil parameters:nil];
     
     __block NSDate *requestDate = [NSDate date];
     SMFullResponseSuccessBlock urlSuccessBlock = ^(NSURLRequest *successRequest, NSHTTPURLResponse *response, id JSON) {
@@ -404,7 +450,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     dispatch_group_enter(group);
     
-    [self.coreDataStore queueRequest:request options:options successCallbackQueue:queue failureCallbackQueue:queue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
+    [self.coreDataStore queueRequest:request options:requestOptions successCallbackQueue:queue failureCallbackQueue:queue onSuccess:urlSuccessBlock onFailure:urlFailureBlock];
     
     dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
     
@@ -494,8 +540,10 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                      error:(NSError *__autoreleasing *)error {
     if (SM_CORE_DATA_DEBUG) { DLog() }
     
-    NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
-    SMRequestOptions *options = [threadDictionary objectForKey:SMRequestSpecificOptions];
+    SMRequestContext *requestContext = [SMRequestContext requestContextForManagedObjectContext:context];
+    if (SM_CORE_DATA_DEBUG && requestContext) { DLog(@"Request %@", requestContext.traceID) }
+    
+    SMRequestOptions *options = requestContext.options;
     if (!options) {
         options = self.coreDataStore.globalRequestOptions;
     }
@@ -504,34 +552,294 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     BOOL networkAvailable;
     if (SM_CACHE_ENABLED) {
-        networkAvailable = [self SM_checkNetworkAvailability];
+        networkAvailable = [self SM_checkNetworkAvailabilityWithOptions:options];
     } else {
         networkAvailable = YES;
     }
     
     NSSet *insertedObjects = [saveRequest insertedObjects];
+    NSSet *updatedObjects = [saveRequest updatedObjects];
+    NSSet *deletedObjects = [saveRequest deletedObjects];
+    
+    // Online, changes that share no relationships are independent, so one failing doesn't hold back the others
+    if (networkAvailable) {
+        NSArray *saveUnits = [self SM_saveUnitsForInsertedObjects:insertedObjects updatedObjects:updatedObjects deletedObjects:deletedObjects];
+        if ([saveUnits count] > 1) {
+            BOOL saveSuccess = [self SM_handleSaveUnits:saveUnits inContext:context options:options error:error];
+            return saveSuccess ? [NSArray array] : nil;
+        }
+    }
+    
+    BOOL saveSuccess = [self SM_handleInsertedObjects:insertedObjects updatedObjects:updatedObjects deletedObjects:deletedObjects inContext:context options:options error:error networkAvailable:networkAvailable];
+    
+    return saveSuccess ? [NSArray array] : nil;
+}
+
+/*
+ Handles inserts, then updates, then deletes, stopping at the first step which fails.
+ */
+- (BOOL)SM_handleInsertedObjects:(NSSet *)insertedObjects updatedObjects:(NSSet *)updatedObjects deletedObjects:(NSSet *)deletedObjects inContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error networkAvailable:(BOOL)networkAvailable
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
     if ([insertedObjects count] > 0) {
         BOOL insertSuccess = [self SM_handleInsertedObjects:insertedObjects inContext:context options:options error:error networkAvailable:networkAvailable];
         if (!insertSuccess) {
-            return nil;
+            return NO;
         }
     }
-    NSSet *updatedObjects = [saveRequest updatedObjects];
     if ([updatedObjects count] > 0) {
         BOOL updateSuccess = [self SM_handleUpdatedObjects:updatedObjects inContext:context options:options error:error networkAvailable:networkAvailable];
         if (!updateSuccess) {
-            return nil;
+            return NO;
         }
     }
-    NSSet *deletedObjects = [saveRequest deletedObjects];
     if ([deletedObjects count] > 0) {
         BOOL deleteSuccess = [self SM_handleDeletedObjects:deletedObjects inContext:context options:options error:error networkAvailable:networkAvailable];
         if (!deleteSuccess) {
-            return nil;
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
+/*
+ Splits the objects of a save into units which can be sent to the server independently of each other.
+ 
+ Two changed objects depend on each other if either references the other through a relationship, either currently or as last saved.  Each unit is a connected set of dependent objects, and is returned as [insertedObjects, updatedObjects, deletedObjects].  Within a unit the insert, update, delete ordering is kept.
+ 
+ Only relationships the context has already loaded are read, by object ID.  A relationship that is still a fault wasn't changed by this save, so it links nothing, and reading it would fire the fault in the middle of the save.  Values as last saved are only read for the relationships this save changed.
+ */
+- (NSArray *)SM_saveUnitsForInsertedObjects:(NSSet *)insertedObjects updatedObjects:(NSSet *)updatedObjects deletedObjects:(NSSet *)deletedObjects
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    NSMutableSet *changedObjects = [NSMutableSet setWithSet:insertedObjects];
+    [changedObjects unionSet:updatedObjects];
+    [changedObjects unionSet:deletedObjects];
+    
+    if ([changedObjects count] < 2) {
+        return [NSArray array];
+    }
+    
+    // Union-find over object IDs, each entry points to its parent and roots point to themselves
+    __block NSMutableDictionary *parents = [NSMutableDictionary dictionaryWithCapacity:[changedObjects count]];
+    for (NSManagedObject *object in changedObjects) {
+        [parents setObject:[object objectID] forKey:[object objectID]];
+    }
+    
+    NSManagedObjectID *(^findRoot)(NSManagedObjectID *) = ^NSManagedObjectID *(NSManagedObjectID *objectID) {
+        NSManagedObjectID *root = objectID;
+        while (![[parents objectForKey:root] isEqual:root]) {
+            root = [parents objectForKey:root];
+        }
+        // Path compression
+        while (![objectID isEqual:root]) {
+            NSManagedObjectID *next = [parents objectForKey:objectID];
+            [parents setObject:root forKey:objectID];
+            objectID = next;
+        }
+        return root;
+    };
+    
+    void (^unionObjects)(NSManagedObject *, id) = ^(NSManagedObject *object, id relatedObject) {
+        if ([relatedObject isKindOfClass:[NSManagedObject class]] && [parents objectForKey:[relatedObject objectID]]) {
+            [parents setObject:findRoot([object objectID]) forKey:findRoot([relatedObject objectID])];
+        }
+    };
+    
+    for (NSManagedObject *object in changedObjects) {
+        NSArray *changedKeys = [insertedObjects containsObject:object] ? nil : [[object changedValues] allKeys];
+        NSMutableArray *changedRelationshipNames = [NSMutableArray array];
+        NSMutableArray *relationshipValues = [NSMutableArray array];
+        
+        for (NSString *relationshipName in [[object entity] relationshipsByName]) {
+            if ([object hasFaultForRelationshipNamed:relationshipName]) {
+                continue;
+            }
+            if (![deletedObjects containsObject:object]) {
+                id value = [object valueForKey:relationshipName];
+                if (value) {
+                    [relationshipValues addObject:value];
+                }
+            }
+            if ([changedKeys containsObject:relationshipName]) {
+                [changedRelationshipNames addObject:relationshipName];
+            }
+        }
+        
+        if ([changedRelationshipNames count] > 0) {
+            [relationshipValues addObjectsFromArray:[[object committedValuesForKeys:changedRelationshipNames] allValues]];
+        }
+        
+        for (id value in relationshipValues) {
+            if ([value isKindOfClass:[NSSet class]] || [value isKindOfClass:[NSOrderedSet class]]) {
+                for (id relatedObject in value) {
+                    unionObjects(object, relatedObject);
+                }
+            } else {
+                unionObjects(object, value);
+            }
+        }
+    }
+    
+    // Group objects by root, keeping the order of first appearance stable
+    NSMutableDictionary *unitsByRoot = [NSMutableDictionary dictionary];
+    NSMutableArray *saveUnits = [NSMutableArray array];
+    for (NSManagedObject *object in changedObjects) {
+        NSManagedObjectID *root = findRoot([object objectID]);
+        NSArray *unit = [unitsByRoot objectForKey:root];
+        if (!unit) {
+            unit = [NSArray arrayWithObjects:[NSMutableSet set], [NSMutableSet set], [NSMutableSet set], nil];
+            [unitsByRoot setObject:unit forKey:root];
+            [saveUnits addObject:unit];
+        }
+        if ([insertedObjects containsObject:object]) {
+            [unit[0] addObject:object];
+        } else if ([updatedObjects containsObject:object]) {
+            [unit[1] addObject:object];
+        } else {
+            [unit[2] addObject:object];
+        }
+    }
+    
+    if (SM_CORE_DATA_DEBUG) { DLog(@"Save split into %lu independent units", (unsigned long)[saveUnits count]) }
+    
+    return saveUnits;
+}
+
+/*
+ Sends the save units concurrently.  The requests of every unit are built first, here on the context's queue, since that is the only place the managed objects may be read.  Each unit then sends its inserts, updates and deletes, in that order, on a queue of its own without waiting for the other units, and stops at its first failed step.
+ 
+ If any unit failed the error lists, under SMSaveUnitResults, the object IDs of every unit and the error of each failed one, so it is known which changes did reach the server.
+ */
+- (BOOL)SM_handleSaveUnits:(NSArray *)saveUnits inContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    dispatch_queue_t queue = dispatch_queue_create("com.stackmob.saveUnitsQueue", NULL);
+    dispatch_group_t group = dispatch_group_create();
+    
+    // Refresh the token once up front rather than having every unit try to
+    BOOL success = [self SM_doTokenRefreshIfNeededWithGroup:group queue:queue options:[options copy] error:error];
+    
+    if (success) {
+        
+        // [steps, error] for each unit, the error stays NSNull while the unit succeeds
+        NSMutableArray *unitSteps = [NSMutableArray arrayWithCapacity:[saveUnits count]];
+        __block NSMutableArray *unitErrors = [NSMutableArray arrayWithCapacity:[saveUnits count]];
+        
+        for (NSArray *unit in saveUnits) {
+            // Steps modify their options (headers, HTTPS for user objects), so each gets its own
+            NSMutableArray *steps = [NSMutableArray array];
+            NSError *buildError = nil;
+            if ([unit[0] count] > 0) {
+                [steps addObject:[self SM_saveStepForInsertedObjects:unit[0] inContext:context serializeFullObjects:NO successBlockAddition:nil options:[options copy] error:&buildError]];
+            }
+            if ([unit[1] count] > 0) {
+                [steps addObject:[self SM_saveStepForUpdatedObjects:unit[1] inContext:context serializeFullObjects:NO successBlockAddition:nil options:[options copy]]];
+            }
+            if ([unit[2] count] > 0) {
+                [steps addObject:[self SM_saveStepForDeletedObjects:unit[2] inContext:context options:[options copy]]];
+            }
+            
+            // A unit that couldn't be built sends nothing
+            [unitSteps addObject:buildError ? [NSArray array] : steps];
+            [unitErrors addObject:buildError ? buildError : [NSNull null]];
+        }
+        
+        dispatch_queue_t unitQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+        [unitSteps enumerateObjectsUsingBlock:^(id steps, NSUInteger idx, BOOL *stop) {
+            dispatch_group_async(group, unitQueue, ^{
+                NSError *stepError = nil;
+                for (SMSaveStep step in steps) {
+                    if (!step(&stepError)) {
+                        if (!stepError) {
+                            stepError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorCoreDataSave userInfo:nil];
+                        }
+                        dispatch_sync(queue, ^{
+                            [unitErrors replaceObjectAtIndex:idx withObject:stepError];
+                        });
+                        break;
+                    }
+                }
+            });
+        }];
+        
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        
+        NSMutableArray *unitResults = [NSMutableArray arrayWithCapacity:[saveUnits count]];
+        __block BOOL anyUnitFailed = NO;
+        [saveUnits enumerateObjectsUsingBlock:^(id unit, NSUInteger idx, BOOL *stop) {
+            NSMutableArray *objectIDs = [NSMutableArray array];
+            for (NSSet *objects in unit) {
+                [objectIDs addObjectsFromArray:[[objects allObjects] valueForKey:@"objectID"]];
+            }
+            
+            id unitError = [unitErrors objectAtIndex:idx];
+            if (unitError == [NSNull null]) {
+                [unitResults addObject:[NSDictionary dictionaryWithObject:objectIDs forKey:SMSaveUnitObjectIDs]];
+            } else {
+                anyUnitFailed = YES;
+                [unitResults addObject:[NSDictionary dictionaryWithObjectsAndKeys:objectIDs, SMSaveUnitObjectIDs, unitError, SMSaveUnitError, nil]];
+            }
+        }];
+        
+        if (SM_CORE_DATA_DEBUG) { DLog(@"Save unit results are %@", unitResults) }
+        
+        if (anyUnitFailed) {
+            success = NO;
+            [self SM_setError:error fromSaveUnitResults:unitResults];
+        }
+    }
+    
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(group);
+    dispatch_release(queue);
+#endif
+    
+    return success;
+}
+
+/*
+ Combines the errors of failed save units.  Failed object lists under the same key are concatenated.  The code of the first error that is not SMErrorCoreDataSave wins, so refresh token failures are not hidden.  The results of every unit are added under SMSaveUnitResults.
+ */
+- (void)SM_setError:(NSError *__autoreleasing *)error fromSaveUnitResults:(NSArray *)unitResults
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    if (error == NULL) {
+        return;
+    }
+    
+    __block NSString *errorDomain = SMErrorDomain;
+    __block NSInteger errorCode = SMErrorCoreDataSave;
+    __block NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
+    
+    for (NSDictionary *unitResult in unitResults) {
+        NSError *unitError = [unitResult objectForKey:SMSaveUnitError];
+        if (!unitError) {
+            continue;
+        }
+        if (errorCode == SMErrorCoreDataSave && [unitError code] != SMErrorCoreDataSave) {
+            errorDomain = [unitError domain];
+            errorCode = [unitError code];
         }
+        [[unitError userInfo] enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stopKeys) {
+            id existingValue = [userInfo objectForKey:key];
+            if (!existingValue) {
+                [userInfo setObject:value forKey:key];
+            } else if ([existingValue isKindOfClass:[NSArray class]] && [value isKindOfClass:[NSArray class]]) {
+                [userInfo setObject:[existingValue arrayByAddingObjectsFromArray:value] forKey:key];
+            }
+        }];
     }
     
-    return [NSArray array];
+    [userInfo setObject:unitResults forKey:SMSaveUnitResults];
+    
+    NSError *errorToSet = [[NSError alloc] initWithDomain:errorDomain code:errorCode userInfo:userInfo];
+    *error = (__bridge id)(__bridge_retained CFTypeRef)errorToSet;
 }
 
 - (BOOL)SM_handleInsertedObjects:(NSSet *)insertedObjects inContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error networkAvailable:(BOOL)networkAvailable
@@ -548,9 +856,19 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 - (BOOL)SM_handleInsertedObjectsWhenOnline:(NSSet *)insertedObjects inContext:(NSManagedObjectContext *)context serializeFullObjects:(BOOL)serializeFullObjects successBlockAddition:(void (^)(NSString *primaryKey, NSString *entityName, NSManagedObjectID *objectID))successBlockAddition options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
     
     if (SM_CORE_DATA_DEBUG) { DLog() }
-    if (SM_CORE_DATA_DEBUG) { DLog(@"objects to be inserted are %@", truncateOutputIfExceedsMaxLogLength(insertedObjects))}
     
-    __block BOOL success = YES;
+    SMSaveStep saveStep = [self SM_saveStepForInsertedObjects:insertedObjects inContext:context serializeFullObjects:serializeFullObjects successBlockAddition:successBlockAddition options:options error:error];
+    
+    return saveStep(error);
+}
+
+/*
+ Serializes the inserted objects and builds their requests.  The managed objects are only read here, so call this on the context's queue.  The returned step sends the requests, waits for them and caches the results, and can run on any thread.
+ */
+- (SMSaveStep)SM_saveStepForInsertedObjects:(NSSet *)insertedObjects inContext:(NSManagedObjectContext *)context serializeFullObjects:(BOOL)serializeFullObjects successBlockAddition:(void (^)(NSString *primaryKey, NSString *entityName, NSManagedObjectID *objectID))successBlockAddition options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
+    
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    if (SM_CORE_DATA_DEBUG) { DLog(@"objects to be inserted are %@", truncateOutputIfExceedsMaxLogLength(insertedObjects))}
     
     // create a group dispatch and queue
     dispatch_queue_t queue = dispatch_queue_create("com.stackmob.insertedObjectsQueue", NULL);
@@ -561,7 +879,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     __block NSMutableArray *regularOperations = [NSMutableArray array];
     __block NSMutableArray *failedRequests = [NSMutableArray array];
     __block NSMutableArray *failedRequestsWithUnauthorizedResponse = [NSMutableArray array];
-    __block BOOL previousStateOfHTTPSOption = [options isSecure];
+    BOOL previousStateOfHTTPSOption = [options isSecure];
     __block NSMutableArray *objectsToBeCached = [NSMutableArray array];
     
     [insertedObjects enumerateObjectsUsingBlock:^(id managedObject, BOOL *stop) {
@@ -571,6 +889,9 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         NSDictionary *serializedObjDict = [managedObject SMDictionarySerialization:serializeFullObjects sendLocalTimestamps:self.coreDataStore.sendLocalTimestamps];
         NSString *schemaName = [managedObject SMSchema];
         __block NSString *insertedObjectID = [managedObject SMObjectId];
+        // Read now, the callbacks run on another queue
+        id primaryKey = [managedObject valueForKey:[managedObject primaryKeyField]];
+        NSEntityDescription *entity = [managedObject entity];
         
         // If superclass is SMUserNSManagedObject, add password
         if ([managedObject isKindOfClass:[SMUserManagedObject class]]) {
@@ -602,11 +923,11 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                 }
                 
                 // Add object to list of objects to be cached [primaryKey, dictionary of object, entity desc, context]
-                NSArray *objectReadyForCache = [NSArray arrayWithObjects:[managedObject valueForKey:[managedObject primaryKeyField]], theObject, [managedObject entity], context, nil];
+                NSArray *objectReadyForCache = [NSArray arrayWithObjects:primaryKey, theObject, entity, context, nil];
                 [objectsToBeCached addObject:objectReadyForCache];
                 
                 if (successBlockAddition) {
-                    successBlockAddition(insertedObjectID, [[managedObject entity] name], [self newObjectIDForEntity:[managedObject entity] referenceObject:insertedObjectID]);
+                    successBlockAddition(insertedObjectID, [entity name], [self newObjectIDForEntity:entity referenceObject:insertedObjectID]);
                 }
                 
                 dispatch_group_leave(callbackGroup);
@@ -618,7 +939,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                 if (SM_CORE_DATA_DEBUG) { DLog(@"SMIncrementalStore failed to insert object %@ on schema %@", truncateOutputIfExceedsMaxLogLength(theObject), schemaName) }
                 if (SM_CORE_DATA_DEBUG) { DLog(@"the error userInfo is %@", [theError userInfo]) }
                 
-                NSDictionary *failedRequestDict = [NSDictionary dictionaryWithObjectsAndKeys:theRequest, SMFailedRequest, theError, SMFailedRequestError, insertedObjectID, SMFailedRequestObjectPrimaryKey, [managedObject entity], SMFailedRequestObjectEntity, theOptions, SMFailedRequestOptions, originalSuccessBlock, SMFailedRequestOriginalSuccessBlock, nil];
+                NSDictionary *failedRequestDict = [NSDictionary dictionaryWithObjectsAndKeys:theRequest, SMFailedRequest, theError, SMFailedRequestError, insertedObjectID, SMFailedRequestObjectPrimaryKey, entity, SMFailedRequestObjectEntity, theOptions, SMFailedRequestOptions, originalSuccessBlock, SMFailedRequestOriginalSuccessBlock, nil];
                 
                 // Add failed request to correct array
                 if ([theError code] == SMErrorUnauthorized) {
@@ -635,26 +956,32 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             
             options.isSecure ? [secureOperations addObject:op] : [regularOperations addObject:op];
             
-        } else {
-            success = NO;
         }
         
     }];
     
-    success = [self SM_enqueueRegularOperations:regularOperations secureOperations:secureOperations withGroup:group callbackGroup:callbackGroup queue:queue options:options refreshAndRetryUnauthorizedRequests:failedRequestsWithUnauthorizedResponse failedRequests:failedRequests errorListName:SMInsertedObjectFailures error:error];
-    
-    dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
-    
-    [self SM_serializeAndCacheObjects:objectsToBeCached];
-    
-    [options setIsSecure:previousStateOfHTTPSOption];
-
+    return ^BOOL(NSError *__autoreleasing *stepError) {
+        
+        BOOL success = [self SM_enqueueRegularOperations:regularOperations secureOperations:secureOperations withGroup:group callbackGroup:callbackGroup queue:queue options:options refreshAndRetryUnauthorizedRequests:failedRequestsWithUnauthorizedResponse failedRequests:failedRequests errorListName:SMInsertedObjectFailures error:stepError];
+        
+        dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
+        
+        // Cache writes go through the cache context queue
+        if (SM_CACHE_ENABLED) {
+            [self.localManagedObjectContext performBlockAndWait:^{
+                [self SM_serializeAndCacheObjects:objectsToBeCached];
+            }];
+        }
+        
+        [options setIsSecure:previousStateOfHTTPSOption];
+        
 #if !OS_OBJECT_USE_OBJC
-    dispatch_release(group);
-    dispatch_release(callbackGroup);
-    dispatch_release(queue);
+        dispatch_release(group);
+        dispatch_release(callbackGroup);
+        dispatch_release(queue);
 #endif
-    return success;
+        return success;
+    };
     
 }
 
@@ -741,9 +1068,20 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 
 - (BOOL)SM_handleUpdatedObjectsWhenOnline:(NSSet *)updatedObjects inContext:(NSManagedObjectContext *)context serializeFullObjects:(BOOL)serializeFullObjects successBlockAddition:(void (^)(NSString *primaryKey, NSString *entityName, NSManagedObjectID *objectID))successBlockAddition options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
     
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    SMSaveStep saveStep = [self SM_saveStepForUpdatedObjects:updatedObjects inContext:context serializeFullObjects:serializeFullObjects successBlockAddition:successBlockAddition options:options];
+    
+    return saveStep(error);
+}
+
+/*
+ Serializes the updated objects and builds their requests, on the context's queue.  See SM_saveStepForInsertedObjects:inContext:serializeFullObjects:successBlockAddition:options:error:.
+ */
+- (SMSaveStep)SM_saveStepForUpdatedObjects:(NSSet *)updatedObjects inContext:(NSManagedObjectContext *)context serializeFullObjects:(BOOL)serializeFullObjects successBlockAddition:(void (^)(NSString *primaryKey, NSString *entityName, NSManagedObjectID *objectID))successBlockAddition options:(SMRequestOptions *)options {
+    
     if (SM_CORE_DATA_DEBUG) { DLog() }
     if (SM_CORE_DATA_DEBUG) { DLog(@"objects to be updated are %@", truncateOutputIfExceedsMaxLogLength(updatedObjects)) }
-    __block BOOL success = YES;
     
     // create a group dispatch and queue
     dispatch_queue_t queue = dispatch_queue_create("com.stackmob.updatedObjectsQueue", NULL);
@@ -763,6 +1101,9 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         NSDictionary *serializedObjDict = [managedObject SMDictionarySerialization:serializeFullObjects sendLocalTimestamps:self.coreDataStore.sendLocalTimestamps];
         NSString *schemaName = [managedObject SMSchema];
         __block NSString *updatedObjectID = [managedObject SMObjectId];
+        // Read now, the callbacks run on another queue
+        id primaryKey = [managedObject valueForKey:[managedObject primaryKeyField]];
+        NSEntityDescription *entity = [managedObject entity];
         
         if (SM_CORE_DATA_DEBUG) { DLog(@"Serialized object dictionary: %@", truncateOutputIfExceedsMaxLogLength(serializedObjDict)) }
         
@@ -773,11 +1114,11 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             if (SM_CORE_DATA_DEBUG) { DLog(@"SMIncrementalStore updated object %@ on schema %@", truncateOutputIfExceedsMaxLogLength(theObject) , schemaName) }
             
             // Add object to list of objects to be cached [primaryKey, dictionary of object, entity desc, context]
-            NSArray *objectReadyForCache = [NSArray arrayWithObjects:[managedObject valueForKey:[managedObject primaryKeyField]], theObject, [managedObject entity], context, nil];
+            NSArray *objectReadyForCache = [NSArray arrayWithObjects:primaryKey, theObject, entity, context, nil];
             [objectsToBeCached addObject:objectReadyForCache];
             
             if (successBlockAddition) {
-                successBlockAddition(updatedObjectID, [[managedObject entity] name], [self newObjectIDForEntity:[managedObject entity] referenceObject:updatedObjectID]);
+                successBlockAddition(updatedObjectID, [entity name], [self newObjectIDForEntity:entity referenceObject:updatedObjectID]);
             }
             
             dispatch_group_leave(callbackGroup);
@@ -789,7 +1130,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             if (SM_CORE_DATA_DEBUG) { DLog(@"SMIncrementalStore failed to update object %@ on schema %@", truncateOutputIfExceedsMaxLogLength(theObject), schemaName) }
             if (SM_CORE_DATA_DEBUG) { DLog(@"the error userInfo is %@", [theError userInfo]) }
             
-            NSDictionary *failedRequestDict = [NSDictionary dictionaryWithObjectsAndKeys:theRequest, SMFailedRequest, theError, SMFailedRequestError, updatedObjectID, SMFailedRequestObjectPrimaryKey, [managedObject entity], SMFailedRequestObjectEntity, theOptions, SMFailedRequestOptions, originalSuccessBlock, SMFailedRequestOriginalSuccessBlock, nil];
+            NSDictionary *failedRequestDict = [NSDictionary dictionaryWithObjectsAndKeys:theRequest, SMFailedRequest, theError, SMFailedRequestError, updatedObjectID, SMFailedRequestObjectPrimaryKey, entity, SMFailedRequestObjectEntity, theOptions, SMFailedRequestOptions, originalSuccessBlock, SMFailedRequestOriginalSuccessBlock, nil];
             
             // Add failed request to correct array
             if ([theError code] == SMErrorUnauthorized) {
@@ -826,18 +1167,26 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         
     }];
     
-    success = [self SM_enqueueRegularOperations:regularOperations secureOperations:secureOperations withGroup:group callbackGroup:callbackGroup queue:queue options:options refreshAndRetryUnauthorizedRequests:failedRequestsWithUnauthorizedResponse failedRequests:failedRequests errorListName:SMUpdatedObjectFailures error:error];
-    
-    dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
-    
-    [self SM_serializeAndCacheObjects:objectsToBeCached];
-    
+    return ^BOOL(NSError *__autoreleasing *stepError) {
+        
+        BOOL success = [self SM_enqueueRegularOperations:regularOperations secureOperations:secureOperations withGroup:group callbackGroup:callbackGroup queue:queue options:options refreshAndRetryUnauthorizedRequests:failedRequestsWithUnauthorizedResponse failedRequests:failedRequests errorListName:SMUpdatedObjectFailures error:stepError];
+        
+        dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
+        
+        // Cache writes go through the cache context queue
+        if (SM_CACHE_ENABLED) {
+            [self.localManagedObjectContext performBlockAndWait:^{
+                [self SM_serializeAndCacheObjects:objectsToBeCached];
+            }];
+        }
+        
 #if !OS_OBJECT_USE_OBJC
-    dispatch_release(group);
-    dispatch_release(callbackGroup);
-    dispatch_release(queue);
+        dispatch_release(group);
+        dispatch_release(callbackGroup);
+        dispatch_release(queue);
 #endif
-    return success;
+        return success;
+    };
     
 }
 
@@ -899,9 +1248,19 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 - (BOOL)SM_handleDeletedObjectsWhenOnline:(NSSet *)deletedObjects inContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
     
     if (SM_CORE_DATA_DEBUG) { DLog() }
-    if (SM_CORE_DATA_DEBUG) { DLog(@"objects to be deleted are %@", truncateOutputIfExceedsMaxLogLength(deletedObjects)) }
     
-    __block BOOL success = YES;
+    SMSaveStep saveStep = [self SM_saveStepForDeletedObjects:deletedObjects inContext:context options:options];
+    
+    return saveStep(error);
+}
+
+/*
+ Builds the requests for the deleted objects, on the context's queue.  See SM_saveStepForInsertedObjects:inContext:serializeFullObjects:successBlockAddition:options:error:.
+ */
+- (SMSaveStep)SM_saveStepForDeletedObjects:(NSSet *)deletedObjects inContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options {
+    
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    if (SM_CORE_DATA_DEBUG) { DLog(@"objects to be deleted are %@", truncateOutputIfExceedsMaxLogLength(deletedObjects)) }
     
     // create a group dispatch and queue
     dispatch_queue_t queue = dispatch_queue_create("com.stackmob.deletedObjectsQueue", NULL);
@@ -920,6 +1279,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         NSString *schemaName = [managedObject SMSchema];
         __block NSString *deletedObjectID = [managedObject SMObjectId];
         __block NSString *deletedObjectEntityname = [[managedObject entity] name];
+        NSEntityDescription *entity = [managedObject entity];
         
         dispatch_group_enter(callbackGroup);
         
@@ -939,7 +1299,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             if (SM_CORE_DATA_DEBUG) { DLog(@"SMIncrementalStore failed to update object %@ on schema %@", truncateOutputIfExceedsMaxLogLength(theObject), schemaName) }
             if (SM_CORE_DATA_DEBUG) { DLog(@"the error userInfo is %@", [theError userInfo]) }
             
-            NSDictionary *failedRequestDict = [NSDictionary dictionaryWithObjectsAndKeys:theRequest, SMFailedRequest, theError, SMFailedRequestError, deletedObjectID, SMFailedRequestObjectPrimaryKey, [managedObject entity], SMFailedRequestObjectEntity, theOptions, SMFailedRequestOptions, originalSuccessBlock, SMFailedRequestOriginalSuccessBlock, nil];
+            NSDictionary *failedRequestDict = [NSDictionary dictionaryWithObjectsAndKeys:theRequest, SMFailedRequest, theError, SMFailedRequestError, deletedObjectID, SMFailedRequestObjectPrimaryKey, entity, SMFailedRequestObjectEntity, theOptions, SMFailedRequestOptions, originalSuccessBlock, SMFailedRequestOriginalSuccessBlock, nil];
             
             // Add failed request to correct array
             if ([theError code] == SMErrorUnauthorized) {
@@ -959,20 +1319,25 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         
     }];
     
-    success = [self SM_enqueueRegularOperations:regularOperations secureOperations:secureOperations withGroup:group callbackGroup:callbackGroup queue:queue options:options refreshAndRetryUnauthorizedRequests:failedRequestsWithUnauthorizedResponse failedRequests:failedRequests errorListName:SMDeletedObjectFailures error:error];
-    
-    dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
-    
-    if (SM_CACHE_ENABLED && success && [deletedObjectIDs count] > 0) {
-        [self SM_purgeObjectsFromCacheByStackMobIDInfo:deletedObjectIDs];
-    }
-    
+    return ^BOOL(NSError *__autoreleasing *stepError) {
+        
+        BOOL success = [self SM_enqueueRegularOperations:regularOperations secureOperations:secureOperations withGroup:group callbackGroup:callbackGroup queue:queue options:options refreshAndRetryUnauthorizedRequests:failedRequestsWithUnauthorizedResponse failedRequests:failedRequests errorListName:SMDeletedObjectFailures error:stepError];
+        
+        dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
+        
+        if (SM_CACHE_ENABLED && success && [deletedObjectIDs count] > 0) {
+            [self.localManagedObjectContext performBlockAndWait:^{
+                [self SM_purgeObjectsFromCacheByStackMobIDInfo:deletedObjectIDs];
+            }];
+        }
+        
 #if !OS_OBJECT_USE_OBJC
-    dispatch_release(group);
-    dispatch_release(callbackGroup);
-    dispatch_release(queue);
+        dispatch_release(group);
+        dispatch_release(callbackGroup);
+        dispatch_release(queue);
 #endif
-    return success;
+        return success;
+    };
     
 }
 
@@ -1019,7 +1384,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     NSArray *entry = [objectIDsForEntity objectForKey:objectID];
     
-    if ([entry count] != 2) {
+    if ([entry count] < 2) {
         // Handle error
         [NSException raise:SMExceptionIncompatibleObject format:@"Cache entry does not have date attached to it (only 1 entry). Please submit a ticket to StackMob reporting this error."];
     }
@@ -1041,58 +1406,31 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         [self SM_enqueueOperations:secureOperations  dispatchGroup:group completionBlockQueue:queue secure:YES];
         [self SM_enqueueOperations:regularOperations dispatchGroup:group completionBlockQueue:queue secure:NO];
         
-        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        BOOL deadlineExceeded = ![self SM_waitForGroup:group cancellingOperations:[secureOperations arrayByAddingObjectsFromArray:regularOperations] atDeadline:options.deadline];
+        
+        // An operation whose request is being retried finishes before the retry does, and only reports the object saved or failed once the retries are over
+        dispatch_group_wait(callbackGroup, DISPATCH_TIME_FOREVER);
         
         // If there were 401s, refresh token is valid, refresh token is present and token has expired, attempt refresh and reprocess
         if ([failedRequestsWithUnauthorizedResponse count] > 0) {
             
-            if ([self.coreDataStore.session eligibleForTokenRefresh:options]) {
-                
-                // If we are refreshing, wait for refresh with 5 sec timeout
-                __block BOOL refreshSuccess = NO;
+            if (!deadlineExceeded && [self.coreDataStore.session eligibleForTokenRefresh:options]) {
                 
-                if (self.coreDataStore.session.refreshing) {
-                    
-                    [self SM_waitForRefreshingWithTimeout:5];
-                    
-                } else {
-                    
-                    [options setTryRefreshToken:NO];
-                    dispatch_group_enter(group);
-                    self.coreDataStore.session.refreshing = YES;//Don't ever trigger two refreshToken calls
-                    [self.coreDataStore.session doTokenRequestWithEndpoint:@"refreshToken" credentials:[NSDictionary dictionaryWithObjectsAndKeys:self.coreDataStore.session.refreshToken, @"refresh_token", nil] options:[SMRequestOptions options] successCallbackQueue:queue failureCallbackQueue:queue onSuccess:^(NSDictionary *userObject) {
-                        refreshSuccess = YES;
-                        dispatch_group_leave(group);
-                    } onFailure:^(NSError *theError) {
-                        
-                        refreshSuccess = NO;
-                        success = NO;
-                        [failedRequests addObjectsFromArray:failedRequestsWithUnauthorizedResponse];
-                        [self SM_setErrorAndUserInfoWithFailedOperations:failedRequests errorCode:SMErrorRefreshTokenFailed errorListName:errorListName error:error];
-                        
-                        for (unsigned int i = 0; i < [failedRequestsWithUnauthorizedResponse count]; i++) {
-                            dispatch_group_leave(callbackGroup);
-                        }
-                        
-                        dispatch_group_leave(group);
-                    }];
-                    
-                    
-                    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-                }
+                // Joins an in-flight refresh if there is one, otherwise starts it
+                [options setTryRefreshToken:NO];
+                BOOL refreshSuccess = [self SM_refreshAccessTokenAndWaitWithOptions:options];
                 
-                if (self.coreDataStore.session.refreshing) {
+                if (!refreshSuccess) {
                     
-                    refreshSuccess = NO;
                     success = NO;
                     [failedRequests addObjectsFromArray:failedRequestsWithUnauthorizedResponse];
-                    [self SM_setErrorAndUserInfoWithFailedOperations:failedRequests errorCode:SMErrorRefreshTokenInProgress errorListName:errorListName error:error];
+                    [self SM_setErrorAndUserInfoWithFailedOperations:failedRequests errorCode:SMErrorRefreshTokenFailed errorListName:errorListName error:error];
+                    
+                    for (unsigned int i = 0; i < [failedRequestsWithUnauthorizedResponse count]; i++) {
+                        dispatch_group_leave(callbackGroup);
+                    }
                     
                 } else {
-                    refreshSuccess = YES;
-                }
-                
-                if (refreshSuccess) {
                     
                     // Retry Failed Requests
                     
@@ -1100,7 +1438,9 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                     [regularOperations removeAllObjects];
                     
                     [failedRequestsWithUnauthorizedResponse enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
-                        SMRequestOptions *retryOptions = [obj objectForKey:SMFailedRequestOptions];
+                        // Sent once more with the new token, a failure is reported rather than retried again
+                        SMRequestOptions *retryOptions = [[obj objectForKey:SMFailedRequestOptions] copy];
+                        [retryOptions setNumberOfRetries:0];
                         
                         SMFullResponseSuccessBlock retrySuccessBlock = [self.coreDataStore SMFullResponseSuccessBlockForResultSuccessBlock:[obj objectForKey:SMFailedRequestOriginalSuccessBlock]];
                         
@@ -1111,15 +1451,18 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                             
                         };
                         
-                        AFJSONRequestOperation *op = [self.coreDataStore newOperationForRequest:[obj objectForKey:SMFailedRequest] options:[obj objectForKey:SMFailedRequestOptions] successCallbackQueue:queue failureCallbackQueue:queue onSuccess:retrySuccessBlock onFailure:retryFailureBlock];
+                        // Signed again, the failed request still carries the expired token
+                        NSURLRequest *retryRequest = [self.coreDataStore.session signRequest:[obj objectForKey:SMFailedRequest]];
+                        AFJSONRequestOperation *op = [self.coreDataStore newOperationForRequest:retryRequest options:retryOptions successCallbackQueue:queue failureCallbackQueue:queue onSuccess:retrySuccessBlock onFailure:retryFailureBlock];
                         
                         retryOptions.isSecure ? [secureOperations addObject:op] : [regularOperations addObject:op];
                     }];
                     
+                    SMMetricsIncrementCounter(SMMetricsRetryCounter, [failedRequestsWithUnauthorizedResponse count]);
                     [self SM_enqueueOperations:secureOperations  dispatchGroup:group completionBlockQueue:queue secure:YES];
                     [self SM_enqueueOperations:regularOperations dispatchGroup:group completionBlockQueue:queue secure:NO];
                     
-                    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+                    deadlineExceeded = ![self SM_waitForGroup:group cancellingOperations:[secureOperations arrayByAddingObjectsFromArray:regularOperations] atDeadline:options.deadline];
                     
                 }
                 
@@ -1131,7 +1474,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         // Error if any failed requests have made it to this point
         if ([failedRequests count] > 0) {
             success = NO;
-            [self SM_setErrorAndUserInfoWithFailedOperations:failedRequests errorCode:SMErrorCoreDataSave errorListName:errorListName error:error];
+            [self SM_setErrorAndUserInfoWithFailedOperations:failedRequests errorCode:(deadlineExceeded ? SMErrorDeadlineExceeded : SMErrorCoreDataSave) errorListName:errorListName error:error];
         }
     } else {
         for (unsigned int i=0; i < ([regularOperations count] + [secureOperations count]); i++) {
@@ -1144,9 +1487,25 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 }
 
 
-- (BOOL)SM_setErrorAndUserInfoWithFailedOperations:(NSMutableArray *)failedOperations errorCode:(int)errorCode errorListName:(NSString *)errorListName error:(NSError *__autoreleasing*)error
+/*
+ Waits for the operations in a group to finish.  If the deadline passes first the operations are cancelled, so their callbacks run right away instead of blocking the save, and NO is returned.
+ */
+- (BOOL)SM_waitForGroup:(dispatch_group_t)group cancellingOperations:(NSArray *)operations atDeadline:(NSDate *)deadline
 {
-    if (SM_CORE_DATA_DEBUG) {DLog()}
+    if (dispatch_group_wait(group, SMDispatchTimeForDeadline(deadline)) == 0) {
+        return YES;
+    }
+    
+    if (SM_CORE_DATA_DEBUG) { DLog(@"Deadline passed, cancelling %lu operations", (unsigned long)[operations count]) }
+    [operations makeObjectsPerformSelector:@selector(cancel)];
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    
+    return NO;
+}
+
+- (BOOL)SM_setErrorAndUserInfoWithFailedOperations:(NSMutableArray *)failedOperations errorCode:(int)errorCode errorListName:(NSString *)errorListName error:(NSError *__autoreleasing*)error
+{
+    if (SM_CORE_DATA_DEBUG) {DLog()}
     
     if (error != NULL && *error == nil) {
         __block NSMutableArray *failedObjects = [NSMutableArray array];
@@ -1167,18 +1526,46 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     return YES;
 }
 
-- (void)SM_waitForRefreshingWithTimeout:(int)timeout
+/*
+ Refreshes the access token, waiting no longer than the deadline of options.  A refresh still running at the deadline counts as failed.
+ */
+- (BOOL)SM_refreshAccessTokenAndWaitWithOptions:(SMRequestOptions *)options
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
-    if (timeout == 0 || !self.coreDataStore.session.refreshing) {
-        return;
-    }
+    __block NSError *refreshError = nil;
+    dispatch_group_t refreshGroup = dispatch_group_create();
+    dispatch_queue_t refreshQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+    
+    // The callbacks may run after the wait gives up, so they hold on to the group themselves
+#if !OS_OBJECT_USE_OBJC
+    dispatch_retain(refreshGroup);
+#endif
+    dispatch_group_enter(refreshGroup);
+    [self.coreDataStore.session refreshTokenWithSuccessCallbackQueue:refreshQueue failureCallbackQueue:refreshQueue onSuccess:^(NSDictionary *userObject) {
+        dispatch_group_leave(refreshGroup);
+#if !OS_OBJECT_USE_OBJC
+        dispatch_release(refreshGroup);
+#endif
+    } onFailure:^(NSError *theError) {
+        refreshError = theError;
+        dispatch_group_leave(refreshGroup);
+#if !OS_OBJECT_USE_OBJC
+        dispatch_release(refreshGroup);
+#endif
+    }];
     
-    sleep(1);
+    BOOL finished = dispatch_group_wait(refreshGroup, SMDispatchTimeForDeadline(options.deadline)) == 0;
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(refreshGroup);
+#endif
     
-    [self SM_waitForRefreshingWithTimeout:(timeout - 1)];
+    if (!finished) {
+        if (SM_CORE_DATA_DEBUG) { DLog(@"Deadline passed while refreshing the access token") }
+        return NO;
+    }
     
+    return refreshError == nil;
 }
 
 - (void)SM_enqueueOperations:(NSArray *)ops dispatchGroup:(dispatch_group_t)group completionBlockQueue:(dispatch_queue_t)queue secure:(BOOL)isSecure
@@ -1200,53 +1587,15 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
-    //dispatch_queue_t refreshQueue = dispatch_queue_create("com.stackmob.refreshQueue", NULL);
-    //dispatch_group_t refreshGroup = dispatch_group_create();
-    
-    __block BOOL success = YES;
+    BOOL success = YES;
     if ([self.coreDataStore.session eligibleForTokenRefresh:options]) {
         
-        if (self.coreDataStore.session.refreshing) {
-            
-            [self SM_waitForRefreshingWithTimeout:5];
-            
-        } else {
-            
-            [options setTryRefreshToken:NO];
-            dispatch_group_enter(group);
-            self.coreDataStore.session.refreshing = YES;//Don't ever trigger two refreshToken calls
-            [self.coreDataStore.session doTokenRequestWithEndpoint:@"refreshToken" credentials:[NSDictionary dictionaryWithObjectsAndKeys:self.coreDataStore.session.refreshToken, @"refresh_token", nil] options:[SMRequestOptions options] successCallbackQueue:queue failureCallbackQueue:queue onSuccess:^(NSDictionary *userObject) {
-                dispatch_group_leave(group);
-            } onFailure:^(NSError *theError) {
-                
-                success = NO;
-                if (error != NULL) {
-                    // Check if tokenRefreshFailBlock
-                    NSError *refreshError = nil;
-                    if (self.coreDataStore.session.tokenRefreshFailureBlock) {
-                        NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:self.coreDataStore.session.tokenRefreshFailureBlock, SMFailedRefreshBlock, nil];
-                        refreshError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenFailed userInfo:userInfo];
-                    } else {
-                        refreshError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenFailed userInfo:nil];
-                    }
-                    
-                    *error = (__bridge id)(__bridge_retained CFTypeRef)refreshError;
-                }
-                dispatch_group_leave(group);
-            }];
-            
-            
-            dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-        }
+        [options setTryRefreshToken:NO];
+        success = [self SM_refreshAccessTokenAndWaitWithOptions:options];
         
-        if (self.coreDataStore.session.refreshing) {
-            
-            success = NO;
-            if (error != NULL) {
-                NSError *refreshError = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenInProgress userInfo:nil];
-                *error = (__bridge id)(__bridge_retained CFTypeRef)refreshError;
-            }
-            
+        if (!success && error != NULL) {
+            NSError *refreshError = [self SM_tokenRefreshFailedError];
+            *error = (__bridge id)(__bridge_retained CFTypeRef)refreshError;
         }
         
     }
@@ -1254,6 +1603,17 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     return success;
 }
 
+- (NSError *)SM_tokenRefreshFailedError
+{
+    // Check if tokenRefreshFailBlock
+    if (self.coreDataStore.session.tokenRefreshFailureBlock) {
+        NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:self.coreDataStore.session.tokenRefreshFailureBlock, SMFailedRefreshBlock, nil];
+        return [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenFailed userInfo:userInfo];
+    }
+    
+    return [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorRefreshTokenFailed userInfo:nil];
+}
+
 ////////////////////////////
 #pragma mark - Fetch Requests
 ////////////////////////////
@@ -1270,8 +1630,10 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                       error:(NSError * __autoreleasing *)error {
     if (SM_CORE_DATA_DEBUG) { DLog() }
     
-    NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
-    SMRequestOptions *options = [threadDictionary objectForKey:SMRequestSpecificOptions];
+    SMRequestContext *requestContext = [SMRequestContext requestContextForManagedObjectContext:context];
+    if (SM_CORE_DATA_DEBUG && requestContext) { DLog(@"Request %@", requestContext.traceID) }
+    
+    SMRequestOptions *options = requestContext.options;
     if (!options) {
         options = self.coreDataStore.globalRequestOptions;
     }
@@ -1285,7 +1647,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             return [self SM_fetchObjectIDs:fetchRequest withContext:context options:options error:error];
             break;
         case NSDictionaryResultType:
-            [NSException raise:SMExceptionIncompatibleObject format:@"Unimplemented result type requested."];
+            return [self SM_fetchDictionaries:fetchRequest withContext:context options:options error:error];
             break;
         case NSCountResultType:
             [NSException raise:SMExceptionIncompatibleObject format:@"Unimplemented result type requested."];
@@ -1297,64 +1659,237 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     return nil;
 }
 
-- (id)SM_fetchObjectsFromNetwork:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError * __autoreleasing *)error {
-    
+/*
+ Returns options expanding the relationships named by keyPaths, so related objects come back nested in the query results instead of being read one fault at a time.  Key paths that don't name relationships are ignored, and the depth is never lowered or taken past the maximum of 3.
+ */
+- (SMRequestOptions *)SM_requestOptions:(SMRequestOptions *)options prefetchingRelationshipKeyPaths:(NSArray *)keyPaths entity:(NSEntityDescription *)entity
+{
     if (SM_CORE_DATA_DEBUG) { DLog() }
     
-    // Build query for StackMob
-    SMQuery *query = [self queryForFetchRequest:fetchRequest error:error];
+    NSUInteger expandDepth = 0;
+    NSMutableArray *expandedFields = [NSMutableArray array];
     
-    if (query == nil) {
-        if (error) {
-            *error = (__bridge id)(__bridge_retained CFTypeRef)*error;
+    for (NSString *keyPath in keyPaths) {
+        NSEntityDescription *currentEntity = entity;
+        NSMutableArray *fieldPath = [NSMutableArray array];
+        for (NSString *key in [keyPath componentsSeparatedByString:@"."]) {
+            NSRelationshipDescription *relationship = [[currentEntity relationshipsByName] objectForKey:key];
+            if (!relationship || [fieldPath count] == SM_MAX_EXPAND_DEPTH) {
+                break;
+            }
+            [fieldPath addObject:[currentEntity SMFieldNameForProperty:relationship]];
+            [expandedFields addObject:[fieldPath componentsJoinedByString:@"."]];
+            currentEntity = [relationship destinationEntity];
         }
-        return nil;
+        expandDepth = MAX(expandDepth, [fieldPath count]);
     }
     
-    __block NSArray *resultsWithoutOID;
-    
-    // create a group dispatch and queue
-    dispatch_queue_t queue = dispatch_queue_create("com.stackmob.fetchFromNetworkQueue", NULL);
-    dispatch_group_t group = dispatch_group_create();
+    NSUInteger currentDepth = (NSUInteger)[[[options headers] objectForKey:@"X-StackMob-Expand"] integerValue];
+    if (expandDepth <= currentDepth) {
+        return options;
+    }
     
-    __block BOOL success = [self SM_doTokenRefreshIfNeededWithGroup:group queue:queue options:options error:error];
+    SMRequestOptions *optionsWithExpansion = options ? [options copy] : [SMRequestOptions options];
+    [optionsWithExpansion setExpandDepth:expandDepth];
     
-    if (!success) {
-        return nil;
+    // A select header would otherwise leave out the prefetched relationships
+    NSString *selectedFields = [[optionsWithExpansion headers] objectForKey:@"X-StackMob-Select"];
+    if (selectedFields) {
+        NSMutableOrderedSet *fields = [NSMutableOrderedSet orderedSetWithArray:[selectedFields componentsSeparatedByString:@","]];
+        [fields addObjectsFromArray:expandedFields];
+        [optionsWithExpansion restrictReturnedFieldsTo:[fields array]];
     }
     
-    options.tryRefreshToken = NO;
+    return optionsWithExpansion;
+}
+
+/*
+ Replaces related objects expanded inside object with their primary keys, so it serializes the same as an unexpanded read.  The expanded objects, collapsed in turn, are collected in expandedObjects by entity name and primary key.
+ */
+- (NSDictionary *)SM_collapseExpandedObject:(NSDictionary *)object entity:(NSEntityDescription *)entity expandedObjects:(NSMutableDictionary *)expandedObjects
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
     
-    dispatch_group_enter(group);
-    [self.coreDataStore performQuery:query options:options successCallbackQueue:queue failureCallbackQueue:queue onSuccess:^(NSArray *results) {
-        
-        resultsWithoutOID = results;
-        dispatch_group_leave(group);
-    } onFailure:^(NSError *queryError) {
+    __block NSMutableDictionary *collapsedObject = nil;
+    
+    [[entity relationshipsByName] enumerateKeysAndObjectsUsingBlock:^(id relationshipName, id relationship, BOOL *stop) {
+        NSString *fieldName = [entity SMFieldNameForProperty:relationship];
+        id relationshipContents = [object objectForKey:fieldName];
+        id collapsedContents = nil;
         
-        if (error != NULL) {
-            *error = (__bridge id)(__bridge_retained CFTypeRef)queryError;
+        if ([relationshipContents isKindOfClass:[NSDictionary class]]) {
+            collapsedContents = [self SM_primaryKeyForExpandedObject:relationshipContents entity:[relationship destinationEntity] expandedObjects:expandedObjects];
+        } else if ([relationshipContents isKindOfClass:[NSArray class]] && [[relationshipContents lastObject] isKindOfClass:[NSDictionary class]]) {
+            collapsedContents = [(NSArray *)relationshipContents map:^(id relatedObject) {
+                return [self SM_primaryKeyForExpandedObject:relatedObject entity:[relationship destinationEntity] expandedObjects:expandedObjects];
+            }];
         }
-        dispatch_group_leave(group);
         
+        if (collapsedContents) {
+            if (!collapsedObject) {
+                collapsedObject = [object mutableCopy];
+            }
+            [collapsedObject setObject:collapsedContents forKey:fieldName];
+        }
     }];
     
-    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    return collapsedObject ? collapsedObject : object;
+}
+
+- (id)SM_primaryKeyForExpandedObject:(id)relatedObject entity:(NSEntityDescription *)entity expandedObjects:(NSMutableDictionary *)expandedObjects
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    if (![relatedObject isKindOfClass:[NSDictionary class]]) {
+        return relatedObject;
+    }
+    
+    NSString *primaryKeyField = nil;
+    @try {
+        primaryKeyField = [entity SMPrimaryKeyField];
+    }
+    @catch (NSException *exception) {
+        primaryKeyField = [self.coreDataStore.session userPrimaryKeyField];
+    }
+    
+    id primaryKey = [relatedObject objectForKey:primaryKeyField];
+    if (!primaryKey) {
+        [NSException raise:SMExceptionIncompatibleObject format:@"No key for supposed primary key field %@ for expanded object %@", primaryKeyField, relatedObject];
+    }
+    
+    NSMutableDictionary *objectsForEntity = [expandedObjects objectForKey:[entity name]];
+    if (!objectsForEntity) {
+        objectsForEntity = [NSMutableDictionary dictionary];
+        [expandedObjects setObject:objectsForEntity forKey:[entity name]];
+    }
+    [objectsForEntity setObject:[self SM_collapseExpandedObject:relatedObject entity:entity expandedObjects:expandedObjects] forKey:primaryKey];
+    
+    return primaryKey;
+}
+
+/*
+ Sends the query for fetchRequest without waiting for the response.  completionBlock is called on the store's callback queue with the results as returned from the server, or with an error.
+ */
+- (void)SM_performNetworkFetch:(NSFetchRequest *)fetchRequest options:(SMRequestOptions *)options onCompletion:(void (^)(NSArray *results, NSError *error))completionBlock
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    // Build query for StackMob
+    NSError *queryError = nil;
+    SMQuery *query = [self queryForFetchRequest:fetchRequest error:&queryError];
+    
+    if (query == nil) {
+        dispatch_async(self.callbackQueue, ^{
+            completionBlock(nil, queryError);
+        });
+        return;
+    }
+    
+    if (!options) {
+        options = self.coreDataStore.globalRequestOptions;
+    }
+    
+    BOOL refreshToken = [self.coreDataStore.session eligibleForTokenRefresh:options];
+    options.tryRefreshToken = NO;
+    // Prefetched objects are only read back from the cache, so without it there is nothing to expand them for
+    SMRequestOptions *queryOptions = SM_CACHE_ENABLED ? [self SM_requestOptions:options prefetchingRelationshipKeyPaths:[fetchRequest relationshipKeyPathsForPrefetching] entity:fetchRequest.entity] : options;
+    
+    dispatch_block_t sendQuery = ^{
+        [self.coreDataStore performQuery:query options:queryOptions successCallbackQueue:self.callbackQueue failureCallbackQueue:self.callbackQueue onSuccess:^(NSArray *results) {
+            completionBlock(results, nil);
+        } onFailure:^(NSError *error) {
+            completionBlock(nil, error);
+        }];
+    };
+    
+    if (refreshToken) {
+        [self.coreDataStore.session refreshTokenWithSuccessCallbackQueue:self.callbackQueue failureCallbackQueue:self.callbackQueue onSuccess:^(NSDictionary *userObject) {
+            sendQuery();
+        } onFailure:^(NSError *theError) {
+            completionBlock(nil, [self SM_tokenRefreshFailedError]);
+        }];
+    } else {
+        sendQuery();
+    }
+}
+
+/*
+ Returns YES if fetchRequest would be answered from the network rather than the cache, without looking at the cache.  Fetches that might be answered from a fresh cache return NO.
+ */
+- (BOOL)SM_fetchRequestGoesToNetwork:(NSFetchRequest *)fetchRequest options:(SMRequestOptions *)options
+{
+    if (!SM_CACHE_ENABLED) {
+        return YES;
+    }
+    
+    if (!options) {
+        options = self.coreDataStore.globalRequestOptions;
+    }
+    
+    NSString *entityName = [[fetchRequest entity] name];
+    SMCachePolicy cachePolicy = [options cachePolicySet] ? [options cachePolicy] : [self.coreDataStore cachePolicyForEntityName:entityName];
+    NSTimeInterval cacheMaxAge = [options cacheMaxAgeSet] ? [options cacheMaxAge] : [self.coreDataStore cacheMaxAgeForEntityName:entityName];
+    
+    return cacheMaxAge <= 0 && (cachePolicy == SMCachePolicyTryNetworkOnly || cachePolicy == SMCachePolicyTryNetworkElseCache);
+}
+
+- (id)SM_fetchObjectsFromNetwork:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError * __autoreleasing *)error {
     
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    __block NSArray *resultsWithoutOID = nil;
+    __block NSError *networkError = nil;
+    
+    SMRequestContext *requestContext = [SMRequestContext requestContextForManagedObjectContext:context];
+    id networkResponse = requestContext.networkFetchResponse;
+    
+    if (networkResponse) {
+        // The query was already sent by executeFetchRequest:onSuccess:onFailure:, without a thread waiting on it
+        requestContext.networkFetchResponse = nil;
+        if ([networkResponse isKindOfClass:[NSError class]]) {
+            networkError = networkResponse;
+        } else {
+            resultsWithoutOID = networkResponse;
+        }
+    } else {
+        dispatch_group_t group = dispatch_group_create();
+        
+        dispatch_group_enter(group);
+        [self SM_performNetworkFetch:fetchRequest options:options onCompletion:^(NSArray *results, NSError *fetchError) {
+            resultsWithoutOID = results;
+            networkError = fetchError;
+            dispatch_group_leave(group);
+        }];
+        
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        
 #if !OS_OBJECT_USE_OBJC
-    dispatch_release(group);
-    dispatch_release(queue);
+        dispatch_release(group);
 #endif
+    }
     
-    if (*error != nil) {
+    if (networkError) {
+        if (error != NULL) {
+            *error = (__bridge id)(__bridge_retained CFTypeRef)networkError;
+        }
         return nil;
     }
     
-    if (SM_CACHE_ENABLED && ![self containsSMPredicate:[fetchRequest predicate]]) {
+    CFAbsoluteTime materializationStart = SMMetricsEnabled() ? CFAbsoluteTimeGetCurrent() : 0;
+    
+    // Expanded related objects are referenced by primary key in the results and cached on their own
+    NSMutableDictionary *expandedObjects = [NSMutableDictionary dictionary];
+    if ((SM_CACHE_ENABLED && [[fetchRequest relationshipKeyPathsForPrefetching] count] > 0) || [[options headers] objectForKey:@"X-StackMob-Expand"]) {
+        resultsWithoutOID = [resultsWithoutOID map:^(id item) {
+            return [self SM_collapseExpandedObject:item entity:fetchRequest.entity expandedObjects:expandedObjects];
+        }];
+    }
+    
+    if (SM_CACHE_ENABLED) {
         
-        // Network fetch was successful, run same fetch on local cache and delete results
+        // Network fetch was successful, run same fetch on local cache and delete results.  Geo fetches can't run against the cache as is, so their results are only added.
         NSError *fetchOnCacheError = nil;
-        NSArray *cacheResults = [self.localManagedObjectContext executeFetchRequest:fetchRequest error:&fetchOnCacheError];
+        NSArray *cacheResults = [self containsSMPredicate:[fetchRequest predicate]] ? nil : [self.localManagedObjectContext executeFetchRequest:fetchRequest error:&fetchOnCacheError];
         
         if (fetchOnCacheError) {
             if (SM_CORE_DATA_DEBUG) { DLog(@"Error fetching from cache, %@", fetchOnCacheError) }
@@ -1404,16 +1939,28 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             __block NSManagedObject *cacheManagedObject = [self.localManagedObjectContext objectWithID:[self SM_retrieveCacheObjectForRemoteID:remoteID entityName:[[sm_managedObject entity] name] createIfNeeded:YES serverLastModDate:[serializedObjectDict objectForKey:SMLastModDateKey]]];
         
             [self SM_populateCacheManagedObject:cacheManagedObject withDictionary:serializedObjectDict entity:fetchRequest.entity];
+            [self SM_confirmRemoteID:remoteID entityName:[[sm_managedObject entity] name] serverValues:item];
             return sm_managedObject;
             
         }];
         
+        // Cache prefetched objects alongside the results, replacing their reference stubs so the relationship faults fill without a read
+        [expandedObjects enumerateKeysAndObjectsUsingBlock:^(id entityName, id objectsForEntity, BOOL *stop) {
+            NSEntityDescription *expandedEntity = [NSEntityDescription entityForName:entityName inManagedObjectContext:context];
+            [objectsForEntity enumerateKeysAndObjectsUsingBlock:^(id primaryKey, id values, BOOL *stopEnum) {
+                [self SM_serializeAndCacheObjectWithID:primaryKey values:values entity:expandedEntity context:context];
+            }];
+        }];
+        
         NSError *cacheSaveError = nil;
         [self SM_saveCache:&cacheSaveError];
         if (cacheSaveError) {
             if (SM_CORE_DATA_DEBUG) { DLog(@"Cache save unsuccessful, %@", cacheSaveError) }
+        } else {
+            [self SM_saveCacheMap];
         }
         
+        SMMetricsRecordDurationSince(SMMetricsMaterializationTimer, materializationStart);
         return results;
         
     } else {
@@ -1450,6 +1997,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             
         }];
         
+        SMMetricsRecordDurationSince(SMMetricsMaterializationTimer, materializationStart);
         return results;
 
     }
@@ -1480,11 +2028,30 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     if (SM_CORE_DATA_DEBUG) { DLog() }
     
-    if ([self containsSMPredicate:[fetchRequest predicate]]) {
-        return [NSArray array];
-    }
+    NSArray *remoteIDsByDistance = nil;
+    NSUInteger fetchOffset = 0;
+    NSUInteger fetchLimit = 0;
     
-    if (fetchRequest.predicate) {
+    if ([self containsSMPredicate:[fetchRequest predicate]]) {
+        // Geo predicates are answered by the geo index, the rest of the predicate still runs against the cache
+        NSPredicate *cachePredicate = [self SM_cachePredicateForGeoPredicate:[fetchRequest predicate] entity:[fetchRequest entity] remoteIDsByDistance:&remoteIDsByDistance];
+        if (!cachePredicate) {
+            return [NSArray array];
+        }
+        
+        fetchRequest = [fetchRequest copy];
+        [fetchRequest setPredicate:cachePredicate];
+        
+        // Results ordered by distance can only be paged once they are sorted
+        if (remoteIDsByDistance && [[fetchRequest sortDescriptors] count] == 0) {
+            fetchOffset = [fetchRequest fetchOffset];
+            fetchLimit = [fetchRequest fetchLimit];
+            [fetchRequest setFetchOffset:0];
+            [fetchRequest setFetchLimit:0];
+        } else {
+            remoteIDsByDistance = nil;
+        }
+    } else if (fetchRequest.predicate) {
         NSPredicate *newPredicate = [self SM_parsePredicate:fetchRequest.predicate];
         if (newPredicate) {
             [fetchRequest setPredicate:newPredicate];
@@ -1513,6 +2080,10 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         primaryKeyField = [self.coreDataStore.session userPrimaryKeyField];
     }
     
+    if (remoteIDsByDistance) {
+        localCacheResults = [self SM_cacheObjects:localCacheResults primaryKeyField:primaryKeyField orderedLike:remoteIDsByDistance offset:fetchOffset limit:fetchLimit];
+    }
+    
     __block NSMutableArray *results = [NSMutableArray array];
     
     [localCacheResults enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
@@ -1533,6 +2104,151 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
 }
 
+/*
+ Rewrites a predicate containing SMPredicates for the cache, replacing each geo predicate with a primary key [in] clause of the matches in the geo index.  Only geo predicates at the top level or directly under an AND can be rewritten, returns nil otherwise.
+ 
+ remoteIDsByDistance is set to the matches ordered by distance when the predicate has a radius or near clause.
+ */
+- (NSPredicate *)SM_cachePredicateForGeoPredicate:(NSPredicate *)predicate entity:(NSEntityDescription *)entity remoteIDsByDistance:(NSArray *__autoreleasing *)remoteIDsByDistance
+{
+    NSArray *subpredicates = nil;
+    if ([predicate isKindOfClass:[SMPredicate class]]) {
+        subpredicates = [NSArray arrayWithObject:predicate];
+    } else if ([predicate isKindOfClass:[NSCompoundPredicate class]] && [(NSCompoundPredicate *)predicate compoundPredicateType] == NSAndPredicateType) {
+        subpredicates = [(NSCompoundPredicate *)predicate subpredicates];
+    } else {
+        return nil;
+    }
+    
+    NSMutableArray *cacheSubpredicates = [NSMutableArray arrayWithCapacity:[subpredicates count]];
+    NSMutableSet *matchingRemoteIDs = nil;
+    NSArray *orderedRemoteIDs = nil;
+    
+    for (NSPredicate *subpredicate in subpredicates) {
+        if ([subpredicate isKindOfClass:[SMPredicate class]]) {
+            NSArray *remoteIDs = [self SM_remoteIDsMatchingGeoPredicate:(SMPredicate *)subpredicate entity:entity];
+            if (matchingRemoteIDs) {
+                [matchingRemoteIDs intersectSet:[NSSet setWithArray:remoteIDs]];
+            } else {
+                matchingRemoteIDs = [NSMutableSet setWithArray:remoteIDs];
+            }
+            if (!orderedRemoteIDs && [(SMPredicate *)subpredicate sm_predicateOperatorType] != SMGeoQueryWithinBoundsOperatorType) {
+                orderedRemoteIDs = remoteIDs;
+            }
+        } else if ([self containsSMPredicate:subpredicate]) {
+            return nil;
+        } else {
+            NSPredicate *parsedPredicate = [self SM_parsePredicate:subpredicate];
+            [cacheSubpredicates addObject:parsedPredicate ? parsedPredicate : subpredicate];
+        }
+    }
+    
+    [cacheSubpredicates insertObject:[NSPredicate predicateWithFormat:@"%K IN %@", [self SM_cachePrimaryKeyFieldForEntity:entity], matchingRemoteIDs] atIndex:0];
+    
+    if (remoteIDsByDistance != NULL) {
+        *remoteIDsByDistance = orderedRemoteIDs;
+    }
+    
+    return [NSCompoundPredicate andPredicateWithSubpredicates:cacheSubpredicates];
+}
+
+- (NSArray *)SM_remoteIDsMatchingGeoPredicate:(SMPredicate *)predicate entity:(NSEntityDescription *)entity
+{
+    NSDictionary *geoDictionary = predicate.predicateDictionary;
+    
+    // Accept the Core Data attribute name as well as the StackMob field name
+    NSString *field = [geoDictionary objectForKey:GEOQUERY_FIELD];
+    NSPropertyDescription *property = [[entity propertiesByName] objectForKey:field];
+    if (property) {
+        field = [entity SMFieldNameForProperty:property];
+    }
+    
+    NSDictionary *coordinateDictionary = [geoDictionary objectForKey:GEOQUERY_COORDINATE];
+    CLLocationCoordinate2D coordinate = CLLocationCoordinate2DMake([[coordinateDictionary objectForKey:GEOQUERY_LAT] doubleValue], [[coordinateDictionary objectForKey:GEOQUERY_LONG] doubleValue]);
+    
+    switch (predicate.sm_predicateOperatorType) {
+        case SMGeoQueryWithinMilesOperatorType:
+            return [self.geoIndex remoteIDsForEntityName:[entity name] field:field withinDistance:[[geoDictionary objectForKey:GEOQUERY_MILES] doubleValue] * 1609.344 ofCoordinate:coordinate];
+        case SMGeoQueryWithinKilometersOperatorType:
+            return [self.geoIndex remoteIDsForEntityName:[entity name] field:field withinDistance:[[geoDictionary objectForKey:GEOQUERY_KILOMETERS] doubleValue] * 1000.0 ofCoordinate:coordinate];
+        case SMGeoQueryWithinBoundsOperatorType: {
+            NSDictionary *sw = [geoDictionary objectForKey:GEOQUERY_SW_BOUND];
+            NSDictionary *ne = [geoDictionary objectForKey:GEOQUERY_NE_BOUND];
+            return [self.geoIndex remoteIDsForEntityName:[entity name] field:field withinBoundsWithSWCorner:CLLocationCoordinate2DMake([[sw objectForKey:GEOQUERY_LAT] doubleValue], [[sw objectForKey:GEOQUERY_LONG] doubleValue]) andNECorner:CLLocationCoordinate2DMake([[ne objectForKey:GEOQUERY_LAT] doubleValue], [[ne objectForKey:GEOQUERY_LONG] doubleValue])];
+        }
+        case SMGeoQueryNearOperatorType:
+            return [self.geoIndex remoteIDsForEntityName:[entity name] field:field nearCoordinate:coordinate];
+        default:
+            return [NSArray array];
+    }
+}
+
+/*
+ Orders cache objects the way their primary keys appear in remoteIDs, then applies offset and limit.
+ */
+- (NSArray *)SM_cacheObjects:(NSArray *)cacheObjects primaryKeyField:(NSString *)primaryKeyField orderedLike:(NSArray *)remoteIDs offset:(NSUInteger)offset limit:(NSUInteger)limit
+{
+    NSMutableDictionary *cacheObjectsByRemoteID = [NSMutableDictionary dictionaryWithCapacity:[cacheObjects count]];
+    for (NSManagedObject *cacheObject in cacheObjects) {
+        [cacheObjectsByRemoteID setObject:cacheObject forKey:[cacheObject valueForKey:primaryKeyField]];
+    }
+    
+    NSMutableArray *orderedObjects = [NSMutableArray arrayWithCapacity:[cacheObjects count]];
+    for (NSString *remoteID in remoteIDs) {
+        NSManagedObject *cacheObject = [cacheObjectsByRemoteID objectForKey:remoteID];
+        if (cacheObject) {
+            [orderedObjects addObject:cacheObject];
+        }
+    }
+    
+    if (offset >= [orderedObjects count]) {
+        return [NSArray array];
+    }
+    
+    NSUInteger length = [orderedObjects count] - offset;
+    if (limit > 0) {
+        length = MIN(length, limit);
+    }
+    
+    return [orderedObjects subarrayWithRange:NSMakeRange(offset, length)];
+}
+
+/*
+ Returns the cache results for fetchRequest if every result was confirmed against the server within maxAge, otherwise nil.
+ */
+- (id)SM_fetchFreshObjectsFromCache:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context maxAge:(NSTimeInterval)maxAge {
+    
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    if ([self containsSMPredicate:[fetchRequest predicate]]) {
+        return nil;
+    }
+    
+    // The cache fetch rewrites the predicate for the local store, so work on a copy in case we fall back to the network
+    NSFetchRequest *cacheFetchRequest = [fetchRequest copy];
+    NSError *cacheError = nil;
+    NSArray *cacheResults = [self SM_fetchObjectsFromCache:cacheFetchRequest withContext:context error:&cacheError];
+    
+    if (cacheError || [cacheResults count] == 0) {
+        return nil;
+    }
+    
+    NSDate *oldestFreshDate = [NSDate dateWithTimeIntervalSinceNow:-maxAge];
+    NSDictionary *remoteIDsForEntity = nil;
+    @synchronized(self) {
+        remoteIDsForEntity = [self.cacheMappingTable objectForKey:[[fetchRequest entity] name]];
+    }
+    
+    for (NSManagedObject *object in cacheResults) {
+        NSArray *entry = [remoteIDsForEntity objectForKey:[self referenceObjectForObjectID:[object objectID]]];
+        if ([entry count] < 3 || [oldestFreshDate compare:entry[2]] == NSOrderedDescending) {
+            if (SM_CORE_DATA_DEBUG) { DLog(@"Cache results are stale, entry %@", entry) }
+            return nil;
+        }
+    }
+    
+    return cacheResults;
+}
 
 - (NSPredicate *)SM_parsePredicate:(NSPredicate *)predicate
 {
@@ -1574,7 +2290,23 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     if (SM_CACHE_ENABLED) {
         id resultsToReturn = nil;
         NSError *tempError = nil;
-        switch ([self.coreDataStore cachePolicy]) {
+        
+        // Cache settings on the request options take precedence over entity settings, which fall back to the global settings
+        NSString *entityName = [[fetchRequest entity] name];
+        SMCachePolicy cachePolicy = [options cachePolicySet] ? [options cachePolicy] : [self.coreDataStore cachePolicyForEntityName:entityName];
+        NSTimeInterval cacheMaxAge = [options cacheMaxAgeSet] ? [options cacheMaxAge] : [self.coreDataStore cacheMaxAgeForEntityName:entityName];
+        
+        if (cacheMaxAge > 0 && cachePolicy != SMCachePolicyTryCacheOnly) {
+            resultsToReturn = [self SM_fetchFreshObjectsFromCache:fetchRequest withContext:context maxAge:cacheMaxAge];
+            if (resultsToReturn) {
+                if (SM_CORE_DATA_DEBUG) { DLog(@"Fetch answered from cache within max age %f", cacheMaxAge) }
+                SMMetricsIncrementCounter(SMMetricsCacheHitCounter, 1);
+                return resultsToReturn;
+            }
+            SMMetricsIncrementCounter(SMMetricsCacheMissCounter, 1);
+        }
+        
+        switch (cachePolicy) {
             case SMCachePolicyTryNetworkOnly:
                 if (SM_CORE_DATA_DEBUG) { DLog(@"Fetch switch: SMCachePolicyTryNetworkOnly") }
                 resultsToReturn = [self SM_fetchObjectsFromNetwork:fetchRequest withContext:context options:options error:error];
@@ -1582,12 +2314,18 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             case SMCachePolicyTryCacheOnly:
                 if (SM_CORE_DATA_DEBUG) { DLog(@"Fetch switch: SMCachePolicyTryCacheOnly") }
                 resultsToReturn = [self SM_fetchObjectsFromCache:fetchRequest withContext:context error:error];
+                if ([resultsToReturn count] > 0) {
+                    SMMetricsIncrementCounter(SMMetricsCacheHitCounter, 1);
+                }
                 break;
             case SMCachePolicyTryNetworkElseCache:
                 if (SM_CORE_DATA_DEBUG) { DLog(@"Fetch switch: SMCachePolicyTryNetworkElseCache") }
                 resultsToReturn = [self SM_fetchObjectsFromNetwork:fetchRequest withContext:context options:options error:&tempError];
                 if (tempError && [tempError code] == SMErrorNetworkNotReachable) {
                     resultsToReturn = [self SM_fetchObjectsFromCache:fetchRequest withContext:context error:error];
+                    if ([resultsToReturn count] > 0) {
+                        SMMetricsIncrementCounter(SMMetricsCacheHitCounter, 1);
+                    }
                 }
                 break;
             case SMCachePolicyTryCacheElseNetwork:
@@ -1597,7 +2335,10 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                     return nil;
                 }
                 if ([resultsToReturn count] == 0) {
+                    SMMetricsIncrementCounter(SMMetricsCacheMissCounter, 1);
                     resultsToReturn = [self SM_fetchObjectsFromNetwork:fetchRequest withContext:context options:options error:error];
+                } else {
+                    SMMetricsIncrementCounter(SMMetricsCacheHitCounter, 1);
                 }
                 break;
             default:
@@ -1609,36 +2350,303 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                 break;
         }
         
-        if (SM_CORE_DATA_DEBUG) { DLog(@"Fetch results to return are %@ with error %@", resultsToReturn, *error) }
-        return resultsToReturn;
-    } else {
-        id resultsToReturn = nil;
-        resultsToReturn = [self SM_fetchObjectsFromNetwork:fetchRequest withContext:context options:options error:error];
-        return resultsToReturn;
+        if (SM_CORE_DATA_DEBUG) { DLog(@"Fetch results to return are %@ with error %@", resultsToReturn, *error) }
+        return resultsToReturn;
+    } else {
+        id resultsToReturn = nil;
+        resultsToReturn = [self SM_fetchObjectsFromNetwork:fetchRequest withContext:context options:options error:error];
+        return resultsToReturn;
+    }
+}
+
+// Returns NSArray<NSManagedObjectID>
+- (id)SM_fetchObjectIDs:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    NSFetchRequest *fetchCopy = [fetchRequest copy];
+    
+    [fetchCopy setResultType:NSManagedObjectResultType];
+    
+    if ([fetchRequest fetchBatchSize] > 0) {
+        [fetchCopy setFetchBatchSize:[fetchRequest fetchBatchSize]];
+    }
+    
+    NSArray *objects = [self SM_fetchObjects:fetchCopy withContext:context options:options error:error];
+    
+    // Error check
+    if (*error != nil) {
+        return nil;
+    }
+    
+    return [objects map:^(id item) {
+        return [item objectID];
+    }];
+}
+
+// Returns NSArray<NSDictionary>
+- (id)SM_fetchDictionaries:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    BOOL hasExpressions = NO;
+    for (id property in [fetchRequest propertiesToFetch]) {
+        if ([property isKindOfClass:[NSExpressionDescription class]]) {
+            hasExpressions = YES;
+            break;
+        }
+    }
+    
+    if (!hasExpressions && ![fetchRequest returnsDistinctResults] && [[fetchRequest propertiesToGroupBy] count] == 0) {
+        // A plain projection, fetched as objects and read back as dictionaries
+        NSFetchRequest *fetchCopy = [fetchRequest copy];
+        [fetchCopy setResultType:NSManagedObjectResultType];
+        [fetchCopy setPropertiesToFetch:nil];
+        
+        NSArray *objects = [self SM_fetchObjects:fetchCopy withContext:context options:options error:error];
+        if (!objects) {
+            return nil;
+        }
+        
+        NSArray *propertyNames = [fetchRequest propertiesToFetch] ? [[fetchRequest propertiesToFetch] map:^(id property) {
+            return [property isKindOfClass:[NSPropertyDescription class]] ? [property name] : property;
+        }] : [[[fetchRequest entity] attributesByName] allKeys];
+        
+        return [objects map:^(id object) {
+            NSMutableDictionary *result = [NSMutableDictionary dictionaryWithCapacity:[propertyNames count]];
+            for (NSString *propertyName in propertyNames) {
+                id value = [object valueForKey:propertyName];
+                if ([value isKindOfClass:[NSManagedObject class]]) {
+                    value = [value objectID];
+                }
+                if (value) {
+                    [result setObject:value forKey:propertyName];
+                }
+            }
+            return [NSDictionary dictionaryWithDictionary:result];
+        }];
+    }
+    
+    // Aggregates, distinct results and groups
+    NSError *queryError = nil;
+    SMQuery *query = [self aggregateQueryForFetchRequest:fetchRequest error:&queryError];
+    if (!query) {
+        if (error != NULL) {
+            *error = (__bridge id)(__bridge_retained CFTypeRef)queryError;
+        }
+        return nil;
+    }
+    
+    if (!SM_CACHE_ENABLED) {
+        return [self SM_fetchAggregates:query fromNetworkForFetchRequest:fetchRequest withContext:context options:options error:error];
+    }
+    
+    NSString *entityName = [[fetchRequest entity] name];
+    SMCachePolicy cachePolicy = [options cachePolicySet] ? [options cachePolicy] : [self.coreDataStore cachePolicyForEntityName:entityName];
+    
+    id resultsToReturn = nil;
+    NSError *tempError = nil;
+    switch (cachePolicy) {
+        case SMCachePolicyTryNetworkOnly:
+            resultsToReturn = [self SM_fetchAggregates:query fromNetworkForFetchRequest:fetchRequest withContext:context options:options error:error];
+            break;
+        case SMCachePolicyTryCacheOnly:
+            resultsToReturn = [self SM_fetchAggregatesFromCache:fetchRequest cachedObjectCount:NULL error:error];
+            break;
+        case SMCachePolicyTryNetworkElseCache:
+            resultsToReturn = [self SM_fetchAggregates:query fromNetworkForFetchRequest:fetchRequest withContext:context options:options error:&tempError];
+            if (tempError && [tempError code] == SMErrorNetworkNotReachable) {
+                resultsToReturn = [self SM_fetchAggregatesFromCache:fetchRequest cachedObjectCount:NULL error:error];
+            } else if (tempError && error != NULL) {
+                *error = (__bridge id)(__bridge_retained CFTypeRef)tempError;
+            }
+            break;
+        case SMCachePolicyTryCacheElseNetwork:
+        {
+            // Aggregates without groups always come back as one row, so go by the objects they were computed from
+            NSUInteger cachedObjectCount = 0;
+            resultsToReturn = [self SM_fetchAggregatesFromCache:fetchRequest cachedObjectCount:&cachedObjectCount error:error];
+            if (resultsToReturn && cachedObjectCount == 0) {
+                resultsToReturn = [self SM_fetchAggregates:query fromNetworkForFetchRequest:fetchRequest withContext:context options:options error:error];
+            }
+            break;
+        }
+        default:
+            if (error != NULL) {
+                NSError *errorToReturn = [[NSError alloc] initWithDomain:SMErrorDomain code:SMErrorInvalidArguments userInfo:nil];
+                *error = (__bridge id)(__bridge_retained CFTypeRef)errorToReturn;
+            }
+            break;
+    }
+    
+    if (SM_CORE_DATA_DEBUG) { DLog(@"Dictionary results to return are %@", resultsToReturn) }
+    return resultsToReturn;
+}
+
+/*
+ Sends the aggregate query and waits for its rows, which are translated from StackMob field names to the property and expression names the fetch request asked for.  Sorting and paging are applied to the rows here, since they can't be applied to the objects being aggregated.
+ */
+- (NSArray *)SM_fetchAggregates:(SMQuery *)query fromNetworkForFetchRequest:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    
+    if (!options) {
+        options = self.coreDataStore.globalRequestOptions;
+    }
+    
+    BOOL refreshToken = [self.coreDataStore.session eligibleForTokenRefresh:options];
+    options.tryRefreshToken = NO;
+    
+    __block NSArray *rows = nil;
+    __block NSError *networkError = nil;
+    dispatch_group_t group = dispatch_group_create();
+    
+    dispatch_block_t sendQuery = ^{
+        [self.coreDataStore performAggregateQuery:query options:options successCallbackQueue:self.callbackQueue failureCallbackQueue:self.callbackQueue onSuccess:^(NSArray *results) {
+            rows = results;
+            dispatch_group_leave(group);
+        } onFailure:^(NSError *queryError) {
+            networkError = queryError;
+            dispatch_group_leave(group);
+        }];
+    };
+    
+    dispatch_group_enter(group);
+    if (refreshToken) {
+        [self.coreDataStore.session refreshTokenWithSuccessCallbackQueue:self.callbackQueue failureCallbackQueue:self.callbackQueue onSuccess:^(NSDictionary *userObject) {
+            sendQuery();
+        } onFailure:^(NSError *theError) {
+            networkError = [self SM_tokenRefreshFailedError];
+            dispatch_group_leave(group);
+        }];
+    } else {
+        sendQuery();
+    }
+    
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(group);
+#endif
+    
+    if (networkError) {
+        if (error != NULL) {
+            *error = (__bridge id)(__bridge_retained CFTypeRef)networkError;
+        }
+        return nil;
+    }
+    
+    NSEntityDescription *entity = [fetchRequest entity];
+    NSMutableDictionary *propertyNamesByField = [NSMutableDictionary dictionary];
+    for (NSString *field in [query groupByFields]) {
+        NSPropertyDescription *property = [entity propertyForSMFieldName:field];
+        if (property) {
+            [propertyNamesByField setObject:[property name] forKey:field];
+        }
+    }
+    
+    NSMutableArray *expressionDescriptions = [NSMutableArray array];
+    for (id property in [fetchRequest propertiesToFetch]) {
+        if ([property isKindOfClass:[NSExpressionDescription class]]) {
+            [expressionDescriptions addObject:property];
+        }
+    }
+    
+    NSArray *results = [rows map:^(id row) {
+        // Group values are converted the way fetched objects are, so dates and related objects come back as Core Data returns them
+        NSDictionary *serializedRow = [self SM_responseSerializationForDictionary:row schemaEntityDescription:entity managedObjectContext:context includeRelationships:NO];
+        NSMutableDictionary *result = [NSMutableDictionary dictionary];
+        [propertyNamesByField enumerateKeysAndObjectsUsingBlock:^(id field, id propertyName, BOOL *stop) {
+            id value = [serializedRow objectForKey:propertyName];
+            if (value && value != [NSNull null]) {
+                [result setObject:value forKey:propertyName];
+            }
+        }];
+        
+        for (NSExpressionDescription *expressionDescription in expressionDescriptions) {
+            id value = [row objectForKey:[expressionDescription name]];
+            if (!value || value == [NSNull null]) {
+                continue;
+            }
+            if ([expressionDescription expressionResultType] == NSDateAttributeType && [value isKindOfClass:[NSNumber class]]) {
+                value = [NSDate dateWithTimeIntervalSince1970:[value doubleValue] / 1000.0000];
+            }
+            [result setObject:value forKey:[expressionDescription name]];
+        }
+        
+        return [NSDictionary dictionaryWithDictionary:result];
+    }];
+    
+    if ([[fetchRequest sortDescriptors] count] > 0) {
+        results = [results sortedArrayUsingDescriptors:[fetchRequest sortDescriptors]];
     }
+    
+    NSUInteger fetchOffset = MIN([fetchRequest fetchOffset], [results count]);
+    NSUInteger fetchLimit = [fetchRequest fetchLimit] > 0 ? MIN([fetchRequest fetchLimit], [results count] - fetchOffset) : [results count] - fetchOffset;
+    
+    return [results subarrayWithRange:NSMakeRange(fetchOffset, fetchLimit)];
 }
 
-// Returns NSArray<NSManagedObjectID>
-- (id)SM_fetchObjectIDs:(NSFetchRequest *)fetchRequest withContext:(NSManagedObjectContext *)context options:(SMRequestOptions *)options error:(NSError *__autoreleasing *)error {
+/*
+ Runs the dictionary fetch against the cache, so SQLite computes the aggregates.  Stub rows for related objects that were never read are left out, and object IDs of the cache are translated back to this store's.  When cachedObjectCount is given, it is set to the number of cached objects the rows were computed from.
+ */
+- (NSArray *)SM_fetchAggregatesFromCache:(NSFetchRequest *)fetchRequest cachedObjectCount:(NSUInteger *)cachedObjectCount error:(NSError *__autoreleasing *)error
+{
     if (SM_CORE_DATA_DEBUG) { DLog() }
     
-    NSFetchRequest *fetchCopy = [fetchRequest copy];
-    
-    [fetchCopy setResultType:NSManagedObjectResultType];
+    NSEntityDescription *entity = [fetchRequest entity];
+    NSPredicate *predicate = [fetchRequest predicate];
     
-    if ([fetchRequest fetchBatchSize] > 0) {
-        [fetchCopy setFetchBatchSize:[fetchRequest fetchBatchSize]];
+    if ([self containsSMPredicate:predicate]) {
+        predicate = [self SM_cachePredicateForGeoPredicate:predicate entity:entity remoteIDsByDistance:NULL];
+        if (!predicate) {
+            if (cachedObjectCount != NULL) {
+                *cachedObjectCount = 0;
+            }
+            return [NSArray array];
+        }
+    } else if (predicate) {
+        NSPredicate *parsedPredicate = [self SM_parsePredicate:predicate];
+        if (parsedPredicate) {
+            predicate = parsedPredicate;
+        }
     }
     
-    NSArray *objects = [self SM_fetchObjects:fetchCopy withContext:context options:options error:error];
+    NSPredicate *stubPredicate = [NSPredicate predicateWithFormat:@"NOT (%K ENDSWITH %@)", [self SM_cachePrimaryKeyFieldForEntity:entity], @":nil"];
     
-    // Error check
-    if (*error != nil) {
+    NSFetchRequest *cacheFetchRequest = [fetchRequest copy];
+    [cacheFetchRequest setPredicate:predicate ? [NSCompoundPredicate andPredicateWithSubpredicates:[NSArray arrayWithObjects:predicate, stubPredicate, nil]] : stubPredicate];
+    
+    __block NSArray *localCacheResults = nil;
+    __block NSUInteger localCacheCount = 0;
+    __block NSError *localCacheError = nil;
+    [self.localManagedObjectContext performBlockAndWait:^{
+        localCacheResults = [self.localManagedObjectContext executeFetchRequest:cacheFetchRequest error:&localCacheError];
+        if (localCacheResults && cachedObjectCount != NULL) {
+            NSFetchRequest *countFetchRequest = [[NSFetchRequest alloc] initWithEntityName:[entity name]];
+            [countFetchRequest setPredicate:[cacheFetchRequest predicate]];
+            localCacheCount = [self.localManagedObjectContext countForFetchRequest:countFetchRequest error:&localCacheError];
+        }
+    }];
+    
+    if (localCacheError != nil || localCacheCount == NSNotFound) {
+        if (error != NULL) {
+            *error = (__bridge id)(__bridge_retained CFTypeRef)localCacheError;
+        }
         return nil;
     }
     
-    return [objects map:^(id item) {
-        return [item objectID];
+    return [localCacheResults map:^(id row) {
+        NSMutableDictionary *result = [NSMutableDictionary dictionaryWithDictionary:row];
+        [row enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if ([value isKindOfClass:[NSManagedObjectID class]]) {
+                NSString *remoteID = [self SM_getRemoteIDForCacheManagedObjectID:value];
+                if (remoteID) {
+                    [result setObject:[self newObjectIDForEntity:[value entity] referenceObject:remoteID] forKey:key];
+                } else {
+                    [result removeObjectForKey:key];
+                }
+            }
+        }];
+        return [NSDictionary dictionaryWithDictionary:result];
     }];
 }
 
@@ -1678,12 +2686,12 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
             
             if (SM_CORE_DATA_DEBUG) { DLog(@"Cache object id not found, need to pull from server if possible") }
             
-            SMRequestOptions *optionsFromDictionary = [[[NSThread currentThread] threadDictionary] objectForKey:SMRequestSpecificOptions];
+            SMRequestOptions *optionsFromRequestContext = [[SMRequestContext requestContextForManagedObjectContext:context] options];
             SMRequestOptions *optionsForRequest = nil;
             if (self.isSaving) {
-                if (optionsFromDictionary) {
+                if (optionsFromRequestContext) {
                     optionsForRequest = [SMRequestOptions options];
-                    [optionsForRequest setIsSecure:[optionsFromDictionary isSecure]];
+                    [optionsForRequest setIsSecure:[optionsFromRequestContext isSecure]];
                 } else {
                     optionsForRequest = self.coreDataStore.globalRequestOptions;
                 }
@@ -1739,12 +2747,12 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         if (range.location != NSNotFound) {
             
             // TODO possible to return error if network not available?
-            SMRequestOptions *optionsFromDictionary = [[[NSThread currentThread] threadDictionary] objectForKey:SMRequestSpecificOptions];
+            SMRequestOptions *optionsFromRequestContext = [[SMRequestContext requestContextForManagedObjectContext:context] options];
             SMRequestOptions *optionsForRequest = nil;
             if (self.isSaving) {
-                if (optionsFromDictionary) {
+                if (optionsFromRequestContext) {
                     optionsForRequest = [SMRequestOptions options];
-                    [optionsForRequest setIsSecure:[optionsFromDictionary isSecure]];
+                    [optionsForRequest setIsSecure:[optionsFromRequestContext isSecure]];
                 } else {
                     optionsForRequest = self.coreDataStore.globalRequestOptions;
                 }
@@ -1794,12 +2802,12 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         
         // Cache is not enabled, must read from server if possible
         
-        SMRequestOptions *optionsFromDictionary = [[[NSThread currentThread] threadDictionary] objectForKey:SMRequestSpecificOptions];
+        SMRequestOptions *optionsFromRequestContext = [[SMRequestContext requestContextForManagedObjectContext:context] options];
         SMRequestOptions *optionsForRequest = nil;
         if (self.isSaving) {
-            if (optionsFromDictionary) {
+            if (optionsFromRequestContext) {
                 optionsForRequest = [SMRequestOptions options];
-                [optionsForRequest setIsSecure:[optionsFromDictionary isSecure]];
+                [optionsForRequest setIsSecure:[optionsFromRequestContext isSecure]];
             } else {
                 optionsForRequest = self.coreDataStore.globalRequestOptions;
             }
@@ -1916,32 +2924,32 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                 return [NSArray array];
             }
             __block NSMutableArray *arrayToReturn = [NSMutableArray array];
-            __block BOOL shouldRetreiveFromNetwork = NO;
+            __block NSMutableArray *missingRemoteIDs = [NSMutableArray array];
             
             [relatedObjectCacheReferenceSet enumerateObjectsUsingBlock:^(id cacheManagedObject, NSUInteger idx, BOOL *stop) {
                 
-                // If primary key includes the nil string, this was just a reference and we need to retreive online, if possible
+                // If primary key includes the nil string, this was just a reference and the object needs to be retreived online, if possible
                 NSString *relatedObjectRemoteID = [cacheManagedObject valueForKey:primaryKeyField];
                 NSRange range = [relatedObjectRemoteID rangeOfString:@":nil"];
                 if (range.location != NSNotFound) {
-                    // All objects are likely references, retreive object online if possible
-                    shouldRetreiveFromNetwork = YES;
-                    *stop = YES;
-                } else {
-                    // Use primary key id to create in-memory context managed object ID equivalent
-                    NSManagedObjectID *sm_managedObjectID = [self newObjectIDForEntity:[relationship destinationEntity] referenceObject:relatedObjectRemoteID];
-                    
-                    [arrayToReturn addObject:sm_managedObjectID];
+                    relatedObjectRemoteID = [relatedObjectRemoteID substringToIndex:range.location];
+                    [missingRemoteIDs addObject:relatedObjectRemoteID];
                 }
                 
+                // Use primary key id to create in-memory context managed object ID equivalent
+                NSManagedObjectID *sm_managedObjectID = [self newObjectIDForEntity:[relationship destinationEntity] referenceObject:relatedObjectRemoteID];
+                
+                [arrayToReturn addObject:sm_managedObjectID];
+                
             }];
             
-            if (shouldRetreiveFromNetwork) {
-                [arrayToReturn removeAllObjects];
+            if ([missingRemoteIDs count] > 0) {
+                // Only the referenced objects are read, membership of the relationship is already known from the cache
                 // TODO add per-request options?
                 SMRequestOptions *optionsForRetrieval = self.coreDataStore.globalRequestOptions;
-                id resultToReturn =  [self SM_retrieveAndCacheRelatedObjectForRelationship:relationship parentObject:sm_managedObject referenceID:sm_managedObjectReferenceID options:optionsForRetrieval context:context error:error];
-                arrayToReturn = resultToReturn;
+                if (![self SM_retrieveAndCacheObjectsWithIDs:missingRemoteIDs entity:[relationship destinationEntity] options:optionsForRetrieval context:context error:error]) {
+                    return nil;
+                }
             }
             
             return arrayToReturn;
@@ -1976,12 +2984,12 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         // Cache is not enabled, read from server if possible
         
         id result = nil;
-        SMRequestOptions *optionsFromDictionary = [[[NSThread currentThread] threadDictionary] objectForKey:SMRequestSpecificOptions];
+        SMRequestOptions *optionsFromRequestContext = [[SMRequestContext requestContextForManagedObjectContext:context] options];
         SMRequestOptions *optionsForRequest = nil;
         if (self.isSaving) {
-            if (optionsFromDictionary) {
+            if (optionsFromRequestContext) {
                 optionsForRequest = [SMRequestOptions options];
-                [optionsForRequest setIsSecure:[optionsFromDictionary isSecure]];
+                [optionsForRequest setIsSecure:[optionsFromRequestContext isSecure]];
             } else {
                 optionsForRequest = self.coreDataStore.globalRequestOptions;
             }
@@ -2037,8 +3045,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     _localManagedObjectModel = self.localManagedObjectModel;
     _localManagedObjectContext = self.localManagedObjectContext;
     _localPersistentStoreCoordinator = self.localPersistentStoreCoordinator;
-    [self SM_readCacheMap];
-    [self SM_readDirtyQueue];
+    // The cache map and dirty queue are read on first use, see cacheMappingTable and dirtyQueue
     if (SM_CORE_DATA_DEBUG) {DLog(@"STACKMOB SYSTEM UPDATE: Cache initialized and ready to go.")}
     
 }
@@ -2087,76 +3094,145 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     return _localPersistentStoreCoordinator;
 }
 
+- (NSMutableDictionary *)cacheMappingTable
+{
+    if (_cacheMappingTable == nil) {
+        @synchronized(self) {
+            if (_cacheMappingTable == nil) {
+                [self SM_readCacheMap];
+            }
+        }
+    }
+    
+    return _cacheMappingTable;
+}
+
+- (SMGeoIndex *)geoIndex
+{
+    if (_geoIndex == nil) {
+        @synchronized(self) {
+            if (_geoIndex == nil) {
+                [self SM_readGeoIndex];
+            }
+        }
+    }
+    
+    return _geoIndex;
+}
+
+- (NSCache *)SM_queryPlanCache
+{
+    if (_queryPlanCache == nil) {
+        @synchronized(self) {
+            if (_queryPlanCache == nil) {
+                _queryPlanCache = [[NSCache alloc] init];
+                [_queryPlanCache setCountLimit:SM_QUERY_PLAN_CACHE_COUNT_LIMIT];
+            }
+        }
+    }
+    
+    return _queryPlanCache;
+}
+
+- (NSMutableDictionary *)dirtyQueue
+{
+    if (_dirtyQueue == nil) {
+        @synchronized(self) {
+            if (_dirtyQueue == nil) {
+                [self SM_readDirtyQueue];
+            }
+        }
+    }
+    
+    return _dirtyQueue;
+}
+
 - (void)SM_readCacheMap
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
-    NSString *errorDesc = nil;
-    NSPropertyListFormat format;
+    NSError *error = nil;
     NSURL *mapPath = [FileManagement SM_getStoreURLForFileComponent:CACHE_MAP_FILE coreDataStore:self.coreDataStore];
+    NSURL *legacyMapPath = [FileManagement SM_getStoreURLForFileComponent:LEGACY_CACHE_MAP_FILE coreDataStore:self.coreDataStore];
     
-    if ([[NSFileManager defaultManager] fileExistsAtPath:[mapPath path]]) {
-        NSData *plistXML = [[NSFileManager defaultManager] contentsAtPath:[mapPath path]];
-        NSDictionary *temp = (NSDictionary *)[NSPropertyListSerialization
-                                              propertyListFromData:plistXML
-                                              mutabilityOption:NSPropertyListMutableContainersAndLeaves
-                                              format:&format
-                                              errorDescription:&errorDesc];
-        
-        if (!temp) {
-            [NSException raise:SMExceptionCacheError format:@"Error reading cachemap: %@, format: %ld", errorDesc, (unsigned long)format];
-        } else {
-            self.cacheMappingTable = [temp mutableCopy];
-        }
-    } else {
-        self.cacheMappingTable = [NSMutableDictionary dictionary];
+    NSMutableDictionary *temp = [FileManagement SM_readMetadataAtURL:mapPath legacyPropertyListURL:legacyMapPath error:&error];
+    
+    if (error) {
+        [NSException raise:SMExceptionCacheError format:@"Error reading cachemap: %@", error];
     }
+    
+    self.cacheMappingTable = temp ? temp : [NSMutableDictionary dictionary];
 }
 
 - (void)SM_saveCacheMap
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     if (SM_CORE_DATA_DEBUG) {DLog(@"Saving current cache map: \n%@", self.cacheMappingTable)}
-    NSString *errorDesc = nil;
     NSError *error = nil;
     NSURL *mapPath = [FileManagement SM_getStoreURLForFileComponent:CACHE_MAP_FILE coreDataStore:self.coreDataStore];
     
-    NSData *mapData = [NSPropertyListSerialization dataFromPropertyList:self.cacheMappingTable
-                                                                 format:NSPropertyListXMLFormat_v1_0
-                                                       errorDescription:&errorDesc];
-    
-    if (!mapData) {
-        [NSException raise:SMExceptionCacheError format:@"Error serializing cachemap data with error description %@", errorDesc];
+    BOOL successfulWrite = NO;
+    @synchronized(self) {
+        successfulWrite = [FileManagement SM_writeMetadata:self.cacheMappingTable toURL:mapPath error:&error];
     }
-    
-    BOOL successfulWrite = [mapData writeToFile:[mapPath path] options:NSDataWritingAtomic error:&error];
     if (!successfulWrite) {
         [NSException raise:SMExceptionCacheError format:@"Error saving cachemap data with error %@", error];
     }
     
+    if ([self.geoIndex hasChanges]) {
+        [self SM_saveGeoIndex];
+    }
+    
+}
+
+- (void)SM_readGeoIndex
+{
+    if (SM_CORE_DATA_DEBUG) {DLog()}
+    
+    NSError *error = nil;
+    NSURL *indexPath = [FileManagement SM_getStoreURLForFileComponent:GEO_INDEX_FILE coreDataStore:self.coreDataStore];
+    
+    NSDictionary *points = [FileManagement SM_readMetadataAtURL:indexPath legacyPropertyListURL:nil error:&error];
+    
+    if (error) {
+        // The index can be rebuilt as objects are cached again, so start over rather than fail
+        if (SM_CORE_DATA_DEBUG) {DLog(@"Error reading geo index, starting with an empty one: %@", error)}
+        points = nil;
+    }
+    
+    self.geoIndex = [[SMGeoIndex alloc] initWithPoints:points];
+}
+
+- (void)SM_saveGeoIndex
+{
+    if (SM_CORE_DATA_DEBUG) {DLog()}
+    
+    NSError *error = nil;
+    NSURL *indexPath = [FileManagement SM_getStoreURLForFileComponent:GEO_INDEX_FILE coreDataStore:self.coreDataStore];
+    
+    if ([FileManagement SM_writeMetadata:[self.geoIndex points] toURL:indexPath error:&error]) {
+        [self.geoIndex markSaved];
+    } else {
+        if (SM_CORE_DATA_DEBUG) {DLog(@"Error saving geo index: %@", error)}
+    }
 }
 
 - (void)SM_readDirtyQueue
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
-    NSString *errorDesc = nil;
-    NSPropertyListFormat format;
+    NSError *error = nil;
     NSURL *mapPath = [FileManagement SM_getStoreURLForFileComponent:DIRTY_QUEUE_FILE coreDataStore:self.coreDataStore];
+    NSURL *legacyMapPath = [FileManagement SM_getStoreURLForFileComponent:LEGACY_DIRTY_QUEUE_FILE coreDataStore:self.coreDataStore];
     
-    if ([[NSFileManager defaultManager] fileExistsAtPath:[mapPath path]]) {
-        NSData *plistXML = [[NSFileManager defaultManager] contentsAtPath:[mapPath path]];
-        NSDictionary *temp = (NSDictionary *)[NSPropertyListSerialization
-                                              propertyListFromData:plistXML
-                                              mutabilityOption:NSPropertyListMutableContainersAndLeaves
-                                              format:&format
-                                              errorDescription:&errorDesc];
-        
-        if (!temp) {
-            [NSException raise:SMExceptionCacheError format:@"Error reading dirty queue file: %@, format: %ld", errorDesc, (unsigned long)format];
-        } else {
-            self.dirtyQueue = [temp mutableCopy];
-        }
+    NSMutableDictionary *temp = [FileManagement SM_readMetadataAtURL:mapPath legacyPropertyListURL:legacyMapPath error:&error];
+    
+    if (error) {
+        [NSException raise:SMExceptionCacheError format:@"Error reading dirty queue file: %@", error];
+    }
+    
+    if (temp) {
+        self.dirtyQueue = temp;
     } else {
         self.dirtyQueue = [NSMutableDictionary dictionary];
         [self.dirtyQueue setObject:[NSArray array] forKey:SMDirtyInsertedObjectKeys];
@@ -2169,23 +3245,19 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
-    NSString *errorDesc = nil;
     NSError *error = nil;
     NSURL *mapPath = [FileManagement SM_getStoreURLForFileComponent:DIRTY_QUEUE_FILE coreDataStore:self.coreDataStore];
     
-    NSData *mapData = [NSPropertyListSerialization dataFromPropertyList:self.dirtyQueue
-                                                                 format:NSPropertyListXMLFormat_v1_0
-                                                       errorDescription:&errorDesc];
-    
-    if (!mapData) {
-        [NSException raise:SMExceptionCacheError format:@"Error serializing dirty queue data with error description %@", errorDesc];
-    }
-    
-    BOOL successfulWrite = [mapData writeToFile:[mapPath path] options:NSDataWritingAtomic error:&error];
+    BOOL successfulWrite = [FileManagement SM_writeMetadata:self.dirtyQueue toURL:mapPath error:&error];
     if (!successfulWrite) {
         [NSException raise:SMExceptionCacheError format:@"Error saving dirty queue data with error %@", error];
     } else {
         
+        if (SMMetricsEnabled()) {
+            NSUInteger dirtyQueueDepth = [[self.dirtyQueue objectForKey:SMDirtyInsertedObjectKeys] count] + [[self.dirtyQueue objectForKey:SMDirtyUpdatedObjectKeys] count] + [[self.dirtyQueue objectForKey:SMDirtyDeletedObjectKeys] count];
+            SMMetricsSetGauge(SMMetricsDirtyQueueDepthGauge, dirtyQueueDepth);
+        }
+        
         // Send dirtyQueue to core data store
         NSNotification *notification = [NSNotification notificationWithName:@"SMDirtyQueueNotification" object:self userInfo:[NSDictionary dictionaryWithObject:[self.dirtyQueue copy] forKey:@"SMDirtyQueue"]];
         [[NSNotificationCenter defaultCenter] postNotification:notification];
@@ -2205,6 +3277,10 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         [objectsToBeCached enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
             [self SM_serializeAndCacheObjectWithID:obj[0] values:obj[1] entity:obj[2] context:obj[3]];
         }];
+        
+        if ([objectsToBeCached count] > 0) {
+            [self SM_saveCacheMap];
+        }
     }
 }
 
@@ -2260,6 +3336,8 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     __block NSDictionary *objectFromServer;
     __block NSError *blockError = nil;
     
+    options = [self SM_requestOptions:options withDefaultPriority:SMRequestPriorityUtility];
+    
     // create a group dispatch and queue
     dispatch_queue_t queue = dispatch_queue_create("com.stackmob.objectRetrievalQueue", NULL);
     dispatch_group_t group = dispatch_group_create();
@@ -2344,12 +3422,9 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     __block NSDictionary *objectDictionaryFromRead = nil;
     __block NSString *sm_fieldName = [sm_managedObjectEntity SMFieldNameForProperty:relationship];
     
-    // TODO support global expand depth functionality
-    [options setExpandDepth:1];
-    objectDictionaryFromRead = [self SM_retrieveObjectWithID:referenceID entity:sm_managedObjectEntity options:options context:context error:error];
-    NSMutableDictionary *headersCopy = [[options headers] mutableCopy];
-    [headersCopy removeObjectForKey:@"X-StackMob-Expand"];
-    [options setHeaders:[NSDictionary dictionaryWithDictionary:headersCopy]];
+    // Expand on a copy so the caller's options, usually the global ones, are left alone
+    SMRequestOptions *optionsWithExpansion = [self SM_requestOptions:options prefetchingRelationshipKeyPaths:[NSArray arrayWithObject:[relationship name]] entity:sm_managedObjectEntity];
+    objectDictionaryFromRead = [self SM_retrieveObjectWithID:referenceID entity:sm_managedObjectEntity options:optionsWithExpansion context:context error:error];
     
     if (!objectDictionaryFromRead) {
         return nil;
@@ -2442,6 +3517,76 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
 }
 
+/*
+ Reads the objects with the given remote IDs using one [in] query per chunk of IDs and caches them.  Cache entries that were reference stubs are filled in place, so relationships pointing at them are left as they are.
+ */
+- (BOOL)SM_retrieveAndCacheObjectsWithIDs:(NSArray *)remoteIDs entity:(NSEntityDescription *)entity options:(SMRequestOptions *)options context:(NSManagedObjectContext *)context error:(NSError *__autoreleasing*)error
+{
+    if (SM_CORE_DATA_DEBUG) {DLog()}
+    
+    NSString *primaryKeyField = nil;
+    @try {
+        primaryKeyField = [entity SMPrimaryKeyField];
+    }
+    @catch (NSException *exception) {
+        primaryKeyField = [self.coreDataStore.session userPrimaryKeyField];
+    }
+    
+    options = [self SM_requestOptions:options withDefaultPriority:SMRequestPriorityUtility];
+    
+    __block NSMutableArray *objectsFromServer = [NSMutableArray array];
+    __block NSError *blockError = nil;
+    
+    // create a group dispatch and queue
+    dispatch_queue_t queue = dispatch_queue_create("com.stackmob.relatedObjectsRetrievalQueue", NULL);
+    dispatch_group_t group = dispatch_group_create();
+    
+    for (NSUInteger chunkStart = 0; chunkStart < [remoteIDs count]; chunkStart += SM_RELATED_OBJECTS_QUERY_CHUNK_SIZE) {
+        NSArray *chunk = [remoteIDs subarrayWithRange:NSMakeRange(chunkStart, MIN((NSUInteger)SM_RELATED_OBJECTS_QUERY_CHUNK_SIZE, [remoteIDs count] - chunkStart))];
+        SMQuery *query = [[SMQuery alloc] initWithEntity:entity];
+        [query where:primaryKeyField isIn:chunk];
+        [query fromIndex:0 toIndex:[chunk count] - 1];
+        
+        dispatch_group_enter(group);
+        [self.coreDataStore performQuery:query options:options successCallbackQueue:queue failureCallbackQueue:queue onSuccess:^(NSArray *results) {
+            [objectsFromServer addObjectsFromArray:results];
+            dispatch_group_leave(group);
+        } onFailure:^(NSError *queryError) {
+            if (SM_CORE_DATA_DEBUG) { DLog(@"Could not read related objects with error userInfo %@", [queryError userInfo]) }
+            blockError = queryError;
+            dispatch_group_leave(group);
+        }];
+    }
+    
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(group);
+    dispatch_release(queue);
+#endif
+    
+    if (blockError) {
+        if (NULL != error) {
+            *error = [[NSError alloc] initWithDomain:[blockError domain] code:[blockError code] userInfo:[blockError userInfo]];
+            *error = (__bridge id)(__bridge_retained CFTypeRef)*error;
+        }
+        return NO;
+    }
+    
+    [objectsFromServer enumerateObjectsUsingBlock:^(id objectFromServer, NSUInteger idx, BOOL *stop) {
+        [self SM_serializeAndCacheObjectWithID:[objectFromServer objectForKey:primaryKeyField] values:objectFromServer entity:entity context:context];
+    }];
+    
+    if ([objectsFromServer count] > 0) {
+        if (![self SM_saveCache:error]) {
+            return NO;
+        }
+        [self SM_saveCacheMap];
+    }
+    
+    return YES;
+}
+
 - (void)SM_serializeAndCacheObjectWithID:(NSString *)objectID values:(NSDictionary *)values entity:(NSEntityDescription *)entity context:(NSManagedObjectContext *)context
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
@@ -2456,6 +3601,8 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     // Populate cached object
     [self SM_populateCacheManagedObject:cacheManagedObject withDictionary:serializedObjectDict entity:entity];
+    
+    [self SM_confirmRemoteID:objectID entityName:[entity name] serverValues:values];
 }
 
 - (void)SM_populateManagedObject:(NSManagedObject *)object withDictionary:(NSDictionary *)dictionary entity:(NSEntityDescription *)entity
@@ -2590,6 +3737,8 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         
     }];
     
+    [self SM_indexGeoPointsOfCacheManagedObject:object entity:entity];
+    
     NSError *saveError = nil;
     BOOL saveSuccess = [self SM_saveCache:&saveError];
     if (!saveSuccess) {
@@ -2597,6 +3746,59 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     }
 }
 
+/*
+ Adds the geo point attributes of a cache object to the geo index, or removes them when they are cleared.
+ */
+- (void)SM_indexGeoPointsOfCacheManagedObject:(NSManagedObject *)object entity:(NSEntityDescription *)entity
+{
+    NSString *remoteID = [object valueForKey:[self SM_cachePrimaryKeyFieldForEntity:entity]];
+    if (![remoteID isKindOfClass:[NSString class]] || [remoteID rangeOfString:@":nil"].location != NSNotFound) {
+        return;
+    }
+    
+    [[entity attributesByName] enumerateKeysAndObjectsUsingBlock:^(id attributeName, id attributeDescription, BOOL *stop) {
+        if ([(NSAttributeDescription *)attributeDescription attributeType] != NSTransformableAttributeType) {
+            return;
+        }
+        
+        NSString *field = [entity SMFieldNameForProperty:attributeDescription];
+        NSDictionary *geoPoint = [self SM_geoPointFromCacheValue:[object valueForKey:attributeName]];
+        if (geoPoint) {
+            CLLocationCoordinate2D coordinate = CLLocationCoordinate2DMake([[geoPoint latitude] doubleValue], [[geoPoint longitude] doubleValue]);
+            [self.geoIndex setCoordinate:coordinate forRemoteID:remoteID field:field entityName:[entity name]];
+        } else {
+            [self.geoIndex removeRemoteID:remoteID field:field entityName:[entity name]];
+        }
+    }];
+}
+
+- (NSDictionary *)SM_geoPointFromCacheValue:(id)value
+{
+    if ([value isKindOfClass:[NSDictionary class]]) {
+        // Attributes using SMGeoPointTransformer are decoded by Core Data
+        return ([(NSDictionary *)value latitude] && [(NSDictionary *)value longitude]) ? value : nil;
+    }
+    
+    if (![value isKindOfClass:[NSData class]]) {
+        return nil;
+    }
+    
+    return [SMGeoPointTransformer geoPointWithData:value];
+}
+
+- (NSString *)SM_cachePrimaryKeyFieldForEntity:(NSEntityDescription *)entity
+{
+    NSString *primaryKeyField = nil;
+    @try {
+        primaryKeyField = [entity primaryKeyField];
+    }
+    @catch (NSException *exception) {
+        primaryKeyField = [self.coreDataStore.session userPrimaryKeyField];
+    }
+    
+    return primaryKeyField;
+}
+
 - (NSManagedObjectID *)SM_retrieveCacheObjectForRemoteID:(NSString *)remoteID entityName:(NSString *)entityName createIfNeeded:(BOOL)createIfNeeded serverLastModDate:(NSDate *)serverLastModDate {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
@@ -2649,43 +3851,78 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 {
     if (SM_CORE_DATA_DEBUG) { DLog() }
     // TODO if remoteID already exists
-    NSDictionary *tempDict = [list objectForKey:entityName];
-    
-    NSMutableDictionary *objectIDsForEntity = tempDict ? [tempDict mutableCopy] : [NSMutableDictionary dictionary];
-    
-    if ([[objectIDsForEntity allKeys] indexOfObject:objectID] == NSNotFound) {
-        if (SM_CORE_DATA_DEBUG) { DLog(@"cacheObjectID is %@", cacheObjectID) }
-        NSString *cacheObjectIDString = [[cacheObjectID URIRepresentation] absoluteString];
-        NSArray *components = [cacheObjectIDString componentsSeparatedByString:[NSString stringWithFormat:@"%@/", entityName]];
-        NSArray *valueToSave = serverLastModDate ? [NSArray arrayWithObjects:[components lastObject], serverLastModDate, nil] : [NSArray arrayWithObject:[components lastObject]];
-        [objectIDsForEntity setObject:valueToSave forKey:objectID];
-    } else {
-        // Need to replace
-
+    @synchronized(self) {
+        NSDictionary *tempDict = [list objectForKey:entityName];
+        
+        NSMutableDictionary *objectIDsForEntity = tempDict ? [tempDict mutableCopy] : [NSMutableDictionary dictionary];
+        
+        if ([[objectIDsForEntity allKeys] indexOfObject:objectID] == NSNotFound) {
+            if (SM_CORE_DATA_DEBUG) { DLog(@"cacheObjectID is %@", cacheObjectID) }
+            NSString *cacheObjectIDString = [[cacheObjectID URIRepresentation] absoluteString];
+            NSArray *components = [cacheObjectIDString componentsSeparatedByString:[NSString stringWithFormat:@"%@/", entityName]];
+            NSArray *valueToSave = serverLastModDate ? [NSArray arrayWithObjects:[components lastObject], serverLastModDate, nil] : [NSArray arrayWithObject:[components lastObject]];
+            [objectIDsForEntity setObject:valueToSave forKey:objectID];
+        } else {
+            // Need to replace
+            
+        }
+        
+        [list setObject:[NSDictionary dictionaryWithDictionary:objectIDsForEntity] forKey:entityName];
     }
-    
-    [list setObject:[NSDictionary dictionaryWithDictionary:objectIDsForEntity] forKey:entityName];
 }
 
-- (void)SM_removeRemoteID:(NSString *)objectID inList:(NSMutableDictionary *)list entityName:(NSString *)entityName
+/*
+ Marks the cache entry for objectID as confirmed against the server now.  values is the object dictionary as returned from the server.  The map is not saved to disk here, callers save it once per batch.
+ */
+- (void)SM_confirmRemoteID:(NSString *)objectID entityName:(NSString *)entityName serverValues:(NSDictionary *)values
 {
     if (SM_CORE_DATA_DEBUG) { DLog() }
-    NSDictionary *tempDict = [list objectForKey:entityName];
-    
-    NSMutableDictionary *objectIDsForEntity = tempDict ? [tempDict mutableCopy] : [NSMutableDictionary dictionary];
-    
-    if ([[objectIDsForEntity allKeys] indexOfObject:objectID] != NSNotFound) {
-        [objectIDsForEntity removeObjectForKey:objectID];
-    }
     
-    // If count of objectIDsForEntity is now 0, remove entity name from list
-    if ([objectIDsForEntity count] != 0) {
-        [list setObject:[NSDictionary dictionaryWithDictionary:objectIDsForEntity] forKey:entityName];
-    } else {
-        [list removeObjectForKey:entityName];
+    id serverLastModDateValue = [values objectForKey:SMLastModDateKey];
+    if (!serverLastModDateValue) {
+        return;
     }
     
+    long double convertedValue = [serverLastModDateValue doubleValue] / 1000.0000;
+    NSDate *serverLastModDate = [NSDate dateWithTimeIntervalSince1970:convertedValue];
     
+    // Fetches confirm entries from the network callbacks while saves update the map
+    @synchronized(self) {
+        NSDictionary *tempDict = [self.cacheMappingTable objectForKey:entityName];
+        NSArray *entry = [tempDict objectForKey:objectID];
+        if (!entry) {
+            return;
+        }
+        
+        NSMutableDictionary *objectIDsForEntity = [tempDict mutableCopy];
+        [objectIDsForEntity setObject:[NSArray arrayWithObjects:entry[0], serverLastModDate, [NSDate date], nil] forKey:objectID];
+        [self.cacheMappingTable setObject:[NSDictionary dictionaryWithDictionary:objectIDsForEntity] forKey:entityName];
+    }
+}
+
+- (void)SM_removeRemoteID:(NSString *)objectID inList:(NSMutableDictionary *)list entityName:(NSString *)entityName
+{
+    if (SM_CORE_DATA_DEBUG) { DLog() }
+    @synchronized(self) {
+        NSDictionary *tempDict = [list objectForKey:entityName];
+        
+        NSMutableDictionary *objectIDsForEntity = tempDict ? [tempDict mutableCopy] : [NSMutableDictionary dictionary];
+        
+        if ([[objectIDsForEntity allKeys] indexOfObject:objectID] != NSNotFound) {
+            [objectIDsForEntity removeObjectForKey:objectID];
+        }
+        
+        if (list == self.cacheMappingTable) {
+            [self.geoIndex removeRemoteID:objectID entityName:entityName];
+        }
+        
+        // If count of objectIDsForEntity is now 0, remove entity name from list
+        if ([objectIDsForEntity count] != 0) {
+            [list setObject:[NSDictionary dictionaryWithDictionary:objectIDsForEntity] forKey:entityName];
+        } else {
+            [list removeObjectForKey:entityName];
+        }
+    }
 }
 
 - (void)SM_addPrimaryKeysToDirtyQueueAndSave:(NSArray *)primaryKeys state:(int)state
@@ -2795,7 +4032,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
 {
     if (SM_CORE_DATA_DEBUG) {DLog()}
     
-    BOOL networkIsReachable = [self SM_checkNetworkAvailability];
+    BOOL networkIsReachable = [self SM_checkNetworkAvailabilityWithOptions:self.coreDataStore.globalRequestOptions];
     
     if (networkIsReachable) {
         [self.coreDataStore.globalRequestOptions setTryRefreshToken:YES];
@@ -2871,7 +4108,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     
     if ([dirtyInsertedObjects count] > 0) {
         
-        SMRequestOptions *options = self.coreDataStore.globalRequestOptions;
+        SMRequestOptions *options = [self SM_requestOptions:self.coreDataStore.globalRequestOptions withDefaultPriority:SMRequestPriorityBackground];
         
         __block NSMutableSet *objectsToMergeWithServerAsInserts = [NSMutableSet set];
         __block NSMutableSet *objectsToMergeWithServerAsUpdates = [NSMutableSet set];
@@ -3039,7 +4276,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         __block NSMutableArray *entriesToPurgeFromDirtyQueue = [NSMutableArray array];
         __block NSMutableArray *objectsToPurgeFromCache = [NSMutableArray array];
         
-        SMRequestOptions *options = self.coreDataStore.globalRequestOptions;
+        SMRequestOptions *options = [self SM_requestOptions:self.coreDataStore.globalRequestOptions withDefaultPriority:SMRequestPriorityBackground];
         
         // For each object
         [dirtyUpdatedObjects enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
@@ -3082,7 +4319,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                 __block NSDate *serverBaseLMD = nil;
                 NSDictionary *cacheEntry = [[self.cacheMappingTable objectForKey:objectEntityName] copy];
                 NSArray *primaryKeyEntry = [cacheEntry objectForKey:objectPrimaryKey];
-                if ([primaryKeyEntry count] == 2) {
+                if ([primaryKeyEntry count] >= 2) {
                     serverBaseLMD = primaryKeyEntry[1];
                 }
                 
@@ -3222,7 +4459,7 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
         __block NSMutableSet *objectsToDelete = [NSMutableSet set];
         __block NSMutableArray *objectsToCache = [NSMutableArray array];
         
-        SMRequestOptions *options = self.coreDataStore.globalRequestOptions;
+        SMRequestOptions *options = [self SM_requestOptions:self.coreDataStore.globalRequestOptions withDefaultPriority:SMRequestPriorityBackground];
         
         [dirtyDeletedObjects enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
             
@@ -3473,7 +4710,10 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
     NSURL *storeURL = [FileManagement SM_getStoreURLForFileComponent:SQL_DB coreDataStore:self.coreDataStore];
     [FileManagement SM_removeStoreURLPath:storeURL];
     
-    [self.cacheMappingTable removeAllObjects];
+    @synchronized(self) {
+        [self.cacheMappingTable removeAllObjects];
+    }
+    [self.geoIndex removeAllPoints];
     [self SM_saveCacheMap];
     
     _localManagedObjectContext = nil;
@@ -3809,8 +5049,13 @@ NSString* truncateOutputIfExceedsMaxLogLength(id objectToCheck) {
                 } else if (value && attributeDescription.attributeType == NSTransformableAttributeType) {
                     if ([value isKindOfClass:[NSDictionary class]]) {
                         // we know it's a geopoint dictionary
-                        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:value];
-                        [serializedDictionary setObject:data forKey:attributeName];
+                        if ([[attributeDescription valueTransformerName] isEqualToString:SMGeoPointTransformerName]) {
+                            // the transformer encodes it when it is stored
+                            [serializedDictionary setObject:value forKey:attributeName];
+                        } else {
+                            NSData *data = [NSKeyedArchiver archivedDataWithRootObject:value];
+                            [serializedDictionary setObject:data forKey:attributeName];
+                        }
                     }
                 } else {
                     [serializedDictionary setObject:value forKey:attributeName];
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <CoreData/CoreData.h>
+
+@class SMRequestOptions;
+
+/**
+ `SMRequestContext` carries everything about a single save or fetch that `SMIncrementalStore` needs to know while it handles it: the <SMRequestOptions> for the request, which also hold its deadline and priority, and an ID that ties together the debug logging for the request.
+ 
+ The methods of the <a href="http://stackmob.github.io/stackmob-ios-sdk/Categories/NSManagedObjectContext+Concurrency.html" target="_blank">NSManagedObjectContext+Concurrency category</a> attach a request context to each managed object context they save or fetch with, for exactly as long as the context runs the save or fetch.  The store looks it up from the managed object context it is handed, not from the current thread, so saves and fetches running one after the other on shared queues never pick up each other's options.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@interface SMRequestContext : NSObject
+
+/**
+ The options for the request, or `nil` to use the global request options of the `SMCoreDataStore`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong, readonly) SMRequestOptions *options;
+
+/**
+ A unique ID for the request, included in the Core Data debug logs.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, copy, readonly) NSString *traceID;
+
+/**
+ The response of a query sent before the fetch reached the store, either an array of results or an `NSError`.
+ 
+ Set by the asynchronous fetch methods so the store doesn't send the query again.  The store clears it once used.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property (nonatomic, strong) id networkFetchResponse;
+
+/**
+ A request context with a new trace ID.
+ 
+ @param options The options for the request, or `nil`.
+ 
+ @return A new instance of `SMRequestContext`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMRequestContext *)requestContextWithOptions:(SMRequestOptions *)options;
+
+/**
+ The request context attached to a managed object context.
+ 
+ Parent contexts are not consulted: they are confined to their own queues and may be running another save or fetch.  Code that hands work to a parent context attaches the request context to it explicitly with <performWithRequestContext:inManagedObjectContext:block:>.
+ 
+ @param context The managed object context to look up.
+ 
+ @return The attached request context, or `nil`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (SMRequestContext *)requestContextForManagedObjectContext:(NSManagedObjectContext *)context;
+
+/**
+ Attach a request context to a managed object context while `block` runs, and put back whatever was attached before once it returns.
+ 
+ Call this from the queue of `context`, for example inside performBlock:.
+ 
+ @param requestContext The request context to attach.  If `nil`, `block` is simply called.
+ @param context The managed object context to attach it to.
+ @param block The block to run, typically calling save: or executeFetchRequest:error: on `context`.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
++ (void)performWithRequestContext:(SMRequestContext *)requestContext inManagedObjectContext:(NSManagedObjectContext *)context block:(void (^)(void))block;
+
+@end
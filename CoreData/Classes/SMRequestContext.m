@@ -0,0 +1,73 @@
+/*
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "SMRequestContext.h"
+#import "SMRequestOptions.h"
+
+static NSString *const SM_RequestContextKey = @"SM_RequestContextKey";
+
+@interface SMRequestContext ()
+
+@property (nonatomic, strong, readwrite) SMRequestOptions *options;
+@property (nonatomic, copy, readwrite) NSString *traceID;
+
+@end
+
+@implementation SMRequestContext
+
+@synthesize options = _SM_options;
+@synthesize traceID = _SM_traceID;
+@synthesize networkFetchResponse = _SM_networkFetchResponse;
+
++ (SMRequestContext *)requestContextWithOptions:(SMRequestOptions *)options
+{
+    SMRequestContext *requestContext = [[SMRequestContext alloc] init];
+    requestContext.options = options;
+    
+    CFUUIDRef uuid = CFUUIDCreate(CFAllocatorGetDefault());
+    requestContext.traceID = (__bridge_transfer NSString *)CFUUIDCreateString(CFAllocatorGetDefault(), uuid);
+    CFRelease(uuid);
+    
+    return requestContext;
+}
+
++ (SMRequestContext *)requestContextForManagedObjectContext:(NSManagedObjectContext *)context
+{
+    // Only the context the store is handed; parents belong to other queues and may be running another request
+    return [[context userInfo] objectForKey:SM_RequestContextKey];
+}
+
++ (void)performWithRequestContext:(SMRequestContext *)requestContext inManagedObjectContext:(NSManagedObjectContext *)context block:(void (^)(void))block
+{
+    if (!requestContext) {
+        block();
+        return;
+    }
+    
+    NSMutableDictionary *userInfo = [context userInfo];
+    SMRequestContext *previousRequestContext = [userInfo objectForKey:SM_RequestContextKey];
+    [userInfo setObject:requestContext forKey:SM_RequestContextKey];
+    
+    block();
+    
+    if (previousRequestContext) {
+        [userInfo setObject:previousRequestContext forKey:SM_RequestContextKey];
+    } else {
+        [userInfo removeObjectForKey:SM_RequestContextKey];
+    }
+}
+
+@end
@@ -73,6 +73,9 @@
                                       path:(NSString *)path
                                 parameters:(NSDictionary *)parameters;
 
+// Sets the Authorization header on every request, sharing one timestamp across the batch.
+- (void) signBatchOfRequests:(NSArray *)requests;
+
 - (void)recordServerTimeDiffFromHeader:(NSString*)header;
 
 @end
@@ -54,19 +54,42 @@
 #define SERVER_TIME_DIFF_KEY @"serverTimeDiff"
 
 static NSString* URLEncodeString(NSString *string);
+static NSString* QueryComponentKey(NSString *component);
 
-@interface SMOAuth1Client()
+// Base string bytes are staged here and fed to the HMAC whenever it fills up, so signing never builds the base string itself
+typedef struct {
+    CCHmacContext context;
+    size_t length;
+    char bytes[256];
+} SMOAuth1SignatureBuffer;
+
+static void SignatureBufferFlush(SMOAuth1SignatureBuffer *buffer);
+static void SignatureBufferAppend(SMOAuth1SignatureBuffer *buffer, const char *bytes, size_t length);
+static void SignatureBufferAppendURLEncoded(SMOAuth1SignatureBuffer *buffer, NSString *string);
+
+@interface SMOAuth1Client() {
+    CCHmacContext _signingKeyContext;
+}
 @property (copy) NSString *consumerKey;
 @property (copy) NSString *consumerSecret;
 @property (copy) NSString *tokenIdentifier;
 @property (copy) NSString *tokenSecret;
 @property (nonatomic, readwrite) NSTimeInterval serverTimeDiff;
 @property (nonatomic, retain) NSDate *nextTimeCheck;
+@property (copy) NSString *encodedConsumerKey;
+@property (copy) NSString *encodedTokenIdentifier;
+@property (nonatomic, copy) NSString *normalizedBaseURL;
+@property (nonatomic, copy) NSString *normalizedSchemeAndHost;
 
 - (id) initWithBaseURL:(NSURL *)url;
-- (void) addGeneratedTimestampAndNonceInto:(NSMutableDictionary *)dictionary;
+- (void) rebuildSigningKey;
+- (NSString *) normalizedURLForAddress:(NSURL *)url;
+- (NSString *) schemeAndHostForAddress:(NSURL *)url;
+- (NSString *) baseURLforAddress:(NSURL *)url;
 
 - (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request;
+- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request timestamp:(NSString *)timestamp;
+- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request timestamp:(NSString *)timestamp nonce:(NSString *)nonce;
 
 @end
 
@@ -78,15 +101,20 @@ tokenIdentifier = _tokenIdentifier,
 signRequests = _signRequests,
 realm = _realm,
 serverTimeDiff = _serverTimeDiff,
-nextTimeCheck = _nextTimeCheck;
+nextTimeCheck = _nextTimeCheck,
+encodedConsumerKey = _encodedConsumerKey,
+encodedTokenIdentifier = _encodedTokenIdentifier,
+normalizedBaseURL = _normalizedBaseURL,
+normalizedSchemeAndHost = _normalizedSchemeAndHost;
 
 - (id) initWithBaseURL:(NSURL *)url consumerKey:(NSString *)consumerKey secret:(NSString *)consumerSecret {
     self = [super initWithBaseURL:url];
     
     if (self) {
         self.signRequests = YES;
-        self.consumerKey = consumerKey;
-        self.consumerSecret = consumerSecret;
+        self.normalizedBaseURL = [self baseURLforAddress:url];
+        self.normalizedSchemeAndHost = [self schemeAndHostForAddress:url];
+        [self setConsumerKey:consumerKey secret:consumerSecret];
         self.serverTimeDiff = [[NSUserDefaults standardUserDefaults] doubleForKey:SERVER_TIME_DIFF_KEY];
         self.nextTimeCheck = [NSDate date];
     }
@@ -99,13 +127,28 @@ nextTimeCheck = _nextTimeCheck;
 }
 
 - (void) setAccessToken:(NSString *)accessToken secret:(NSString *)secret {
-    self.tokenIdentifier = accessToken;
-    self.tokenSecret = secret;
+    @synchronized(self) {
+        self.tokenIdentifier = accessToken;
+        self.encodedTokenIdentifier = accessToken != nil ? URLEncodeString(accessToken) : nil;
+        self.tokenSecret = secret;
+        [self rebuildSigningKey];
+    }
 }
 
 - (void) setConsumerKey:(NSString *)consumerKey secret:(NSString *)secret {
-    self.consumerKey = consumerKey;
-    self.consumerSecret = secret;
+    @synchronized(self) {
+        self.consumerKey = consumerKey;
+        self.encodedConsumerKey = consumerKey != nil ? URLEncodeString(consumerKey) : nil;
+        self.consumerSecret = secret;
+        [self rebuildSigningKey];
+    }
+}
+
+- (void) rebuildSigningKey {
+    // The HMAC key only changes with the secrets, so it is scheduled once here rather than for every request
+    NSString *key = [NSString stringWithFormat:@"%@&%@", self.consumerSecret != nil ? URLEncodeString(self.consumerSecret) : @"", self.tokenSecret != nil ? URLEncodeString(self.tokenSecret) : @""];
+    const char *keyBytes = [key UTF8String];
+    CCHmacInit(&_signingKeyContext, kCCHmacAlgSHA1, keyBytes, strlen(keyBytes));
 }
 
 - (NSMutableURLRequest *) requestWithMethod:(NSString *)method
@@ -137,6 +180,14 @@ nextTimeCheck = _nextTimeCheck;
     return request;
 }
 
+- (void) signBatchOfRequests:(NSArray *)requests {
+    // The whole batch shares a timestamp, each request still gets its own nonce
+    NSString *timestamp = [NSString stringWithFormat:@"%ld", (long) [[self getServerTime] timeIntervalSince1970]];
+    for (NSMutableURLRequest *request in requests) {
+        [request setValue:[self authorizationHeaderValueForRequest:request timestamp:timestamp] forHTTPHeaderField:@"Authorization"];
+    }
+}
+
 #pragma mark - "private" methods.
 
 static const NSString *kOAuthSignatureMethodKey = @"oauth_signature_method";
@@ -148,109 +199,143 @@ static const NSString *kOAuthSignatureKey = @"oauth_signature";
 static const NSString *kOAuthSignatureTypeHMAC_SHA1 = @"HMAC-SHA1";
 static const NSString *kOAuthVersion1_0 = @"1.0";
 
-- (NSMutableDictionary *) mutableDictionaryWithOAuthInitialData {
-    NSMutableDictionary *result = [NSMutableDictionary dictionaryWithObjectsAndKeys:
-                                   kOAuthSignatureTypeHMAC_SHA1, kOAuthSignatureMethodKey,
-                                   kOAuthVersion1_0, kOAuthVersionKey,
-                                   nil];
-    
-    if (self.consumerKey) [result setObject:self.consumerKey forKey:kOAuthConsumerKey];
-    if (self.tokenIdentifier) [result setObject:self.tokenIdentifier forKey:kOAuthTokenIdentifier];
-    
-    [self addGeneratedTimestampAndNonceInto:result];
-    
-    return  result;
+- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request {
+    NSString *timestamp = [NSString stringWithFormat:@"%ld", (long) [[self getServerTime] timeIntervalSince1970]];
+    return [self authorizationHeaderValueForRequest:request timestamp:timestamp];
 }
 
-- (NSString *) stringWithOAuthParameters:(NSMutableDictionary *)oauthParams requestParameters:(NSDictionary *)parameters {
-    NSMutableDictionary *params = [NSMutableDictionary dictionaryWithDictionary:oauthParams];
-    [params addEntriesFromDictionary:parameters];
-    
-    // sorting parameters
-    NSArray *sortedKeys = [[params allKeys] sortedArrayUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
-        NSComparisonResult result = [key1 compare:key2 options:NSLiteralSearch];
-        if (result == NSOrderedSame)
-            result = [[params objectForKey:key1] compare:[params objectForKey:key2] options:NSLiteralSearch];
-        
-        return result;
-    }];
-    
-    // join keys and values with =
-    NSMutableArray *longListOfParameters = [NSMutableArray arrayWithCapacity:[sortedKeys count]];
-    [sortedKeys enumerateObjectsUsingBlock:^(NSString *key, NSUInteger idx, BOOL *stop) {
-        [longListOfParameters addObject:[NSString stringWithFormat:@"%@=%@", key, [params objectForKey:key]]];
-    }];
+- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request timestamp:(NSString *)timestamp {
+    CFUUIDRef theUUID = CFUUIDCreate(NULL);
+    NSString *nonce = (__bridge_transfer NSString *)CFUUIDCreateString(NULL, theUUID);
+    CFRelease(theUUID);
     
-    // join components with &
-    return [longListOfParameters componentsJoinedByString:@"&"];
+    return [self authorizationHeaderValueForRequest:request timestamp:timestamp nonce:nonce];
 }
 
-- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request {
-    NSURL *url = request.URL;
-    NSString *fixedURL = [self baseURLforAddress:url];
-    NSMutableDictionary *oauthParams = [self mutableDictionaryWithOAuthInitialData];
-    
-    // adding oauth_ extra params to the header
-    NSArray *parameterComponents = [[request.URL query] componentsSeparatedByString:@"&"];
-    NSMutableDictionary *parameters = [NSMutableDictionary dictionaryWithCapacity:[parameterComponents count]];
-    for(NSString *component in parameterComponents) {
-        NSArray *subComponents = [component componentsSeparatedByString:@"="];
-        if ([subComponents count] == 2) {
-            [parameters setObject:[subComponents objectAtIndex:1] forKey:[subComponents objectAtIndex:0]];
-        }
+- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request timestamp:(NSString *)timestamp nonce:(NSString *)nonce {
+    SMOAuth1SignatureBuffer buffer;
+    buffer.length = 0;
+    NSString *consumerKey = nil;
+    NSString *encodedConsumerKey = nil;
+    NSString *tokenIdentifier = nil;
+    NSString *encodedTokenIdentifier = nil;
+    @synchronized(self) {
+        buffer.context = _signingKeyContext;
+        consumerKey = self.consumerKey;
+        encodedConsumerKey = self.encodedConsumerKey;
+        tokenIdentifier = self.tokenIdentifier;
+        encodedTokenIdentifier = self.encodedTokenIdentifier;
     }
     
-    NSString *allParameters = [self stringWithOAuthParameters:oauthParams requestParameters:parameters];
-    // adding HTTP method and URL
-    NSString *signatureBaseString = [NSString stringWithFormat:@"%@&%@&%@", [request.HTTPMethod uppercaseString], URLEncodeString(fixedURL), URLEncodeString(allParameters)];
+    // The oauth_ params, already in sorted order, nil values are left out
+    NSString *oauthKeys[] = {(NSString *)kOAuthConsumerKey, @"oauth_nonce", (NSString *)kOAuthSignatureMethodKey, @"oauth_timestamp", (NSString *)kOAuthTokenIdentifier, (NSString *)kOAuthVersionKey};
+    NSString *oauthValues[] = {consumerKey, nonce, (NSString *)kOAuthSignatureTypeHMAC_SHA1, timestamp, tokenIdentifier, (NSString *)kOAuthVersion1_0};
+    NSUInteger oauthCount = sizeof(oauthKeys) / sizeof(oauthKeys[0]);
     
-    NSString *signature = [self signatureForBaseString:signatureBaseString];
+    // The query parameters, which are already percent encoded in the URL, sorted by key.  Only the last of a repeated key is signed.
+    NSArray *queryComponents = nil;
+    NSString *query = [request.URL query];
+    if ([query length] > 0) {
+        queryComponents = [[query componentsSeparatedByString:@"&"] sortedArrayWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSString *component1, NSString *component2) {
+            NSString *key1 = QueryComponentKey(component1);
+            NSString *key2 = QueryComponentKey(component2);
+            return [key1 ? key1 : @"" compare:key2 ? key2 : @"" options:NSLiteralSearch];
+        }];
+    }
+    NSUInteger queryCount = [queryComponents count];
     
-    // add to OAuth params
-    [oauthParams setObject:signature forKey:kOAuthSignatureKey];
+    // METHOD&encoded URL&encoded parameter string, where the parameter string is k=v pairs joined with &
+    NSString *method = [request.HTTPMethod uppercaseString];
+    SignatureBufferAppend(&buffer, [method UTF8String], [method lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+    SignatureBufferAppend(&buffer, "&", 1);
+    SignatureBufferAppendURLEncoded(&buffer, [self normalizedURLForAddress:request.URL]);
+    SignatureBufferAppend(&buffer, "&", 1);
     
-    // build OAuth Authorization Header
-    NSMutableArray *headerParams = [NSMutableArray arrayWithCapacity:[oauthParams count]];
-    [oauthParams enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *obj, BOOL *stop) {
-        [headerParams addObject:[NSString stringWithFormat:@"%@=\"%@\"", key, URLEncodeString(obj)]];
-    }];
+    // Both lists are sorted, so they are merged as they are written
+    BOOL firstParameter = YES;
+    NSUInteger oauthIndex = 0;
+    NSUInteger queryIndex = 0;
+    while (oauthIndex < oauthCount || queryIndex < queryCount) {
+        NSString *key = nil;
+        NSString *value = nil;
+        NSString *queryKey = queryIndex < queryCount ? QueryComponentKey([queryComponents objectAtIndex:queryIndex]) : nil;
+        
+        // Components that aren't a single k=v pair are not signed
+        if (queryIndex < queryCount && !queryKey) {
+            queryIndex++;
+            continue;
+        }
+        
+        if (queryKey && (oauthIndex == oauthCount || [queryKey compare:oauthKeys[oauthIndex] options:NSLiteralSearch] == NSOrderedAscending)) {
+            NSString *component = [queryComponents objectAtIndex:queryIndex++];
+            if (queryIndex < queryCount && [QueryComponentKey([queryComponents objectAtIndex:queryIndex]) isEqualToString:queryKey]) {
+                continue;
+            }
+            key = queryKey;
+            value = [component substringFromIndex:[queryKey length] + 1];
+        } else {
+            key = oauthKeys[oauthIndex];
+            value = oauthValues[oauthIndex++];
+            if (!value) {
+                continue;
+            }
+        }
+        
+        if (!firstParameter) {
+            SignatureBufferAppend(&buffer, "%26", 3);
+        }
+        firstParameter = NO;
+        SignatureBufferAppendURLEncoded(&buffer, key);
+        SignatureBufferAppend(&buffer, "%3D", 3);
+        SignatureBufferAppendURLEncoded(&buffer, value);
+    }
+    SignatureBufferFlush(&buffer);
+    
+    unsigned char digestBytes[CC_SHA1_DIGEST_LENGTH];
+    CCHmacFinal(&buffer.context, digestBytes);
+    NSString *signature = Base64EncodedStringFromData([NSData dataWithBytesNoCopy:digestBytes length:CC_SHA1_DIGEST_LENGTH freeWhenDone:NO]);
     
     // let's use the base URL if a realm was not set
     NSString *oauthRealm = self.realm;
-    if (!oauthRealm) oauthRealm = [self baseURLforAddress:[self baseURL]];
+    if (!oauthRealm) oauthRealm = self.normalizedBaseURL;
     
-    NSString *result = [NSString stringWithFormat:@"OAuth realm=\"%@\",%@", oauthRealm, [headerParams componentsJoinedByString:@","]];
+    // build OAuth Authorization Header
+    NSMutableString *result = [NSMutableString stringWithCapacity:256];
+    [result appendString:@"OAuth realm=\""];
+    [result appendString:oauthRealm];
+    [result appendString:@"\",oauth_signature_method=\"HMAC-SHA1\",oauth_version=\"1.0\""];
+    if (encodedConsumerKey) {
+        [result appendString:@",oauth_consumer_key=\""];
+        [result appendString:encodedConsumerKey];
+        [result appendString:@"\""];
+    }
+    if (encodedTokenIdentifier) {
+        [result appendString:@",oauth_token=\""];
+        [result appendString:encodedTokenIdentifier];
+        [result appendString:@"\""];
+    }
+    [result appendString:@",oauth_nonce=\""];
+    [result appendString:nonce];
+    [result appendString:@"\",oauth_timestamp=\""];
+    [result appendString:timestamp];
+    [result appendString:@"\",oauth_signature=\""];
+    [result appendString:URLEncodeString(signature)];
+    [result appendString:@"\""];
     
     return result;
 }
 
-- (void)addGeneratedTimestampAndNonceInto:(NSMutableDictionary *)dictionary {
-    
-    NSString *timestamp = [NSString stringWithFormat:@"%ld", (long) [[self getServerTime] timeIntervalSince1970]];
-    CFUUIDRef theUUID = CFUUIDCreate(NULL);
-    CFStringRef string = CFUUIDCreateString(NULL, theUUID);
-    NSString *nonce = (__bridge_transfer NSString *)string;
-    CFRelease(theUUID);
-    
-    [dictionary setObject:nonce forKey:@"oauth_nonce"];
-    [dictionary setObject:timestamp forKey:@"oauth_timestamp"];
-}
-
-- (NSString *) signatureForBaseString:(NSString *)baseString {
-    NSString *key = [NSString stringWithFormat:@"%@&%@", self.consumerSecret != nil ? URLEncodeString(self.consumerSecret) : @"", self.tokenSecret != nil ? URLEncodeString(self.tokenSecret) : @""];
-    
-    const char *keyBytes = [key cStringUsingEncoding:NSUTF8StringEncoding];
-    
-    const char *baseStringBytes = [baseString cStringUsingEncoding:NSUTF8StringEncoding];
-    unsigned char digestBytes[CC_SHA1_DIGEST_LENGTH];
-    
-    CCHmac(kCCHmacAlgSHA1, keyBytes, strlen(keyBytes), baseStringBytes, strlen(baseStringBytes), digestBytes);
-    
-    NSData *digestData = [NSData dataWithBytes:digestBytes length:CC_SHA1_DIGEST_LENGTH];
-    return Base64EncodedStringFromData(digestData);
+- (NSString *) normalizedURLForAddress:(NSURL *)url {
+    // Requests are almost always made relative to the base URL, whose normalized scheme and host are cached
+    NSURL *baseURL = [self baseURL];
+    BOOL samePort = [url port] == nil ? [baseURL port] == nil : ([baseURL port] != nil && [[url port] isEqualToNumber:[baseURL port]]);
+    if (samePort && [[url scheme] isEqualToString:[baseURL scheme]] && [[url host] isEqualToString:[baseURL host]]) {
+        return [self.normalizedSchemeAndHost stringByAppendingString:[[url absoluteURL] path]];
+    }
+    return [self baseURLforAddress:url];
 }
 
-- (NSString *) baseURLforAddress:(NSURL *)url {
+- (NSString *) schemeAndHostForAddress:(NSURL *)url {
     NSAssert1([url host] != nil, @"URL host missing: %@", [url absoluteString]);
     
     // Port need only be present if it's not the default
@@ -263,7 +348,11 @@ static const NSString *kOAuthVersion1_0 = @"1.0";
         hostString = [NSString stringWithFormat:@"%@:%@", [[url host] lowercaseString], [url port]];
     }
     
-    return [NSString stringWithFormat:@"%@://%@%@", [[url scheme] lowercaseString], hostString, [[url absoluteURL] path]];
+    return [NSString stringWithFormat:@"%@://%@", [[url scheme] lowercaseString], hostString];
+}
+
+- (NSString *) baseURLforAddress:(NSURL *)url {
+    return [[self schemeAndHostForAddress:url] stringByAppendingString:[[url absoluteURL] path]];
 }
 
 - (NSDate *)getServerTime {
@@ -304,3 +393,47 @@ static NSString *URLEncodeString(NSString *string) {
     
     return (__bridge_transfer NSString *)CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (__bridge CFStringRef)string, NULL, legalURLCharactersToBeEscaped, kCFStringEncodingUTF8);
 }
+
+// The key of a k=v query component, or nil if the component isn't a single pair
+static NSString *QueryComponentKey(NSString *component) {
+    NSRange separator = [component rangeOfString:@"="];
+    if (separator.location == NSNotFound || [component rangeOfString:@"=" options:NSBackwardsSearch].location != separator.location) {
+        return nil;
+    }
+    return [component substringToIndex:separator.location];
+}
+
+static void SignatureBufferFlush(SMOAuth1SignatureBuffer *buffer) {
+    if (buffer->length > 0) {
+        CCHmacUpdate(&buffer->context, buffer->bytes, buffer->length);
+        buffer->length = 0;
+    }
+}
+
+static void SignatureBufferAppend(SMOAuth1SignatureBuffer *buffer, const char *bytes, size_t length) {
+    while (length > 0) {
+        size_t count = MIN(length, sizeof(buffer->bytes) - buffer->length);
+        memcpy(buffer->bytes + buffer->length, bytes, count);
+        buffer->length += count;
+        bytes += count;
+        length -= count;
+        if (buffer->length == sizeof(buffer->bytes)) {
+            SignatureBufferFlush(buffer);
+        }
+    }
+}
+
+// Same output as URLEncodeString: only the RFC3986 unreserved characters are left alone
+static void SignatureBufferAppendURLEncoded(SMOAuth1SignatureBuffer *buffer, NSString *string) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    const unsigned char *bytes = (const unsigned char *)[string UTF8String];
+    for (; *bytes != 0; bytes++) {
+        unsigned char c = *bytes;
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~') {
+            SignatureBufferAppend(buffer, (const char *)bytes, 1);
+        } else {
+            char escaped[3] = { '%', hexDigits[c >> 4], hexDigits[c & 0x0F] };
+            SignatureBufferAppend(buffer, escaped, 3);
+        }
+    }
+}
@@ -19,6 +19,16 @@
 
 #define DEFAULT_PUSH_HOST @"push.stackmob.com"
 
+/**
+ Called once for every chunk of a bulk push. The error is `nil` if the chunk was sent.
+ */
+typedef void (^SMPushChunkCompletionBlock)(NSUInteger chunkIndex, NSArray *chunk, NSError *error);
+
+/**
+ Called once a bulk push has finished sending every chunk.
+ */
+typedef void (^SMPushBulkCompletionBlock)(NSUInteger sentChunks, NSUInteger failedChunks);
+
 /**
  An `SMPushClient` provides a high level interface to interacting with StackMob's push service. A new client must be given an API Version and OAuth credentials in order to communicate with your StackMob application.
  
@@ -83,6 +93,10 @@
  * sendMessage:toUsers:onSuccess:onFailure:
  * sendMessage:toTokens:onSuccess:onFailure:
  
+ ### Sending to large numbers of devices ###
+ 
+ For campaigns to many devices, use sendMessage:toTokensFromEnumerator:onChunkComplete:onComplete: or sendMessage:toUsersFromEnumerator:onChunkComplete:onComplete:. The tokens or users are pulled from the enumerator in chunks of <bulkChunkSize>, at most <maxConcurrentBulkRequests> chunks are in flight at once, and failed chunks are retried with exponential backoff.
+ 
  */
 @interface SMPushClient : NSObject
 
@@ -91,6 +105,51 @@
 @property(nonatomic, readonly, copy) NSString *privateKey;
 @property(nonatomic, readonly, copy) NSString *host;
 
+/**
+ The number of tokens or users sent in each request of a bulk push. Default is 1000.
+ */
+@property(nonatomic) NSUInteger bulkChunkSize;
+
+/**
+ The maximum number of bulk push requests in flight at once. Default is 4.
+ */
+@property(nonatomic) NSUInteger maxConcurrentBulkRequests;
+
+/**
+ How many times a bulk push chunk is retried after a network error or a 5xx response. Default is 3.
+ */
+@property(nonatomic) NSUInteger bulkRetryCount;
+
+/**
+ The delay before the first retry of a bulk push chunk, in seconds. The delay doubles with every further retry, up to 5 minutes. Default is 1.
+ */
+@property(nonatomic) NSTimeInterval bulkRetryInterval;
+
+/**
+ When `YES`, token registration, token removal and single push requests are written to an on-disk journal before they are sent. Requests made while offline are kept and replayed once the network is reachable again, including after the app is relaunched. Default is `NO`.
+ 
+ Pending requests for the same token are collapsed, so registering and then removing a token while offline sends only the removal. The callbacks of a collapsed request are called with the result of the request that replaced it.
+ 
+ Callbacks only survive for the lifetime of the app; requests replayed after a relaunch are sent without them.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property(nonatomic) BOOL queuesRequestsWhileOffline;
+
+/**
+ The maximum number of queued requests sent at once while replaying the journal. Default is 10.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+@property(nonatomic) NSUInteger outboundQueueBatchSize;
+
+/**
+ The number of requests waiting in the outbound journal, see <queuesRequestsWhileOffline>.
+ 
+ @since Available in iOS SDK 2.0.0 and later.
+ */
+- (NSUInteger)pendingRequestCount;
+
 ///--------------------
 /// @name Initialize
 ///--------------------
@@ -197,6 +256,33 @@
 - (void)sendMessage:(NSDictionary *)message toTokens:(NSArray *)tokens onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
 
 
+/**
+ Send a message to a large number of tokens in chunks.
+ 
+ Tokens are pulled from the enumerator only as chunks are sent, so the whole list never has to be in memory. Use `[tokens objectEnumerator]` to send to an array. Up to <maxConcurrentBulkRequests> chunks of <bulkChunkSize> tokens are sent at once. Chunks that fail with a network error or a 5xx response are retried up to <bulkRetryCount> times with exponential backoff.
+ 
+ @param message The message to send. See [Apple's docs](http://developer.apple.com/library/mac/#documentation/NetworkingInternet/Conceptual/RemoteNotificationsPG/ApplePushService/ApplePushService.html) for details on format.
+ @param tokens An enumerator of device token strings or SMPushToken objects to push to.
+ @param chunkBlock Called on the main queue with the outcome of each chunk.
+ @param completionBlock Called on the main queue once every chunk has been sent or has failed.
+ 
+ */
+- (void)sendMessage:(NSDictionary *)message toTokensFromEnumerator:(NSEnumerator *)tokens onChunkComplete:(SMPushChunkCompletionBlock)chunkBlock onComplete:(SMPushBulkCompletionBlock)completionBlock;
+
+/**
+ Send a message to a large number of users in chunks.
+ 
+ Works like sendMessage:toTokensFromEnumerator:onChunkComplete:onComplete:, but with username strings.
+ 
+ @param message The message to send. See [Apple's docs](http://developer.apple.com/library/mac/#documentation/NetworkingInternet/Conceptual/RemoteNotificationsPG/ApplePushService/ApplePushService.html) for details on format.
+ @param users An enumerator of username strings to push to.
+ @param chunkBlock Called on the main queue with the outcome of each chunk.
+ @param completionBlock Called on the main queue once every chunk has been sent or has failed.
+ 
+ */
+- (void)sendMessage:(NSDictionary *)message toUsersFromEnumerator:(NSEnumerator *)users onChunkComplete:(SMPushChunkCompletionBlock)chunkBlock onComplete:(SMPushBulkCompletionBlock)completionBlock;
+
+
 ///--------------------
 /// @name Retrieving Tokens For Users
 ///--------------------
@@ -206,6 +292,8 @@
  
  If successful the onSuccess block will be called with an NSDictionary mapping username strings to NSArrays of SMPushToken objects.
  
+ Large user lists are looked up in chunks of 100 users, so the request URL stays within length limits. The results are merged before onSuccess is called.
+ 
  @param users An array of username strings to query.
  @param successBlock The block to call on success.
  @param failureBlock The block to call on failure.
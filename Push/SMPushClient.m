@@ -23,12 +23,28 @@
 #import "SMOAuth1Client.h"
 #import "AFJSONRequestOperation.h"
 #import "SMJSONRequestOperation.h"
+#import "SMMetrics+Protected.h"
 #import "SMVersion.h"
+#import "SMNetworkReachability.h"
 #import <stdlib.h>
 #import <stdio.h>
 #import <sys/types.h>
 #import <sys/sysctl.h>
 
+#define DEFAULT_BULK_CHUNK_SIZE 1000
+#define DEFAULT_MAX_CONCURRENT_BULK_REQUESTS 4
+#define DEFAULT_BULK_RETRY_COUNT 3
+#define DEFAULT_BULK_RETRY_INTERVAL 1.0
+#define MAX_BULK_RETRY_DELAY 300.0
+#define USER_LOOKUP_CHUNK_SIZE 100
+#define DEFAULT_OUTBOUND_QUEUE_BATCH_SIZE 10
+
+#define OUTBOUND_ENTRY_ID @"id"
+#define OUTBOUND_ENTRY_METHOD @"method"
+#define OUTBOUND_ENTRY_PATH @"path"
+#define OUTBOUND_ENTRY_PARAMETERS @"parameters"
+#define OUTBOUND_ENTRY_COLLAPSE_KEY @"collapseKey"
+
 static SMPushClient *defaultClient = nil;
 
 @interface SMPushClient ()
@@ -39,6 +55,25 @@ static SMPushClient *defaultClient = nil;
 @property(nonatomic, readwrite, copy) NSString *host;
 @property(nonatomic, retain) SMOAuth1Client *oauthClient;
 
+- (NSDictionary *)SM_tokenDictionaryFromToken:(id)token;
+- (void)SM_sendChunksFromEnumerator:(NSEnumerator *)items requestForChunk:(NSMutableURLRequest *(^)(NSArray *chunk))requestBlock onChunkComplete:(SMPushChunkCompletionBlock)chunkBlock onComplete:(SMPushBulkCompletionBlock)completionBlock;
+- (BOOL)SM_shouldRetryChunkWithError:(NSError *)error;
+- (void)SM_getTokensForUsers:(NSArray *)users onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+
+@property(nonatomic, strong) SMNetworkReachability *networkMonitor;
+@property(nonatomic, strong) NSMutableArray *outboundQueue;
+@property(nonatomic, strong) NSMutableDictionary *outboundCallbacks;
+@property(nonatomic, strong) NSMutableSet *inFlightEntryIDs;
+@property(nonatomic) BOOL flushingOutboundQueue;
+
+- (void)SM_sendRequestWithMethod:(NSString *)method path:(NSString *)path parameters:(NSDictionary *)parameters collapseKey:(NSString *)collapseKey onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+- (void)SM_flushOutboundQueue;
+- (void)SM_finishOutboundEntry:(NSDictionary *)entry results:(NSDictionary *)results error:(NSError *)error;
+- (void)SM_networkStatusDidChange:(NSNotification *)notification;
+- (NSURL *)SM_outboundQueueURL;
+- (void)SM_readOutboundQueue;
+- (void)SM_saveOutboundQueue;
+
 @end
 
 @implementation SMPushClient
@@ -48,6 +83,17 @@ static SMPushClient *defaultClient = nil;
 @synthesize publicKey = _SM_publicKey;
 @synthesize host = _SM_host;
 @synthesize oauthClient = _SM_oauthClient;
+@synthesize bulkChunkSize = _SM_bulkChunkSize;
+@synthesize maxConcurrentBulkRequests = _SM_maxConcurrentBulkRequests;
+@synthesize bulkRetryCount = _SM_bulkRetryCount;
+@synthesize bulkRetryInterval = _SM_bulkRetryInterval;
+@synthesize queuesRequestsWhileOffline = _SM_queuesRequestsWhileOffline;
+@synthesize outboundQueueBatchSize = _SM_outboundQueueBatchSize;
+@synthesize networkMonitor = _SM_networkMonitor;
+@synthesize outboundQueue = _SM_outboundQueue;
+@synthesize outboundCallbacks = _SM_outboundCallbacks;
+@synthesize inFlightEntryIDs = _SM_inFlightEntryIDs;
+@synthesize flushingOutboundQueue = _SM_flushingOutboundQueue;
 
 - (id)initWithAPIVersion:(NSString *)appAPIVersion publicKey:(NSString *)publicKey privateKey:(NSString *)privateKey
 {
@@ -63,6 +109,14 @@ static SMPushClient *defaultClient = nil;
         self.publicKey = publicKey;
         self.privateKey = privateKey;
         self.host = pushHost;
+        self.bulkChunkSize = DEFAULT_BULK_CHUNK_SIZE;
+        self.maxConcurrentBulkRequests = DEFAULT_MAX_CONCURRENT_BULK_REQUESTS;
+        self.bulkRetryCount = DEFAULT_BULK_RETRY_COUNT;
+        self.bulkRetryInterval = DEFAULT_BULK_RETRY_INTERVAL;
+        self.outboundQueueBatchSize = DEFAULT_OUTBOUND_QUEUE_BATCH_SIZE;
+        self.outboundQueue = [NSMutableArray array];
+        self.outboundCallbacks = [NSMutableDictionary dictionary];
+        self.inFlightEntryIDs = [NSMutableSet set];
         NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@", pushHost]];
         self.oauthClient = [[SMOAuth1Client alloc] initWithBaseURL:url consumerKey:publicKey secret:privateKey];
         NSString *acceptHeader = [NSString stringWithFormat:@"application/vnd.stackmob+json; version=%@", appAPIVersion];
@@ -109,6 +163,11 @@ static SMPushClient *defaultClient = nil;
         return [token isMemberOfClass:[SMPushToken class]] ? ((SMPushToken *)token).type : TOKEN_TYPE_IOS;
 }
 
+- (NSDictionary *)SM_tokenDictionaryFromToken:(id)token
+{
+    return [NSDictionary dictionaryWithObjectsAndKeys:[self tokenStringFromToken:token], @"token", [self tokenTypeFromToken:token], @"type", nil];
+}
+
 - (void)registerDeviceToken:(id)token withUser:(NSString *)username onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     [self registerDeviceToken:token withUser:username overwrite:YES onSuccess:successBlock onFailure:failureBlock];
@@ -126,23 +185,20 @@ static SMPushClient *defaultClient = nil;
                           tokenDict, @"token",
                           [NSNumber numberWithBool:overwrite], @"overwrite",
                           nil];
-    NSURLRequest *request = [self.oauthClient requestWithMethod:@"POST" path:@"register_device_token_universal" parameters:args];
-  
-    [self enqueueRequest:request onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+    NSString *collapseKey = [NSString stringWithFormat:@"token:%@:%@", type, tokenString];
+    [self SM_sendRequestWithMethod:@"POST" path:@"register_device_token_universal" parameters:args collapseKey:collapseKey onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
 }
 
 - (void)broadcastMessage:(NSDictionary *)message onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     NSDictionary *args = [NSDictionary dictionaryWithObject:message forKey:@"kvPairs"];
-    NSURLRequest *request = [self.oauthClient requestWithMethod:@"POST" path:@"push_broadcast_universal" parameters:args];
-    [self enqueueRequest:request onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+    [self SM_sendRequestWithMethod:@"POST" path:@"push_broadcast_universal" parameters:args collapseKey:nil onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
 }
 
 - (void)sendMessage:(NSDictionary *)message toUsers:(NSArray *)users onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     NSDictionary *args = [NSDictionary dictionaryWithObjectsAndKeys:message, @"kvPairs", users, @"userIds", nil]; 
-    NSURLRequest *request = [self.oauthClient requestWithMethod:@"POST" path:@"push_users_universal" parameters:args];
-    [self enqueueRequest:request onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+    [self SM_sendRequestWithMethod:@"POST" path:@"push_users_universal" parameters:args collapseKey:nil onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
 }
 
 - (void)sendMessage:(NSDictionary *)message toTokens:(NSArray *)tokens onSuccess:(SMSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
@@ -150,17 +206,171 @@ static SMPushClient *defaultClient = nil;
     NSDictionary *payload = [NSDictionary dictionaryWithObject:message forKey:@"kvPairs"];
     NSMutableArray * tokensArray = [NSMutableArray array];
     [tokens enumerateObjectsUsingBlock:^(id token, NSUInteger idx, BOOL *stop) {
-        NSString *tokenString = [self tokenStringFromToken:token];
-        NSString *type = [self tokenTypeFromToken:token];
-        NSDictionary * tokenDict = [NSDictionary dictionaryWithObjectsAndKeys:tokenString, @"token", type, @"type", nil];
-        [tokensArray addObject:tokenDict];
+        [tokensArray addObject:[self SM_tokenDictionaryFromToken:token]];
     }];
     NSDictionary *args = [NSDictionary dictionaryWithObjectsAndKeys:tokensArray, @"tokens", payload, @"payload", nil];
-    NSURLRequest *request = [self.oauthClient requestWithMethod:@"POST" path:@"push_tokens_universal" parameters:args];
-    [self enqueueRequest:request onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+    [self SM_sendRequestWithMethod:@"POST" path:@"push_tokens_universal" parameters:args collapseKey:nil onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+}
+
+- (void)sendMessage:(NSDictionary *)message toTokensFromEnumerator:(NSEnumerator *)tokens onChunkComplete:(SMPushChunkCompletionBlock)chunkBlock onComplete:(SMPushBulkCompletionBlock)completionBlock
+{
+    NSDictionary *payload = [NSDictionary dictionaryWithObject:message forKey:@"kvPairs"];
+    [self SM_sendChunksFromEnumerator:tokens requestForChunk:^NSMutableURLRequest *(NSArray *chunk) {
+        NSMutableArray *tokensArray = [NSMutableArray arrayWithCapacity:[chunk count]];
+        for (id token in chunk) {
+            [tokensArray addObject:[self SM_tokenDictionaryFromToken:token]];
+        }
+        NSDictionary *args = [NSDictionary dictionaryWithObjectsAndKeys:tokensArray, @"tokens", payload, @"payload", nil];
+        return [[self.oauthClient unsignedRequestWithMethod:@"POST" path:@"push_tokens_universal" parameters:args] mutableCopy];
+    } onChunkComplete:chunkBlock onComplete:completionBlock];
+}
+
+- (void)sendMessage:(NSDictionary *)message toUsersFromEnumerator:(NSEnumerator *)users onChunkComplete:(SMPushChunkCompletionBlock)chunkBlock onComplete:(SMPushBulkCompletionBlock)completionBlock
+{
+    [self SM_sendChunksFromEnumerator:users requestForChunk:^NSMutableURLRequest *(NSArray *chunk) {
+        NSDictionary *args = [NSDictionary dictionaryWithObjectsAndKeys:message, @"kvPairs", chunk, @"userIds", nil];
+        return [[self.oauthClient unsignedRequestWithMethod:@"POST" path:@"push_users_universal" parameters:args] mutableCopy];
+    } onChunkComplete:chunkBlock onComplete:completionBlock];
+}
+
+- (void)SM_sendChunksFromEnumerator:(NSEnumerator *)items requestForChunk:(NSMutableURLRequest *(^)(NSArray *chunk))requestBlock onChunkComplete:(SMPushChunkCompletionBlock)chunkBlock onComplete:(SMPushBulkCompletionBlock)completionBlock
+{
+    // All bookkeeping happens on this serial queue, request callbacks hop back onto it
+    dispatch_queue_t bulkQueue = dispatch_queue_create("com.stackmob.push.bulkQueue", NULL);
+    NSUInteger chunkSize = MAX(self.bulkChunkSize, (NSUInteger)1);
+    NSUInteger maxConcurrent = MAX(self.maxConcurrentBulkRequests, (NSUInteger)1);
+    NSUInteger retryCount = self.bulkRetryCount;
+    NSTimeInterval retryInterval = self.bulkRetryInterval;
+    
+    __block NSUInteger nextChunkIndex = 0;
+    __block NSUInteger chunksInFlight = 0;
+    __block NSUInteger sentChunks = 0;
+    __block NSUInteger failedChunks = 0;
+    __block BOOL enumeratorExhausted = NO;
+    __block void (^sendNextChunks)(void) = nil;
+    __block void (^sendChunk)(NSArray *chunk, NSUInteger chunkIndex, NSUInteger attempt, NSURLRequest *signedRequest) = nil;
+    
+    void (^finishChunk)(NSArray *, NSUInteger, NSError *) = ^(NSArray *chunk, NSUInteger chunkIndex, NSError *error) {
+        chunksInFlight--;
+        if (error) {
+            failedChunks++;
+        } else {
+            sentChunks++;
+        }
+        if (chunkBlock) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                chunkBlock(chunkIndex, chunk, error);
+            });
+        }
+        sendNextChunks();
+    };
+    
+    sendChunk = ^(NSArray *chunk, NSUInteger chunkIndex, NSUInteger attempt, NSURLRequest *signedRequest) {
+        if (!signedRequest) {
+            // Retries are signed again so they get a fresh nonce and timestamp
+            NSMutableURLRequest *request = requestBlock(chunk);
+            [self.oauthClient signBatchOfRequests:[NSArray arrayWithObject:request]];
+            signedRequest = request;
+        }
+        [self enqueueRequest:signedRequest onSuccess:^(NSDictionary *results) {
+            dispatch_async(bulkQueue, ^{
+                finishChunk(chunk, chunkIndex, nil);
+            });
+        } onFailure:^(NSError *error) {
+            dispatch_async(bulkQueue, ^{
+                if (attempt < retryCount && [self SM_shouldRetryChunkWithError:error]) {
+                    double delayInSeconds = MIN(MAX_BULK_RETRY_DELAY, retryInterval * pow(2.0, MIN(attempt, (NSUInteger)30)));
+                    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delayInSeconds * NSEC_PER_SEC));
+                    dispatch_after(popTime, bulkQueue, ^{
+                        sendChunk(chunk, chunkIndex, attempt + 1, nil);
+                    });
+                } else {
+                    finishChunk(chunk, chunkIndex, error);
+                }
+            });
+        }];
+    };
+    
+    sendNextChunks = ^{
+        NSMutableArray *chunks = [NSMutableArray array];
+        NSMutableArray *requests = [NSMutableArray array];
+        while (!enumeratorExhausted && chunksInFlight + [chunks count] < maxConcurrent) {
+            NSMutableArray *chunk = [NSMutableArray arrayWithCapacity:chunkSize];
+            id item = nil;
+            while ([chunk count] < chunkSize && (item = [items nextObject])) {
+                [chunk addObject:item];
+            }
+            if ([chunk count] < chunkSize) {
+                enumeratorExhausted = YES;
+            }
+            if ([chunk count] > 0) {
+                [chunks addObject:chunk];
+                [requests addObject:requestBlock(chunk)];
+            }
+        }
+        
+        // Every chunk that can start now is signed in one call
+        [self.oauthClient signBatchOfRequests:requests];
+        for (NSUInteger i = 0; i < [chunks count]; i++) {
+            chunksInFlight++;
+            sendChunk([chunks objectAtIndex:i], nextChunkIndex++, 0, [requests objectAtIndex:i]);
+        }
+        
+        if (enumeratorExhausted && chunksInFlight == 0) {
+            NSUInteger sent = sentChunks;
+            NSUInteger failed = failedChunks;
+            if (completionBlock) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completionBlock(sent, failed);
+                });
+            }
+            // Break the retain cycles between the blocks
+            sendNextChunks = nil;
+            sendChunk = nil;
+#if !OS_OBJECT_USE_OBJC
+            dispatch_release(bulkQueue);
+#endif
+        }
+    };
+    
+    dispatch_async(bulkQueue, sendNextChunks);
+}
+
+- (BOOL)SM_shouldRetryChunkWithError:(NSError *)error
+{
+    // A code of 0 means there was no response at all
+    return [error code] == 0 || ([error code] >= 500 && [error code] < 600);
 }
 
 - (void)getTokensForUsers:(NSArray *)users onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+{
+    if ([users count] <= USER_LOOKUP_CHUNK_SIZE) {
+        [self SM_getTokensForUsers:users onSuccess:successBlock onFailure:failureBlock];
+        return;
+    }
+    
+    // Callbacks arrive on the main queue, so the shared state needs no locking
+    __block NSUInteger remainingChunks = ([users count] + USER_LOOKUP_CHUNK_SIZE - 1) / USER_LOOKUP_CHUNK_SIZE;
+    __block BOOL failed = NO;
+    NSMutableDictionary *mergedTokens = [NSMutableDictionary dictionary];
+    for (NSUInteger location = 0; location < [users count]; location += USER_LOOKUP_CHUNK_SIZE) {
+        NSRange range = NSMakeRange(location, MIN((NSUInteger)USER_LOOKUP_CHUNK_SIZE, [users count] - location));
+        [self SM_getTokensForUsers:[users subarrayWithRange:range] onSuccess:^(NSDictionary *result) {
+            [mergedTokens addEntriesFromDictionary:result];
+            if (--remainingChunks == 0 && !failed) {
+                successBlock(mergedTokens);
+            }
+        } onFailure:^(NSError *error) {
+            remainingChunks--;
+            if (!failed) {
+                failed = YES;
+                failureBlock(error);
+            }
+        }];
+    }
+}
+
+- (void)SM_getTokensForUsers:(NSArray *)users onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
 {
     NSString *usersString = [users componentsJoinedByString:@","];
     NSDictionary *args = [NSDictionary dictionaryWithObject:usersString forKey:@"userIds"];
@@ -192,9 +402,226 @@ static SMPushClient *defaultClient = nil;
     NSString *tokenString = [self tokenStringFromToken:token];
     NSString *type = [self tokenTypeFromToken:token];
     NSDictionary *args = [NSDictionary dictionaryWithObjectsAndKeys:tokenString, @"token", type, @"type", nil];
-    NSURLRequest *request = [self.oauthClient requestWithMethod:@"POST" path:@"remove_token_universal" parameters:args];
+    NSString *collapseKey = [NSString stringWithFormat:@"token:%@:%@", type, tokenString];
+    [self SM_sendRequestWithMethod:@"POST" path:@"remove_token_universal" parameters:args collapseKey:collapseKey onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+}
+
+#pragma mark - Outbound queue
+
+- (void)setQueuesRequestsWhileOffline:(BOOL)queuesRequestsWhileOffline
+{
+    if (queuesRequestsWhileOffline == _SM_queuesRequestsWhileOffline) {
+        return;
+    }
+    _SM_queuesRequestsWhileOffline = queuesRequestsWhileOffline;
+    
+    if (queuesRequestsWhileOffline) {
+        self.networkMonitor = [[SMNetworkReachability alloc] init];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(SM_networkStatusDidChange:) name:SMNetworkStatusDidChangeNotification object:nil];
+        // Replay whatever an earlier launch could not deliver
+        [self SM_readOutboundQueue];
+        [self SM_flushOutboundQueue];
+    } else {
+        [[NSNotificationCenter defaultCenter] removeObserver:self name:SMNetworkStatusDidChangeNotification object:nil];
+        self.networkMonitor = nil;
+    }
+}
+
+- (NSUInteger)pendingRequestCount
+{
+    @synchronized(self.outboundQueue) {
+        return [self.outboundQueue count];
+    }
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:SMNetworkStatusDidChangeNotification object:nil];
+}
+
+- (void)SM_sendRequestWithMethod:(NSString *)method path:(NSString *)path parameters:(NSDictionary *)parameters collapseKey:(NSString *)collapseKey onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
+{
+    if (!self.queuesRequestsWhileOffline) {
+        NSURLRequest *request = [self.oauthClient requestWithMethod:method path:path parameters:parameters];
+        [self enqueueRequest:request onSuccess:successBlock onFailure:failureBlock];
+        return;
+    }
+    
+    CFUUIDRef theUUID = CFUUIDCreate(NULL);
+    NSString *entryID = (__bridge_transfer NSString *)CFUUIDCreateString(NULL, theUUID);
+    CFRelease(theUUID);
+    
+    NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:entryID, OUTBOUND_ENTRY_ID, method, OUTBOUND_ENTRY_METHOD, path, OUTBOUND_ENTRY_PATH, parameters, OUTBOUND_ENTRY_PARAMETERS, nil];
+    NSMutableArray *callbacks = [NSMutableArray arrayWithObject:[NSArray arrayWithObjects:[successBlock copy], [failureBlock copy], nil]];
+    
+    @synchronized(self.outboundQueue) {
+        if (collapseKey) {
+            [entry setObject:collapseKey forKey:OUTBOUND_ENTRY_COLLAPSE_KEY];
+            // A newer operation on the same token supersedes any pending one, e.g. register followed by remove.
+            // The superseded callers are answered with the outcome of the newer operation.
+            NSIndexSet *superseded = [self.outboundQueue indexesOfObjectsPassingTest:^BOOL(NSDictionary *pending, NSUInteger idx, BOOL *stop) {
+                return [collapseKey isEqualToString:[pending objectForKey:OUTBOUND_ENTRY_COLLAPSE_KEY]] && ![self.inFlightEntryIDs containsObject:[pending objectForKey:OUTBOUND_ENTRY_ID]];
+            }];
+            [[self.outboundQueue objectsAtIndexes:superseded] enumerateObjectsUsingBlock:^(NSDictionary *pending, NSUInteger idx, BOOL *stop) {
+                NSString *pendingID = [pending objectForKey:OUTBOUND_ENTRY_ID];
+                NSArray *pendingCallbacks = [self.outboundCallbacks objectForKey:pendingID];
+                if (pendingCallbacks) {
+                    [callbacks addObjectsFromArray:pendingCallbacks];
+                    [self.outboundCallbacks removeObjectForKey:pendingID];
+                }
+            }];
+            [self.outboundQueue removeObjectsAtIndexes:superseded];
+        }
+        [self.outboundQueue addObject:entry];
+        [self.outboundCallbacks setObject:callbacks forKey:entryID];
+        [self SM_saveOutboundQueue];
+    }
+    
+    [self SM_flushOutboundQueue];
+}
+
+- (void)SM_flushOutboundQueue
+{
+    NSMutableArray *batch = [NSMutableArray array];
+    @synchronized(self.outboundQueue) {
+        if (self.flushingOutboundQueue || [self.networkMonitor currentNetworkStatus] == SMNetworkStatusNotReachable) {
+            return;
+        }
+        for (NSDictionary *entry in self.outboundQueue) {
+            if ([batch count] == MAX(self.outboundQueueBatchSize, (NSUInteger)1)) {
+                break;
+            }
+            [batch addObject:entry];
+            [self.inFlightEntryIDs addObject:[entry objectForKey:OUTBOUND_ENTRY_ID]];
+        }
+        if ([batch count] == 0) {
+            return;
+        }
+        self.flushingOutboundQueue = YES;
+    }
+    
+    NSMutableArray *requests = [NSMutableArray arrayWithCapacity:[batch count]];
+    for (NSDictionary *entry in batch) {
+        [requests addObject:[[self.oauthClient unsignedRequestWithMethod:[entry objectForKey:OUTBOUND_ENTRY_METHOD] path:[entry objectForKey:OUTBOUND_ENTRY_PATH] parameters:[entry objectForKey:OUTBOUND_ENTRY_PARAMETERS]] mutableCopy]];
+    }
+    [self.oauthClient signBatchOfRequests:requests];
+    
+    // Callbacks arrive on the main queue, so the batch bookkeeping needs no locking
+    __block NSUInteger remaining = [batch count];
+    __block BOOL lostConnection = NO;
+    __block double retryAfter = 0;
+    void (^finishRequest)(void) = ^{
+        if (--remaining > 0) {
+            return;
+        }
+        @synchronized(self.outboundQueue) {
+            [self.inFlightEntryIDs removeAllObjects];
+            self.flushingOutboundQueue = NO;
+            [self SM_saveOutboundQueue];
+        }
+        if (retryAfter > 0) {
+            dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(retryAfter * NSEC_PER_SEC));
+            dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
+                [self SM_flushOutboundQueue];
+            });
+        } else if (!lostConnection) {
+            [self SM_flushOutboundQueue];
+        }
+    };
+    
+    [batch enumerateObjectsUsingBlock:^(NSDictionary *entry, NSUInteger idx, BOOL *stop) {
+        AFJSONRequestOperation *op = [SMJSONRequestOperation JSONRequestOperationWithRequest:[requests objectAtIndex:idx] success:^(NSURLRequest *urlRequest, NSHTTPURLResponse *response, id JSON) {
+            [self SM_finishOutboundEntry:entry results:JSON error:nil];
+            finishRequest();
+        } failure:^(NSURLRequest *urlRequest, NSHTTPURLResponse *response, NSError *error, id JSON) {
+            NSString *retryAfterHeader = [[response allHeaderFields] valueForKey:@"Retry-After"];
+            if (response == nil) {
+                // Still offline, the entry stays journaled until the network comes back
+                lostConnection = YES;
+            } else if ([response statusCode] == 503 && retryAfterHeader) {
+                retryAfter = MAX(retryAfter, [retryAfterHeader doubleValue]);
+                SMMetricsIncrementCounter(SMMetricsRetryAfterBackoffCounter, 1);
+                SMMetricsIncrementCounter(SMMetricsRetryCounter, 1);
+            } else {
+                [self SM_finishOutboundEntry:entry results:nil error:[NSError errorWithDomain:@"SMError" code:[response statusCode] userInfo:JSON]];
+            }
+            finishRequest();
+        }];
+        [self.oauthClient enqueueHTTPRequestOperation:op];
+    }];
+}
+
+- (void)SM_finishOutboundEntry:(NSDictionary *)entry results:(NSDictionary *)results error:(NSError *)error
+{
+    NSString *entryID = [entry objectForKey:OUTBOUND_ENTRY_ID];
+    NSArray *callbacks = nil;
+    @synchronized(self.outboundQueue) {
+        [self.outboundQueue removeObject:entry];
+        callbacks = [self.outboundCallbacks objectForKey:entryID];
+        [self.outboundCallbacks removeObjectForKey:entryID];
+    }
     
-    [self enqueueRequest:request onSuccess:^(NSDictionary *results) {successBlock();} onFailure:failureBlock];
+    // Entries replayed from an earlier launch have no callbacks
+    for (NSArray *callback in callbacks) {
+        if (error) {
+            SMFailureBlock failureBlock = [callback objectAtIndex:1];
+            failureBlock(error);
+        } else {
+            SMResultSuccessBlock successBlock = [callback objectAtIndex:0];
+            successBlock(results);
+        }
+    }
+}
+
+- (void)SM_networkStatusDidChange:(NSNotification *)notification
+{
+    if ([[[notification userInfo] objectForKey:SMCurrentNetworkStatusKey] intValue] == SMNetworkStatusReachable) {
+        [self SM_flushOutboundQueue];
+    }
+}
+
+- (NSURL *)SM_outboundQueueURL
+{
+    NSString *applicationName = [[[NSBundle mainBundle] infoDictionary] valueForKey:(NSString *)kCFBundleNameKey];
+    NSString *applicationStorageDirectory = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) lastObject] stringByAppendingPathComponent:applicationName != nil ? applicationName : @""];
+    return [NSURL fileURLWithPath:[applicationStorageDirectory stringByAppendingPathComponent:[NSString stringWithFormat:@"%@-PushQueue.plist", self.publicKey]]];
+}
+
+- (void)SM_readOutboundQueue
+{
+    NSData *queueData = [NSData dataWithContentsOfURL:[self SM_outboundQueueURL]];
+    if (!queueData) {
+        return;
+    }
+    
+    NSError *error = nil;
+    NSArray *entries = [NSPropertyListSerialization propertyListWithData:queueData options:NSPropertyListMutableContainers format:NULL error:&error];
+    if (![entries isKindOfClass:[NSArray class]]) {
+        return;
+    }
+    
+    // The queue doubles as the lock for the outbound state, so journaled entries are merged in place rather than swapping it out
+    @synchronized(self.outboundQueue) {
+        [self.outboundQueue insertObjects:entries atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, [entries count])]];
+    }
+}
+
+- (void)SM_saveOutboundQueue
+{
+    SMMetricsSetGauge(SMMetricsPushOutboundQueueDepthGauge, [self.outboundQueue count]);
+    
+    NSURL *queueURL = [self SM_outboundQueueURL];
+    if ([self.outboundQueue count] == 0) {
+        [[NSFileManager defaultManager] removeItemAtURL:queueURL error:nil];
+        return;
+    }
+    
+    [[NSFileManager defaultManager] createDirectoryAtPath:[[queueURL URLByDeletingLastPathComponent] path] withIntermediateDirectories:YES attributes:nil error:nil];
+    NSError *error = nil;
+    NSData *queueData = [NSPropertyListSerialization dataWithPropertyList:self.outboundQueue format:NSPropertyListBinaryFormat_v1_0 options:0 error:&error];
+    if (!queueData || ![queueData writeToURL:queueURL options:NSDataWritingAtomic error:&error]) {
+        DLog(@"StackMob push queue could not be saved: %@", error)
+    }
 }
 
 - (void)enqueueRequest:(NSURLRequest *)request onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock
@@ -0,0 +1,480 @@
+/**
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Kiwi/Kiwi.h>
+#import <mach/mach.h>
+#import "StackMob.h"
+#import "SMStubServer.h"
+#import "SMOAuth1Client.h"
+#import "SMSpecHelpers.h"
+
+// Benchmarks run against SMStubServer, so results only depend on the SDK and the machine.
+// They are left out of the unit tests unless built with SM_BENCHMARK defined, for example
+// xcodebuild test GCC_PREPROCESSOR_DEFINITIONS='$(inherited) SM_BENCHMARK=1'.  Every scenario runs at each dataset size and
+// results are written as JSON to SM_BENCHMARK_RESULTS, or stackmob-benchmarks.json in the temporary directory.
+
+#ifdef SM_BENCHMARK
+
+#define SM_BENCHMARK_HOST @"benchmark.stackmob.stub"
+#define SM_BENCHMARK_TIMEOUT 120
+
+static NSMutableArray *SMBenchmarkResults = nil;
+
+static NSArray *SMBenchmarkDatasetSizes(void)
+{
+    return [NSArray arrayWithObjects:[NSNumber numberWithInt:10], [NSNumber numberWithInt:100], [NSNumber numberWithInt:1000], nil];
+}
+
+static void SMBenchmarkRecord(NSString *scenario, NSUInteger size, NSUInteger requests, CFAbsoluteTime start)
+{
+    NSTimeInterval elapsed = CFAbsoluteTimeGetCurrent() - start;
+    [SMBenchmarkResults addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                   scenario, @"scenario",
+                                   [NSNumber numberWithUnsignedInteger:size], @"size",
+                                   [NSNumber numberWithDouble:elapsed], @"seconds",
+                                   [NSNumber numberWithDouble:size > 0 ? elapsed / size : elapsed], @"secondsPerObject",
+                                   [NSNumber numberWithUnsignedInteger:requests], @"requests",
+                                   nil]];
+}
+
+static BOOL SMBenchmarkWait(dispatch_semaphore_t semaphore)
+{
+    BOOL finished = dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, SM_BENCHMARK_TIMEOUT * NSEC_PER_SEC)) == 0;
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(semaphore);
+#endif
+    return finished;
+}
+
+static NSUInteger SMBenchmarkThreadCount(void)
+{
+    thread_act_array_t threads;
+    mach_msg_type_number_t threadCount = 0;
+    if (task_threads(mach_task_self(), &threads, &threadCount) != KERN_SUCCESS) {
+        return 0;
+    }
+    for (mach_msg_type_number_t i = 0; i < threadCount; i++) {
+        mach_port_deallocate(mach_task_self(), threads[i]);
+    }
+    vm_deallocate(mach_task_self(), (vm_address_t)threads, threadCount * sizeof(thread_act_t));
+    return threadCount;
+}
+
+static NSDictionary *SMBenchmarkPerson(NSUInteger idx)
+{
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSString stringWithFormat:@"First%lu", (unsigned long)idx], @"first_name",
+            [NSString stringWithFormat:@"Last%lu", (unsigned long)idx], @"last_name",
+            @"StackMob", @"company",
+            [NSNumber numberWithUnsignedInteger:idx % 20], @"armor_class",
+            [NSString stringWithFormat:@"superpower%lu", (unsigned long)idx], @"superpower",
+            nil];
+}
+
+static NSDictionary *SMBenchmarkSuperpower(NSUInteger idx)
+{
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSString stringWithFormat:@"Power%lu", (unsigned long)idx], @"name",
+            [NSNumber numberWithUnsignedInteger:idx % 10], @"level",
+            nil];
+}
+
+static BOOL SMBenchmarkSaveOneAtATime(NSManagedObjectContext *context, NSUInteger count)
+{
+    for (NSUInteger i = 0; i < count; i++) {
+        NSManagedObject *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:context];
+        [person setValuesForKeysWithDictionary:[NSDictionary dictionaryWithObjectsAndKeys:[person assignObjectId], @"person_id", [NSString stringWithFormat:@"First%lu", (unsigned long)i], @"first_name", nil]];
+        NSError *error = nil;
+        if (![context saveAndWait:&error]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+SPEC_BEGIN(SMBenchmarkSpec)
+
+describe(@"Benchmarks", ^{
+    __block SMClient *client = nil;
+    __block dispatch_queue_t callbackQueue = nil;
+    
+    beforeAll(^{
+        SMBenchmarkResults = [NSMutableArray array];
+        callbackQueue = dispatch_queue_create("com.stackmob.benchmark", NULL);
+    });
+    
+    afterAll(^{
+        NSString *path = getenv("SM_BENCHMARK_RESULTS") ? [NSString stringWithUTF8String:getenv("SM_BENCHMARK_RESULTS")] : [NSTemporaryDirectory() stringByAppendingPathComponent:@"stackmob-benchmarks.json"];
+        NSData *resultsData = [NSJSONSerialization dataWithJSONObject:SMBenchmarkResults options:NSJSONWritingPrettyPrinted error:nil];
+        [resultsData writeToFile:path atomically:YES];
+#if !OS_OBJECT_USE_OBJC
+        dispatch_release(callbackQueue);
+#endif
+    });
+    
+    beforeEach(^{
+        [SMStubServer startWithHost:SM_BENCHMARK_HOST];
+        client = [[SMClient alloc] initWithAPIVersion:@"0" apiHost:SM_BENCHMARK_HOST publicKey:@"XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" userSchema:@"user" userPrimaryKeyField:@"username" userPasswordField:@"password"];
+        dispatch_semaphore_t loggedIn = dispatch_semaphore_create(0);
+        [client loginWithUsername:@"bob" password:@"1234" options:[SMRequestOptions options] successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSDictionary *result) {
+            dispatch_semaphore_signal(loggedIn);
+        } onFailure:^(NSError *error) {
+            dispatch_semaphore_signal(loggedIn);
+        }];
+        SMBenchmarkWait(loggedIn);
+    });
+    
+    afterEach(^{
+        [SMStubServer stop];
+        SM_CACHE_ENABLED = NO;
+    });
+    
+    for (NSNumber *datasetSize in SMBenchmarkDatasetSizes()) {
+        NSUInteger size = [datasetSize unsignedIntegerValue];
+        
+        describe([NSString stringWithFormat:@"with %lu objects", (unsigned long)size], ^{
+            it(@"fetch: pages a query through the datastore", ^{
+                [SMStubServer seedSchema:@"person" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkPerson(idx);
+                }];
+                NSUInteger pageSize = 50;
+                __block NSUInteger fetched = 0;
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                for (NSUInteger offset = 0; offset < size; offset += pageSize) {
+                    SMQuery *query = [[SMQuery alloc] initWithSchema:@"person"];
+                    [query fromIndex:offset toIndex:MIN(offset + pageSize, size) - 1];
+                    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+                    [[client dataStore] performQuery:query options:[SMRequestOptions options] successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSArray *results) {
+                        fetched += [results count];
+                        dispatch_semaphore_signal(done);
+                    } onFailure:^(NSError *error) {
+                        dispatch_semaphore_signal(done);
+                    }];
+                    [[theValue(SMBenchmarkWait(done)) should] beYes];
+                }
+                SMBenchmarkRecord(@"fetch", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(fetched) should] equal:theValue(size)];
+            });
+            it(@"fetch expanded: reads objects with their relationships expanded", ^{
+                [SMStubServer seedSchema:@"superpower" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkSuperpower(idx);
+                }];
+                [SMStubServer seedSchema:@"person" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkPerson(idx);
+                }];
+                // Relations are learned from a write, as they are from the SDK's own saves
+                dispatch_semaphore_t related = dispatch_semaphore_create(0);
+                SMRequestOptions *relationsOptions = [SMRequestOptions optionsWithHeaders:[NSDictionary dictionaryWithObject:@"superpower=superpower" forKey:@"X-StackMob-Relations"]];
+                [[client dataStore] updateObjectWithId:@"person0" inSchema:@"person" update:[NSDictionary dictionary] options:relationsOptions successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSDictionary *theObject, NSString *schema) {
+                    dispatch_semaphore_signal(related);
+                } onFailure:^(NSError *theError, NSDictionary *theObject, NSString *schema) {
+                    dispatch_semaphore_signal(related);
+                }];
+                SMBenchmarkWait(related);
+                
+                SMRequestOptions *options = [SMRequestOptions options];
+                [options setExpandDepth:1];
+                SMQuery *query = [[SMQuery alloc] initWithSchema:@"person"];
+                __block NSArray *fetched = nil;
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                dispatch_semaphore_t done = dispatch_semaphore_create(0);
+                [[client dataStore] performQuery:query options:options successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSArray *results) {
+                    fetched = results;
+                    dispatch_semaphore_signal(done);
+                } onFailure:^(NSError *error) {
+                    dispatch_semaphore_signal(done);
+                }];
+                [[theValue(SMBenchmarkWait(done)) should] beYes];
+                SMBenchmarkRecord(@"fetch expanded", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue([fetched count]) should] equal:theValue(size)];
+                [[[[fetched objectAtIndex:0] objectForKey:@"superpower"] should] beKindOfClass:[NSDictionary class]];
+            });
+            it(@"save: creates objects through the datastore", ^{
+                __block NSUInteger created = 0;
+                dispatch_group_t group = dispatch_group_create();
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                for (NSUInteger i = 0; i < size; i++) {
+                    dispatch_group_enter(group);
+                    [[client dataStore] createObject:SMBenchmarkPerson(i) inSchema:@"person" options:[SMRequestOptions options] successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSDictionary *theObject, NSString *schema) {
+                        created++;
+                        dispatch_group_leave(group);
+                    } onFailure:^(NSError *theError, NSDictionary *theObject, NSString *schema) {
+                        dispatch_group_leave(group);
+                    }];
+                }
+                dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, SM_BENCHMARK_TIMEOUT * NSEC_PER_SEC));
+#if !OS_OBJECT_USE_OBJC
+                dispatch_release(group);
+#endif
+                SMBenchmarkRecord(@"save", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(created) should] equal:theValue(size)];
+            });
+            it(@"retry: recovers from 503 and 401 responses", ^{
+                [SMStubServer seedSchema:@"person" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkPerson(idx);
+                }];
+                __block NSUInteger read = 0;
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                for (NSUInteger i = 0; i < size; i++) {
+                    // Alternate between a Retry-After backoff and an access token refresh
+                    [SMStubServer failNextRequests:1 withStatusCode:(i % 2 == 0 ? 503 : 401) retryAfter:(i % 2 == 0 ? 0.001 : 0)];
+                    // Every 503 is retried, so keep the shared retry budget out of it and the backoff short
+                    SMRequestOptions *options = [SMRequestOptions options];
+                    options.retryPolicy = [SMRetryPolicy policyWithBaseDelay:0.001 maxDelay:0.01];
+                    options.retryPolicy.retryBudget = nil;
+                    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+                    [[client dataStore] readObjectWithId:[NSString stringWithFormat:@"person%lu", (unsigned long)i] inSchema:@"person" options:options successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSDictionary *theObject, NSString *schema) {
+                        read++;
+                        dispatch_semaphore_signal(done);
+                    } onFailure:^(NSError *theError, NSString *theObjectId, NSString *schema) {
+                        dispatch_semaphore_signal(done);
+                    }];
+                    [[theValue(SMBenchmarkWait(done)) should] beYes];
+                }
+                SMBenchmarkRecord(@"retry", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(read) should] equal:theValue(size)];
+            });
+            it(@"core data fetch and fault: fetches faults then fires them", ^{
+                SM_CACHE_ENABLED = YES;
+                [SMStubServer seedSchema:@"person" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkPerson(idx);
+                }];
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                [coreDataStore setCachePolicy:SMCachePolicyTryNetworkOnly];
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Person"];
+                [fetchRequest setReturnsObjectsAsFaults:YES];
+                
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                NSError *error = nil;
+                NSArray *results = [context executeFetchRequest:fetchRequest error:&error];
+                SMBenchmarkRecord(@"core data fetch", size, [SMStubServer requestCount] - requestsBefore, start);
+                [error shouldBeNil];
+                [[theValue([results count]) should] equal:theValue(size)];
+                
+                requestsBefore = [SMStubServer requestCount];
+                start = CFAbsoluteTimeGetCurrent();
+                for (NSManagedObject *person in results) {
+                    [person valueForKey:@"first_name"];
+                }
+                SMBenchmarkRecord(@"core data fault", size, [SMStubServer requestCount] - requestsBefore, start);
+            });
+            it(@"core data prefetch: fetches with relationships prefetched then follows them", ^{
+                SM_CACHE_ENABLED = YES;
+                [SMStubServer seedSchema:@"superpower" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkSuperpower(idx);
+                }];
+                [SMStubServer seedSchema:@"person" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkPerson(idx);
+                }];
+                dispatch_semaphore_t related = dispatch_semaphore_create(0);
+                SMRequestOptions *relationsOptions = [SMRequestOptions optionsWithHeaders:[NSDictionary dictionaryWithObject:@"superpower=superpower" forKey:@"X-StackMob-Relations"]];
+                [[client dataStore] updateObjectWithId:@"person0" inSchema:@"person" update:[NSDictionary dictionary] options:relationsOptions successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSDictionary *theObject, NSString *schema) {
+                    dispatch_semaphore_signal(related);
+                } onFailure:^(NSError *theError, NSDictionary *theObject, NSString *schema) {
+                    dispatch_semaphore_signal(related);
+                }];
+                SMBenchmarkWait(related);
+                
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                [coreDataStore setCachePolicy:SMCachePolicyTryNetworkOnly];
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Person"];
+                [fetchRequest setRelationshipKeyPathsForPrefetching:[NSArray arrayWithObject:@"superpower"]];
+                
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                NSError *error = nil;
+                NSArray *results = [context executeFetchRequest:fetchRequest error:&error];
+                SMBenchmarkRecord(@"core data prefetch fetch", size, [SMStubServer requestCount] - requestsBefore, start);
+                [error shouldBeNil];
+                [[theValue([results count]) should] equal:theValue(size)];
+                
+                requestsBefore = [SMStubServer requestCount];
+                start = CFAbsoluteTimeGetCurrent();
+                for (NSManagedObject *person in results) {
+                    [[person valueForKey:@"superpower"] valueForKey:@"name"];
+                }
+                NSUInteger relationshipRequests = [SMStubServer requestCount] - requestsBefore;
+                SMBenchmarkRecord(@"core data prefetch follow", size, relationshipRequests, start);
+                // Without prefetching every superpower fault is a read of its person
+                [[theValue(relationshipRequests) should] beLessThan:theValue(size)];
+            });
+            it(@"core data async fetch: runs concurrent fetches without a thread per fetch", ^{
+                [SMStubServer seedSchema:@"person" count:size objectBlock:^NSDictionary *(NSUInteger idx) {
+                    return SMBenchmarkPerson(idx);
+                }];
+                [SMStubServer setLatency:0.05];
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                NSUInteger fetchCount = 50;
+                __block NSUInteger fetched = 0;
+                __block NSUInteger peakThreadCount = 0;
+                NSUInteger threadCountBefore = SMBenchmarkThreadCount();
+                dispatch_group_t group = dispatch_group_create();
+                
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                for (NSUInteger i = 0; i < fetchCount; i++) {
+                    dispatch_group_enter(group);
+                    [context executeFetchRequest:[[NSFetchRequest alloc] initWithEntityName:@"Person"] returnManagedObjectIDs:YES successCallbackQueue:callbackQueue failureCallbackQueue:callbackQueue onSuccess:^(NSArray *results) {
+                        fetched++;
+                        peakThreadCount = MAX(peakThreadCount, SMBenchmarkThreadCount());
+                        dispatch_group_leave(group);
+                    } onFailure:^(NSError *error) {
+                        dispatch_group_leave(group);
+                    }];
+                }
+                peakThreadCount = MAX(peakThreadCount, SMBenchmarkThreadCount());
+                BOOL finished = dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, SM_BENCHMARK_TIMEOUT * NSEC_PER_SEC)) == 0;
+#if !OS_OBJECT_USE_OBJC
+                dispatch_release(group);
+#endif
+                SMBenchmarkRecord(@"core data async fetch", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(finished) should] beYes];
+                [[theValue(fetched) should] equal:theValue(fetchCount)];
+                [[theValue(peakThreadCount) should] beLessThan:theValue(threadCountBefore + fetchCount)];
+            });
+            it(@"core data save: inserts objects and saves", ^{
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                for (NSUInteger i = 0; i < size; i++) {
+                    NSManagedObject *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:context];
+                    [person setValuesForKeysWithDictionary:[NSDictionary dictionaryWithObjectsAndKeys:[person assignObjectId], @"person_id", [NSString stringWithFormat:@"First%lu", (unsigned long)i], @"first_name", nil]];
+                }
+                
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                NSError *error = nil;
+                BOOL saved = [context save:&error];
+                SMBenchmarkRecord(@"core data save", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(saved) should] beYes];
+                [[theValue([SMStubServer countOfSchema:@"person"]) should] equal:theValue(size)];
+            });
+            it(@"core data save chain: saves one object at a time through every context", ^{
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                BOOL saved = SMBenchmarkSaveOneAtATime(context, size);
+                SMBenchmarkRecord(@"core data save chain", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(saved) should] beYes];
+                [[theValue([SMStubServer countOfSchema:@"person"]) should] equal:theValue(size)];
+            });
+            it(@"core data direct save: saves one object at a time straight to the store context", ^{
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                coreDataStore.savesDirectlyToStore = YES;
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                BOOL saved = SMBenchmarkSaveOneAtATime(context, size);
+                SMBenchmarkRecord(@"core data direct save", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue(saved) should] beYes];
+                [[theValue([SMStubServer countOfSchema:@"person"]) should] equal:theValue(size)];
+            });
+            it(@"sync: replays offline saves", ^{
+                SM_CACHE_ENABLED = YES;
+                SMCoreDataStore *coreDataStore = [client coreDataStoreWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                NSManagedObjectContext *context = [coreDataStore contextForCurrentThread];
+                [SMStubServer setOffline:YES];
+                for (NSUInteger i = 0; i < size; i++) {
+                    NSManagedObject *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:context];
+                    [person setValuesForKeysWithDictionary:[NSDictionary dictionaryWithObjectsAndKeys:[person assignObjectId], @"person_id", [NSString stringWithFormat:@"First%lu", (unsigned long)i], @"first_name", nil]];
+                }
+                NSError *error = nil;
+                [[theValue([context save:&error]) should] beYes];
+                [SMStubServer setOffline:NO];
+                
+                dispatch_semaphore_t synced = dispatch_semaphore_create(0);
+                [coreDataStore setSyncCompletionCallback:^(NSArray *objects) {
+                    dispatch_semaphore_signal(synced);
+                }];
+                NSUInteger requestsBefore = [SMStubServer requestCount];
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                [coreDataStore syncWithServer];
+                [[theValue(SMBenchmarkWait(synced)) should] beYes];
+                SMBenchmarkRecord(@"sync", size, [SMStubServer requestCount] - requestsBefore, start);
+                [[theValue([SMStubServer countOfSchema:@"person"]) should] equal:theValue(size)];
+            });
+            it(@"serialization: serializes managed objects", ^{
+                NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:[[SMSpecHelpers entityForName:@"Person"] managedObjectModel]];
+                [coordinator addPersistentStoreWithType:NSInMemoryStoreType configuration:nil URL:nil options:nil error:nil];
+                NSManagedObjectContext *context = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSConfinementConcurrencyType];
+                [context setPersistentStoreCoordinator:coordinator];
+                NSMutableArray *people = [NSMutableArray arrayWithCapacity:size];
+                for (NSUInteger i = 0; i < size; i++) {
+                    NSManagedObject *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:context];
+                    [person setValuesForKeysWithDictionary:[NSDictionary dictionaryWithObjectsAndKeys:[person assignObjectId], @"person_id", [NSString stringWithFormat:@"First%lu", (unsigned long)i], @"first_name", @"StackMob", @"company", nil]];
+                    [people addObject:person];
+                }
+                
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                for (NSManagedObject *person in people) {
+                    [person SMDictionarySerialization:NO sendLocalTimestamps:NO];
+                }
+                SMBenchmarkRecord(@"serialization", size, 0, start);
+            });
+            it(@"base64: encodes and decodes binary data", ^{
+                NSMutableData *data = [NSMutableData dataWithLength:size * 1024];
+                arc4random_buf([data mutableBytes], [data length]);
+                
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                NSString *encoded = [SMBinaryDataConversion stringForBinaryData:data name:@"benchmark.bin" contentType:@"application/octet-stream"];
+                NSData *decoded = [SMBinaryDataConversion dataForString:encoded];
+                SMBenchmarkRecord(@"base64", size, 0, start);
+                [[decoded should] equal:data];
+            });
+            it(@"signing: signs MAC headers", ^{
+                SMOAuth2Client *oauthClient = client.session.regularOAuthClient;
+                [[theValue([oauthClient hasValidCredentials]) should] beYes];
+                NSUInteger count = size * 10;
+                NSUInteger signedCount = 0;
+                
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                for (NSUInteger i = 0; i < count; i++) {
+                    if ([oauthClient createMACHeaderForHttpMethod:@"GET" path:@"/user?username=bob" timestamp:1337 nonce:@"noncenonce"]) {
+                        signedCount++;
+                    }
+                }
+                SMBenchmarkRecord(@"signing", count, 0, start);
+                [[theValue(signedCount) should] equal:theValue(count)];
+            });
+            it(@"push signing: signs a batch of OAuth1 requests", ^{
+                SMOAuth1Client *oauthClient = [[SMOAuth1Client alloc] initWithBaseURL:[NSURL URLWithString:@"http://push.stackmob.com"] consumerKey:@"public" secret:@"private"];
+                NSMutableArray *requests = [NSMutableArray arrayWithCapacity:size * 10];
+                for (NSUInteger i = 0; i < size * 10; i++) {
+                    [requests addObject:[[oauthClient unsignedRequestWithMethod:@"GET" path:@"get_tokens_for_users_universal" parameters:[NSDictionary dictionaryWithObject:[NSString stringWithFormat:@"user%lu", (unsigned long)i] forKey:@"userIds"]] mutableCopy]];
+                }
+                
+                CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                [oauthClient signBatchOfRequests:requests];
+                SMBenchmarkRecord(@"push signing", [requests count], 0, start);
+                [[[[requests lastObject] valueForHTTPHeaderField:@"Authorization"] should] beNonNil];
+            });
+        });
+    }
+});
+
+SPEC_END
+
+#endif
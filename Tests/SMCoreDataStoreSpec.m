@@ -85,6 +85,39 @@ describe(@"SMCoreDataStore", ^{
             [theContext setMergePolicy:NSMergeByPropertyStoreTrumpMergePolicy];
             [[theValue([theContext mergePolicy]) should] equal:theValue(NSMergeByPropertyStoreTrumpMergePolicy)];
         });
+        describe(@"per entity cache settings", ^{
+            it(@"falls back to the global cache policy and max age", ^{
+                [coreDataStore setCachePolicy:SMCachePolicyTryCacheElseNetwork];
+                coreDataStore.cacheMaxAge = 60;
+                [[theValue([coreDataStore cachePolicyForEntityName:@"Person"]) should] equal:theValue(SMCachePolicyTryCacheElseNetwork)];
+                [[theValue([coreDataStore cacheMaxAgeForEntityName:@"Person"]) should] equal:theValue(60.0)];
+            });
+            it(@"returns the entity cache policy and max age when set", ^{
+                [coreDataStore setCachePolicy:SMCachePolicyTryNetworkOnly];
+                [coreDataStore setCachePolicy:SMCachePolicyTryCacheOnly forEntityName:@"Person"];
+                [coreDataStore setCacheMaxAge:3600 forEntityName:@"Person"];
+                [[theValue([coreDataStore cachePolicyForEntityName:@"Person"]) should] equal:theValue(SMCachePolicyTryCacheOnly)];
+                [[theValue([coreDataStore cacheMaxAgeForEntityName:@"Person"]) should] equal:theValue(3600.0)];
+                [[theValue([coreDataStore cachePolicyForEntityName:@"Superpower"]) should] equal:theValue(SMCachePolicyTryNetworkOnly)];
+                [[theValue([coreDataStore cacheMaxAgeForEntityName:@"Superpower"]) should] equal:theValue(0.0)];
+            });
+        });
+        describe(@"direct saves", ^{
+            it(@"is off by default", ^{
+                [[theValue(coreDataStore.savesDirectlyToStore) should] beNo];
+                [[theValue([[coreDataStore mainThreadContext] contextSavesDirectlyToStore]) should] beNo];
+            });
+            it(@"flags the main thread context and keeps its merge policy", ^{
+                [coreDataStore setDefaultMergePolicy:NSMergeByPropertyStoreTrumpMergePolicy applyToMainThreadContextAndParent:YES];
+                coreDataStore.savesDirectlyToStore = YES;
+                NSManagedObjectContext *mainContext = [coreDataStore mainThreadContext];
+                [[theValue([mainContext contextSavesDirectlyToStore]) should] beYes];
+                [[theValue([mainContext mergePolicy]) should] equal:theValue(NSMergeByPropertyStoreTrumpMergePolicy)];
+                [[theValue([[mainContext parentContext] mergePolicy]) should] equal:theValue(NSMergeByPropertyStoreTrumpMergePolicy)];
+                coreDataStore.savesDirectlyToStore = NO;
+                [[theValue([mainContext contextSavesDirectlyToStore]) should] beNo];
+            });
+        });
     });
 });
 
@@ -73,6 +73,10 @@ describe(@"SMCustomCodeRequest", ^{
             [request addQueryStringParameterWhere:@"b" equals:@"3"];
             [[theValue([request.queryStringParameters count]) should] equal:theValue(3)];
         });
+        it(@"should escape query string delimiters", ^{
+            [request addQueryStringParameterWhere:@"q" equals:@"a&b=c"];
+            [[[request.queryStringParameters objectAtIndex:0] should] equal:@"q=a%26b%3Dc"];
+        });
     });
     
 });
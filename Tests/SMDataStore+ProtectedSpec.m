@@ -17,6 +17,17 @@
 #import <Kiwi/Kiwi.h>
 #import "SMClient.h"
 #import "SMDataStore+Protected.h"
+#import "SMOAuth2Client.h"
+#import "SMRequestOptions.h"
+#import "SMError.h"
+#import "AFHTTPRequestOperation.h"
+#import "SMRetryPolicy.h"
+
+@interface SMDataStore (RetrySpec)
+
+- (BOOL)SM_scheduleRetryOfRequest:(NSURLRequest *)request response:(NSHTTPURLResponse *)response error:(NSError *)error options:(SMRequestOptions *)options retry:(void (^)(SMRequestOptions *retryOptions))retry;
+
+@end
 
 SPEC_BEGIN(SMDataStore_CompletionBlocksSpec)
 __block SMDataStore *dataStore = nil;
@@ -97,5 +108,79 @@ describe(@"countFromRangeHeader", ^{
         [[[NSNumber numberWithInt:[dataStore countFromRangeHeader:@"1-1/637," results:nil]] should] equal:[NSNumber numberWithInt:637]];
     });
 });
+describe(@"SMRequestHandle", ^{
+    it(@"cancels the operations it tracks", ^{
+        NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"http://api.stackmob.com/book"]];
+        AFHTTPRequestOperation *operation = [[AFHTTPRequestOperation alloc] initWithRequest:request];
+        SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:nil];
+        [handle SM_addCancellable:operation];
+        [handle cancel];
+        [[theValue(handle.isCancelled) should] beYes];
+        [[theValue([operation isCancelled]) should] beYes];
+    });
+    it(@"cancels operations added after it was cancelled right away", ^{
+        NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"http://api.stackmob.com/book"]];
+        AFHTTPRequestOperation *operation = [[AFHTTPRequestOperation alloc] initWithRequest:request];
+        SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:nil];
+        [handle cancel];
+        [handle SM_addCancellable:operation];
+        [[theValue([operation isCancelled]) should] beYes];
+    });
+    it(@"reports a cancellation or an exceeded deadline", ^{
+        SMRequestHandle *cancelledHandle = [[SMRequestHandle alloc] initWithDeadline:nil];
+        [cancelledHandle cancel];
+        [[theValue([[cancelledHandle SM_cancellationErrorWithUnderlyingError:nil] code]) should] equal:theValue(SMErrorRequestCancelled)];
+        [[theValue(cancelledHandle.deadlineExceeded) should] beNo];
+        
+        SMRequestHandle *expiredHandle = [[SMRequestHandle alloc] initWithDeadline:nil];
+        [expiredHandle SM_expire];
+        [[theValue(expiredHandle.isCancelled) should] beYes];
+        [[theValue(expiredHandle.deadlineExceeded) should] beYes];
+        [[theValue([[expiredHandle SM_cancellationErrorWithUnderlyingError:nil] code]) should] equal:theValue(SMErrorDeadlineExceeded)];
+    });
+    it(@"expires once its deadline passes", ^{
+        SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+        [[handle shouldEventually] receive:@selector(cancel)];
+    });
+});
+
+describe(@"-queueRequest:options:handle:successCallbackQueue:failureCallbackQueue:onSuccess:onFailure:", ^{
+    it(@"never sends a request whose handle is cancelled", ^{
+        dataStore.session.regularOAuthClient = [SMOAuth2Client nullMock];
+        NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"http://api.stackmob.com/book"]];
+        SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:nil];
+        [handle cancel];
+        [[dataStore.session.regularOAuthClient shouldNot] receive:@selector(enqueueHTTPRequestOperation:)];
+        [dataStore queueRequest:request options:[SMRequestOptions options] handle:handle successCallbackQueue:nil failureCallbackQueue:nil onSuccess:nil onFailure:nil];
+    });
+    it(@"tracks the operation it sends on the handle", ^{
+        dataStore.session.regularOAuthClient = [SMOAuth2Client nullMock];
+        NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"http://api.stackmob.com/book"]];
+        SMRequestHandle *handle = [[SMRequestHandle alloc] initWithDeadline:nil];
+        [[handle should] receive:@selector(SM_addCancellable:)];
+        [dataStore queueRequest:request options:[SMRequestOptions options] handle:handle successCallbackQueue:nil failureCallbackQueue:nil onSuccess:nil onFailure:nil];
+    });
+});
+
+describe(@"-SM_scheduleRetryOfRequest:response:error:options:retry:", ^{
+    it(@"counts retries on a copy of the options", ^{
+        NSURL *url = [NSURL URLWithString:@"http://api.stackmob.com/book"];
+        NSURLRequest *request = [NSURLRequest requestWithURL:url];
+        NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:503 HTTPVersion:@"1.1" headerFields:nil];
+        SMRequestOptions *options = [SMRequestOptions options];
+        options.retryPolicy = [SMRetryPolicy policyWithBaseDelay:0.01 maxDelay:0.01];
+        options.retryPolicy.retryBudget = nil;
+        __block SMRequestOptions *scheduledOptions = nil;
+        BOOL retrying = [dataStore SM_scheduleRetryOfRequest:request response:response error:nil options:options retry:^(SMRequestOptions *retryOptions) {
+            scheduledOptions = retryOptions;
+        }];
+        [[theValue(retrying) should] beYes];
+        [[expectFutureValue(scheduledOptions) shouldEventually] beNonNil];
+        [[theValue(scheduledOptions.numberOfRetries) should] equal:theValue(2)];
+        [[theValue([scheduledOptions SM_retryAttempt]) should] equal:theValue(1)];
+        [[theValue(options.numberOfRetries) should] equal:theValue(3)];
+        [[theValue([options SM_retryAttempt]) should] equal:theValue(0)];
+    });
+});
 
 SPEC_END
@@ -336,7 +336,7 @@ describe(@"perform custom code request", ^{
         });
         it(@"should perform the request", ^{
             [[dataStore.session.regularOAuthClient should] receive:@selector(customCodeRequest:options:)];
-            [[dataStore should] receive:@selector(queueRequest:options:successCallbackQueue:failureCallbackQueue:onSuccess:onFailure:)];
+            [[dataStore should] receive:@selector(queueRequest:options:handle:successCallbackQueue:failureCallbackQueue:onSuccess:onFailure:)];
             [dataStore performCustomCodeRequest:customCodeRequest onSuccess:^(NSURLRequest *request, NSHTTPURLResponse *response, id JSON) {
                 
             } onFailure:^(NSURLRequest *request, NSHTTPURLResponse *response, NSError *error, id JSON) {
@@ -344,6 +344,63 @@ describe(@"perform custom code request", ^{
             }];
         });
     });
+    context(@"given a streaming custom code request", ^{
+        __block SMCustomCodeRequest *customCodeRequest = nil;
+        __block SMDataStore *dataStore = nil;
+        beforeEach(^{
+            SMClient *client = [[SMClient alloc] initWithAPIVersion:@"0" publicKey:@"XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"];
+            dataStore = [[SMDataStore alloc] initWithAPIVersion:@"0" session:[client session]];
+            customCodeRequest = [[SMCustomCodeRequest alloc] initGetRequestWithMethod:@"method"];
+            customCodeRequest.responseOutputStream = [NSOutputStream outputStreamToMemory];
+        });
+        it(@"should leave the caller's options alone", ^{
+            [dataStore.session.regularOAuthClient stub:@selector(enqueueHTTPRequestOperation:)];
+            SMRequestOptions *options = [SMRequestOptions options];
+            [dataStore performCustomCodeRequest:customCodeRequest options:options onSuccess:nil onFailure:nil];
+            [[theValue(options.tryRefreshToken) should] beYes];
+            [[theValue(options.numberOfRetries) should] equal:theValue(3)];
+        });
+        it(@"should call the token refresh failure block when the refresh fails", ^{
+            [dataStore.session stub:@selector(eligibleForTokenRefresh:) andReturn:theValue(YES)];
+            [dataStore.session stub:@selector(refreshTokenWithSuccessCallbackQueue:failureCallbackQueue:onSuccess:onFailure:) withBlock:^id(NSArray *params) {
+                void (^failureBlock)(NSError *) = [params objectAtIndex:3];
+                failureBlock([NSError errorWithDomain:HTTPErrorDomain code:401 userInfo:nil]);
+                return nil;
+            }];
+            __block NSError *refreshError = nil;
+            [dataStore.session setTokenRefreshFailureBlock:^(NSError *error, SMFailureBlock originalFailureBlock) {
+                refreshError = error;
+            }];
+            [dataStore performCustomCodeRequest:customCodeRequest options:[SMRequestOptions options] onSuccess:nil onFailure:nil];
+            [[expectFutureValue(theValue([refreshError code])) shouldEventually] equal:theValue(SMErrorRefreshTokenFailed)];
+        });
+    });
+    context(@"given a batch of custom code requests", ^{
+        __block NSMutableArray *customCodeRequests = nil;
+        __block SMDataStore *dataStore = nil;
+        beforeEach(^{
+            SMClient *client = [[SMClient alloc] initWithAPIVersion:@"0" publicKey:@"XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"];
+            dataStore = [[SMDataStore alloc] initWithAPIVersion:@"0" session:[client session]];
+            customCodeRequests = [NSMutableArray array];
+            for (int i = 0; i < 5; i++) {
+                [customCodeRequests addObject:[[SMCustomCodeRequest alloc] initGetRequestWithMethod:[NSString stringWithFormat:@"method%d", i]]];
+            }
+        });
+        it(@"should not send more requests than the window at once", ^{
+            [[[dataStore shouldEventually] receiveWithCount:2] queueRequest:[KWAny any] options:[KWAny any] handle:[KWAny any] successCallbackQueue:[KWAny any] failureCallbackQueue:[KWAny any] onSuccess:[KWAny any] onFailure:[KWAny any]];
+            [dataStore performCustomCodeRequests:customCodeRequests options:[SMRequestOptions options] maxConcurrentRequests:2 onComplete:nil];
+        });
+        it(@"should send every request at once without a window", ^{
+            [[[dataStore shouldEventually] receiveWithCount:5] queueRequest:[KWAny any] options:[KWAny any] handle:[KWAny any] successCallbackQueue:[KWAny any] failureCallbackQueue:[KWAny any] onSuccess:[KWAny any] onFailure:[KWAny any]];
+            [dataStore performCustomCodeRequests:customCodeRequests options:[SMRequestOptions options] maxConcurrentRequests:0 onComplete:nil];
+        });
+        it(@"should return a handle that cancels the batch", ^{
+            SMRequestHandle *handle = [dataStore performCustomCodeRequests:customCodeRequests options:[SMRequestOptions options] maxConcurrentRequests:2 onComplete:nil];
+            [handle shouldNotBeNil];
+            [handle cancel];
+            [[theValue(handle.isCancelled) should] beYes];
+        });
+    });
 });
 
 
@@ -0,0 +1,82 @@
+/**
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Kiwi/Kiwi.h>
+#import "SMGeoIndex.h"
+
+SPEC_BEGIN(SMGeoIndexSpec)
+
+describe(@"SMGeoIndex", ^{
+    __block SMGeoIndex *geoIndex = nil;
+    
+    beforeEach(^{
+        geoIndex = [[SMGeoIndex alloc] init];
+        // Downtown San Francisco, Oakland, Los Angeles
+        [geoIndex setCoordinate:CLLocationCoordinate2DMake(37.7749, -122.4194) forRemoteID:@"sf" field:@"location" entityName:@"Place"];
+        [geoIndex setCoordinate:CLLocationCoordinate2DMake(37.8044, -122.2711) forRemoteID:@"oakland" field:@"location" entityName:@"Place"];
+        [geoIndex setCoordinate:CLLocationCoordinate2DMake(34.0522, -118.2437) forRemoteID:@"la" field:@"location" entityName:@"Place"];
+    });
+    
+    it(@"computes standard geohashes", ^{
+        [[SMGeohashForCoordinate(CLLocationCoordinate2DMake(57.64911, 10.40744), 10) should] equal:@"u4pruydqqv"];
+        [[SMGeohashForCoordinate(CLLocationCoordinate2DMake(57.64911, 10.40744), 3) should] equal:@"u4p"];
+    });
+    
+    it(@"finds points within a distance, nearest first", ^{
+        NSArray *remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" withinDistance:20000 ofCoordinate:CLLocationCoordinate2DMake(37.7790, -122.4100)];
+        [[remoteIDs should] equal:[NSArray arrayWithObjects:@"sf", @"oakland", nil]];
+        
+        remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" withinDistance:1000 ofCoordinate:CLLocationCoordinate2DMake(37.7790, -122.4100)];
+        [[remoteIDs should] equal:[NSArray arrayWithObject:@"sf"]];
+    });
+    
+    it(@"finds points within bounds", ^{
+        NSArray *remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" withinBoundsWithSWCorner:CLLocationCoordinate2DMake(33.0, -123.0) andNECorner:CLLocationCoordinate2DMake(35.0, -117.0)];
+        [[remoteIDs should] equal:[NSArray arrayWithObject:@"la"]];
+    });
+    
+    it(@"finds points in bounds crossing the 180th meridian", ^{
+        [geoIndex setCoordinate:CLLocationCoordinate2DMake(-17.7, 178.0) forRemoteID:@"fiji" field:@"location" entityName:@"Place"];
+        [geoIndex setCoordinate:CLLocationCoordinate2DMake(-14.3, -170.7) forRemoteID:@"samoa" field:@"location" entityName:@"Place"];
+        NSArray *remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" withinBoundsWithSWCorner:CLLocationCoordinate2DMake(-20.0, 170.0) andNECorner:CLLocationCoordinate2DMake(-10.0, -165.0)];
+        [[[NSSet setWithArray:remoteIDs] should] equal:[NSSet setWithObjects:@"fiji", @"samoa", nil]];
+    });
+    
+    it(@"orders every point by distance for near", ^{
+        NSArray *remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" nearCoordinate:CLLocationCoordinate2DMake(34.0, -118.0)];
+        [[remoteIDs should] equal:[NSArray arrayWithObjects:@"la", @"oakland", @"sf", nil]];
+    });
+    
+    it(@"moves and removes points", ^{
+        [geoIndex setCoordinate:CLLocationCoordinate2DMake(34.05, -118.25) forRemoteID:@"sf" field:@"location" entityName:@"Place"];
+        NSArray *remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" withinDistance:5000 ofCoordinate:CLLocationCoordinate2DMake(34.0522, -118.2437)];
+        [[[NSSet setWithArray:remoteIDs] should] equal:[NSSet setWithObjects:@"sf", @"la", nil]];
+        
+        [geoIndex removeRemoteID:@"la" entityName:@"Place"];
+        remoteIDs = [geoIndex remoteIDsForEntityName:@"Place" field:@"location" withinDistance:5000 ofCoordinate:CLLocationCoordinate2DMake(34.0522, -118.2437)];
+        [[remoteIDs should] equal:[NSArray arrayWithObject:@"sf"]];
+    });
+    
+    it(@"round trips through its points", ^{
+        [[theValue([geoIndex hasChanges]) should] beYes];
+        SMGeoIndex *reloaded = [[SMGeoIndex alloc] initWithPoints:[geoIndex points]];
+        [[theValue([reloaded hasChanges]) should] beNo];
+        NSArray *remoteIDs = [reloaded remoteIDsForEntityName:@"Place" field:@"location" withinDistance:20000 ofCoordinate:CLLocationCoordinate2DMake(37.7790, -122.4100)];
+        [[remoteIDs should] equal:[NSArray arrayWithObjects:@"sf", @"oakland", nil]];
+    });
+});
+
+SPEC_END
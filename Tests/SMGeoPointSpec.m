@@ -0,0 +1,71 @@
+/**
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Kiwi/Kiwi.h>
+#import "StackMob.h"
+
+SPEC_BEGIN(SMGeoPointSpec)
+
+describe(@"SMGeoPointTransformer", ^{
+    __block SMGeoPoint *geoPoint = nil;
+    __block NSValueTransformer *transformer = nil;
+    
+    beforeEach(^{
+        geoPoint = [SMGeoPoint geoPointWithCoordinate:CLLocationCoordinate2DMake(37.77215879638275, -122.4064476357965)];
+        transformer = [NSValueTransformer valueTransformerForName:SMGeoPointTransformerName];
+    });
+    
+    it(@"is found by name", ^{
+        [[transformer should] beKindOfClass:[SMGeoPointTransformer class]];
+    });
+    
+    it(@"stores a geo point in 16 bytes", ^{
+        NSData *data = [transformer transformedValue:geoPoint];
+        [[theValue([data length]) should] equal:theValue(16)];
+        
+        NSDictionary *decoded = [transformer reverseTransformedValue:data];
+        [[[decoded latitude] should] equal:[geoPoint latitude]];
+        [[[decoded longitude] should] equal:[geoPoint longitude]];
+    });
+    
+    it(@"stores the latitude then the longitude as little-endian doubles", ^{
+        NSData *data = [SMGeoPointTransformer dataWithGeoPoint:[SMGeoPoint geoPointWithCoordinate:CLLocationCoordinate2DMake(1.0, -2.0)]];
+        const unsigned char expected[16] = { 0, 0, 0, 0, 0, 0, 0xf0, 0x3f, 0, 0, 0, 0, 0, 0, 0, 0xc0 };
+        [[data should] equal:[NSData dataWithBytes:expected length:16]];
+    });
+    
+    it(@"reads geo points archived in the old format", ^{
+        NSData *archived = [NSKeyedArchiver archivedDataWithRootObject:geoPoint];
+        [[[SMGeoPointTransformer geoPointWithData:archived] should] equal:geoPoint];
+        
+        // Transformable attributes without a transformer name archive the data again
+        NSData *archivedTwice = [NSKeyedArchiver archivedDataWithRootObject:archived];
+        [[[transformer reverseTransformedValue:archivedTwice] should] equal:geoPoint];
+    });
+    
+    it(@"rewrites archived geo points in the compact format", ^{
+        NSData *archived = [NSKeyedArchiver archivedDataWithRootObject:geoPoint];
+        [[theValue([[transformer transformedValue:archived] length]) should] equal:theValue(16)];
+    });
+    
+    it(@"returns nil for data that is not a geo point", ^{
+        [[SMGeoPointTransformer geoPointWithData:[@"not a geo point" dataUsingEncoding:NSUTF8StringEncoding]] shouldBeNil];
+        [[SMGeoPointTransformer geoPointWithData:[NSKeyedArchiver archivedDataWithRootObject:@"string"]] shouldBeNil];
+        [[SMGeoPointTransformer dataWithGeoPoint:[NSDictionary dictionary]] shouldBeNil];
+    });
+});
+
+SPEC_END
@@ -194,4 +194,122 @@ describe(@"-queryForEntity:predicate:error", ^{
     });
 });
 
+describe(@"query plans", ^{
+    __block NSDictionary *(^uncachedParameters)(NSPredicate *);
+    
+    beforeEach(^{
+        entity = [SMSpecHelpers entityForName:@"Person"];
+        query = nil;
+        error = nil;
+        store = [[SMIncrementalStore alloc] init];
+        uncachedParameters = ^NSDictionary *(NSPredicate *thePredicate) {
+            NSError *uncachedError = nil;
+            return [[[[SMIncrementalStore alloc] init] queryForEntity:entity predicate:thePredicate error:&uncachedError] requestParameters];
+        };
+    });
+    it(@"binds new values into a predicate of the same shape", ^{
+        [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"last_name == %@ AND armor_class BETWEEN %@", @"Cooper", [NSArray arrayWithObjects:[NSNumber numberWithInt:12], [NSNumber numberWithInt:16], nil]] error:&error];
+        
+        predicate = [NSPredicate predicateWithFormat:@"last_name == %@ AND armor_class BETWEEN %@", @"Williams", [NSArray arrayWithObjects:[NSNumber numberWithInt:2], [NSNumber numberWithInt:4], nil]];
+        query = [store queryForEntity:entity predicate:predicate error:&error];
+        [error shouldBeNil];
+        [[[query requestParameters] should] haveCountOf:3];
+        [[[query requestParameters] should] haveValue:@"Williams" forKey:@"last_name"];
+        [[[query requestParameters] should] haveValue:[NSNumber numberWithInt:2] forKey:@"armor_class[gte]"];
+        [[[query requestParameters] should] haveValue:[NSNumber numberWithInt:4] forKey:@"armor_class[lte]"];
+    });
+    it(@"matches the uncached query for OR predicates", ^{
+        [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"first_name IN %@ OR (last_name != %@ AND armor_class < %@)", [NSArray arrayWithObject:@"Bob"], @"Cooper", [NSNumber numberWithInt:16]] error:&error];
+        
+        predicate = [NSPredicate predicateWithFormat:@"first_name IN %@ OR (last_name != %@ AND armor_class < %@)", [NSArray arrayWithObjects:@"Aaron", @"Clyde", nil], @"Williams", [NSNumber numberWithInt:8]];
+        query = [store queryForEntity:entity predicate:predicate error:&error];
+        [error shouldBeNil];
+        [[[query requestParameters] should] equal:uncachedParameters(predicate)];
+    });
+    it(@"treats nil and empty values as a different shape", ^{
+        [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"last_name == %@", @"Cooper"] error:&error];
+        
+        query = [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"last_name == nil"] error:&error];
+        [[[query requestParameters] should] equal:[NSDictionary dictionaryWithObject:@"true" forKey:@"last_name[null]"]];
+        
+        query = [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"last_name == %@", @""] error:&error];
+        [[[query requestParameters] should] equal:[NSDictionary dictionaryWithObject:@"true" forKey:@"last_name[empty]"]];
+    });
+    it(@"doesn't plan comparisons with nil", ^{
+        [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"first_name == %@ AND armor_class < %@", @"Bob", [NSNumber numberWithInt:1]] error:&error];
+        
+        [[theBlock(^{
+            [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"first_name == %@ AND armor_class < nil", @"Bob"] error:&error];
+        }) should] raise];
+        [[theBlock(^{
+            [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"armor_class < nil"] error:&error];
+        }) should] raise];
+    });
+    it(@"still reports errors for predicates it can't plan", ^{
+        query = [store queryForEntity:entity predicate:[NSPredicate predicateWithFormat:@"NOT (last_name == %@)", @"Cooper"] error:&error];
+        [[error should] beNonNil];
+    });
+    it(@"keeps ordering in the plan and paging per request", ^{
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] init];
+        [fetchRequest setEntity:entity];
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"armor_class > %@", [NSNumber numberWithInt:1]]];
+        [fetchRequest setSortDescriptors:[NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"last_name" ascending:YES]]];
+        [fetchRequest setFetchOffset:10];
+        query = [store queryForFetchRequest:fetchRequest error:&error];
+        [[[query requestHeaders] should] haveValue:@"objects=10-" forKey:@"Range"];
+        
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"armor_class > %@", [NSNumber numberWithInt:5]]];
+        [fetchRequest setFetchOffset:0];
+        query = [store queryForFetchRequest:fetchRequest error:&error];
+        [error shouldBeNil];
+        [[[query requestParameters] should] haveValue:[NSNumber numberWithInt:5] forKey:@"armor_class[gt]"];
+        [[[query requestHeaders] should] equal:[NSDictionary dictionaryWithObject:@"last_name:asc" forKey:@"X-StackMob-OrderBy"]];
+    });
+});
+
+describe(@"-aggregateQueryForFetchRequest:error:", ^{
+    __block NSFetchRequest *fetchRequest;
+    __block NSExpressionDescription *(^expressionDescription)(NSString *, NSString *, NSString *);
+    
+    beforeEach(^{
+        entity = [SMSpecHelpers entityForName:@"Person"];
+        query = nil;
+        error = nil;
+        store = [[SMIncrementalStore alloc] init];
+        fetchRequest = [[NSFetchRequest alloc] init];
+        [fetchRequest setEntity:entity];
+        [fetchRequest setResultType:NSDictionaryResultType];
+        expressionDescription = ^NSExpressionDescription *(NSString *name, NSString *function, NSString *keyPath) {
+            NSExpressionDescription *description = [[NSExpressionDescription alloc] init];
+            [description setName:name];
+            [description setExpression:[NSExpression expressionForFunction:function arguments:[NSArray arrayWithObject:[NSExpression expressionForKeyPath:keyPath]]]];
+            [description setExpressionResultType:NSDoubleAttributeType];
+            return description;
+        };
+    });
+    it(@"translates expressions into aggregates grouped by the other properties", ^{
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"armor_class > %@", [NSNumber numberWithInt:1]]];
+        [fetchRequest setPropertiesToFetch:[NSArray arrayWithObjects:@"last_name", expressionDescription(@"total", @"sum:", @"armor_class"), nil]];
+        query = [store aggregateQueryForFetchRequest:fetchRequest error:&error];
+        [error shouldBeNil];
+        [[[query requestParameters] should] haveValue:[NSNumber numberWithInt:1] forKey:@"armor_class[gt]"];
+        [[[query groupByFields] should] equal:[NSArray arrayWithObject:@"last_name"]];
+        [[[query aggregates] should] equal:[NSArray arrayWithObject:[NSDictionary dictionaryWithObjectsAndKeys:@"sum", @"function", @"armor_class", @"field", @"total", @"name", nil]]];
+    });
+    it(@"groups distinct results by the properties to fetch", ^{
+        [fetchRequest setPropertiesToFetch:[NSArray arrayWithObject:[[entity attributesByName] objectForKey:@"last_name"]]];
+        [fetchRequest setReturnsDistinctResults:YES];
+        query = [store aggregateQueryForFetchRequest:fetchRequest error:&error];
+        [error shouldBeNil];
+        [[[query groupByFields] should] equal:[NSArray arrayWithObject:@"last_name"]];
+        [[[query aggregates] should] beEmpty];
+    });
+    it(@"returns an error for expressions it can't aggregate", ^{
+        [fetchRequest setPropertiesToFetch:[NSArray arrayWithObject:expressionDescription(@"lower", @"lowercase:", @"last_name")]];
+        query = [store aggregateQueryForFetchRequest:fetchRequest error:&error];
+        [query shouldBeNil];
+        [[error should] beNonNil];
+    });
+});
+
 SPEC_END
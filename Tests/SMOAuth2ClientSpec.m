@@ -16,6 +16,7 @@
 
 #import <Kiwi/Kiwi.h>
 #import "StackMob.h"
+#import "SMMetrics+Protected.h"
 
 SPEC_BEGIN(SMOAuth2ClientSpec)
 
@@ -59,6 +60,47 @@ describe(@"Generating a mac key", ^{
     });
 });
 
+describe(@"Signing requests", ^{
+    __block SMOAuth2Client *client  = nil;
+    beforeEach(^{
+        client = [[SMOAuth2Client alloc] initWithAPIVersion:@"1" scheme:@"https" apiHost:@"host" publicKey:@"XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"];
+        client.accessToken = @"accessToken";
+        client.macKey = @"macKey";
+    });
+    it(@"should use the cached port", ^{
+        [[[client getPort] should] equal:@"443"];
+    });
+    it(@"should match the precomputed value after the mac key changes", ^{
+        client.macKey = @"otherKey";
+        client.macKey = @"macKey";
+        [[[client createMACHeaderForHttpMethod:@"POST" path:@"hello" timestamp:1337 nonce:@"noncenonce"] should] equal:@"MAC id=\"accessToken\",ts=\"1337\",nonce=\"noncenonce\",mac=\"ZpsJivPXcc4cTc6I50bC5XpQfEU=\""];
+    });
+    it(@"should not repeat nonces", ^{
+        NSMutableSet *headers = [NSMutableSet set];
+        for (int i = 0; i < 10000; i++) {
+            [headers addObject:[client createMACHeaderForHttpMethod:@"GET" path:@"/hello"]];
+        }
+        [[theValue([headers count]) should] equal:theValue(10000)];
+    });
+    it(@"should sign a batch of requests", ^{
+        NSMutableArray *requests = [NSMutableArray array];
+        for (int i = 0; i < 5; i++) {
+            [requests addObject:[NSMutableURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://host/hello/%d", i]]]];
+        }
+        [client signRequests:requests];
+        NSMutableSet *headers = [NSMutableSet set];
+        for (NSMutableURLRequest *request in requests) {
+            [[theValue([[request valueForHTTPHeaderField:@"Authorization"] hasPrefix:@"MAC id=\"accessToken\""]) should] beYes];
+            [headers addObject:[request valueForHTTPHeaderField:@"Authorization"]];
+        }
+        [[theValue([headers count]) should] equal:theValue(5)];
+    });
+    it(@"should not sign without credentials", ^{
+        client.accessToken = nil;
+        [[client createMACHeaderForHttpMethod:@"GET" path:@"/hello"] shouldBeNil];
+    });
+});
+
 describe(@"has valid credentials", ^{
     
 });
@@ -163,7 +205,135 @@ describe(@"-customCodeRequest:options", ^{
             
             [[[aRequest URL] should] equal:[NSURL URLWithString:@"http://api.stackmob.com/method?a=3&a=1&bob=5"]];
         });
+        it(@"customCodeRequest should prefer a binary body", ^{
+            request.requestBodyData = [NSData dataWithBytes:"\x01\x02" length:2];
+            NSURLRequest *aRequest = [dataStore.session.regularOAuthClient customCodeRequest:request options:[SMRequestOptions options]];
+            [[[aRequest HTTPBody] should] equal:request.requestBodyData];
+        });
+
+    });
+});
 
+describe(@"Scheduling requests", ^{
+    __block SMOAuth2Client *client = nil;
+    __block AFHTTPRequestOperation *(^operationWithPriority)(SMRequestPriority);
+    beforeEach(^{
+        client = [[SMOAuth2Client alloc] initWithAPIVersion:@"0" scheme:@"http" apiHost:@"localhost" publicKey:@"public"];
+        client.maxConcurrentRequests = 2;
+        client.reservedInteractiveRequests = 1;
+        // Operations handed to the queue stay there, so the queue shows what the scheduler started
+        [client.operationQueue setSuspended:YES];
+        operationWithPriority = ^(SMRequestPriority priority) {
+            AFHTTPRequestOperation *operation = [[AFHTTPRequestOperation alloc] initWithRequest:[client requestWithMethod:@"GET" path:@"thing" parameters:nil]];
+            [operation setQueuePriority:SMOperationQueuePriorityForRequestPriority(priority)];
+            return operation;
+        };
+    });
+    afterEach(^{
+        [client.operationQueue cancelAllOperations];
+        [client.operationQueue setSuspended:NO];
+    });
+    it(@"should have sensible defaults", ^{
+        SMOAuth2Client *defaultClient = [[SMOAuth2Client alloc] initWithAPIVersion:@"0" scheme:@"http" apiHost:@"localhost" publicKey:@"public"];
+        [[theValue(defaultClient.maxConcurrentRequests) should] equal:theValue(4)];
+        [[theValue(defaultClient.reservedInteractiveRequests) should] equal:theValue(1)];
+    });
+    it(@"should keep capacity free for interactive requests", ^{
+        for (int i = 0; i < 3; i++) {
+            [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityBackground)];
+        }
+        [[theValue([client.operationQueue operationCount]) should] equal:theValue(1)];
+        [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityInteractive)];
+        [[theValue([client.operationQueue operationCount]) should] equal:theValue(2)];
+    });
+    it(@"should not start more than the maximum", ^{
+        for (int i = 0; i < 3; i++) {
+            [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityInteractive)];
+        }
+        [[theValue([client.operationQueue operationCount]) should] equal:theValue(2)];
+    });
+    it(@"should promote waiting requests", ^{
+        client.priorityAgingInterval = 0.01;
+        [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityBackground)];
+        AFHTTPRequestOperation *waitingOperation = operationWithPriority(SMRequestPriorityBackground);
+        [client enqueueHTTPRequestOperation:waitingOperation];
+        [[theValue([[client.operationQueue operations] containsObject:waitingOperation]) should] beNo];
+        [NSThread sleepForTimeInterval:0.05];
+        [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityInteractive)];
+        [[theValue([[client.operationQueue operations] containsObject:waitingOperation]) should] beYes];
+    });
+    it(@"should promote waiting requests while the queue is idle", ^{
+        client.priorityAgingInterval = 0.01;
+        [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityBackground)];
+        AFHTTPRequestOperation *waitingOperation = operationWithPriority(SMRequestPriorityBackground);
+        [client enqueueHTTPRequestOperation:waitingOperation];
+        [[expectFutureValue(theValue([[client.operationQueue operations] containsObject:waitingOperation])) shouldEventually] beYes];
+    });
+    it(@"should let go of waiting requests when they are cancelled", ^{
+        for (int i = 0; i < 2; i++) {
+            [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityInteractive)];
+        }
+        AFHTTPRequestOperation *waitingOperation = operationWithPriority(SMRequestPriorityInteractive);
+        [client enqueueHTTPRequestOperation:waitingOperation];
+        [[theValue([[client.operationQueue operations] containsObject:waitingOperation]) should] beNo];
+
+        [waitingOperation cancel];
+        [[theValue([[client.operationQueue operations] containsObject:waitingOperation]) should] beYes];
+
+        // Without taking one of the slots
+        [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityInteractive)];
+        [[theValue([client.operationQueue operationCount]) should] equal:theValue(3)];
+    });
+    it(@"should finish waiting requests that are cancelled", ^{
+        [client.operationQueue setSuspended:NO];
+        client.maxConcurrentRequests = 1;
+        AFHTTPRequestOperation *runningOperation = operationWithPriority(SMRequestPriorityInteractive);
+        [runningOperation addDependency:[[NSOperation alloc] init]];
+        [client enqueueHTTPRequestOperation:runningOperation];
+        AFHTTPRequestOperation *waitingOperation = operationWithPriority(SMRequestPriorityInteractive);
+        [client enqueueHTTPRequestOperation:waitingOperation];
+
+        [waitingOperation cancel];
+        [[expectFutureValue(theValue([waitingOperation isFinished])) shouldEventually] beYes];
+        [[theValue([runningOperation isFinished]) should] beNo];
+    });
+    it(@"should always leave a slot for non-interactive requests", ^{
+        client.maxConcurrentRequests = 1;
+        [client enqueueHTTPRequestOperation:operationWithPriority(SMRequestPriorityUtility)];
+        [[theValue([client.operationQueue operationCount]) should] equal:theValue(1)];
+    });
+});
+
+describe(@"Reporting metrics", ^{
+    __block SMOAuth2Client *client  = nil;
+    __block id observer = nil;
+    beforeEach(^{
+        client = [[SMOAuth2Client alloc] initWithAPIVersion:@"1" scheme:@"https" apiHost:@"host" publicKey:@"XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"];
+        client.accessToken = @"accessToken";
+        client.macKey = @"macKey";
+        observer = [KWMock nullMockForProtocol:@protocol(SMMetricsObserver)];
+    });
+    afterEach(^{
+        [SMMetrics setObserver:nil];
+    });
+    it(@"should be off until an observer is set", ^{
+        [[theValue(SMMetricsEnabled()) should] beNo];
+        [SMMetrics setObserver:observer];
+        [[theValue(SMMetricsEnabled()) should] beYes];
+        [[(id)[SMMetrics observer] should] equal:observer];
+    });
+    it(@"should pass counters to the observer", ^{
+        [SMMetrics setObserver:observer];
+        [[observer should] receive:@selector(metricsCounter:didIncrementBy:) withArguments:SMMetricsRetryCounter, theValue(2)];
+        SMMetricsIncrementCounter(SMMetricsRetryCounter, 2);
+    });
+    it(@"should record the signing time on the request", ^{
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://host/hello"]];
+        [client signRequest:request path:@"/hello"];
+        [[NSURLProtocol propertyForKey:SMMetricsSigningDurationKey inRequest:request] shouldBeNil];
+        [SMMetrics setObserver:observer];
+        [client signRequest:request path:@"/hello"];
+        [[NSURLProtocol propertyForKey:SMMetricsSigningDurationKey inRequest:request] shouldNotBeNil];
     });
 });
 
@@ -16,6 +16,21 @@
 
 #import <Kiwi/Kiwi.h>
 #import "SMPushClient.h"
+#import "SMOAuth1Client.h"
+
+@interface SMPushClient (BulkPushSpec)
+
+- (void)enqueueRequest:(NSURLRequest *)request onSuccess:(SMResultSuccessBlock)successBlock onFailure:(SMFailureBlock)failureBlock;
+- (void)SM_flushOutboundQueue;
+- (NSURL *)SM_outboundQueueURL;
+
+@end
+
+@interface SMOAuth1Client (SigningSpec)
+
+- (NSString *) authorizationHeaderValueForRequest:(NSURLRequest *)request timestamp:(NSString *)timestamp nonce:(NSString *)nonce;
+
+@end
 
 SPEC_BEGIN(SMPushClientSpec)
 
@@ -95,4 +110,109 @@ describe(@"configuration", ^{
     });
 });
 
+describe(@"bulk push", ^{
+    __block SMPushClient *client = nil;
+    __block NSMutableArray *tokens = nil;
+    beforeEach(^{
+        client = [[SMPushClient alloc] initWithAPIVersion:@"0" publicKey:@"public" privateKey:@"private"];
+        tokens = [NSMutableArray array];
+        for (int i = 0; i < 2500; i++) {
+            [tokens addObject:[NSString stringWithFormat:@"%064d", i]];
+        }
+    });
+    it(@"should have sensible defaults", ^{
+        [[theValue(client.bulkChunkSize) should] equal:theValue(1000)];
+        [[theValue(client.maxConcurrentBulkRequests) should] equal:theValue(4)];
+        [[theValue(client.bulkRetryCount) should] equal:theValue(3)];
+    });
+    it(@"should send one request per chunk", ^{
+        [[[client shouldEventually] receiveWithCount:3] enqueueRequest:[KWAny any] onSuccess:[KWAny any] onFailure:[KWAny any]];
+        [client sendMessage:[NSDictionary dictionaryWithObject:@"hello" forKey:@"alert"] toTokensFromEnumerator:[tokens objectEnumerator] onChunkComplete:nil onComplete:nil];
+    });
+    it(@"should not send more chunks than the concurrency limit at once", ^{
+        client.maxConcurrentBulkRequests = 2;
+        [[[client shouldEventually] receiveWithCount:2] enqueueRequest:[KWAny any] onSuccess:[KWAny any] onFailure:[KWAny any]];
+        [client sendMessage:[NSDictionary dictionaryWithObject:@"hello" forKey:@"alert"] toTokensFromEnumerator:[tokens objectEnumerator] onChunkComplete:nil onComplete:nil];
+    });
+    it(@"should look up large user lists in chunks", ^{
+        [[[client should] receiveWithCount:25] enqueueRequest:[KWAny any] onSuccess:[KWAny any] onFailure:[KWAny any]];
+        [client getTokensForUsers:tokens onSuccess:^(NSDictionary *result) {} onFailure:^(NSError *error) {}];
+    });
+});
+
+describe(@"outbound queue", ^{
+    __block SMPushClient *client = nil;
+    beforeEach(^{
+        client = [[SMPushClient alloc] initWithAPIVersion:@"0" publicKey:@"outbound-queue-spec" privateKey:@"private"];
+        [client stub:@selector(SM_flushOutboundQueue)];
+        client.queuesRequestsWhileOffline = YES;
+    });
+    afterEach(^{
+        client.queuesRequestsWhileOffline = NO;
+        [[NSFileManager defaultManager] removeItemAtURL:[client SM_outboundQueueURL] error:nil];
+    });
+    it(@"should send directly when the queue is disabled", ^{
+        client.queuesRequestsWhileOffline = NO;
+        [[client should] receive:@selector(enqueueRequest:onSuccess:onFailure:)];
+        [client deleteToken:@"aaaa" onSuccess:^{} onFailure:^(NSError *error) {}];
+        [[theValue([client pendingRequestCount]) should] equal:theValue(0)];
+    });
+    it(@"should journal requests while they are pending", ^{
+        [client registerDeviceToken:@"aaaa" withUser:@"bob" onSuccess:^{} onFailure:^(NSError *error) {}];
+        [client registerDeviceToken:@"bbbb" withUser:@"bob" onSuccess:^{} onFailure:^(NSError *error) {}];
+        [[theValue([client pendingRequestCount]) should] equal:theValue(2)];
+        [[theValue([[NSFileManager defaultManager] fileExistsAtPath:[[client SM_outboundQueueURL] path]]) should] beYes];
+    });
+    it(@"should collapse pending operations on the same token", ^{
+        [client registerDeviceToken:@"aaaa" withUser:@"bob" onSuccess:^{} onFailure:^(NSError *error) {}];
+        [client deleteToken:@"aaaa" onSuccess:^{} onFailure:^(NSError *error) {}];
+        [[theValue([client pendingRequestCount]) should] equal:theValue(1)];
+    });
+    it(@"should reload the journal in a new client", ^{
+        [client registerDeviceToken:@"aaaa" withUser:@"bob" onSuccess:^{} onFailure:^(NSError *error) {}];
+        SMPushClient *relaunchedClient = [[SMPushClient alloc] initWithAPIVersion:@"0" publicKey:@"outbound-queue-spec" privateKey:@"private"];
+        [relaunchedClient stub:@selector(SM_flushOutboundQueue)];
+        relaunchedClient.queuesRequestsWhileOffline = YES;
+        [[theValue([relaunchedClient pendingRequestCount]) should] equal:theValue(1)];
+        relaunchedClient.queuesRequestsWhileOffline = NO;
+    });
+});
+
+describe(@"oauth1 signing", ^{
+    __block SMOAuth1Client *oauthClient = nil;
+    beforeEach(^{
+        oauthClient = [[SMOAuth1Client alloc] initWithBaseURL:[NSURL URLWithString:@"http://push.stackmob.com"] consumerKey:@"public" secret:@"private"];
+    });
+    it(@"should sign requests with the consumer key and base URL realm", ^{
+        NSURLRequest *request = [oauthClient requestWithMethod:@"POST" path:@"push_tokens_universal" parameters:[NSDictionary dictionaryWithObject:@"bar" forKey:@"foo"]];
+        NSString *header = [request valueForHTTPHeaderField:@"Authorization"];
+        [[theValue([header hasPrefix:@"OAuth realm=\"http://push.stackmob.com\""]) should] beYes];
+        [[theValue([header rangeOfString:@"oauth_consumer_key=\"public\""].location != NSNotFound) should] beYes];
+        [[theValue([header rangeOfString:@"oauth_signature=\""].location != NSNotFound) should] beYes];
+    });
+    it(@"should sign a batch of requests", ^{
+        NSMutableArray *requests = [NSMutableArray array];
+        for (int i = 0; i < 5; i++) {
+            [requests addObject:[[oauthClient unsignedRequestWithMethod:@"GET" path:@"get_tokens_for_users_universal" parameters:[NSDictionary dictionaryWithObject:[NSString stringWithFormat:@"user%d", i] forKey:@"userIds"]] mutableCopy]];
+        }
+        [oauthClient signBatchOfRequests:requests];
+        NSMutableSet *headers = [NSMutableSet set];
+        for (NSURLRequest *request in requests) {
+            [[request valueForHTTPHeaderField:@"Authorization"] shouldNotBeNil];
+            [headers addObject:[request valueForHTTPHeaderField:@"Authorization"]];
+        }
+        [[theValue([headers count]) should] equal:theValue(5)];
+    });
+    it(@"should produce the same signature for a fixed timestamp and nonce", ^{
+        NSURLRequest *request = [oauthClient unsignedRequestWithMethod:@"GET" path:@"device_tokens" parameters:[NSDictionary dictionaryWithObject:@"bar" forKey:@"foo"]];
+        NSString *header = [oauthClient authorizationHeaderValueForRequest:request timestamp:@"1350000000" nonce:@"2B4F6B1E-1A2B-4C3D-9E8F-0123456789AB"];
+        [[header should] equal:@"OAuth realm=\"http://push.stackmob.com\",oauth_signature_method=\"HMAC-SHA1\",oauth_version=\"1.0\",oauth_consumer_key=\"public\",oauth_nonce=\"2B4F6B1E-1A2B-4C3D-9E8F-0123456789AB\",oauth_timestamp=\"1350000000\",oauth_signature=\"fxIRqcbq5D%2F%2F0siFHActo2jSQKc%3D\""];
+    });
+    it(@"should sign query parameters in key order", ^{
+        NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"http://push.stackmob.com/device_tokens?zeta=1&alpha=2"]];
+        NSString *header = [oauthClient authorizationHeaderValueForRequest:request timestamp:@"1350000000" nonce:@"2B4F6B1E-1A2B-4C3D-9E8F-0123456789AB"];
+        [[theValue([header hasSuffix:@",oauth_signature=\"rdDviL15FdS2baCIbp25LCrYnjI%3D\""]) should] beYes];
+    });
+});
+
 SPEC_END
\ No newline at end of file
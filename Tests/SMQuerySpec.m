@@ -125,6 +125,49 @@ describe(@"multiple where clauses", ^{
         [[requestParameters should] haveValue:@"value1" forKey:@"field1"];
         [[requestParameters should] haveValue:[NSNumber numberWithInt:2] forKey:CONCAT(@"field2", @"[gt]")];
     });
+    it(@"does not change parameters already returned", ^{
+        [query where:@"field1" isEqualTo:@"value1"];
+        NSDictionary *requestParameters = [query requestParameters];
+        [query where:@"field2" isEqualTo:@"value2"];
+        [[requestParameters should] haveCountOf:1];
+        [[[query requestParameters] should] haveCountOf:2];
+    });
+    it(@"adds to parameters that were set", ^{
+        query.requestParameters = [NSDictionary dictionaryWithObject:@"value1" forKey:@"field1"];
+        [query where:@"field2" isEqualTo:@"value2"];
+        [[[query requestParameters] should] equal:[NSDictionary dictionaryWithObjectsAndKeys:@"value1", @"field1", @"value2", @"field2", nil]];
+    });
+});
+
+describe(@"or", ^{
+    it(@"groups the conditions of each query", ^{
+        SMQuery *second = [[SMQuery alloc] initWithSchema:TEST_SCHEMA];
+        SMQuery *third = [[SMQuery alloc] initWithSchema:TEST_SCHEMA];
+        [query where:@"field1" isEqualTo:@"value1"];
+        [second where:@"field2" isEqualTo:@"value2"];
+        [third where:@"field3" isEqualTo:@"value3"];
+        [third where:@"field4" isEqualTo:@"value4"];
+        [[query or:second] or:third];
+        NSDictionary *expectation = [NSDictionary dictionaryWithObjectsAndKeys:
+                                     @"value1", @"[or1].field1",
+                                     @"value2", @"[or1].field2",
+                                     @"value3", @"[or1].[and1].field3",
+                                     @"value4", @"[or1].[and1].field4", nil];
+        [[[query requestParameters] should] equal:expectation];
+    });
+    it(@"raises on duplicate conditions without changing the query", ^{
+        SMQuery *second = [[SMQuery alloc] initWithSchema:TEST_SCHEMA];
+        SMQuery *duplicate = [[SMQuery alloc] initWithSchema:TEST_SCHEMA];
+        [query where:@"field1" isEqualTo:@"value1"];
+        [second where:@"field2" isEqualTo:@"value2"];
+        [duplicate where:@"field1" isEqualTo:@"value3"];
+        [query or:second];
+        [[theBlock(^{
+            [query or:duplicate];
+        }) should] raise];
+        [[[query requestParameters] should] haveCountOf:2];
+        [[[query requestParameters] should] haveValue:@"value1" forKey:@"[or1].field1"];
+    });
 });
 
 describe(@"field selection", ^{
@@ -183,4 +226,61 @@ describe(@"near", ^{
     });
 });
 
+describe(@"aggregates", ^{
+    __block NSArray *objects;
+    beforeEach(^{
+        objects = [NSArray arrayWithObjects:
+                   [NSDictionary dictionaryWithObjectsAndKeys:@"red", @"color", [NSNumber numberWithInt:2], @"size", nil],
+                   [NSDictionary dictionaryWithObjectsAndKeys:@"blue", @"color", [NSNumber numberWithInt:6], @"size", nil],
+                   [NSDictionary dictionaryWithObjectsAndKeys:@"red", @"color", [NSNumber numberWithInt:4], @"size", nil],
+                   [NSDictionary dictionaryWithObjectsAndKeys:@"red", @"color", [NSNull null], @"size", nil], nil];
+    });
+    it(@"-aggregate:ofField:as:", ^{
+        [query aggregate:SMAggregateSum ofField:@"size" as:@"total"];
+        [query aggregate:SMAggregateCount ofField:nil as:@"count"];
+        [[[query aggregates] should] equal:[NSArray arrayWithObjects:
+                                            [NSDictionary dictionaryWithObjectsAndKeys:@"sum", @"function", @"size", @"field", @"total", @"name", nil],
+                                            [NSDictionary dictionaryWithObjectsAndKeys:@"count", @"function", @"count", @"name", nil], nil]];
+        [[theValue([query isAggregateQuery]) should] beYes];
+        [[[query requestParameters] should] beEmpty];
+    });
+    it(@"needs a field for anything but count", ^{
+        [[theBlock(^{
+            [query aggregate:SMAggregateMax ofField:nil as:@"largest"];
+        }) should] raise];
+    });
+    it(@"computes one row without group-by fields", ^{
+        [query aggregate:SMAggregateCount ofField:nil as:@"objects"];
+        [query aggregate:SMAggregateCount ofField:@"size" as:@"sizes"];
+        [query aggregate:SMAggregateAverage ofField:@"size" as:@"average"];
+        [query aggregate:SMAggregateMin ofField:@"size" as:@"smallest"];
+        NSArray *rows = [query aggregateObjects:objects];
+        [[rows should] haveCountOf:1];
+        NSDictionary *row = [rows lastObject];
+        [[[row objectForKey:@"objects"] should] equal:[NSNumber numberWithInt:4]];
+        [[[row objectForKey:@"sizes"] should] equal:[NSNumber numberWithInt:3]];
+        [[[row objectForKey:@"average"] should] equal:[NSNumber numberWithInt:4]];
+        [[[row objectForKey:@"smallest"] should] equal:[NSNumber numberWithInt:2]];
+    });
+    it(@"computes a row per group in the order groups are seen", ^{
+        [query groupByField:@"color"];
+        [query aggregate:SMAggregateMax ofField:@"size" as:@"largest"];
+        NSArray *rows = [query aggregateObjects:objects];
+        [[rows should] equal:[NSArray arrayWithObjects:
+                              [NSDictionary dictionaryWithObjectsAndKeys:@"red", @"color", [NSNumber numberWithInt:4], @"largest", nil],
+                              [NSDictionary dictionaryWithObjectsAndKeys:@"blue", @"color", [NSNumber numberWithInt:6], @"largest", nil], nil]];
+    });
+    it(@"-selectDistinctValuesOfField:", ^{
+        [query selectDistinctValuesOfField:@"color"];
+        [[[query aggregateObjects:objects] should] equal:[NSArray arrayWithObjects:
+                                                         [NSDictionary dictionaryWithObject:@"red" forKey:@"color"],
+                                                         [NSDictionary dictionaryWithObject:@"blue" forKey:@"color"], nil]];
+    });
+    it(@"leaves out aggregates of no values", ^{
+        [query aggregate:SMAggregateSum ofField:@"size" as:@"total"];
+        [query aggregate:SMAggregateCount ofField:@"size" as:@"sizes"];
+        [[[query aggregateObjects:[NSArray array]] should] equal:[NSArray arrayWithObject:[NSDictionary dictionaryWithObject:[NSNumber numberWithInt:0] forKey:@"sizes"]]];
+    });
+});
+
 SPEC_END
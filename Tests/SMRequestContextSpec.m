@@ -0,0 +1,85 @@
+/**
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Kiwi/Kiwi.h>
+#import "StackMob.h"
+
+SPEC_BEGIN(SMRequestContextSpec)
+
+describe(@"SMRequestContext", ^{
+    __block NSManagedObjectContext *parentContext = nil;
+    __block NSManagedObjectContext *childContext = nil;
+    
+    beforeEach(^{
+        parentContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSConfinementConcurrencyType];
+        childContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSConfinementConcurrencyType];
+        [childContext setParentContext:parentContext];
+    });
+    
+    it(@"gives every request its own trace ID", ^{
+        SMRequestContext *first = [SMRequestContext requestContextWithOptions:nil];
+        SMRequestContext *second = [SMRequestContext requestContextWithOptions:nil];
+        [first.traceID shouldNotBeNil];
+        [[first.traceID shouldNot] equal:second.traceID];
+    });
+    
+    it(@"is only attached while the block runs", ^{
+        SMRequestOptions *options = [SMRequestOptions optionsWithHTTPS];
+        SMRequestContext *requestContext = [SMRequestContext requestContextWithOptions:options];
+        __block SMRequestContext *attached = nil;
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:parentContext block:^{
+            attached = [SMRequestContext requestContextForManagedObjectContext:parentContext];
+        }];
+        [[attached should] equal:requestContext];
+        [[[attached options] should] equal:options];
+        [[SMRequestContext requestContextForManagedObjectContext:parentContext] shouldBeNil];
+    });
+    
+    it(@"is not found from child contexts", ^{
+        SMRequestContext *requestContext = [SMRequestContext requestContextWithOptions:nil];
+        __block SMRequestContext *found = nil;
+        [SMRequestContext performWithRequestContext:requestContext inManagedObjectContext:parentContext block:^{
+            found = [SMRequestContext requestContextForManagedObjectContext:childContext];
+        }];
+        [found shouldBeNil];
+    });
+    
+    it(@"puts back the request context it replaced", ^{
+        SMRequestContext *outer = [SMRequestContext requestContextWithOptions:nil];
+        SMRequestContext *inner = [SMRequestContext requestContextWithOptions:nil];
+        __block SMRequestContext *afterInner = nil;
+        [SMRequestContext performWithRequestContext:outer inManagedObjectContext:parentContext block:^{
+            [SMRequestContext performWithRequestContext:inner inManagedObjectContext:parentContext block:^{}];
+            afterInner = [SMRequestContext requestContextForManagedObjectContext:parentContext];
+        }];
+        [[afterInner should] equal:outer];
+    });
+    
+    it(@"keeps separate options for contexts used at the same time", ^{
+        NSManagedObjectContext *otherContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSConfinementConcurrencyType];
+        SMRequestContext *first = [SMRequestContext requestContextWithOptions:[SMRequestOptions optionsWithHTTPS]];
+        SMRequestContext *second = [SMRequestContext requestContextWithOptions:[SMRequestOptions options]];
+        __block SMRequestContext *seenByFirst = nil;
+        [SMRequestContext performWithRequestContext:first inManagedObjectContext:parentContext block:^{
+            [SMRequestContext performWithRequestContext:second inManagedObjectContext:otherContext block:^{
+                seenByFirst = [SMRequestContext requestContextForManagedObjectContext:parentContext];
+            }];
+        }];
+        [[seenByFirst should] equal:first];
+    });
+});
+
+SPEC_END
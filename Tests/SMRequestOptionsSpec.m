@@ -28,6 +28,8 @@ describe(@"SMRequestOptions", ^{
         [[theValue(options.numberOfRetries) should] equal:theValue(3)];
         [[theValue(options.tryRefreshToken) should] equal:theValue(YES)];
         [options.retryBlock shouldBeNil];
+        [[theValue(options.cachePolicySet) should] equal:theValue(NO)];
+        [[theValue(options.cacheMaxAge) should] equal:theValue(0.0)];
     });
     it(@"+optionsWithHeaders", ^{
         NSDictionary *headersDict = [NSDictionary dictionaryWithObjectsAndKeys:@"headerValue", @"header", nil];
@@ -106,6 +108,72 @@ describe(@"SMRequestOptions", ^{
         [[theValue(myOptions.tryRefreshToken) should] equal:theValue(YES)];
         [[myOptions.retryBlock should] equal:myRetryBlock];
     });
+    it(@"+optionsWithCachePolicy", ^{
+        SMRequestOptions *options = [SMRequestOptions optionsWithCachePolicy:SMCachePolicyTryCacheElseNetwork];
+        [options.headers shouldBeNil];
+        [[theValue(options.cachePolicySet) should] equal:theValue(YES)];
+        [[theValue(options.cachePolicy) should] equal:theValue(SMCachePolicyTryCacheElseNetwork)];
+        [[theValue(options.cacheMaxAge) should] equal:theValue(0.0)];
+    });
+    it(@"setting cache policy marks it as set", ^{
+        SMRequestOptions *options = [SMRequestOptions options];
+        options.cachePolicy = SMCachePolicyTryNetworkOnly;
+        options.cacheMaxAge = 300;
+        [[theValue(options.cachePolicySet) should] equal:theValue(YES)];
+        [[theValue(options.cacheMaxAge) should] equal:theValue(300.0)];
+    });
+    it(@"setting max age to 0 marks it as set", ^{
+        SMRequestOptions *options = [SMRequestOptions options];
+        [[theValue(options.cacheMaxAgeSet) should] equal:theValue(NO)];
+        options.cacheMaxAge = 0;
+        [[theValue(options.cacheMaxAgeSet) should] equal:theValue(YES)];
+        [[theValue([options copy].cacheMaxAgeSet) should] equal:theValue(YES)];
+    });
+    it(@"-copy", ^{
+        SMRequestOptions *options = [SMRequestOptions optionsWithExpandDepth:2];
+        options.isSecure = YES;
+        options.numberOfRetries = 5;
+        options.cacheMaxAge = 60;
+        SMRequestOptions *copiedOptions = [options copy];
+        [[copiedOptions.headers should] equal:options.headers];
+        [[theValue(copiedOptions.isSecure) should] equal:theValue(YES)];
+        [[theValue(copiedOptions.numberOfRetries) should] equal:theValue(5)];
+        [[theValue(copiedOptions.tryRefreshToken) should] equal:theValue(YES)];
+        [[theValue(copiedOptions.cachePolicySet) should] equal:theValue(NO)];
+        [[theValue(copiedOptions.cacheMaxAge) should] equal:theValue(60.0)];
+        [copiedOptions setTryRefreshToken:NO];
+        [[theValue(options.tryRefreshToken) should] equal:theValue(YES)];
+    });
+    it(@"setting priority marks it as set and survives a copy", ^{
+        SMRequestOptions *options = [SMRequestOptions options];
+        [[theValue(options.priority) should] equal:theValue(SMRequestPriorityInteractive)];
+        [[theValue(options.prioritySet) should] equal:theValue(NO)];
+        options.priority = SMRequestPriorityBackground;
+        SMRequestOptions *copiedOptions = [options copy];
+        [[theValue(copiedOptions.prioritySet) should] equal:theValue(YES)];
+        [[theValue(copiedOptions.priority) should] equal:theValue(SMRequestPriorityBackground)];
+    });
+    it(@"deadline survives a copy", ^{
+        SMRequestOptions *options = [SMRequestOptions options];
+        [options.deadline shouldBeNil];
+        NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:30];
+        options.deadline = deadline;
+        SMRequestOptions *copiedOptions = [options copy];
+        [[copiedOptions.deadline should] equal:deadline];
+    });
+    it(@"retry policy defaults and survives a copy", ^{
+        SMRequestOptions *options = [SMRequestOptions options];
+        [options.retryPolicy shouldNotBeNil];
+        [[theValue(options.retryPolicy.baseDelay) should] equal:theValue(0.5)];
+        [[theValue(options.retryPolicy.maxDelay) should] equal:theValue(30.0)];
+        [[options.retryPolicy.retryBudget should] equal:[SMRetryBudget defaultBudget]];
+        options.retryPolicy.retriesNonIdempotentRequests = YES;
+        SMRequestOptions *copiedOptions = [options copy];
+        [[theValue(copiedOptions.retryPolicy.retriesNonIdempotentRequests) should] equal:theValue(YES)];
+        [[copiedOptions.retryPolicy.retryBudget should] equal:options.retryPolicy.retryBudget];
+        copiedOptions.retryPolicy.baseDelay = 2.0;
+        [[theValue(options.retryPolicy.baseDelay) should] equal:theValue(0.5)];
+    });
     it(@"restrict returned fields method", ^{
         NSArray *restrictArray = [NSArray arrayWithObjects:@"name", @"age", @"year", nil];
         SMRequestOptions *options = [SMRequestOptions options];
@@ -119,4 +187,68 @@ describe(@"SMRequestOptions", ^{
     });
 });
 
-SPEC_END
\ No newline at end of file
+describe(@"SMRetryPolicy", ^{
+    __block SMRetryPolicy *policy = nil;
+    __block NSMutableURLRequest *request = nil;
+    beforeEach(^{
+        policy = [SMRetryPolicy policy];
+        request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"http://api.stackmob.com/todo"]];
+    });
+    it(@"retries a 503 for any method", ^{
+        NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[request URL] statusCode:503 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+        [request setHTTPMethod:@"POST"];
+        [[theValue([policy shouldRetryRequest:request response:response error:nil]) should] beYes];
+    });
+    it(@"retries 502 and 504 only for idempotent methods unless told to", ^{
+        NSHTTPURLResponse *badGateway = [[NSHTTPURLResponse alloc] initWithURL:[request URL] statusCode:502 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+        NSHTTPURLResponse *gatewayTimeout = [[NSHTTPURLResponse alloc] initWithURL:[request URL] statusCode:504 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+        [request setHTTPMethod:@"GET"];
+        [[theValue([policy shouldRetryRequest:request response:badGateway error:nil]) should] beYes];
+        [[theValue([policy shouldRetryRequest:request response:gatewayTimeout error:nil]) should] beYes];
+        [request setHTTPMethod:@"POST"];
+        [[theValue([policy shouldRetryRequest:request response:badGateway error:nil]) should] beNo];
+        [[theValue([policy shouldRetryRequest:request response:gatewayTimeout error:nil]) should] beNo];
+        policy.retriesNonIdempotentRequests = YES;
+        [[theValue([policy shouldRetryRequest:request response:gatewayTimeout error:nil]) should] beYes];
+    });
+    it(@"does not retry client errors", ^{
+        NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[request URL] statusCode:400 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+        [[theValue([policy shouldRetryRequest:request response:response error:nil]) should] beNo];
+    });
+    it(@"retries connection failures for any method and timeouts only for idempotent methods", ^{
+        NSError *cannotConnect = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotConnectToHost userInfo:nil];
+        NSError *timedOut = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+        NSError *offline = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil];
+        [request setHTTPMethod:@"PUT"];
+        [[theValue([policy shouldRetryRequest:request response:nil error:timedOut]) should] beYes];
+        [[theValue([policy shouldRetryRequest:request response:nil error:offline]) should] beNo];
+        [request setHTTPMethod:@"POST"];
+        [[theValue([policy shouldRetryRequest:request response:nil error:cannotConnect]) should] beYes];
+        [[theValue([policy shouldRetryRequest:request response:nil error:timedOut]) should] beNo];
+    });
+    it(@"keeps the delay within the capped backoff", ^{
+        policy.baseDelay = 1.0;
+        policy.maxDelay = 4.0;
+        for (int i = 0; i < 50; i++) {
+            [[theValue([policy delayForRetryAttempt:0 response:nil]) should] beBetween:theValue(0.0) and:theValue(1.0)];
+            [[theValue([policy delayForRetryAttempt:10 response:nil]) should] beBetween:theValue(0.0) and:theValue(4.0)];
+        }
+    });
+    it(@"waits at least as long as Retry-After", ^{
+        NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[request URL] statusCode:503 HTTPVersion:@"HTTP/1.1" headerFields:[NSDictionary dictionaryWithObject:@"3" forKey:@"Retry-After"]];
+        policy.baseDelay = 1.0;
+        [[theValue([policy delayForRetryAttempt:0 response:response]) should] beBetween:theValue(3.0) and:theValue(4.0)];
+    });
+    it(@"budget limits retries until requests are recorded", ^{
+        SMRetryBudget *budget = [[SMRetryBudget alloc] initWithMaxTokens:2 tokenRatio:0.5];
+        [[theValue([budget withdrawRetry]) should] beYes];
+        [[theValue([budget withdrawRetry]) should] beYes];
+        [[theValue([budget withdrawRetry]) should] beNo];
+        [budget recordRequest];
+        [[theValue([budget withdrawRetry]) should] beNo];
+        [budget recordRequest];
+        [[theValue([budget withdrawRetry]) should] beYes];
+    });
+});
+
+SPEC_END
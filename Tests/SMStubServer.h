@@ -0,0 +1,84 @@
+/**
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ An in-process stand-in for the StackMob REST API, used to run the SDK against a repeatable backend.
+
+ Once started, every request to the stub host is answered from an in-memory datastore instead of the network.  It covers the parts of the API the SDK uses:
+
+ * CRUD on `/<schema>` and `/<schema>/<id>`, with equality and `[in]` query parameters.
+ * `Range: objects=a-b` paging, answered with `Content-Range`.
+ * `X-StackMob-Relations` on create and update, and `X-StackMob-Expand` on reads.
+ * The `accessToken` and `refreshToken` endpoints of the user schema.
+ * Injected 401 and 503 responses, with `Retry-After`, and an offline mode.
+
+ Latency and extra payload size are configurable so benchmarks can model a slow backend or large objects.
+ */
+@interface SMStubServer : NSURLProtocol
+
+/**
+ Register the stub for requests to `host` and empty its datastore.
+ */
++ (void)startWithHost:(NSString *)host;
+
+/**
+ Unregister the stub.
+ */
++ (void)stop;
+
+/**
+ Delay before every response is sent.  Default is 0.
+ */
++ (void)setLatency:(NSTimeInterval)latency;
+
+/**
+ Number of padding bytes added to every object returned, in a field the SDK ignores.  Default is 0.
+ */
++ (void)setPayloadPadding:(NSUInteger)bytes;
+
+/**
+ While offline every request fails with `NSURLErrorNotConnectedToInternet`.
+ */
++ (void)setOffline:(BOOL)offline;
+
+/**
+ The primary key field of a schema.  Defaults to `username` for `user` and `<schema>_id` otherwise.
+ */
++ (void)setPrimaryKeyField:(NSString *)field forSchema:(NSString *)schema;
+
+/**
+ Store `count` objects in `schema`, built by `objectBlock`.  Objects without a primary key are given one.
+ */
++ (void)seedSchema:(NSString *)schema count:(NSUInteger)count objectBlock:(NSDictionary *(^)(NSUInteger idx))objectBlock;
+
+/**
+ Answer the next `count` requests with `statusCode`, adding a `Retry-After` header when `retryAfter` is positive.
+ */
++ (void)failNextRequests:(NSUInteger)count withStatusCode:(NSInteger)statusCode retryAfter:(NSTimeInterval)retryAfter;
+
+/**
+ Number of objects stored in `schema`.
+ */
++ (NSUInteger)countOfSchema:(NSString *)schema;
+
+/**
+ Number of requests answered since the stub was started.
+ */
++ (NSUInteger)requestCount;
+
+@end
@@ -0,0 +1,466 @@
+/**
+ * Copyright 2012-2013 StackMob
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "SMStubServer.h"
+
+#define SM_STUB_PADDING_FIELD @"sm_stub_padding"
+
+static NSString *SMStubHost = nil;
+static NSTimeInterval SMStubLatency = 0;
+static NSUInteger SMStubPayloadPadding = 0;
+static BOOL SMStubOffline = NO;
+static NSUInteger SMStubRequestCount = 0;
+static NSUInteger SMStubFailuresRemaining = 0;
+static NSInteger SMStubFailureStatusCode = 0;
+static NSTimeInterval SMStubFailureRetryAfter = 0;
+
+// schema -> ordered array of objects, schema -> field -> related schema, schema -> primary key field
+static NSMutableDictionary *SMStubObjects = nil;
+static NSMutableDictionary *SMStubRelations = nil;
+static NSMutableDictionary *SMStubPrimaryKeyFields = nil;
+
+@interface SMStubServer ()
+{
+    NSHTTPURLResponse *_SM_response;
+    NSData *_SM_responseData;
+    NSError *_SM_error;
+}
+
++ (NSString *)SM_primaryKeyFieldForSchema:(NSString *)schema;
++ (NSMutableArray *)SM_objectsForSchema:(NSString *)schema;
++ (NSMutableDictionary *)SM_objectWithId:(NSString *)objectId inSchema:(NSString *)schema;
++ (NSDictionary *)SM_parametersFromString:(NSString *)string;
++ (void)SM_recordRelationsHeader:(NSString *)header forSchema:(NSString *)schema;
++ (id)SM_expandObject:(NSDictionary *)object inSchema:(NSString *)schema depth:(NSInteger)depth;
+
+- (void)SM_respond;
+- (void)SM_prepareResponse;
+- (void)SM_setResponseStatusCode:(NSInteger)statusCode headers:(NSDictionary *)headers JSON:(id)JSON;
+
+@end
+
+@implementation SMStubServer
+
+#pragma mark - Configuration
+
++ (void)startWithHost:(NSString *)host
+{
+    @synchronized(self) {
+        SMStubHost = [host copy];
+        SMStubLatency = 0;
+        SMStubPayloadPadding = 0;
+        SMStubOffline = NO;
+        SMStubRequestCount = 0;
+        SMStubFailuresRemaining = 0;
+        SMStubObjects = [NSMutableDictionary dictionary];
+        SMStubRelations = [NSMutableDictionary dictionary];
+        SMStubPrimaryKeyFields = [NSMutableDictionary dictionary];
+    }
+    [NSURLProtocol registerClass:self];
+}
+
++ (void)stop
+{
+    [NSURLProtocol unregisterClass:self];
+    @synchronized(self) {
+        SMStubHost = nil;
+    }
+}
+
++ (void)setLatency:(NSTimeInterval)latency
+{
+    @synchronized(self) {
+        SMStubLatency = latency;
+    }
+}
+
++ (void)setPayloadPadding:(NSUInteger)bytes
+{
+    @synchronized(self) {
+        SMStubPayloadPadding = bytes;
+    }
+}
+
++ (void)setOffline:(BOOL)offline
+{
+    @synchronized(self) {
+        SMStubOffline = offline;
+    }
+}
+
++ (void)setPrimaryKeyField:(NSString *)field forSchema:(NSString *)schema
+{
+    @synchronized(self) {
+        [SMStubPrimaryKeyFields setObject:field forKey:[schema lowercaseString]];
+    }
+}
+
++ (void)seedSchema:(NSString *)schema count:(NSUInteger)count objectBlock:(NSDictionary *(^)(NSUInteger idx))objectBlock
+{
+    @synchronized(self) {
+        NSString *primaryKeyField = [self SM_primaryKeyFieldForSchema:schema];
+        NSMutableArray *objects = [self SM_objectsForSchema:schema];
+        NSNumber *now = [NSNumber numberWithLongLong:(long long)([[NSDate date] timeIntervalSince1970] * 1000)];
+        for (NSUInteger i = 0; i < count; i++) {
+            NSMutableDictionary *object = [objectBlock(i) mutableCopy];
+            if (![object objectForKey:primaryKeyField]) {
+                [object setObject:[NSString stringWithFormat:@"%@%lu", schema, (unsigned long)i] forKey:primaryKeyField];
+            }
+            [object setObject:now forKey:@"createddate"];
+            [object setObject:now forKey:@"lastmoddate"];
+            [objects addObject:object];
+        }
+    }
+}
+
++ (void)failNextRequests:(NSUInteger)count withStatusCode:(NSInteger)statusCode retryAfter:(NSTimeInterval)retryAfter
+{
+    @synchronized(self) {
+        SMStubFailuresRemaining = count;
+        SMStubFailureStatusCode = statusCode;
+        SMStubFailureRetryAfter = retryAfter;
+    }
+}
+
++ (NSUInteger)countOfSchema:(NSString *)schema
+{
+    @synchronized(self) {
+        return [[self SM_objectsForSchema:schema] count];
+    }
+}
+
++ (NSUInteger)requestCount
+{
+    @synchronized(self) {
+        return SMStubRequestCount;
+    }
+}
+
+#pragma mark - NSURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    @synchronized(self) {
+        return SMStubHost != nil && [[[request URL] host] isEqualToString:SMStubHost];
+    }
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    NSTimeInterval latency = 0;
+    @synchronized([self class]) {
+        latency = SMStubLatency;
+    }
+    
+    if (latency > 0) {
+        [self performSelector:@selector(SM_respond) withObject:nil afterDelay:latency inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+    } else {
+        [self SM_respond];
+    }
+}
+
+- (void)stopLoading
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(SM_respond) object:nil];
+}
+
+#pragma mark - Responding
+
+- (void)SM_respond
+{
+    @synchronized([self class]) {
+        SMStubRequestCount++;
+        [self SM_prepareResponse];
+    }
+    
+    // Delivered outside the lock so the client can't call back into the stub while it is held
+    if (_SM_error) {
+        [[self client] URLProtocol:self didFailWithError:_SM_error];
+    } else {
+        [[self client] URLProtocol:self didReceiveResponse:_SM_response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+        [[self client] URLProtocol:self didLoadData:_SM_responseData];
+        [[self client] URLProtocolDidFinishLoading:self];
+    }
+}
+
+// Called with the class locked
+- (void)SM_prepareResponse
+{
+    NSURLRequest *request = [self request];
+    NSString *method = [request HTTPMethod];
+    NSArray *pathComponents = [[[request URL] path] pathComponents];
+    NSMutableArray *components = [NSMutableArray array];
+    for (NSString *component in pathComponents) {
+        if (![component isEqualToString:@"/"]) {
+            [components addObject:component];
+        }
+    }
+    
+    if (SMStubOffline) {
+        _SM_error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil];
+        return;
+    }
+    
+    if (SMStubFailuresRemaining > 0) {
+        SMStubFailuresRemaining--;
+        NSDictionary *headers = SMStubFailureRetryAfter > 0 ? [NSDictionary dictionaryWithObject:[NSString stringWithFormat:@"%g", SMStubFailureRetryAfter] forKey:@"Retry-After"] : nil;
+        [self SM_setResponseStatusCode:SMStubFailureStatusCode headers:headers JSON:[NSDictionary dictionaryWithObject:@"Injected failure" forKey:@"error"]];
+        return;
+    }
+    
+    // Reachability checks
+    if ([components count] == 0) {
+        [self SM_setResponseStatusCode:200 headers:nil JSON:nil];
+        return;
+    }
+    
+    NSString *schema = [[components objectAtIndex:0] lowercaseString];
+    NSString *primaryKeyField = [[self class] SM_primaryKeyFieldForSchema:schema];
+    NSData *body = [request HTTPBody];
+    
+    // Token endpoints
+    if ([components count] == 2 && [method isEqualToString:@"POST"] && ([[components objectAtIndex:1] isEqualToString:@"accessToken"] || [[components objectAtIndex:1] isEqualToString:@"refreshToken"])) {
+        NSDictionary *credentials = [[self class] SM_parametersFromString:[[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding]];
+        NSString *username = [credentials objectForKey:@"username"] ?: @"stub";
+        NSDictionary *token = [NSDictionary dictionaryWithObjectsAndKeys:
+                               [NSString stringWithFormat:@"access%lu", (unsigned long)SMStubRequestCount], @"access_token",
+                               [NSString stringWithFormat:@"refresh%lu", (unsigned long)SMStubRequestCount], @"refresh_token",
+                               @"stubMacKey", @"mac_key",
+                               @"mac", @"token_type",
+                               [NSNumber numberWithInt:3600], @"expires_in",
+                               [NSDictionary dictionaryWithObject:[NSDictionary dictionaryWithObject:username forKey:primaryKeyField] forKey:@"user"], @"stackmob",
+                               nil];
+        [self SM_setResponseStatusCode:200 headers:nil JSON:token];
+        return;
+    }
+    
+    NSString *relationsHeader = [request valueForHTTPHeaderField:@"X-StackMob-Relations"];
+    if (relationsHeader) {
+        [[self class] SM_recordRelationsHeader:relationsHeader forSchema:schema];
+    }
+    NSInteger expandDepth = [[request valueForHTTPHeaderField:@"X-StackMob-Expand"] integerValue];
+    NSNumber *now = [NSNumber numberWithLongLong:(long long)([[NSDate date] timeIntervalSince1970] * 1000)];
+    
+    if ([components count] == 1 && [method isEqualToString:@"GET"]) {
+        // Query
+        NSDictionary *parameters = [[self class] SM_parametersFromString:[[request URL] query]];
+        NSMutableArray *matches = [NSMutableArray array];
+        for (NSDictionary *object in [[self class] SM_objectsForSchema:schema]) {
+            __block BOOL matched = YES;
+            [parameters enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *value, BOOL *stop) {
+                if ([key hasSuffix:@"[in]"]) {
+                    id objectValue = [object objectForKey:[key substringToIndex:[key length] - 4]];
+                    matched = objectValue && [[value componentsSeparatedByString:@","] containsObject:[objectValue description]];
+                } else if ([key rangeOfString:@"["].location == NSNotFound && ![key hasPrefix:@"_"]) {
+                    id objectValue = [object objectForKey:key];
+                    matched = objectValue && [[objectValue description] isEqualToString:value];
+                }
+                *stop = !matched;
+            }];
+            if (matched) {
+                [matches addObject:object];
+            }
+        }
+        
+        NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        NSUInteger total = [matches count];
+        if ([range hasPrefix:@"objects="] && total > 0) {
+            NSArray *bounds = [[range substringFromIndex:8] componentsSeparatedByString:@"-"];
+            NSUInteger start = MIN((NSUInteger)[[bounds objectAtIndex:0] integerValue], total - 1);
+            NSUInteger end = [bounds count] > 1 && [[bounds objectAtIndex:1] length] > 0 ? MIN((NSUInteger)[[bounds objectAtIndex:1] integerValue], total - 1) : total - 1;
+            end = MAX(start, end);
+            matches = [[matches subarrayWithRange:NSMakeRange(start, end - start + 1)] mutableCopy];
+            [headers setObject:[NSString stringWithFormat:@"objects %lu-%lu/%lu", (unsigned long)start, (unsigned long)end, (unsigned long)total] forKey:@"Content-Range"];
+        }
+        
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:[matches count]];
+        for (NSDictionary *object in matches) {
+            [results addObject:[[self class] SM_expandObject:object inSchema:schema depth:expandDepth]];
+        }
+        [self SM_setResponseStatusCode:200 headers:headers JSON:results];
+        return;
+    }
+    
+    if ([components count] == 1 && [method isEqualToString:@"POST"]) {
+        // Create
+        NSMutableDictionary *object = [[NSJSONSerialization JSONObjectWithData:body options:NSJSONReadingMutableContainers error:nil] mutableCopy];
+        if (![object isKindOfClass:[NSDictionary class]]) {
+            [self SM_setResponseStatusCode:400 headers:nil JSON:[NSDictionary dictionaryWithObject:@"Body must be a JSON object" forKey:@"error"]];
+            return;
+        }
+        if (![object objectForKey:primaryKeyField]) {
+            CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+            [object setObject:[(__bridge_transfer NSString *)CFUUIDCreateString(kCFAllocatorDefault, uuid) lowercaseString] forKey:primaryKeyField];
+            CFRelease(uuid);
+        }
+        [object setObject:now forKey:@"createddate"];
+        [object setObject:now forKey:@"lastmoddate"];
+        [[[self class] SM_objectsForSchema:schema] addObject:object];
+        [self SM_setResponseStatusCode:201 headers:nil JSON:object];
+        return;
+    }
+    
+    NSString *objectId = [components count] > 1 ? [components objectAtIndex:1] : nil;
+    NSMutableDictionary *object = [[self class] SM_objectWithId:objectId inSchema:schema];
+    if (!object) {
+        [self SM_setResponseStatusCode:404 headers:nil JSON:[NSDictionary dictionaryWithObject:@"Object not found" forKey:@"error"]];
+        return;
+    }
+    
+    if ([method isEqualToString:@"GET"]) {
+        [self SM_setResponseStatusCode:200 headers:nil JSON:[[self class] SM_expandObject:object inSchema:schema depth:expandDepth]];
+    } else if ([method isEqualToString:@"PUT"] || [method isEqualToString:@"POST"]) {
+        // Update, or an append to a relationship which is answered with the unchanged object
+        id changes = [components count] == 2 ? [NSJSONSerialization JSONObjectWithData:body options:0 error:nil] : nil;
+        if ([changes isKindOfClass:[NSDictionary class]]) {
+            [object addEntriesFromDictionary:changes];
+        }
+        [object setObject:now forKey:@"lastmoddate"];
+        [self SM_setResponseStatusCode:200 headers:nil JSON:object];
+    } else if ([method isEqualToString:@"DELETE"]) {
+        [[[self class] SM_objectsForSchema:schema] removeObjectIdenticalTo:object];
+        [self SM_setResponseStatusCode:200 headers:nil JSON:nil];
+    } else {
+        [self SM_setResponseStatusCode:405 headers:nil JSON:nil];
+    }
+}
+
+- (void)SM_setResponseStatusCode:(NSInteger)statusCode headers:(NSDictionary *)headers JSON:(id)JSON
+{
+    if (SMStubPayloadPadding > 0 && statusCode < 300) {
+        NSString *padding = [@"" stringByPaddingToLength:SMStubPayloadPadding withString:@"x" startingAtIndex:0];
+        if ([JSON isKindOfClass:[NSDictionary class]]) {
+            JSON = [JSON mutableCopy];
+            [JSON setObject:padding forKey:SM_STUB_PADDING_FIELD];
+        } else if ([JSON isKindOfClass:[NSArray class]]) {
+            NSMutableArray *padded = [NSMutableArray arrayWithCapacity:[JSON count]];
+            for (NSDictionary *object in JSON) {
+                NSMutableDictionary *paddedObject = [object mutableCopy];
+                [paddedObject setObject:padding forKey:SM_STUB_PADDING_FIELD];
+                [padded addObject:paddedObject];
+            }
+            JSON = padded;
+        }
+    }
+    
+    NSData *data = JSON ? [NSJSONSerialization dataWithJSONObject:JSON options:0 error:nil] : [NSData data];
+    NSMutableDictionary *headerFields = [NSMutableDictionary dictionaryWithObjectsAndKeys:@"application/json", @"Content-Type", [NSString stringWithFormat:@"%lu", (unsigned long)[data length]], @"Content-Length", nil];
+    [headerFields addEntriesFromDictionary:headers];
+    _SM_response = [[NSHTTPURLResponse alloc] initWithURL:[[self request] URL] statusCode:statusCode HTTPVersion:@"HTTP/1.1" headerFields:headerFields];
+    _SM_responseData = data;
+}
+
+#pragma mark - Datastore
+
++ (NSString *)SM_primaryKeyFieldForSchema:(NSString *)schema
+{
+    NSString *field = [SMStubPrimaryKeyFields objectForKey:[schema lowercaseString]];
+    if (field) {
+        return field;
+    }
+    
+    return [[schema lowercaseString] isEqualToString:@"user"] ? @"username" : [NSString stringWithFormat:@"%@_id", [schema lowercaseString]];
+}
+
++ (NSMutableArray *)SM_objectsForSchema:(NSString *)schema
+{
+    NSMutableArray *objects = [SMStubObjects objectForKey:[schema lowercaseString]];
+    if (!objects) {
+        objects = [NSMutableArray array];
+        [SMStubObjects setObject:objects forKey:[schema lowercaseString]];
+    }
+    
+    return objects;
+}
+
++ (NSMutableDictionary *)SM_objectWithId:(NSString *)objectId inSchema:(NSString *)schema
+{
+    if (!objectId) {
+        return nil;
+    }
+    
+    NSString *primaryKeyField = [self SM_primaryKeyFieldForSchema:schema];
+    for (NSMutableDictionary *object in [self SM_objectsForSchema:schema]) {
+        if ([[[object objectForKey:primaryKeyField] description] isEqualToString:objectId]) {
+            return object;
+        }
+    }
+    
+    return nil;
+}
+
++ (NSDictionary *)SM_parametersFromString:(NSString *)string
+{
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    for (NSString *pair in [string componentsSeparatedByString:@"&"]) {
+        NSRange separator = [pair rangeOfString:@"="];
+        if (separator.location == NSNotFound) {
+            continue;
+        }
+        NSString *key = [[pair substringToIndex:separator.location] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+        NSString *value = [[[pair substringFromIndex:separator.location + 1] stringByReplacingOccurrencesOfString:@"+" withString:@" "] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+        [parameters setObject:value forKey:key];
+    }
+    
+    return parameters;
+}
+
++ (void)SM_recordRelationsHeader:(NSString *)header forSchema:(NSString *)schema
+{
+    NSMutableDictionary *relations = [SMStubRelations objectForKey:schema];
+    if (!relations) {
+        relations = [NSMutableDictionary dictionary];
+        [SMStubRelations setObject:relations forKey:schema];
+    }
+    [relations addEntriesFromDictionary:[self SM_parametersFromString:header]];
+}
+
++ (id)SM_expandObject:(NSDictionary *)object inSchema:(NSString *)schema depth:(NSInteger)depth
+{
+    NSDictionary *relations = [SMStubRelations objectForKey:schema];
+    if (depth <= 0 || [relations count] == 0) {
+        return object;
+    }
+    
+    NSMutableDictionary *expanded = [object mutableCopy];
+    [relations enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *relatedSchema, BOOL *stop) {
+        id value = [object objectForKey:field];
+        if ([value isKindOfClass:[NSArray class]]) {
+            NSMutableArray *relatedObjects = [NSMutableArray arrayWithCapacity:[value count]];
+            for (id relatedId in value) {
+                NSDictionary *related = [self SM_objectWithId:[relatedId description] inSchema:relatedSchema];
+                [relatedObjects addObject:related ? [self SM_expandObject:related inSchema:relatedSchema depth:depth - 1] : relatedId];
+            }
+            [expanded setObject:relatedObjects forKey:field];
+        } else if (value) {
+            NSDictionary *related = [self SM_objectWithId:[value description] inSchema:relatedSchema];
+            if (related) {
+                [expanded setObject:[self SM_expandObject:related inSchema:relatedSchema depth:depth - 1] forKey:field];
+            }
+        }
+    }];
+    
+    return expanded;
+}
+
+@end
+
@@ -17,6 +17,13 @@
 #import <Kiwi/Kiwi.h>
 #import "StackMob.h"
 
+@interface SMUserSession (IdentifierMapSpec)
+
+- (NSURL *)SM_getStoreURLForUserIdentifierTableFile:(NSString *)fileComponent;
+- (void)SM_scheduleProactiveRefreshForGeneration:(NSUInteger)generation attempt:(NSUInteger)attempt afterDelay:(NSTimeInterval)delayInSeconds;
+
+@end
+
 SPEC_BEGIN(SMUserSessionSpec)
 
 #pragma mark Authentication with StackMob
@@ -202,6 +209,92 @@ describe(@"saveAccessTokenInfo", ^{
 });
 
 
+describe(@"user identifier map", ^{
+    __block SMUserSession *userSession  = nil;
+    __block NSURL *mapURL = nil;
+    __block NSURL *legacyMapURL = nil;
+    beforeEach(^{
+        userSession = [[SMUserSession alloc] initWithAPIVersion:@"1"
+                                                        apiHost:@"host"
+                                                      publicKey:@"identifier-map-spec"
+                                                     userSchema:@"user"
+                                            userPrimaryKeyField:@"username"
+                                              userPasswordField:@"password"];
+        mapURL = [userSession SM_getStoreURLForUserIdentifierTableFile:@"UserIdentifierMap.smdata"];
+        legacyMapURL = [userSession SM_getStoreURLForUserIdentifierTableFile:@"UserIdentifierMap.plist"];
+    });
+    afterEach(^{
+        [[NSFileManager defaultManager] removeItemAtURL:mapURL error:nil];
+        [[NSFileManager defaultManager] removeItemAtURL:legacyMapURL error:nil];
+    });
+    it(@"should round trip the map", ^{
+        [userSession.userIdentifierMap setObject:@"abc" forKey:@"bob"];
+        [userSession SMSaveUserIdentifierMap];
+        userSession.userIdentifierMap = nil;
+        [userSession SMReadUserIdentifierMap];
+        [[[userSession.userIdentifierMap objectForKey:@"bob"] should] equal:@"abc"];
+        [userSession.userIdentifierMap setObject:@"def" forKey:@"alice"];
+        [[theValue([userSession.userIdentifierMap count]) should] equal:theValue(2)];
+    });
+    it(@"should migrate an XML map once", ^{
+        NSData *legacyData = [NSPropertyListSerialization dataWithPropertyList:[NSDictionary dictionaryWithObject:@"abc" forKey:@"bob"] format:NSPropertyListXMLFormat_v1_0 options:0 error:nil];
+        [[NSFileManager defaultManager] createDirectoryAtURL:[legacyMapURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+        [legacyData writeToURL:legacyMapURL atomically:YES];
+        [userSession SMReadUserIdentifierMap];
+        [[[userSession.userIdentifierMap objectForKey:@"bob"] should] equal:@"abc"];
+        [[theValue([[NSFileManager defaultManager] fileExistsAtPath:[legacyMapURL path]]) should] beNo];
+        [[theValue([[NSFileManager defaultManager] fileExistsAtPath:[mapURL path]]) should] beYes];
+    });
+});
+
+describe(@"refreshing the access token", ^{
+    __block SMUserSession *userSession  = nil;
+    beforeEach(^{
+        userSession = [[SMUserSession alloc] initWithAPIVersion:@"1"
+                                                        apiHost:@"host"
+                                                      publicKey:@"foo"
+                                                     userSchema:@"user"
+                                            userPrimaryKeyField:@"username"
+                                              userPasswordField:@"password"];
+        userSession.tokenClient = [AFHTTPClient nullMock];
+        userSession.refreshToken = @"1234";
+    });
+    
+    it(@"should only send one refresh request for concurrent callers", ^{
+        [[[userSession.tokenClient should] receiveWithCount:1] enqueueHTTPRequestOperation:[KWAny any]];
+        __block NSError *refreshError = nil;
+        [userSession refreshTokenWithSuccessCallbackQueue:nil failureCallbackQueue:nil onSuccess:^(NSDictionary *userObject) {} onFailure:^(NSError *theError) {}];
+        [userSession refreshTokenWithSuccessCallbackQueue:nil failureCallbackQueue:nil onSuccess:^(NSDictionary *userObject) {} onFailure:^(NSError *theError) {
+            refreshError = theError;
+        }];
+        [[theValue(userSession.refreshing) should] beYes];
+        [refreshError shouldBeNil];
+    });
+    
+    it(@"should refresh in the background within the refresh margin", ^{
+        [[[userSession.tokenClient shouldEventually] receive] enqueueHTTPRequestOperation:[KWAny any]];
+        userSession.expiration = [NSDate dateWithTimeIntervalSinceNow:30];
+        userSession.tokenRefreshMargin = 60;
+    });
+    
+    it(@"should retry a failed background refresh with backoff", ^{
+        [userSession stub:@selector(refreshTokenWithSuccessCallbackQueue:failureCallbackQueue:onSuccess:onFailure:) withBlock:^id(NSArray *params) {
+            void (^failureBlock)(NSError *) = [params objectAtIndex:3];
+            failureBlock([NSError errorWithDomain:HTTPErrorDomain code:503 userInfo:nil]);
+            return nil;
+        }];
+        [[userSession shouldEventually] receive:@selector(SM_scheduleProactiveRefreshForGeneration:attempt:afterDelay:) withArguments:[KWAny any], theValue((NSUInteger)1), theValue(5.0)];
+        userSession.expiration = [NSDate dateWithTimeIntervalSinceNow:30];
+        userSession.tokenRefreshMargin = 60;
+    });
+    
+    it(@"should not refresh in the background when no margin is set", ^{
+        [[[userSession.tokenClient shouldNot] receive] enqueueHTTPRequestOperation:[KWAny any]];
+        userSession.expiration = [NSDate dateWithTimeIntervalSinceNow:30];
+        userSession.tokenRefreshMargin = 0;
+    });
+});
+
 
 
 
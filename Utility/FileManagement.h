@@ -22,4 +22,12 @@
 + (void)SM_createStoreURLPathIfNeeded:(NSURL *)storeURL;
 + (void)SM_removeStoreURLPath:(NSURL *)storeURL;
 
+/*
+ SDK metadata files (cache map, dirty queue, user identifier map) are stored as a binary property list behind a small versioned header, and are memory mapped when read.  Containers come back mutable, leaves are left immutable.
+ 
+ When the file at metadataURL does not exist but one at legacyURL does, the legacy XML property list is read, rewritten in the new format and removed.  Returns nil without an error when neither file exists.
+ */
++ (id)SM_readMetadataAtURL:(NSURL *)metadataURL legacyPropertyListURL:(NSURL *)legacyURL error:(NSError *__autoreleasing *)error;
++ (BOOL)SM_writeMetadata:(id)propertyList toURL:(NSURL *)metadataURL error:(NSError *__autoreleasing *)error;
+
 @end
@@ -22,6 +22,15 @@
 #import "SMError.h"
 #import "Common.h"
 
+// 'SMMD' followed by the format version, both stored big endian
+#define SM_METADATA_MAGIC 0x534D4D44
+#define SM_METADATA_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} SMMetadataHeader;
+
 @implementation FileManagement
 
 + (void)SM_createStoreURLPathIfNeeded:(NSURL *)storeURL
@@ -90,4 +99,76 @@
     return aURL;
 }
 
++ (id)SM_readMetadataAtURL:(NSURL *)metadataURL legacyPropertyListURL:(NSURL *)legacyURL error:(NSError *__autoreleasing *)error
+{
+    if (SM_CORE_DATA_DEBUG) {DLog()}
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    
+    if (![fileManager fileExistsAtPath:[metadataURL path]]) {
+        if (!legacyURL || ![fileManager fileExistsAtPath:[legacyURL path]]) {
+            return nil;
+        }
+        
+        // One time migration from the XML property list written by earlier versions of the SDK
+        NSData *legacyData = [NSData dataWithContentsOfURL:legacyURL options:NSDataReadingMappedIfSafe error:error];
+        id propertyList = legacyData ? [NSPropertyListSerialization propertyListWithData:legacyData options:NSPropertyListMutableContainers format:NULL error:error] : nil;
+        if (propertyList) {
+            // The data was read, so a failed rewrite only means the migration is tried again next time
+            NSError *writeError = nil;
+            if ([self SM_writeMetadata:propertyList toURL:metadataURL error:&writeError]) {
+                [fileManager removeItemAtURL:legacyURL error:nil];
+            } else if (SM_CORE_DATA_DEBUG) {
+                DLog(@"Could not migrate %@: %@", [legacyURL lastPathComponent], writeError)
+            }
+        }
+        return propertyList;
+    }
+    
+    NSData *data __attribute__((objc_precise_lifetime)) = [NSData dataWithContentsOfURL:metadataURL options:NSDataReadingMappedIfSafe error:error];
+    if (!data) {
+        return nil;
+    }
+    
+    SMMetadataHeader header;
+    if ([data length] < sizeof(header)) {
+        if (error != NULL) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:[NSDictionary dictionaryWithObject:[metadataURL path] forKey:NSFilePathErrorKey]];
+        }
+        return nil;
+    }
+    [data getBytes:&header length:sizeof(header)];
+    if (CFSwapInt32BigToHost(header.magic) != SM_METADATA_MAGIC || CFSwapInt32BigToHost(header.version) > SM_METADATA_VERSION) {
+        if (error != NULL) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:[NSDictionary dictionaryWithObject:[metadataURL path] forKey:NSFilePathErrorKey]];
+        }
+        return nil;
+    }
+    
+    // Parse straight out of the mapped file, the payload is never copied
+    NSData *payload = [NSData dataWithBytesNoCopy:(void *)((const char *)[data bytes] + sizeof(header)) length:[data length] - sizeof(header) freeWhenDone:NO];
+    return [NSPropertyListSerialization propertyListWithData:payload options:NSPropertyListMutableContainers format:NULL error:error];
+}
+
++ (BOOL)SM_writeMetadata:(id)propertyList toURL:(NSURL *)metadataURL error:(NSError *__autoreleasing *)error
+{
+    if (SM_CORE_DATA_DEBUG) {DLog()}
+    
+    NSData *payload = [NSPropertyListSerialization dataWithPropertyList:propertyList format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (!payload) {
+        return NO;
+    }
+    
+    SMMetadataHeader header;
+    header.magic = CFSwapInt32HostToBig(SM_METADATA_MAGIC);
+    header.version = CFSwapInt32HostToBig(SM_METADATA_VERSION);
+    
+    NSMutableData *data = [NSMutableData dataWithCapacity:sizeof(header) + [payload length]];
+    [data appendBytes:&header length:sizeof(header)];
+    [data appendData:payload];
+    
+    [self SM_createStoreURLPathIfNeeded:metadataURL];
+    return [data writeToURL:metadataURL options:NSDataWritingAtomic error:error];
+}
+
 @end
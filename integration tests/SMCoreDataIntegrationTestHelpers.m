@@ -17,6 +17,7 @@
 #import "SMCoreDataIntegrationTestHelpers.h"
 #import "SMIncrementalStore.h"
 #import "SMIntegrationTestHelpers.h"
+#import "FileManagement.h"
 
 static SMCoreDataIntegrationTestHelpers *_singletonInstance;
 
@@ -40,7 +41,7 @@ static SMCoreDataIntegrationTestHelpers *_singletonInstance;
     NSString *applicationDocumentsDirectory = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) lastObject];
     NSString *applicationStorageDirectory = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) lastObject] stringByAppendingPathComponent:applicationName];
     
-    NSString *defaultName = [NSString stringWithFormat:@"%@-CacheMap.plist", publicKey];
+    NSString *defaultName = [NSString stringWithFormat:@"%@-CacheMap.smdata", publicKey];
     
     NSArray *paths = [NSArray arrayWithObjects:applicationDocumentsDirectory, applicationStorageDirectory, nil];
     
@@ -67,7 +68,7 @@ static SMCoreDataIntegrationTestHelpers *_singletonInstance;
     NSString *applicationDocumentsDirectory = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) lastObject];
     NSString *applicationStorageDirectory = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) lastObject] stringByAppendingPathComponent:applicationName];
     
-    NSString *defaultName = [NSString stringWithFormat:@"%@-DirtyQueue.plist", publicKey];
+    NSString *defaultName = [NSString stringWithFormat:@"%@-DirtyQueue.smdata", publicKey];
     
     NSArray *paths = [NSArray arrayWithObjects:applicationDocumentsDirectory, applicationStorageDirectory, nil];
     
@@ -89,24 +90,13 @@ static SMCoreDataIntegrationTestHelpers *_singletonInstance;
 
 + (NSDictionary *)getContentsOfFileAtPath:(NSString *)path
 {
-    NSString *errorDesc = nil;
-    NSPropertyListFormat format;
-    if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
-        NSData *plistXML = [[NSFileManager defaultManager] contentsAtPath:path];
-        NSDictionary *temp = (NSDictionary *)[NSPropertyListSerialization
-                                              propertyListFromData:plistXML
-                                              mutabilityOption:NSPropertyListMutableContainersAndLeaves
-                                              format:&format
-                                              errorDescription:&errorDesc];
-        
-        if (!temp) {
-            [NSException raise:SMExceptionCacheError format:@"Error reading cachemap: %@, format: %d", errorDesc, format];
-        } else {
-            return [temp mutableCopy];
-        }
+    NSError *error = nil;
+    NSDictionary *temp = [FileManagement SM_readMetadataAtURL:[NSURL fileURLWithPath:path] legacyPropertyListURL:nil error:&error];
+    if (!temp && error) {
+        [NSException raise:SMExceptionCacheError format:@"Error reading cachemap: %@", error];
     }
     
-    return nil;
+    return temp;
 }
 
 + (SMCoreDataIntegrationTestHelpers *)singleton {
@@ -132,7 +122,7 @@ static SMCoreDataIntegrationTestHelpers *_singletonInstance;
         }
     }
     
-    defaultName = [NSString stringWithFormat:@"%@-UserIdentifierMap.plist", publicKey];
+    defaultName = [NSString stringWithFormat:@"%@-UserIdentifierMap.smdata", publicKey];
     NSURL *aURL = [NSURL fileURLWithPath:[applicationStorageDirectory stringByAppendingPathComponent:defaultName]];
     if ([fileManager fileExistsAtPath:[aURL path]]) {
         NSError *sqliteDeleteError = nil;
@@ -142,7 +132,7 @@ static SMCoreDataIntegrationTestHelpers *_singletonInstance;
         }
     }
     
-    defaultName = [NSString stringWithFormat:@"%@-CacheMap.plist", publicKey];
+    defaultName = [NSString stringWithFormat:@"%@-CacheMap.smdata", publicKey];
     aURL = [NSURL fileURLWithPath:[applicationStorageDirectory stringByAppendingPathComponent:defaultName]];
     if ([fileManager fileExistsAtPath:[aURL path]]) {
         NSError *sqliteDeleteError = nil;
@@ -152,7 +142,7 @@ static SMCoreDataIntegrationTestHelpers *_singletonInstance;
         }
     }
     
-    defaultName = [NSString stringWithFormat:@"%@-DirtyQueue.plist", publicKey];
+    defaultName = [NSString stringWithFormat:@"%@-DirtyQueue.smdata", publicKey];
     aURL = [NSURL fileURLWithPath:[applicationStorageDirectory stringByAppendingPathComponent:defaultName]];
     if ([fileManager fileExistsAtPath:[aURL path]]) {
         NSError *sqliteDeleteError = nil;
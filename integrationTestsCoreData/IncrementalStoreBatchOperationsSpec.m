@@ -504,4 +504,129 @@ describe(@"Calling refresh block", ^{
         [[theValue(refreshFailed) should] beYes];
     });
 });
-SPEC_END
\ No newline at end of file
+SPEC_END
+describe(@"Save units", ^{
+    __block SMClient *client = nil;
+    __block SMCoreDataStore *cds = nil;
+    __block NSManagedObjectContext *moc = nil;
+    
+    beforeEach(^{
+        client = [SMIntegrationTestHelpers defaultClient];
+        [SMClient setDefaultClient:client];
+        [[client.session.networkMonitor stubAndReturn:theValue(1)] currentNetworkStatus];
+        NSBundle *classBundle = [NSBundle bundleForClass:[self class]];
+        NSURL *modelURL = [classBundle URLForResource:@"SMCoreDataIntegrationTest" withExtension:@"momd"];
+        NSManagedObjectModel *aModel = [[NSManagedObjectModel alloc] initWithContentsOfURL:modelURL];
+        cds = [client coreDataStoreWithManagedObjectModel:aModel];
+        moc = [cds contextForCurrentThread];
+    });
+    afterEach(^{
+        [[client.session.networkMonitor stubAndReturn:theValue(1)] currentNetworkStatus];
+        for (NSString *entityName in [NSArray arrayWithObjects:@"Todo", @"Person", @"Superpower", nil]) {
+            NSFetchRequest *fetch = [[NSFetchRequest alloc] initWithEntityName:entityName];
+            NSError *fetchError = nil;
+            NSArray *resultsArray = [moc executeFetchRequestAndWait:fetch error:&fetchError];
+            for (NSManagedObject *obj in resultsArray) {
+                [moc deleteObject:obj];
+            }
+        }
+        NSError *error = nil;
+        BOOL saveSuccess = [moc saveAndWait:&error];
+        [[theValue(saveSuccess) should] beYes];
+    });
+    it(@"sends the inserts of a unit before its updates", ^{
+        NSManagedObject *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:moc];
+        [person setValue:@"bob" forKey:@"first_name"];
+        [person setValue:[person assignObjectId] forKey:[person primaryKeyField]];
+        NSError *error = nil;
+        BOOL saveSuccess = [moc saveAndWait:&error];
+        [[theValue(saveSuccess) should] beYes];
+        
+        // Operations post their start notification on the main queue, in the order they start
+        NSMutableArray *startedRequests = [NSMutableArray array];
+        id observer = [[NSNotificationCenter defaultCenter] addObserverForName:AFNetworkingOperationDidStartNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
+            NSURLRequest *request = [[note object] request];
+            [startedRequests addObject:[NSString stringWithFormat:@"%@ %@", [request HTTPMethod], [[request URL] path]]];
+        }];
+        
+        // The superpower and person form one unit, the todo another
+        NSManagedObject *superpower = [NSEntityDescription insertNewObjectForEntityForName:@"Superpower" inManagedObjectContext:moc];
+        [superpower setValue:@"flying" forKey:@"name"];
+        [superpower setValue:[superpower assignObjectId] forKey:[superpower primaryKeyField]];
+        [superpower setValue:person forKey:@"person"];
+        NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:moc];
+        [todo setValue:@"bob" forKey:@"title"];
+        [todo setValue:[todo assignObjectId] forKey:[todo primaryKeyField]];
+        
+        saveSuccess = [moc saveAndWait:&error];
+        [[theValue(saveSuccess) should] beYes];
+        
+        [[expectFutureValue(theValue([startedRequests count])) shouldEventually] equal:theValue(3)];
+        
+        NSUInteger superpowerInsert = [startedRequests indexOfObjectPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+            return [obj hasPrefix:@"POST"] && [obj rangeOfString:@"superpower"].location != NSNotFound;
+        }];
+        NSUInteger personUpdate = [startedRequests indexOfObjectPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+            return [obj hasPrefix:@"PUT"] && [obj rangeOfString:@"person"].location != NSNotFound;
+        }];
+        [[theValue(superpowerInsert) shouldNot] equal:theValue(NSNotFound)];
+        [[theValue(personUpdate) shouldNot] equal:theValue(NSNotFound)];
+        [[theValue(superpowerInsert) should] beLessThan:theValue(personUpdate)];
+        
+        [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    });
+    it(@"reports which units failed and saves the others", ^{
+        NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:moc];
+        [todo setValue:@"bob" forKey:@"title"];
+        [todo setValue:@"primarykey" forKey:[todo primaryKeyField]];
+        NSError *error = nil;
+        BOOL saveSuccess = [moc saveAndWait:&error];
+        [[theValue(saveSuccess) should] beYes];
+        
+        // Produce a 409 in one unit while an unrelated person saves in another
+        NSManagedObject *duplicateTodo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:moc];
+        [duplicateTodo setValue:@"bob" forKey:@"title"];
+        [duplicateTodo setValue:@"primarykey" forKey:[duplicateTodo primaryKeyField]];
+        NSManagedObject *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:moc];
+        [person setValue:@"bob" forKey:@"first_name"];
+        NSString *personId = [person assignObjectId];
+        [person setValue:personId forKey:[person primaryKeyField]];
+        NSManagedObjectID *duplicateTodoID = [duplicateTodo objectID];
+        NSManagedObjectID *personID = [person objectID];
+        
+        saveSuccess = [moc saveAndWait:&error];
+        [[theValue(saveSuccess) should] beNo];
+        [[theValue([error code]) should] equal:theValue(SMErrorCoreDataSave)];
+        
+        NSArray *unitResults = [[error userInfo] objectForKey:SMSaveUnitResults];
+        [[theValue([unitResults count]) should] equal:theValue(2)];
+        for (NSDictionary *unitResult in unitResults) {
+            NSArray *objectIDs = [unitResult objectForKey:SMSaveUnitObjectIDs];
+            [[theValue([objectIDs count]) should] equal:theValue(1)];
+            if ([[objectIDs lastObject] isEqual:duplicateTodoID]) {
+                [[unitResult objectForKey:SMSaveUnitError] shouldNotBeNil];
+            } else {
+                [[[objectIDs lastObject] should] equal:personID];
+                [[unitResult objectForKey:SMSaveUnitError] shouldBeNil];
+            }
+        }
+        
+        [moc deleteObject:duplicateTodo];
+        [moc deleteObject:person];
+        
+        // The person reached the server even though the save failed
+        __block NSArray *people = nil;
+        syncWithSemaphore(^(dispatch_semaphore_t semaphore) {
+            SMQuery *query = [[SMQuery alloc] initWithSchema:@"person"];
+            [query where:@"person_id" isEqualTo:personId];
+            [[client dataStore] performQuery:query onSuccess:^(NSArray *results) {
+                people = results;
+                syncReturn(semaphore);
+            } onFailure:^(NSError *queryError) {
+                [queryError shouldBeNil];
+                syncReturn(semaphore);
+            }];
+        });
+        [[theValue([people count]) should] equal:theValue(1)];
+    });
+});
@@ -20,6 +20,12 @@
 #import "SMCoreDataIntegrationTestHelpers.h"
 #import "Person.h"
 
+@interface SMIncrementalStore (LocalReadCacheSpec)
+
+- (NSPredicate *)SM_cachePredicateForGeoPredicate:(NSPredicate *)predicate entity:(NSEntityDescription *)entity remoteIDsByDistance:(NSArray *__autoreleasing *)remoteIDsByDistance;
+
+@end
+
 SPEC_BEGIN(LocalReadCacheSpec)
 
 
@@ -2075,4 +2081,265 @@ describe(@"cache enabling and disabling", ^{
  });
  */
 
+describe(@"cache max age", ^{
+    __block SMClient *client = nil;
+    __block SMCoreDataStore *cds = nil;
+    __block NSManagedObjectContext *moc = nil;
+    __block SMIncrementalStore *store = nil;
+    __block NSUInteger networkFetchCount = 0;
+    beforeEach(^{
+        SM_CACHE_ENABLED = YES;
+        client = [SMIntegrationTestHelpers defaultClient];
+        [SMClient setDefaultClient:client];
+        [SMCoreDataIntegrationTestHelpers removeSQLiteDatabaseAndMapsWithPublicKey:client.publicKey];
+        NSBundle *classBundle = [NSBundle bundleForClass:[self class]];
+        NSURL *modelURL = [classBundle URLForResource:@"SMCoreDataIntegrationTest" withExtension:@"momd"];
+        NSManagedObjectModel *aModel = [[NSManagedObjectModel alloc] initWithContentsOfURL:modelURL];
+        cds = [client coreDataStoreWithManagedObjectModel:aModel];
+        moc = [cds contextForCurrentThread];
+        store = [[cds.persistentStoreCoordinator persistentStores] lastObject];
+        
+        Person *person = [NSEntityDescription insertNewObjectForEntityForName:@"Person" inManagedObjectContext:moc];
+        [person setValue:[person assignObjectId] forKey:[person primaryKeyField]];
+        [person setValue:@"Bob" forKey:@"first_name"];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousSave:moc withBlock:^(NSError *error) {
+            [error shouldBeNil];
+        }];
+        
+        networkFetchCount = 0;
+    });
+    afterEach(^{
+        [cds setCacheMaxAge:0];
+        [cds setCachePolicy:SMCachePolicyTryNetworkOnly];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:[SMCoreDataIntegrationTestHelpers makePersonFetchRequest:nil context:moc] andBlock:^(NSArray *results, NSError *error) {
+            for (NSManagedObject *obj in results) {
+                [moc deleteObject:obj];
+            }
+        }];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousSave:moc withBlock:^(NSError *error) {
+            [error shouldBeNil];
+        }];
+        SM_CACHE_ENABLED = NO;
+    });
+    it(@"answers from the cache once results were confirmed within the max age", ^{
+        // A network fetch confirms the cached entries
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:[SMCoreDataIntegrationTestHelpers makePersonFetchRequest:[NSPredicate predicateWithFormat:@"first_name == 'Bob'"] context:moc] andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[theValue([results count]) should] equal:theValue(1)];
+        }];
+        
+        [cds setCacheMaxAge:60];
+        [store stub:@selector(SM_performNetworkFetch:options:onCompletion:) withBlock:^id(NSArray *params) {
+            networkFetchCount++;
+            void (^completion)(NSArray *, NSError *) = [params objectAtIndex:2];
+            completion([NSArray array], nil);
+            return nil;
+        }];
+        
+        NSError *fetchError = nil;
+        NSArray *results = [moc executeFetchRequestAndWait:[SMCoreDataIntegrationTestHelpers makePersonFetchRequest:[NSPredicate predicateWithFormat:@"first_name == 'Bob'"] context:moc] error:&fetchError];
+        [fetchError shouldBeNil];
+        [[theValue([results count]) should] equal:theValue(1)];
+        [[theValue(networkFetchCount) should] equal:theValue(0)];
+    });
+    it(@"goes to the network when the cached results were never confirmed", ^{
+        [cds setCacheMaxAge:60];
+        [store stub:@selector(SM_performNetworkFetch:options:onCompletion:) withBlock:^id(NSArray *params) {
+            networkFetchCount++;
+            void (^completion)(NSArray *, NSError *) = [params objectAtIndex:2];
+            completion([NSArray array], nil);
+            return nil;
+        }];
+        
+        NSError *fetchError = nil;
+        [moc executeFetchRequestAndWait:[SMCoreDataIntegrationTestHelpers makePersonFetchRequest:[NSPredicate predicateWithFormat:@"first_name == 'Bob'"] context:moc] error:&fetchError];
+        [[theValue(networkFetchCount) should] equal:theValue(1)];
+    });
+});
+
+describe(@"geo queries from the cache", ^{
+    __block SMClient *client = nil;
+    __block SMCoreDataStore *cds = nil;
+    __block NSManagedObjectContext *moc = nil;
+    __block SMIncrementalStore *store = nil;
+    __block NSString *sanFranciscoID = nil;
+    __block NSString *framinghamID = nil;
+    __block CLLocationCoordinate2D fishermansWharf;
+    beforeEach(^{
+        SM_CACHE_ENABLED = YES;
+        client = [SMIntegrationTestHelpers defaultClient];
+        [SMClient setDefaultClient:client];
+        [SMCoreDataIntegrationTestHelpers removeSQLiteDatabaseAndMapsWithPublicKey:client.publicKey];
+        NSBundle *classBundle = [NSBundle bundleForClass:[self class]];
+        NSURL *modelURL = [classBundle URLForResource:@"SMCoreDataIntegrationTest" withExtension:@"momd"];
+        NSManagedObjectModel *aModel = [[NSManagedObjectModel alloc] initWithContentsOfURL:modelURL];
+        cds = [client coreDataStoreWithManagedObjectModel:aModel];
+        moc = [cds contextForCurrentThread];
+        store = [[cds.persistentStoreCoordinator persistentStores] lastObject];
+        [[client.session.networkMonitor stubAndReturn:theValue(1)] currentNetworkStatus];
+        
+        NSManagedObject *sanFrancisco = [NSEntityDescription insertNewObjectForEntityForName:@"Random" inManagedObjectContext:moc];
+        sanFranciscoID = [sanFrancisco assignObjectId];
+        [sanFrancisco setValue:sanFranciscoID forKey:[sanFrancisco primaryKeyField]];
+        [sanFrancisco setValue:@"StackMob" forKey:@"name"];
+        [sanFrancisco setValue:[NSKeyedArchiver archivedDataWithRootObject:[SMGeoPoint geoPointWithLatitude:[NSNumber numberWithDouble:37.77215879638275] longitude:[NSNumber numberWithDouble:-122.4064476357965]]] forKey:@"geopoint"];
+        
+        NSManagedObject *framingham = [NSEntityDescription insertNewObjectForEntityForName:@"Random" inManagedObjectContext:moc];
+        framinghamID = [framingham assignObjectId];
+        [framingham setValue:framinghamID forKey:[framingham primaryKeyField]];
+        [framingham setValue:@"Framingham" forKey:@"name"];
+        [framingham setValue:[NSKeyedArchiver archivedDataWithRootObject:[SMGeoPoint geoPointWithLatitude:[NSNumber numberWithDouble:42.280373] longitude:[NSNumber numberWithDouble:-71.416669]]] forKey:@"geopoint"];
+        
+        [SMCoreDataIntegrationTestHelpers executeSynchronousSave:moc withBlock:^(NSError *error) {
+            [error shouldBeNil];
+        }];
+        
+        // Fetched from the network so both objects are cached and indexed by location
+        [cds setCachePolicy:SMCachePolicyTryNetworkOnly];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:[[NSFetchRequest alloc] initWithEntityName:@"Random"] andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[theValue([results count]) should] equal:theValue(2)];
+        }];
+        
+        fishermansWharf = CLLocationCoordinate2DMake(37.810317, -122.418167);
+        [[client.session.networkMonitor stubAndReturn:theValue(0)] currentNetworkStatus];
+    });
+    afterEach(^{
+        [[client.session.networkMonitor stubAndReturn:theValue(1)] currentNetworkStatus];
+        [cds setCachePolicy:SMCachePolicyTryNetworkOnly];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:[[NSFetchRequest alloc] initWithEntityName:@"Random"] andBlock:^(NSArray *results, NSError *error) {
+            for (NSManagedObject *obj in results) {
+                [moc deleteObject:obj];
+            }
+        }];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousSave:moc withBlock:^(NSError *error) {
+            [error shouldBeNil];
+        }];
+        SM_CACHE_ENABLED = NO;
+    });
+    it(@"answers a distance query offline", ^{
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Random"];
+        [fetchRequest setPredicate:[SMPredicate predicateWhere:@"geopoint" isWithin:3.5 milesOf:fishermansWharf]];
+        
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:fetchRequest andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[theValue([results count]) should] equal:theValue(1)];
+            [[[[results lastObject] valueForKey:@"name"] should] equal:@"StackMob"];
+        }];
+    });
+    it(@"orders a near query offline by distance", ^{
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Random"];
+        [fetchRequest setPredicate:[SMPredicate predicateWhere:@"geopoint" near:fishermansWharf]];
+        
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:fetchRequest andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[[results valueForKey:@"name"] should] equal:[NSArray arrayWithObjects:@"StackMob", @"Framingham", nil]];
+        }];
+    });
+    it(@"combines geo and plain conditions in the cache predicate", ^{
+        NSEntityDescription *entity = [NSEntityDescription entityForName:@"Random" inManagedObjectContext:moc];
+        NSPredicate *predicate = [NSCompoundPredicate andPredicateWithSubpredicates:[NSArray arrayWithObjects:[SMPredicate predicateWhere:@"geopoint" isWithin:5000 kilometersOf:fishermansWharf], [NSPredicate predicateWithFormat:@"name == %@", @"Framingham"], nil]];
+        
+        NSArray *remoteIDsByDistance = nil;
+        NSPredicate *cachePredicate = [store SM_cachePredicateForGeoPredicate:predicate entity:entity remoteIDsByDistance:&remoteIDsByDistance];
+        [cachePredicate shouldNotBeNil];
+        [[remoteIDsByDistance should] equal:[NSArray arrayWithObjects:sanFranciscoID, framinghamID, nil]];
+        
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Random"];
+        [fetchRequest setPredicate:predicate];
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:fetchRequest andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[theValue([results count]) should] equal:theValue(1)];
+            [[[[results lastObject] valueForKey:@"name"] should] equal:@"Framingham"];
+        }];
+    });
+    it(@"does not plan geo predicates it can't answer from the cache", ^{
+        NSEntityDescription *entity = [NSEntityDescription entityForName:@"Random" inManagedObjectContext:moc];
+        NSPredicate *predicate = [NSCompoundPredicate orPredicateWithSubpredicates:[NSArray arrayWithObjects:[SMPredicate predicateWhere:@"geopoint" near:fishermansWharf], [NSPredicate predicateWithFormat:@"name == %@", @"Framingham"], nil]];
+        
+        [[store SM_cachePredicateForGeoPredicate:predicate entity:entity remoteIDsByDistance:NULL] shouldBeNil];
+    });
+});
+
+describe(@"aggregate fetches", ^{
+    __block SMClient *client = nil;
+    __block SMCoreDataStore *cds = nil;
+    __block NSManagedObjectContext *moc = nil;
+    __block NSArray *aggregateRows = nil;
+    __block NSUInteger aggregateQueryCount = 0;
+    __block NSExpressionDescription *total = nil;
+    beforeEach(^{
+        SM_CACHE_ENABLED = YES;
+        client = [SMIntegrationTestHelpers defaultClient];
+        [SMClient setDefaultClient:client];
+        [SMCoreDataIntegrationTestHelpers removeSQLiteDatabaseAndMapsWithPublicKey:client.publicKey];
+        NSBundle *classBundle = [NSBundle bundleForClass:[self class]];
+        NSURL *modelURL = [classBundle URLForResource:@"SMCoreDataIntegrationTest" withExtension:@"momd"];
+        NSManagedObjectModel *aModel = [[NSManagedObjectModel alloc] initWithContentsOfURL:modelURL];
+        cds = [client coreDataStoreWithManagedObjectModel:aModel];
+        moc = [cds contextForCurrentThread];
+        [[client.session.networkMonitor stubAndReturn:theValue(1)] currentNetworkStatus];
+        
+        // Rows as the server returns them, keyed by StackMob field names
+        aggregateQueryCount = 0;
+        [cds stub:@selector(performAggregateQuery:options:successCallbackQueue:failureCallbackQueue:onSuccess:onFailure:) withBlock:^id(NSArray *params) {
+            aggregateQueryCount++;
+            SMResultsSuccessBlock successBlock = [params objectAtIndex:4];
+            dispatch_async([params objectAtIndex:2], ^{
+                successBlock(aggregateRows);
+            });
+            return nil;
+        }];
+        
+        total = [[NSExpressionDescription alloc] init];
+        [total setName:@"total"];
+        [total setExpression:[NSExpression expressionForFunction:@"count:" arguments:[NSArray arrayWithObject:[NSExpression expressionForKeyPath:@"name"]]]];
+        [total setExpressionResultType:NSInteger32AttributeType];
+    });
+    afterEach(^{
+        [cds setCachePolicy:SMCachePolicyTryNetworkOnly];
+        SM_CACHE_ENABLED = NO;
+    });
+    it(@"goes to the network when the cache has nothing to aggregate", ^{
+        aggregateRows = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:[NSNumber numberWithInt:3] forKey:@"total"]];
+        [cds setCachePolicy:SMCachePolicyTryCacheElseNetwork];
+        
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Random"];
+        [fetchRequest setResultType:NSDictionaryResultType];
+        [fetchRequest setPropertiesToFetch:[NSArray arrayWithObject:total]];
+        
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:fetchRequest andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[results should] equal:aggregateRows];
+        }];
+        [[theValue(aggregateQueryCount) should] equal:theValue(1)];
+    });
+    it(@"translates network rows to property names, then sorts and pages them", ^{
+        NSExpressionDescription *latest = [[NSExpressionDescription alloc] init];
+        [latest setName:@"latest"];
+        [latest setExpression:[NSExpression expressionForFunction:@"max:" arguments:[NSArray arrayWithObject:[NSExpression expressionForKeyPath:@"time"]]]];
+        [latest setExpressionResultType:NSDateAttributeType];
+        
+        aggregateRows = [NSArray arrayWithObjects:
+                         [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInt:1980], @"year_born", [NSNumber numberWithInt:2], @"total", [NSNumber numberWithDouble:1000000000000], @"latest", nil],
+                         [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInt:1975], @"year_born", [NSNumber numberWithInt:5], @"total", nil],
+                         [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInt:1990], @"year_born", [NSNumber numberWithInt:1], @"total", nil],
+                         nil];
+        
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:@"Random"];
+        [fetchRequest setResultType:NSDictionaryResultType];
+        [fetchRequest setPropertiesToFetch:[NSArray arrayWithObjects:@"yearBorn", total, latest, nil]];
+        [fetchRequest setPropertiesToGroupBy:[NSArray arrayWithObject:@"yearBorn"]];
+        [fetchRequest setSortDescriptors:[NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"yearBorn" ascending:YES]]];
+        [fetchRequest setFetchOffset:1];
+        [fetchRequest setFetchLimit:1];
+        
+        [SMCoreDataIntegrationTestHelpers executeSynchronousFetch:moc withRequest:fetchRequest andBlock:^(NSArray *results, NSError *error) {
+            [error shouldBeNil];
+            [[results should] equal:[NSArray arrayWithObject:[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInt:1980], @"yearBorn", [NSNumber numberWithInt:2], @"total", [NSDate dateWithTimeIntervalSince1970:1000000000], @"latest", nil]]];
+        }];
+        [[theValue(aggregateQueryCount) should] equal:theValue(1)];
+    });
+});
+
 SPEC_END
\ No newline at end of file
@@ -60,14 +60,14 @@ describe(@"Insert 1 Online, Delete 1 Offline, NO CONFLICT", ^{
         // Offline delete
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -138,7 +138,7 @@ describe(@"Insert 1 Online, Delete Offline at T1, Update Online at T2", ^{
         // Delete offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
@@ -162,7 +162,7 @@ describe(@"Insert 1 Online, Delete Offline at T1, Update Online at T2", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -205,7 +205,7 @@ describe(@"Insert 1 Online, Delete Offline at T1, Update Online at T2", ^{
         // Delete offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
@@ -229,7 +229,7 @@ describe(@"Insert 1 Online, Delete Offline at T1, Update Online at T2", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -274,7 +274,7 @@ describe(@"Insert 1 Online, Delete Offline at T1, Update Online at T2", ^{
         // Delete offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
@@ -299,7 +299,7 @@ describe(@"Insert 1 Online, Delete Offline at T1, Update Online at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -381,7 +381,7 @@ describe(@"Insert 1 Online, Update Online at T1, Delete Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
@@ -389,7 +389,7 @@ describe(@"Insert 1 Online, Update Online at T1, Delete Offline at T2", ^{
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -449,7 +449,7 @@ describe(@"Insert 1 Online, Update Online at T1, Delete Offline at T2", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
@@ -457,7 +457,7 @@ describe(@"Insert 1 Online, Update Online at T1, Delete Offline at T2", ^{
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -515,7 +515,7 @@ describe(@"Insert 1 Online, Update Online at T1, Delete Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
@@ -523,7 +523,7 @@ describe(@"Insert 1 Online, Update Online at T1, Delete Offline at T2", ^{
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -592,14 +592,14 @@ describe(@"Insert 1 Online, Delete 1 Offline at T1, Delete 1 Online at T2, NO CO
         // Offline delete at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -699,14 +699,14 @@ describe(@"Insert 1 Online, Delete 1 Online at T1, Delete 1 Offline at T2, NO CO
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:todo];
         saveError = nil;
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
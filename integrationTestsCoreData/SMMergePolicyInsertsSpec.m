@@ -49,7 +49,7 @@ describe(@"Insert 1 Offline, should send as an insert no merge, NO CONFLICT", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -59,7 +59,7 @@ describe(@"Insert 1 Offline, should send as an insert no merge, NO CONFLICT", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
@@ -132,7 +132,7 @@ describe(@"Insert 1 Offline at T1, Insert 1 Offline at T2", ^{
         // Insert 1 offline
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -142,7 +142,7 @@ describe(@"Insert 1 Offline at T1, Insert 1 Offline at T2", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
@@ -204,7 +204,7 @@ describe(@"Insert 1 Offline at T1, Insert 1 Offline at T2", ^{
         // Insert 1 offline
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -214,7 +214,7 @@ describe(@"Insert 1 Offline at T1, Insert 1 Offline at T2", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
@@ -276,7 +276,7 @@ describe(@"Insert 1 Offline at T1, Insert 1 Offline at T2", ^{
         // Insert 1 offline
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -286,7 +286,7 @@ describe(@"Insert 1 Offline at T1, Insert 1 Offline at T2", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
@@ -386,7 +386,7 @@ describe(@"While offline, Insert 1 Online at T1, Insert 1 Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -396,7 +396,7 @@ describe(@"While offline, Insert 1 Online at T1, Insert 1 Offline at T2", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
@@ -458,7 +458,7 @@ describe(@"While offline, Insert 1 Online at T1, Insert 1 Offline at T2", ^{
         [NSThread sleepForTimeInterval:0.5];
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -468,7 +468,7 @@ describe(@"While offline, Insert 1 Online at T1, Insert 1 Offline at T2", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
@@ -530,7 +530,7 @@ describe(@"While offline, Insert 1 Online at T1, Insert 1 Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -540,7 +540,7 @@ describe(@"While offline, Insert 1 Online at T1, Insert 1 Offline at T2", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [[theValue([testProperties.cds isDirtyObject:[todo objectID]]) should] beYes];
         
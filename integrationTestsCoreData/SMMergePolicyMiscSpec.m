@@ -34,7 +34,7 @@ describe(@"Sync Errors, Inserting offline to a forbidden schema with POST perms"
     it(@"Error callback should get called", ^{
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Offlinepermspost" inManagedObjectContext:testProperties.moc];
         [object setValue:@"1234" forKey:@"offlinepermspostId"];
@@ -44,7 +44,7 @@ describe(@"Sync Errors, Inserting offline to a forbidden schema with POST perms"
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -106,7 +106,7 @@ describe(@"Sync Errors, Inserting offline to a forbidden schema with GET perms",
     it(@"Error callback should get called", ^{
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Offlinepermsget" inManagedObjectContext:testProperties.moc];
         [object setValue:@"1234" forKey:@"offlinepermsgetId"];
@@ -116,7 +116,7 @@ describe(@"Sync Errors, Inserting offline to a forbidden schema with GET perms",
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -209,7 +209,7 @@ describe(@"Insert 5 Online, Go offline and delete 5, T2 update 2 Online", ^{
         // Delete 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -251,7 +251,7 @@ describe(@"Insert 5 Online, Go offline and delete 5, T2 update 2 Online", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -334,7 +334,7 @@ describe(@"Insert 5 Online, Go offline and delete 5, T2 update 2 Online", ^{
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -376,7 +376,7 @@ describe(@"Insert 5 Online, Go offline and delete 5, T2 update 2 Online", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -460,7 +460,7 @@ describe(@"Insert 5 Online, Go offline and delete 5, T2 update 2 Online", ^{
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -502,7 +502,7 @@ describe(@"Insert 5 Online, Go offline and delete 5, T2 update 2 Online", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -632,7 +632,7 @@ describe(@"Insert 5 Online, Update 2 Online T1, Go offline and delete 5 T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -649,7 +649,7 @@ describe(@"Insert 5 Online, Update 2 Online T1, Go offline and delete 5 T2", ^{
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -760,7 +760,7 @@ describe(@"Insert 5 Online, Update 2 Online T1, Go offline and delete 5 T2", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -778,7 +778,7 @@ describe(@"Insert 5 Online, Update 2 Online T1, Go offline and delete 5 T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -887,7 +887,7 @@ describe(@"Insert 5 Online, Update 2 Online T1, Go offline and delete 5 T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -905,7 +905,7 @@ describe(@"Insert 5 Online, Update 2 Online T1, Go offline and delete 5 T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -1003,7 +1003,7 @@ describe(@"Sync Errors, Updating offline to a forbidden schema with PUT perms",
         // Update offline
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [object setValue:@"put perms" forKey:@"title"];
         
@@ -1013,7 +1013,7 @@ describe(@"Sync Errors, Updating offline to a forbidden schema with PUT perms",
         
         // Sync
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1111,7 +1111,7 @@ describe(@"Sync Errors, Updating offline to a forbidden schema with GET perms",
         // Update offline
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [object setValue:@"get perms" forKey:@"title"];
         
@@ -1121,7 +1121,7 @@ describe(@"Sync Errors, Updating offline to a forbidden schema with GET perms",
         
         // Sync
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1181,7 +1181,7 @@ describe(@"Sync Global request options with HTTPS", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [object setValue:@"1234" forKey:@"todoId"];
@@ -1191,7 +1191,7 @@ describe(@"Sync Global request options with HTTPS", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1260,7 +1260,7 @@ describe(@"Syncing with user objects, Inserts", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSEntityDescription *entity = [NSEntityDescription entityForName:@"User3" inManagedObjectContext:testProperties.moc];
         User3 *user = [[User3 alloc] initWithEntity:entity insertIntoManagedObjectContext:testProperties.moc];
@@ -1271,7 +1271,7 @@ describe(@"Syncing with user objects, Inserts", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1342,7 +1342,7 @@ describe(@"Syncing with user objects, Updates", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [user setEmail:@"bob@bob.com"];
         
@@ -1350,7 +1350,7 @@ describe(@"Syncing with user objects, Updates", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1412,7 +1412,7 @@ describe(@"Syncing with user objects, Deletes", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.moc deleteObject:user];
         
@@ -1420,7 +1420,7 @@ describe(@"Syncing with user objects, Deletes", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1476,7 +1476,7 @@ describe(@"syncInProgress", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -1486,7 +1486,7 @@ describe(@"syncInProgress", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -1531,7 +1531,7 @@ describe(@"syncInProgress", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         NSManagedObject *todo = [NSEntityDescription insertNewObjectForEntityForName:@"Todo" inManagedObjectContext:testProperties.moc];
         [todo setValue:@"1234" forKey:[todo primaryKeyField]];
@@ -1541,7 +1541,7 @@ describe(@"syncInProgress", ^{
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -57,14 +57,14 @@ describe(@"Insert 1 Online, Update 1 Offline, NO CONFLICT", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline update" forKey:@"title"];
         saveError = nil;
         [testProperties.moc saveAndWait:&saveError];
         [saveError shouldBeNil];
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         dispatch_queue_t queue = dispatch_queue_create("queue", NULL);
         dispatch_group_t group = dispatch_group_create();
@@ -137,7 +137,7 @@ describe(@"Insert 1 Online, Update 1 Offline at T1, Update 1 Online at T2", ^{
         // Update offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -158,7 +158,7 @@ describe(@"Insert 1 Online, Update 1 Offline at T1, Update 1 Online at T2", ^{
         
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -208,7 +208,7 @@ describe(@"Insert 1 Online, Update 1 Offline at T1, Update 1 Online at T2", ^{
         // Update offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -231,7 +231,7 @@ describe(@"Insert 1 Online, Update 1 Offline at T1, Update 1 Online at T2", ^{
         
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -278,7 +278,7 @@ describe(@"Insert 1 Online, Update 1 Offline at T1, Update 1 Online at T2", ^{
         // Update offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -300,7 +300,7 @@ describe(@"Insert 1 Online, Update 1 Offline at T1, Update 1 Online at T2", ^{
         
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -383,7 +383,7 @@ describe(@"Insert 1 Online, Update Online at T1, Update Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -391,7 +391,7 @@ describe(@"Insert 1 Online, Update Online at T1, Update Offline at T2", ^{
         [saveError shouldBeNil];
         
         // Syn with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -456,7 +456,7 @@ describe(@"Insert 1 Online, Update Online at T1, Update Offline at T2", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -464,7 +464,7 @@ describe(@"Insert 1 Online, Update Online at T1, Update Offline at T2", ^{
         [saveError shouldBeNil];
         
         // Syn with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -528,7 +528,7 @@ describe(@"Insert 1 Online, Update Online at T1, Update Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -536,7 +536,7 @@ describe(@"Insert 1 Online, Update Online at T1, Update Offline at T2", ^{
         [saveError shouldBeNil];
         
         // Syn with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -604,7 +604,7 @@ describe(@"Insert 1 Online, Update Offline at T1, Delete Online at T2", ^{
         // Update offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -629,7 +629,7 @@ describe(@"Insert 1 Online, Update Offline at T1, Delete Online at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -675,7 +675,7 @@ describe(@"Insert 1 Online, Update Offline at T1, Delete Online at T2", ^{
         // Update offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -700,7 +700,7 @@ describe(@"Insert 1 Online, Update Offline at T1, Delete Online at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -745,7 +745,7 @@ describe(@"Insert 1 Online, Update Offline at T1, Delete Online at T2", ^{
         // Update offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -770,7 +770,7 @@ describe(@"Insert 1 Online, Update Offline at T1, Delete Online at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -850,7 +850,7 @@ describe(@"Insert 1 Online, Delete Online at T1, Update Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -859,7 +859,7 @@ describe(@"Insert 1 Online, Delete Online at T1, Update Offline at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyClientWins];
@@ -919,7 +919,7 @@ describe(@"Insert 1 Online, Delete Online at T1, Update Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -928,7 +928,7 @@ describe(@"Insert 1 Online, Delete Online at T1, Update Offline at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -988,7 +988,7 @@ describe(@"Insert 1 Online, Delete Online at T1, Update Offline at T2", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [todo setValue:@"offline client update" forKey:@"title"];
         saveError = nil;
@@ -997,7 +997,7 @@ describe(@"Insert 1 Online, Delete Online at T1, Update Offline at T2", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -1071,7 +1071,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 2 Online", ^{
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1113,7 +1113,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 2 Online", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -1196,7 +1196,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 2 Online", ^{
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1238,7 +1238,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 2 Online", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -1368,7 +1368,7 @@ describe(@"Insert 5 Online, T1 update 2 Online, Go offline and update 5,", ^{
         //sleep(3);
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1385,7 +1385,7 @@ describe(@"Insert 5 Online, T1 update 2 Online, Go offline and update 5,", ^{
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -1497,7 +1497,7 @@ describe(@"Insert 5 Online, T1 update 2 Online, Go offline and update 5,", ^{
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1514,7 +1514,7 @@ describe(@"Insert 5 Online, T1 update 2 Online, Go offline and update 5,", ^{
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -1619,7 +1619,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 delete 2 Online", ^{
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1661,7 +1661,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 delete 2 Online", ^{
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -1745,7 +1745,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 delete 2 Online", ^{
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1788,7 +1788,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 delete 2 Online", ^{
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -1920,7 +1920,7 @@ describe(@"Insert 5 Online, Delete 2 online at T1, Go offline and update 5 at T2
         
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -1937,7 +1937,7 @@ describe(@"Insert 5 Online, Delete 2 online at T1, Go offline and update 5 at T2
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -2046,7 +2046,7 @@ describe(@"Insert 5 Online, Delete 2 online at T1, Go offline and update 5 at T2
         [NSThread sleepForTimeInterval:0.5];
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -2064,7 +2064,7 @@ describe(@"Insert 5 Online, Delete 2 online at T1, Go offline and update 5 at T2
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -2169,7 +2169,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 1 and delete 1 On
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -2212,7 +2212,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 1 and delete 1 On
         dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -2296,7 +2296,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 1 and delete 1 On
         // Update 5 offline at T1
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -2340,7 +2340,7 @@ describe(@"Insert 5 Online, Go offline and update 5, T2 update 1 and delete 1 On
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];
@@ -2472,7 +2472,7 @@ describe(@"Insert 5 Online, Delete 1 online at T1, update 1 at T1, Go offline an
         [NSThread sleepForTimeInterval:0.5];
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -2489,7 +2489,7 @@ describe(@"Insert 5 Online, Delete 1 online at T1, update 1 at T1, Go offline an
         [saveError shouldBeNil];
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyServerModifiedWins];
@@ -2599,7 +2599,7 @@ describe(@"Insert 5 Online, Delete 1 online at T1, update 1 at T1, Go offline an
         [NSThread sleepForTimeInterval:0.5];
         NSArray *persistentStores = [testProperties.cds.persistentStoreCoordinator persistentStores];
         SMIncrementalStore *store = [persistentStores lastObject];
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(NO)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(NO)];
         
         [testProperties.cds setCachePolicy:SMCachePolicyTryCacheOnly];
         NSFetchRequest *todoFetch = [[NSFetchRequest alloc] initWithEntityName:@"Todo"];
@@ -2617,7 +2617,7 @@ describe(@"Insert 5 Online, Delete 1 online at T1, update 1 at T1, Go offline an
         
         
         // Sync with server
-        [store stub:@selector(SM_checkNetworkAvailability) andReturn:theValue(YES)];
+        [store stub:@selector(SM_checkNetworkAvailabilityWithOptions:) andReturn:theValue(YES)];
         
         [testProperties.cds setSyncCallbackQueue:queue];
         [testProperties.cds setDefaultSMMergePolicy:SMMergePolicyLastModifiedWins];